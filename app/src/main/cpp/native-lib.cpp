@@ -109,6 +109,7 @@ static std::unique_ptr<ModelDAG> load_model_dag(const std::string &model_dag_pat
   dag->layers["relu0"] = relu0;
   dag->layers["layer1"] = layer1;
   dag->layers["relu1"] = relu1;
+  dag->layer_order = {"layer0", "relu0", "layer1", "relu1"};
 
   /* == Define execution units == */
   ExecutionUnit layer0_eu0{
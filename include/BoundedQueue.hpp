@@ -0,0 +1,253 @@
+#ifndef EDGEFLOW_BOUNDEDQUEUE_HPP
+#define EDGEFLOW_BOUNDEDQUEUE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+/// What `BoundedQueue::push` does when the queue is full
+enum class OverflowPolicy : uint8_t {
+  Block,      // Wait until there is space (backpressure)
+  Reject,     // Discard the new item
+  DropOldest, // Discard the oldest item to make space
+};
+
+/// Bounded lock-free multi-producer multi-consumer queue on a ring buffer
+/// (D. Vyukov's bounded MPMC queue). The `try_*` operations never block or
+/// take a lock; the blocking and timed operations only sleep on a
+/// condition variable when the queue is full or empty.
+template<typename T>
+class BoundedQueue {
+public:
+  /// @param capacity Maximum number of items, rounded up to a power of two
+  /// @param policy Overflow policy of `push`
+  explicit BoundedQueue(size_t capacity,
+                        OverflowPolicy policy = OverflowPolicy::Block)
+      : policy_(policy) {
+    size_t pow2 = 2;
+    while (pow2 < capacity) pow2 <<= 1;
+    mask_ = pow2 - 1;
+    cells_ = std::make_unique<Cell[]>(pow2);
+    for (size_t i = 0; i < pow2; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~BoundedQueue() {
+    while (try_pop()) {}
+  }
+
+  // Non-copyable and non-movable
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+  BoundedQueue(BoundedQueue &&) = delete;
+  BoundedQueue &operator=(BoundedQueue &&) = delete;
+
+  /// Push an item, applying the overflow policy if the queue is full
+  /// @return false if the item was discarded (rejected or closed)
+  bool push(std::unique_ptr<T> item) {
+    switch (policy_) {
+      case OverflowPolicy::Block: {
+        while (!try_push(item)) {
+          std::unique_lock<std::mutex> lock(wait_mtx_);
+          push_waiters_.fetch_add(1, std::memory_order_seq_cst);
+          not_full_.wait(lock, [this] { return closed_ || !full(); });
+          push_waiters_.fetch_sub(1, std::memory_order_relaxed);
+          if (closed_) return false;
+        }
+        return true;
+      }
+      case OverflowPolicy::Reject: {
+        if (try_push(item)) return true;
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      case OverflowPolicy::DropOldest: {
+        while (!try_push(item)) {
+          if (closed_) return false;
+          if (try_pop()) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Non-blocking push. `item` is left untouched if the queue is full.
+  /// @return true if the item was pushed
+  bool try_push(std::unique_ptr<T> &item) {
+    if (closed_.load(std::memory_order_relaxed)) {
+      return false;
+    }
+
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->seq.load(std::memory_order_acquire);
+      const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false; // Full
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->item = item.release();
+    cell->seq.store(pos + 1, std::memory_order_release);
+
+    notify(pop_waiters_, not_empty_);
+    return true;
+  }
+
+  /// Push with a timeout, waiting for space regardless of the policy
+  /// @return true if the item was pushed; `item` is left untouched otherwise
+  template<typename Rep, typename Period>
+  bool try_push_for(std::unique_ptr<T> &item,
+                    const std::chrono::duration<Rep, Period> &timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!try_push(item)) {
+      std::unique_lock<std::mutex> lock(wait_mtx_);
+      push_waiters_.fetch_add(1, std::memory_order_seq_cst);
+      const bool ready = not_full_.wait_until(
+          lock, deadline, [this] { return closed_ || !full(); });
+      push_waiters_.fetch_sub(1, std::memory_order_relaxed);
+      if (!ready || closed_) return false;
+    }
+    return true;
+  }
+
+  /// Blocking pop
+  /// @return The item, or nullptr if the queue is closed and drained
+  std::unique_ptr<T> pop() {
+    while (true) {
+      if (auto item = try_pop()) return item;
+
+      std::unique_lock<std::mutex> lock(wait_mtx_);
+      pop_waiters_.fetch_add(1, std::memory_order_seq_cst);
+      not_empty_.wait(lock, [this] { return closed_ || !empty(); });
+      pop_waiters_.fetch_sub(1, std::memory_order_relaxed);
+      if (closed_ && empty()) return nullptr;
+    }
+  }
+
+  /// Non-blocking pop; returns nullptr if the queue is empty
+  std::unique_ptr<T> try_pop() {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->seq.load(std::memory_order_acquire);
+      const auto diff =
+          static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return nullptr; // Empty
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    std::unique_ptr<T> item(cell->item);
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+
+    notify(push_waiters_, not_full_);
+    return item;
+  }
+
+  /// Pop with a timeout
+  /// @return The item, or nullptr on timeout or if closed and drained
+  template<typename Rep, typename Period>
+  std::unique_ptr<T> try_pop_for(const std::chrono::duration<Rep, Period> &timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+      if (auto item = try_pop()) return item;
+
+      std::unique_lock<std::mutex> lock(wait_mtx_);
+      pop_waiters_.fetch_add(1, std::memory_order_seq_cst);
+      const bool ready = not_empty_.wait_until(
+          lock, deadline, [this] { return closed_ || !empty(); });
+      pop_waiters_.fetch_sub(1, std::memory_order_relaxed);
+      if (!ready || (closed_ && empty())) return nullptr;
+    }
+  }
+
+  /// Reject further pushes and wake up every blocked producer and consumer.
+  /// Consumers can still drain the remaining items.
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(wait_mtx_);
+      closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+  bool closed() const noexcept { return closed_; }
+
+  /// Approximate number of items in the queue
+  size_t size() const noexcept {
+    const size_t enq = enqueue_pos_.load(std::memory_order_seq_cst);
+    const size_t deq = dequeue_pos_.load(std::memory_order_seq_cst);
+    return enq > deq ? enq - deq : 0;
+  }
+
+  bool empty() const noexcept { return size() == 0; }
+
+  bool full() const noexcept { return size() >= capacity(); }
+
+  size_t capacity() const noexcept { return mask_ + 1; }
+
+  /// Number of items discarded by `OverflowPolicy::DropOldest`
+  uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+  /// Number of items discarded by `OverflowPolicy::Reject`
+  uint64_t rejected() const noexcept { return rejected_.load(std::memory_order_relaxed); }
+
+private:
+  struct Cell {
+    std::atomic<size_t> seq{0};
+    T *item = nullptr;
+  };
+
+  /// Wake up one waiter of `cv`, taking the lock only if someone waits.
+  /// Pairs with the `*_waiters_` increment before waiting.
+  void notify(std::atomic<unsigned int> &waiters, std::condition_variable &cv) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_seq_cst) > 0) {
+      { std::lock_guard<std::mutex> lock(wait_mtx_); }
+      cv.notify_one();
+    }
+  }
+
+  const OverflowPolicy policy_;
+  size_t mask_ = 0;
+  std::unique_ptr<Cell[]> cells_;
+
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<size_t> dequeue_pos_{0};
+
+  std::atomic<bool> closed_{false};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> rejected_{0};
+
+  std::atomic<unsigned int> push_waiters_{0};
+  std::atomic<unsigned int> pop_waiters_{0};
+  std::mutex wait_mtx_{};
+  std::condition_variable not_full_{};
+  std::condition_variable not_empty_{};
+};
+
+#endif // EDGEFLOW_BOUNDEDQUEUE_HPP
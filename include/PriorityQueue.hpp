@@ -0,0 +1,64 @@
+#ifndef EDGEFLOW_PRIORITYQUEUE_HPP
+#define EDGEFLOW_PRIORITYQUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// Multi-producer multi-consumer priority queue on a binary heap behind a
+/// mutex. `try_pop` returns the item with the highest priority, i.e., the
+/// greatest item under `Less`. Items are owned by the queue while they are
+/// in it.
+template<typename T, typename Less>
+class PriorityQueue {
+public:
+  explicit PriorityQueue(Less less = Less()) : less_(std::move(less)) {}
+
+  // Non-copyable and non-movable
+  PriorityQueue(const PriorityQueue &) = delete;
+  PriorityQueue &operator=(const PriorityQueue &) = delete;
+  PriorityQueue(PriorityQueue &&) = delete;
+  PriorityQueue &operator=(PriorityQueue &&) = delete;
+
+  void push(std::unique_ptr<T> item) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    heap_.push_back(std::move(item));
+    std::push_heap(heap_.begin(), heap_.end(), compare());
+    size_.store(heap_.size(), std::memory_order_relaxed);
+  }
+
+  /// Take the item with the highest priority without blocking
+  /// @return The item, or nullptr if the queue is empty
+  std::unique_ptr<T> try_pop() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (heap_.empty()) {
+      return nullptr;
+    }
+    std::pop_heap(heap_.begin(), heap_.end(), compare());
+    auto item = std::move(heap_.back());
+    heap_.pop_back();
+    size_.store(heap_.size(), std::memory_order_relaxed);
+    return item;
+  }
+
+  /// Approximate number of items in the queue, read without the lock
+  size_t size() const noexcept {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+private:
+  auto compare() const {
+    return [this](const std::unique_ptr<T> &a, const std::unique_ptr<T> &b) {
+      return less_(*a, *b);
+    };
+  }
+
+  Less less_;
+  std::vector<std::unique_ptr<T>> heap_{};
+  std::atomic<size_t> size_{0};
+  std::mutex mtx_{};
+};
+
+#endif // EDGEFLOW_PRIORITYQUEUE_HPP
@@ -0,0 +1,128 @@
+#ifndef EDGEFLOW_RANKEDDEQUE_HPP
+#define EDGEFLOW_RANKEDDEQUE_HPP
+
+#include "WorkStealingDeque.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+/// Ready queue of one worker: a Chase-Lev deque per bucket of rank, the
+/// greatest bucket first. The owner pushes and pops without a lock, the
+/// most recent item of a bucket first so that its input is still in the
+/// cache; any thread may steal the oldest item of the greatest bucket.
+/// Buckets age so that none starves: a bucket gains one bucket of rank per
+/// `promotion` since it was last served oldest first, and the owner takes
+/// the oldest item of a bucket that waited that long.
+template<typename T, size_t NumBuckets>
+class RankedDeque {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  /// @param promotion Wait after which the oldest item of a bucket is due,
+  /// and for which a bucket gains the rank of one bucket
+  explicit RankedDeque(Clock::duration promotion) : promotion_(promotion) {
+    since_.fill(kEmpty);
+  }
+
+  // Non-copyable and non-movable
+  RankedDeque(const RankedDeque &) = delete;
+  RankedDeque &operator=(const RankedDeque &) = delete;
+  RankedDeque(RankedDeque &&) = delete;
+  RankedDeque &operator=(RankedDeque &&) = delete;
+
+  /// Push an item into a bucket; owner thread only.
+  /// A bucket starts to wait at the next `pop` after it became non-empty.
+  /// @param bucket Bucket of the item's rank, below `NumBuckets`
+  void push(size_t bucket, std::unique_ptr<T> item) {
+    if (deques_[bucket].size() == 0) {
+      since_[bucket] = kEmpty;
+    }
+    deques_[bucket].push(std::move(item));
+  }
+
+  /// Take the item of the bucket with the highest aged rank; owner thread
+  /// only. That is the most recent item of the bucket, or its oldest one if
+  /// the bucket waited `promotion` since it was last served so.
+  /// @return The item, or nullptr if the deque is empty
+  std::unique_ptr<T> pop(Clock::time_point now) {
+    // Buckets found empty by a take that lost a race with the thieves
+    std::array<bool, NumBuckets> drained{};
+    for (;;) {
+      size_t best = NumBuckets;
+      double best_rank = 0;
+      for (size_t b = NumBuckets; b-- > 0;) {
+        if (drained[b] || deques_[b].size() == 0) {
+          since_[b] = kEmpty;
+          continue;
+        }
+        if (since_[b] == kEmpty) {
+          since_[b] = now;
+        }
+        const double rank = static_cast<double>(b) + waited(b, now);
+        if (best == NumBuckets || rank > best_rank) {
+          best = b;
+          best_rank = rank;
+        }
+      }
+      if (best == NumBuckets) {
+        return nullptr;
+      }
+
+      std::unique_ptr<T> item;
+      if (waited(best, now) >= 1) {
+        item = deques_[best].steal();
+        since_[best] = now;
+      }
+      if (!item) {
+        item = deques_[best].pop();
+      }
+      if (item) {
+        return item;
+      }
+      drained[best] = true;
+    }
+  }
+
+  /// Steal the oldest item of the greatest bucket; any thread
+  /// @return The item, or nullptr if the deque looks empty or every race
+  /// is lost
+  std::unique_ptr<T> steal() {
+    for (size_t b = NumBuckets; b-- > 0;) {
+      if (deques_[b].size() == 0) {
+        continue;
+      }
+      if (auto item = deques_[b].steal()) {
+        return item;
+      }
+    }
+    return nullptr;
+  }
+
+  /// Approximate number of items in the deque
+  size_t size() const noexcept {
+    size_t total = 0;
+    for (const auto &deque: deques_) {
+      total += deque.size();
+    }
+    return total;
+  }
+
+private:
+  static constexpr Clock::time_point kEmpty = Clock::time_point::max();
+
+  /// Rank gained by the bucket since it was last served oldest first, in
+  /// buckets
+  double waited(size_t bucket, Clock::time_point now) const {
+    return std::chrono::duration<double>(now - since_[bucket]) /
+           std::chrono::duration<double>(promotion_);
+  }
+
+  const Clock::duration promotion_;
+  std::array<WorkStealingDeque<T>, NumBuckets> deques_;
+  // When each bucket was last served oldest first or found non-empty by
+  // `pop`; owner thread only
+  std::array<Clock::time_point, NumBuckets> since_{};
+};
+
+#endif // EDGEFLOW_RANKEDDEQUE_HPP
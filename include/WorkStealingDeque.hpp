@@ -0,0 +1,140 @@
+#ifndef EDGEFLOW_WORKSTEALINGDEQUE_HPP
+#define EDGEFLOW_WORKSTEALINGDEQUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// Chase-Lev work-stealing deque
+/// (Lê et al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+/// Only the owner thread may `push` and `pop` at the bottom; any thread may
+/// `steal` from the top. Items are owned by the deque while they are in it.
+template<typename T>
+class WorkStealingDeque {
+public:
+  explicit WorkStealingDeque(size_t capacity = 64) {
+    size_t pow2 = 1;
+    while (pow2 < capacity) pow2 <<= 1;
+    arrays_.push_back(std::make_unique<Array>(pow2));
+    array_.store(arrays_.back().get(), std::memory_order_relaxed);
+  }
+
+  ~WorkStealingDeque() {
+    // Destroy the items that were never taken
+    while (auto item = pop()) {}
+  }
+
+  // Non-copyable and non-movable
+  WorkStealingDeque(const WorkStealingDeque &) = delete;
+  WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+  WorkStealingDeque(WorkStealingDeque &&) = delete;
+  WorkStealingDeque &operator=(WorkStealingDeque &&) = delete;
+
+  /// Push an item at the bottom; owner thread only
+  void push(std::unique_ptr<T> item) {
+    const int64_t b = bottom_.load(std::memory_order_relaxed);
+    const int64_t t = top_.load(std::memory_order_acquire);
+    Array *a = array_.load(std::memory_order_relaxed);
+    if (b - t > static_cast<int64_t>(a->capacity) - 1) {
+      a = grow(a, t, b);
+    }
+    a->put(b, item.release());
+    // Publishes the item to the thieves that read the new bottom
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  /// Pop the most recently pushed item; owner thread only
+  /// @return The item, or nullptr if the deque is empty
+  std::unique_ptr<T> pop() {
+    const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Array *a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+
+    T *item = nullptr;
+    if (t <= b) {
+      item = a->get(b);
+      if (t == b) {
+        // Last item; race against the thieves
+        if (!top_.compare_exchange_strong(t, t + 1,
+                                          std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+          item = nullptr;
+        }
+        bottom_.store(b + 1, std::memory_order_relaxed);
+      }
+    } else {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return std::unique_ptr<T>(item);
+  }
+
+  /// Steal the oldest item; any thread
+  /// @return The item, or nullptr if the deque is empty or the race is lost
+  std::unique_ptr<T> steal() {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+
+    Array *a = array_.load(std::memory_order_acquire);
+    T *item = a->get(t);
+    if (!top_.compare_exchange_strong(t, t + 1,
+                                      std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return std::unique_ptr<T>(item);
+  }
+
+  /// Approximate number of items in the deque
+  size_t size() const noexcept {
+    const int64_t b = bottom_.load(std::memory_order_relaxed);
+    const int64_t t = top_.load(std::memory_order_relaxed);
+    return b > t ? static_cast<size_t>(b - t) : 0;
+  }
+
+private:
+  struct Array {
+    explicit Array(size_t capacity)
+        : capacity(capacity), mask(capacity - 1),
+          slots(std::make_unique<std::atomic<T *>[]>(capacity)) {}
+
+    T *get(int64_t i) const noexcept {
+      return slots[i & mask].load(std::memory_order_relaxed);
+    }
+
+    void put(int64_t i, T *item) noexcept {
+      slots[i & mask].store(item, std::memory_order_relaxed);
+    }
+
+    const size_t capacity;
+    const size_t mask;
+    std::unique_ptr<std::atomic<T *>[]> slots;
+  };
+
+  /// Double the capacity of the array; owner thread only.
+  /// Retired arrays are kept alive since thieves may still read them.
+  Array *grow(Array *old, int64_t t, int64_t b) {
+    auto bigger = std::make_unique<Array>(old->capacity * 2);
+    for (int64_t i = t; i < b; ++i) {
+      bigger->put(i, old->get(i));
+    }
+    Array *a = bigger.get();
+    arrays_.push_back(std::move(bigger));
+    array_.store(a, std::memory_order_release);
+    return a;
+  }
+
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  alignas(64) std::atomic<Array *> array_{nullptr};
+
+  std::vector<std::unique_ptr<Array>> arrays_{}; // Current and retired arrays
+};
+
+#endif // EDGEFLOW_WORKSTEALINGDEQUE_HPP
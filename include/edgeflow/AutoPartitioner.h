@@ -0,0 +1,68 @@
+#ifndef EDGEFLOW_AUTOPARTITIONER_H
+#define EDGEFLOW_AUTOPARTITIONER_H
+
+#include "edgeflow/DataTypes.h"
+#include <unordered_map>
+#include <vector>
+
+/// AutoPartitioner generates the execution units of a layer-level model
+/// DAG. Every layer is either placed whole on one device or, for layers
+/// partitionable by rows, split into bands over all devices in proportion
+/// to their throughput. A fully connected layer is split into bands of its
+/// output features, each computed with the same band of the weights. The
+/// placement minimizing the predicted end-to-end latency is chosen by
+/// dynamic programming over the layer chain.
+///
+/// The prediction of each placement replays the execution units in order:
+/// a unit starts when its device is free and all of its input pieces have
+/// arrived, and each device sends its results one after another, as the
+/// egress queue of `NetworkEventHandler` does. The root layer is only
+/// placed on the devices the app gives the model input to (see
+/// `DeviceInfo::has_input`), where it is available at once.
+class AutoPartitioner {
+public:
+  /// Partition the layers of `dag.layer_order` and fill `dag.eus` with the
+  /// execution units, their input requirements and forward tables
+  /// @param dag The model DAG; its execution units are replaced
+  /// @param devices The devices to place the layers on
+  /// @param profile Throughput of the devices and the links between them
+  /// @param predicted_latency If not null, set to the predicted latency in ms
+  /// @return false if the DAG has no layer order or there is no device
+  static bool partition(ModelDAG &dag,
+                        const DeviceMap &devices,
+                        const ClusterProfile &profile,
+                        double *predicted_latency = nullptr);
+
+private:
+  /// Placement of a layer considered by the search
+  struct Candidate {
+    std::vector<ExecutionUnit> eus; // Not connected
+
+    // Best placement of the preceding layers ending with this one
+    double latency = 0;  // Predicted finish time of the slowest unit
+    size_t prev = 0;     // Candidate of the preceding layer
+    std::vector<double> finish;  // Finish time of each unit
+    std::unordered_map<DeviceID, double> device_free; // Busy until
+  };
+
+  /// Placements of the layer: whole on each device, plus row bands over
+  /// all devices if the layer can be partitioned
+  /// @param devices The devices the layer may be placed on
+  static std::vector<Candidate>
+  candidates(const std::shared_ptr<Layer> &layer,
+             const std::vector<DeviceID> &devices,
+             const ClusterProfile &profile);
+
+  /// Replay the units of `consumer` after those of `producer`
+  /// @param producer The placement of the preceding layer, or nullptr for
+  /// the root layer
+  /// @param consumer The placement to evaluate; its prediction is updated
+  /// if the result is better
+  /// @param prev Index of `producer` among the candidates of its layer
+  static void evaluate(const Candidate *producer,
+                       Candidate &consumer,
+                       size_t prev,
+                       const ClusterProfile &profile);
+};
+
+#endif // EDGEFLOW_AUTOPARTITIONER_H
@@ -1,58 +1,281 @@
 #ifndef EDGEFLOW_COMPUTATIONENGINE_H
 #define EDGEFLOW_COMPUTATIONENGINE_H
 
-#include "ThreadSafeQueue.hpp"
+#include "BoundedQueue.hpp"
+#include "PriorityQueue.hpp"
+#include "RankedDeque.hpp"
 #include "edgeflow/DataTypes.h"
-#include "edgeflow/EdgeFlow.h"
+#include "edgeflow/ExecutionPlan.h"
 #include "edgeflow/NetworkEventHandler.h"
 #include "edgeflow/Orchestrator.h"
+#include "arm_compute/runtime/IFunction.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <utility>
 
 class Orchestrator;
+struct InferenceRequest;
 
 class ComputationEngine {
 public:
-  ComputationEngine(Orchestrator &orch, const ModelDAG &dag);
+  /// @param plan The compiled plan of this device, including the arena
+  /// placement of the execution units' outputs
+  ComputationEngine(Orchestrator &orch, const ExecutionPlan &plan,
+                    const EngineOptions &options = {});
   ~ComputationEngine();
 
   /// Computation task worker processes
   struct Task {
-    const ExecutionUnit &eu;
+    InferenceRequest &request;
+    EUHandle eu;
     std::unique_ptr<arm_compute::Tensor> input;
+    // Upward rank of the unit less its aging credit at submission, by
+    // which the shared ready queue orders the tasks; the greatest runs first
+    double priority = 0;
 
-    Task(const ExecutionUnit &eu,
-         std::unique_ptr<arm_compute::Tensor> input)
-        : eu(eu), input(std::move(input)) {}
+    Task(InferenceRequest &request,
+         EUHandle eu,
+         std::unique_ptr<arm_compute::Tensor> input,
+         double priority)
+        : request(request), eu(eu), input(std::move(input)),
+          priority(priority) {}
   };
 
-  /// Enqueue an execution unit for processing to the task queue.
+  /// Enqueue an execution unit for processing.
+  /// Ready tasks run in the order of their upward rank, so the units on the
+  /// critical path of an inference do not wait behind off-path work. Tasks
+  /// gain `kAgingRate` of rank per millisecond of waiting so that none
+  /// starves.
+  /// Tasks submitted by a worker thread (e.g., successors dispatched from
+  /// `Orchestrator::on_computation_complete`) go to the ready queue of that
+  /// worker; other threads use the bounded injection queue, and block
+  /// while it is full. A worker takes its own tasks without a lock, by
+  /// bucket of rank and the most recent first within a bucket, and a
+  /// worker out of work steals the oldest task of the highest bucket from
+  /// another worker's queue. With `EngineOptions::per_worker_queues` off,
+  /// the workers share one queue ordered by aged rank instead, the older
+  /// inference first among equal ranks. A task whose inference timed out
+  /// or was cancelled by the time a worker takes it is dropped instead of
+  /// run.
+  /// @param request The inference the execution unit runs for
   /// @param eu Execution unit to run
   /// @param input The input tensor for the execution unit
-  void submit_task(const ExecutionUnit &eu,
+  void submit_task(InferenceRequest &request,
+                   EUHandle eu,
                    std::unique_ptr<arm_compute::Tensor> input);
 
+  /// ACL functions configured once for an execution unit.
+  /// `input` and `output` only carry the tensor info the functions were
+  /// configured with; their memory is imported from the task's tensors on
+  /// every run, so no re-configuration is needed per inference.
+  /// A unit streaming its output has functions for each band of it instead
+  /// (see `ExecutionUnit::num_stream_chunks`), which run one after the
+  /// other on bands of the same tensors.
+  struct PreparedOperator {
+    /// Band of the output computed on its own
+    struct Chunk {
+      Range rows{};       // Rows of the output, local to it
+      Range input_rows{}; // Rows of the input the band depends on
+      // Layers sliced for the band, e.g., the weights of its features
+      std::vector<std::shared_ptr<Layer>> layers;
+      std::vector<std::unique_ptr<arm_compute::IFunction>> functions;
+      // Imported from the band of the task's input, or a copy of it if the
+      // band is strided
+      arm_compute::Tensor input;
+      bool copies_input = false;
+      std::vector<std::unique_ptr<arm_compute::Tensor>> intermediates;
+      arm_compute::Tensor output;
+    };
+
+    // Layers sliced for the unit, e.g., the weights of its features
+    std::vector<std::shared_ptr<Layer>> layers;
+    // The unit's own operator followed by its fused stages, run in order;
+    // empty if the unit streams its output
+    std::vector<std::unique_ptr<arm_compute::IFunction>> functions;
+    arm_compute::Tensor input;
+    // Outputs of all stages but the last one, allocated once
+    std::vector<std::unique_ptr<arm_compute::Tensor>> intermediates;
+    arm_compute::Tensor output;
+    // Empty if the unit computes its output at once
+    std::vector<std::unique_ptr<Chunk>> chunks;
+
+    // Moving average of the time spent in the functions, for the
+    // per-layer cost; follows throttling within a few dozen runs
+    double run_time_ms = 0;
+    size_t num_runs = 0;
+
+    std::mutex mtx{}; // ACL functions are not re-entrant
+  };
+
+  /// Recent mean run time of the execution unit's operator
+  /// @return The time in milliseconds, or 0 if it has not run yet
+  double mean_run_time(EUHandle eu);
+
+  /// Total time during which at least one task was running, i.e., the time
+  /// this device was busy
+  std::chrono::nanoseconds busy_time();
+
+  /// Weight of the latest run in the moving average of the run time
+  static constexpr double kRunTimeSmoothing = 0.1;
+
+  /// Rank, in milliseconds, a task gains per millisecond in the queue
+  static constexpr double kAgingRate = 1.0;
+
+  /// Buckets of rank of the ready queue of a worker, evenly splitting the
+  /// ranks of the plan
+  static constexpr size_t kNumRankBuckets = 16;
+
 private:
+  /// Configure the operators of all execution units assigned to this device.
+  /// This function is invoked once by the constructor.
+  void prepare_operators();
+
+  /// Configure the ACL functions for the given execution unit.
+  /// @param output_info Info of the output tensor; strided for the leaves,
+  /// which write into the output of the request in place
+  /// @return The prepared operator, or nullptr if an operator is unsupported
+  static std::unique_ptr<PreparedOperator>
+  prepare_operator(const ExecutionUnit &eu,
+                   const arm_compute::TensorInfo &output_info);
+
+  /// Configure the ACL functions of the stages, each one reading the output
+  /// of the previous one
+  /// @param eu The execution unit, for logging
+  /// @param intermediates Filled with the outputs of all stages but the
+  /// last one, allocated
+  /// @return false if a stage is unsupported
+  static bool
+  configure_stages(const ExecutionUnit &eu,
+                   const std::vector<FusedStage> &stages,
+                   arm_compute::ITensor *input,
+                   arm_compute::ITensor *output,
+                   std::vector<std::unique_ptr<arm_compute::IFunction>> &functions,
+                   std::vector<std::unique_ptr<arm_compute::Tensor>> &intermediates);
+
+  /// Configure the functions of each band of the output of a unit streaming
+  /// its output. The band of every stage reads the receptive field of the
+  /// band of the next one; a fully connected layer computes a band of its
+  /// features with the same band of its weights.
+  /// @param stages The unit's own operator followed by its fused stages
+  /// @param op Gets the bands; its `input` and `output` are initialized
+  /// @return false if the bands cannot be computed on their own, in which
+  /// case the unit computes its output at once
+  static bool prepare_chunks(const ExecutionUnit &eu,
+                             const std::vector<FusedStage> &stages,
+                             PreparedOperator &op);
+
+  /// Configure the ACL function of a single stage
+  /// @param stage The layer, fused activation and padding of the stage
+  /// @return The configured function, or nullptr if the layer is unsupported
+  static std::unique_ptr<arm_compute::IFunction>
+  configure_function(const FusedStage &stage,
+                     arm_compute::ITensor *input,
+                     arm_compute::ITensor *output);
+
+  /// Allocate the output tensor of the execution unit.
+  /// The output of a leaf is a view of its rows in the output of the
+  /// request. Other outputs are placed in the arena of the request if they
+  /// are planned, otherwise they are taken from the tensor pool.
+  std::unique_ptr<arm_compute::Tensor>
+  allocate_output(InferenceRequest &request,
+                  EUHandle eu,
+                  const arm_compute::TensorInfo &info);
+
   /// Worker thread loop.
-  /// Pops tasks from the queue and executes them.
+  /// Pops the task with the highest priority and executes it.
   /// After finishing the task, it calls the Orchestrator to
   /// forward the output.
-  void worker_thread_loop();
+  /// @param worker Index of the worker
+  void worker_thread_loop(unsigned int worker);
+
+  /// Take the next task for the worker, sleeping while there is no work.
+  /// @return The task, or nullptr if the engine is stopping
+  std::unique_ptr<Task> next_task(unsigned int worker);
+
+  /// Try to take a task without blocking.
+  /// The injected tasks are moved to the worker's ready queue first, so
+  /// that they are ordered with the others. If that queue is empty, a task
+  /// of the highest bucket of another worker's queue is stolen.
+  std::unique_ptr<Task> try_take_task(unsigned int worker);
+
+  /// Make the task ready on the worker's queue, or on the shared one
+  void push_ready(unsigned int worker, std::unique_ptr<Task> task);
 
   /// Execute the operator for the given execution unit.
   /// This function is invoked by the `worker_thread_loop`.
-  static std::unique_ptr<arm_compute::Tensor>
-  execute_operator(
-      const ExecutionUnit &eu,
-      std::unique_ptr<arm_compute::Tensor> input);
+  std::unique_ptr<arm_compute::Tensor>
+  execute_operator(InferenceRequest &request,
+                   EUHandle eu,
+                   std::unique_ptr<arm_compute::Tensor> input);
+
+  /// Outcome of `execute_chunks`
+  enum class ChunksResult {
+    Completed, // All the bands were computed and forwarded
+    Expired,   // The inference timed out or was cancelled midway
+    Failed,    // The input or the output could not be allocated
+  };
+
+  /// Execute the bands of a unit streaming its output, passing each one to
+  /// the Orchestrator as soon as it is done. The bands left once the
+  /// inference timed out or was cancelled are skipped.
+  /// The functions of the unit are held for one band at a time, and not
+  /// while a band is forwarded.
+  /// This function is invoked by the `worker_thread_loop`.
+  ChunksResult execute_chunks(InferenceRequest &request,
+                              EUHandle eu,
+                              std::unique_ptr<arm_compute::Tensor> input);
 
   Orchestrator &orch_; // For calling `on_computation_complete`
-  const ModelDAG &dag_;
+  const ExecutionPlan &plan_;
+
+  // Operator configured for each execution unit of this device,
+  // indexed by its handle
+  std::vector<std::unique_ptr<PreparedOperator>> prepared_ops_{};
+
+  // Tasks submitted by non-worker threads (e.g., the network listener).
+  // Bounded so that bursts of incoming results push back on the producers.
+  static constexpr size_t kInjectionQueueCapacity = 256;
+  BoundedQueue<Task> injection_queue_{kInjectionQueueCapacity,
+                                      OverflowPolicy::Block};
+  struct TaskOrder {
+    bool operator()(const Task &a, const Task &b) const {
+      return a.priority < b.priority;
+    }
+  };
+  using SharedQueue = PriorityQueue<Task, TaskOrder>;
+  using WorkerQueue = RankedDeque<Task, kNumRankBuckets>;
+  // Ready tasks by bucket of rank, indexed by the worker: only the owner
+  // pushes and pops, without a lock, and the other workers steal.
+  // Empty if the workers share `shared_queue_` instead.
+  std::vector<std::unique_ptr<WorkerQueue>> worker_queues_{};
+  std::unique_ptr<SharedQueue> shared_queue_{};
+  // Greatest rank of the plan, i.e., the top of the highest bucket
+  double max_rank_ = 0;
 
-  ThreadSafeQueue<Task> task_queue_;
+  /// Bucket of the worker queues for the rank of the execution unit
+  size_t rank_bucket(EUHandle eu) const;
+
+  // Origin of the aging clock
+  const std::chrono::steady_clock::time_point start_time_ =
+      std::chrono::steady_clock::now();
   std::vector<std::thread> worker_threads_;
+
+  // Idle workers sleep on `idle_cv_` until a task is queued or stopping
+  std::atomic<size_t> num_queued_{0};
+  std::atomic<unsigned int> num_idle_{0};
+  std::mutex idle_mtx_{};
+  std::condition_variable idle_cv_{};
   std::atomic<bool> stop_{false};
   const unsigned int num_workers_;
+
+  // Busy time accounting; updated when the first task starts and when the
+  // last one ends
+  std::mutex busy_mtx_{};
+  unsigned int num_running_ = 0;
+  std::chrono::steady_clock::time_point busy_since_{};
+  std::chrono::nanoseconds busy_time_{0};
 };
 
 #endif // EDGEFLOW_COMPUTATIONENGINE_H
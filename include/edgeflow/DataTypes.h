@@ -2,8 +2,10 @@
 #define EDGEFLOW_DATATYPES_H
 
 #include "arm_compute/core/Types.h"
+#include "arm_compute/function_info/ActivationLayerInfo.h"
 #include "arm_compute/runtime/Tensor.h"
 #include <android/log.h>
+#include <chrono>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -17,27 +19,149 @@ using LayerID = std::string;
 using ExecutionUnitID = std::string;
 using ParamsT = std::unordered_map<std::string, std::unique_ptr<arm_compute::Tensor>>;
 using HyperParamsT = std::unordered_map<std::string, float>;
+/// ID of an inference, assigned by the device that started it
+using RequestID = uint32_t;
+/// Default limit of the inferences in flight on a device
+inline constexpr size_t kDefaultMaxInFlight = 2;
+/// Threads and ready queues of the computation engine of a device
+struct EngineOptions {
+  // Worker threads; 0 for three quarters of the cores, at least one
+  unsigned int num_workers = 0;
+  // Whether each worker has a ready queue of its own and steals from the
+  // others', rather than all of them sharing one; see
+  // `ComputationEngine::submit_task`
+  bool per_worker_queues = true;
+};
+/// Point in time by which an inference must complete
+using Deadline = std::chrono::steady_clock::time_point;
+/// Deadline of an inference that may take as long as it needs
+inline constexpr Deadline kNoDeadline = Deadline::max();
+
+/// Outcome of an inference, reported by the devices with leaf units
+enum class InferenceStatus : uint8_t {
+  Completed,
+  TimedOut,  // Missed its deadline; dropped on every device
+  Cancelled, // Cancelled by the caller
+  Failed,    // An execution unit could not run; dropped on every device
+};
+
+/// Name of the status, for logs and the callback info
+inline const char *status_name(InferenceStatus status) {
+  switch (status) {
+    case InferenceStatus::Completed: return "completed";
+    case InferenceStatus::TimedOut: return "timed_out";
+    case InferenceStatus::Cancelled: return "cancelled";
+    case InferenceStatus::Failed: return "failed";
+  }
+  return "unknown";
+}
 
 enum class LayerType : uint8_t {
   ReLU,
   // Sigmoid,
   // BatchNorm,
   // Concatenation,
-  // Convolution,
+  Convolution, // 2D convolution on NCHW feature maps
   // Flatten,
   // Identity,
   Linear, // Fully Connected
-  // PoolingAvg,
-  // PoolingMax,
+  PoolingAvg,
+  PoolingMax,
   // Reshape,
 };
 
+/// Encoding of the F32 elements of a result sent to another device
+enum class WireCodec : uint8_t {
+  Raw,    // As computed
+  Sparse, // Bitmap of the nonzero elements, then their values; lossless
+  FP16,   // Rounded to half precision
+  Int8,   // Quantized with one scale and zero point per tensor
+};
+
+/// How the execution units of a layer-level model DAG are generated
+enum class Partitioning : uint8_t {
+  CostModel,  // Per-layer placement minimizing the predicted latency
+  FusedTiles, // Tiles through groups of layers; recomputes the halo rows
+  Pipeline,   // Consecutive layers per device; inferences overlap
+};
+
+/// Measured capabilities of the devices and the links between them
+struct ClusterProfile {
+  struct Link {
+    double bytes_per_ms = 0;
+    double latency_ms = 0;
+  };
+
+  // DeviceID |-> Compute throughput in MACs per millisecond
+  std::unordered_map<DeviceID, double> macs_per_ms;
+  // Source DeviceID |-> Destination DeviceID |-> Link
+  std::unordered_map<DeviceID, std::unordered_map<DeviceID, Link>> links;
+
+  // Used for the devices and links that are not profiled
+  double default_macs_per_ms = 1e6; // ~1 GMAC/s, a mobile CPU
+  Link default_link{.bytes_per_ms = 1e4, .latency_ms = 2}; // ~10 MB/s Wi-Fi
+
+  double throughput(const DeviceID &device) const {
+    const auto it = macs_per_ms.find(device);
+    return it != macs_per_ms.end() ? it->second : default_macs_per_ms;
+  }
+
+  const Link &link(const DeviceID &src, const DeviceID &dest) const {
+    const auto it = links.find(src);
+    if (it != links.end()) {
+      const auto link_it = it->second.find(dest);
+      if (link_it != it->second.end()) {
+        return link_it->second;
+      }
+    }
+    return default_link;
+  }
+};
+
+/// Options of a device, given to `EdgeFlow::initialize`
+struct EdgeFlowOptions {
+  // Limit of the inferences in flight at once
+  size_t max_in_flight = kDefaultMaxInFlight;
+  // Throughput of the devices and links, used to generate the execution
+  // units if the DAG has none. Those are generated again from the
+  // measurements when the latency drifts; see `EdgeFlow::plan_loop`.
+  ClusterProfile profile{};
+  // Run a backup copy of the execution units on a second device when their
+  // result is late; see `Orchestrator::SpeculationStats`
+  bool speculative = false;
+  // Lossy encoding of the results sent to other devices, FP16 or Int8;
+  // Raw keeps them exact, and sparse after a ReLU
+  WireCodec wire_codec = WireCodec::Raw;
+  // Bands the outputs sent to other devices are computed and sent in, at
+  // most, so that transfer overlaps compute; see
+  // `Partitioner::assign_stream_chunks`. 1 sends them at once.
+  size_t stream_chunks = 1;
+  // How the execution units are generated if the DAG has none
+  Partitioning partitioning = Partitioning::CostModel;
+  // Layers per group of fused tiles; see `Partitioner::partition_fused_tiles`
+  size_t fusion_depth = 2;
+  // Threads and ready queues of the computation engine
+  EngineOptions engine_options{};
+};
+
+/// Source ID of an input requirement on the model input itself
+/// (e.g., a row band of the input image for a partitioned root layer)
+inline const ExecutionUnitID kModelInputID = "input";
+
 struct Layer;
 struct Range;
 struct InputRequirement;
 struct ForwardTableEntry;
+struct FusedStage;
 struct ExecutionUnit;
 
+/// Hyperparameters (`hparams`) read by the operators:
+///  - Linear: "in_features", "out_features"
+///  - Convolution: "kernel_h", "kernel_w", "stride_h", "stride_w",
+///    "pad_top", "pad_bottom", "pad_left", "pad_right"
+///  - PoolingAvg/PoolingMax: same as Convolution, plus "exclude_padding"
+/// Convolution and pooling use FLOOR rounding on NCHW tensors of shape
+/// (W, H, C), whose rows (H) are what execution units partition.
 struct Layer {
   LayerID id;
 
@@ -47,6 +171,23 @@ struct Layer {
   HyperParamsT hparams;
 
   arm_compute::TensorShape input_shape, output_shape;
+
+  const arm_compute::Tensor *get_param(const std::string &name) const {
+    auto it = params.find(name);
+    if (it != params.end()) {
+      return it->second.get();
+    }
+    return nullptr;
+  }
+
+  /// Get an integer hyperparameter, or `default_value` if it is not set
+  int get_hparam_int(const std::string &name, int default_value = 0) const {
+    auto it = hparams.find(name);
+    if (it != hparams.end()) {
+      return static_cast<int>(it->second);
+    }
+    return default_value;
+  }
 };
 
 /// Required input range to compute the assigned output partition of the
@@ -74,9 +215,11 @@ struct Range {
 /// Single input requirement of the execution unit
 struct InputRequirement {
   // Source execution unit ID where the partial input comes from.
+  // `kModelInputID` if the input is taken from the model input.
   ExecutionUnitID src_eu_id;
 
-  // Required range from `src_eu_id`'s output
+  // Required range from `src_eu_id`'s output, in the coordinates of the
+  // source layer's whole output (rows for feature maps)
   Range src_range; // May go outside [0, H)
 };
 
@@ -87,6 +230,30 @@ struct InputRequirement {
 struct ForwardTableEntry {
   ExecutionUnitID dest_eu_id; // The destination execution unit ID
   Range required_range;       // The required range of this execution unit's output
+  // Encoding of the range when sent to another device; set by
+  // `Partitioner::assign_wire_codecs`
+  WireCodec codec = WireCodec::Raw;
+};
+
+/// Operator of another execution unit merged into an execution unit by
+/// `GraphOptimizer`. It runs on the same worker right after the preceding
+/// operator, without a round-trip through the Orchestrator.
+struct FusedStage {
+  ExecutionUnitID original_eu_id; // For logging
+
+  std::shared_ptr<Layer> layer;
+
+  // `expected_input_shape` is the output shape of the preceding operator
+  arm_compute::TensorShape expected_input_shape, expected_output_shape;
+
+  // Activation folded into this stage's operator
+  arm_compute::ActivationLayerInfo fused_activation{};
+
+  // Padding applied by the stage's operator (see `ExecutionUnit::prepad_*`)
+  int prepad_top = 0;
+  int prepad_bottom = 0;
+  int prepad_left = 0;
+  int prepad_right = 0;
 };
 
 struct ExecutionUnit {
@@ -107,21 +274,37 @@ struct ExecutionUnit {
 
   /* == Optional fields for the convolution layer == */
   // Pre-padding amounts calculated by EdgeFlow based on paper's Eq. (5) & (6)
+  // The operator pads its input slice by these amounts instead of the
+  // layer's own padding; only slices at the border of the feature map
+  // get the layer's padding, the others get halo rows from their sources.
   int prepad_top = 0;    // Eq. (5) in the paper (upper padding)
   int prepad_bottom = 0; // Eq. (6) in the paper (bottom padding)
   int prepad_left = 0;
   int prepad_right = 0;
 
+  /* == Fields filled by GraphOptimizer == */
+  // Activation folded into this unit's operator
+  arm_compute::ActivationLayerInfo fused_activation{};
+  // Operators run back-to-back after this unit's own operator;
+  // `expected_output_shape` is the output shape of the last stage
+  std::vector<FusedStage> fused_stages{};
+
+  /* == Field filled by Partitioner::assign_backup_devices == */
+  // Device that runs a speculative copy of this unit when its result is
+  // late; empty if the unit has no backup
+  DeviceID backup_device{};
+
+  /* == Field filled by Partitioner::assign_stream_chunks == */
+  // Number of bands of rows the output is computed in; each band goes to
+  // the consumers as soon as it is done, while the next one computes
+  size_t num_stream_chunks = 1;
+
   const LayerType &get_type() const {
     return layer->type;
   }
 
   const arm_compute::Tensor *get_param(const std::string &name) const {
-    auto it = layer->params.find(name);
-    if (it != layer->params.end()) {
-      return it->second.get();
-    }
-    return nullptr;
+    return layer->get_param(name);
   }
 
   float *get_hparam(const std::string &name) const {
@@ -137,6 +320,9 @@ struct ModelDAG {
   std::string name;
 
   std::unordered_map<LayerID, std::shared_ptr<Layer>> layers;
+  // Layers from the input to the output; each one feeds the next.
+  // Needed to generate the execution units with `AutoPartitioner`.
+  std::vector<LayerID> layer_order;
   std::unordered_map<ExecutionUnitID, ExecutionUnit> eus;
 
   arm_compute::TensorShape input_shape, output_shape;
@@ -147,6 +333,8 @@ struct DeviceInfo {
   DeviceID id;
   std::string ip_address;
   unsigned int port;
+  // The app gives this device the model input, so it can run root units
+  bool has_input = true;
 };
 
 using DeviceMap = std::unordered_map<DeviceID, DeviceInfo>;
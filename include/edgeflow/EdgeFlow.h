@@ -1,11 +1,18 @@
 #ifndef EDGEFLOW_EDGEFLOW_H
 #define EDGEFLOW_EDGEFLOW_H
 
+#include "edgeflow/AutoPartitioner.h"
 #include "edgeflow/ComputationEngine.h"
 #include "edgeflow/DataTypes.h"
+#include "edgeflow/ExecutionPlan.h"
+#include "edgeflow/MemoryPlanner.h"
 #include "edgeflow/NetworkEventHandler.h"
 #include "edgeflow/Orchestrator.h"
+#include <condition_variable>
+#include <deque>
 #include <jni.h>
+#include <optional>
+#include <thread>
 
 /// EdgeFlow is the main class that manages the
 /// distributed inference process
@@ -27,9 +34,12 @@ public:
   /// @param dag The model DAG to be executed
   /// @param device_info Local device information
   /// @param devices List of devices to be used
+  /// @param options Limits, codecs and partitioning of this device; see
+  /// `EdgeFlowOptions`
   bool initialize(std::unique_ptr<ModelDAG> dag,
                   std::unique_ptr<DeviceInfo> device_info,
-                  const std::vector<DeviceInfo> &devices);
+                  const std::vector<DeviceInfo> &devices,
+                  const EdgeFlowOptions &options = {});
 
   /// Register the JNI completion callback for the Java side
   /// @param env
@@ -37,18 +47,95 @@ public:
   /// @param callback
   void register_jni_callback(JNIEnv *env, jobject thiz, jmethodID callback);
 
-  /// Start inference using the given input tensor on the model DAG
+  /// Start inference using the given input tensor on the model DAG.
+  /// It does not wait for the previous inferences to complete.
   /// @param input The input tensor
-  bool inference(std::unique_ptr<arm_compute::Tensor> input);
+  /// @param deadline The inference is dropped on every device once this
+  /// passes, and reported as timed out
+  /// @return The ID of the inference, or nothing if it could not be
+  /// started, e.g., because too many inferences are in flight, it would
+  /// not make its deadline, or the devices are switching to a new plan
+  std::optional<RequestID> inference(std::unique_ptr<arm_compute::Tensor> input,
+                                     Deadline deadline = kNoDeadline);
+
+  /// Cancel an inference in flight; it is reported as cancelled unless it
+  /// completed already
+  /// @param request_id The ID returned by `inference`
+  /// @return false if no such inference was started
+  bool cancel(RequestID request_id);
 
   /// Callback function to be called by Orchestrator
   /// when the inference process is complete.
   /// This function will invoke the registered JNI callback
-  /// @param output The output tensor
-  void on_inference_complete(const arm_compute::Tensor &output);
+  /// @param request_id The inference that is complete
+  /// @param status Whether it completed, timed out or was cancelled
+  /// @param output The output tensor; empty unless it completed
+  void on_inference_complete(RequestID request_id,
+                             InferenceStatus status,
+                             const arm_compute::Tensor &output);
 
 private:
   EdgeFlow() = default;
+  ~EdgeFlow();
+
+  /// Generate the execution units of the layers of `dag.layer_order` from
+  /// the profile of `options_`. The cost model places each layer by the predicted latency
+  /// (see `AutoPartitioner`). Fused tiles are sized by the throughput of
+  /// the devices, and need layers partitionable by rows to pay off. A
+  /// pipeline is balanced on the MACs of the layers, so its stages do not
+  /// follow the profile. The first units run on the devices given the model
+  /// input, in the order of their IDs.
+  /// @return false if a layer is unknown or no device is given the input
+  bool generate_eus(ModelDAG &dag) const;
+
+  /// Plan the DAG for this device, start an Orchestrator on the plan, and
+  /// attach it to the network handler for the current epoch
+  /// @param boundaries IDs the devices continue from after a switch; see
+  /// `Orchestrator::resume_request_ids`
+  void start_orchestrator(const std::vector<RequestID> &boundaries = {});
+
+  /// Tell the coordinator when the latency drifts on the current plan
+  void register_drift_callback();
+
+  /// Plan message sent by a device, or posted by this one to itself
+  struct PlanEvent {
+    NetworkEventHandler::PlanMessage message;
+    DeviceID sender;
+    uint32_t epoch;
+    std::vector<uint8_t> payload;
+  };
+
+  /// Send a plan message to the device, or post it to the plan thread if it
+  /// is this one
+  void post_plan_message(const DeviceID &dest_device_id,
+                         NetworkEventHandler::PlanMessage message,
+                         uint32_t epoch,
+                         std::vector<uint8_t> payload = {});
+
+  /// Thread switching every device to a new plan at the same inference.
+  /// The coordinator, the device with the lowest ID, decides: a drift of
+  /// the latency measured on any device is sent to it, and it asks every
+  /// device to prepare the next epoch. A device preparing stops starting
+  /// inferences, and replies with the ID of its next inference and its
+  /// measurements. With all the replies, the coordinator merges the
+  /// measurements, and commits the profile and the IDs to every device;
+  /// without them in time, it cancels. On the commit, each device waits
+  /// until every inference below the IDs is settled on it, and switches:
+  /// as every device generates the same execution units from the same
+  /// profile, the plans agree. The messages of the inferences on the new
+  /// plan that arrive before this device switched are held meanwhile.
+  void plan_loop();
+
+  /// Handle a plan message on the plan thread
+  void handle_plan_event(PlanEvent &event);
+
+  /// Wait until the inferences started before are settled, then switch to
+  /// the plan generated from the profile
+  /// @param boundaries Per device, the ID of its first inference on the new
+  /// plan; see `Orchestrator::wait_settled`
+  void switch_plan(uint32_t epoch,
+                   const ClusterProfile &profile,
+                   const std::vector<RequestID> &boundaries);
 
   // Model definition
   std::unique_ptr<ModelDAG> dag_ = nullptr;
@@ -59,12 +146,48 @@ private:
   // DeviceID |-> DeviceInfo mapping
   std::unique_ptr<DeviceMap> device_map_ = nullptr;
 
+  // Arena placement of the intermediate tensors on this device
+  std::unique_ptr<MemoryPlan> memory_plan_ = nullptr;
+
+  // The DAG lowered to dense handles for the hot path
+  std::unique_ptr<ExecutionPlan> execution_plan_ = nullptr;
+
+  // Exchanges the messages of every plan with the other devices; destroyed
+  // after the Orchestrator, which is attached to it
+  std::unique_ptr<NetworkEventHandler> network_event_handler_ = nullptr;
+
   // Orchestrator instance that manages the inference process
   std::unique_ptr<Orchestrator> orch_ = nullptr;
 
-  // Manages the inference process state
-  std::mutex inference_state_mtx_{};
-  bool inference_active_ = false;
+  // Options given to `initialize`; the profile is updated with the
+  // measurements on every re-partitioning
+  EdgeFlowOptions options_{};
+  // The execution units were generated from the profile, so they can be
+  // again; a DAG given with its execution units keeps them
+  bool eus_generated_ = false;
+
+  /* == Switching plans; see `plan_loop` == */
+  static constexpr std::chrono::seconds kPlanTimeout{5};
+  DeviceID coordinator_id_{};
+  // Epoch of the running plan; used by the plan thread once started
+  uint32_t plan_epoch_ = 0;
+  // Coordinator: the epoch being prepared, the replies so far by device,
+  // and when it asked for them
+  std::optional<uint32_t> preparing_epoch_{};
+  std::unordered_map<DeviceID, std::vector<uint8_t>> ready_payloads_{};
+  std::chrono::steady_clock::time_point prepare_time_{};
+
+  std::deque<PlanEvent> plan_events_{};
+  std::mutex plan_mtx_{};
+  std::condition_variable plan_cv_{};
+  bool stop_plan_ = false;
+  std::thread plan_thread_{};
+
+  // Serializes starting inferences with switching plans
+  std::mutex inference_mtx_{};
+  // No inference is started from the prepare to the switch; guarded by
+  // `inference_mtx_`
+  bool plan_paused_ = false;
 
   /* JNI stuff */
   JavaVM *java_vm_ = nullptr;
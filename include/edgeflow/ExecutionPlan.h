@@ -0,0 +1,169 @@
+#ifndef EDGEFLOW_EXECUTIONPLAN_H
+#define EDGEFLOW_EXECUTIONPLAN_H
+
+#include "edgeflow/AutoPartitioner.h"
+#include "edgeflow/DataTypes.h"
+#include "edgeflow/MemoryPlanner.h"
+#include <limits>
+
+/// Dense handle of an execution unit in an `ExecutionPlan`
+using EUHandle = uint32_t;
+
+inline constexpr EUHandle kInvalidEUHandle =
+    std::numeric_limits<EUHandle>::max();
+
+/// ExecutionPlan is the `ModelDAG` lowered for the hot path of a device.
+/// The execution units, their forward tables and their input requirements
+/// are stored in contiguous arrays indexed by dense handles, and everything
+/// looked up by a string ID is resolved once at compile time.
+/// String IDs are only kept for logging and the wire protocol.
+class ExecutionPlan {
+public:
+  /// A resolved forward table entry
+  struct Forward {
+    EUHandle dest = kInvalidEUHandle;
+    // Required rows, local to the output tensor of the source unit
+    Range range{};
+  };
+
+  /// A resolved input requirement
+  struct Input {
+    EUHandle src = kInvalidEUHandle; // kInvalidEUHandle for the model input
+    // Rows received, in the coordinates of the source layer's whole output;
+    // they may come in several pieces when the source streams its output
+    Range src_rows{};
+    // Row of the input tensor of the unit where `src_rows` start
+    int dst_start = 0;
+  };
+
+  struct Unit {
+    const ExecutionUnit *eu = nullptr;
+    bool is_local = false; // Assigned to this device
+    bool has_backup = false; // Run speculatively on a backup device
+    bool is_backup = false;  // This device is the backup device
+    // Placement of the output in the arena, or nullptr if not planned
+    const MemoryPlan::Allocation *allocation = nullptr;
+
+    uint32_t first_forward = 0, num_forwards = 0;
+    uint32_t first_input = 0, num_inputs = 0;
+    // Rows of all inputs; the unit runs once they are all received
+    uint32_t num_input_rows = 0;
+
+    // Upward rank (HEFT): predicted time from the start of the unit to the
+    // end of the inference along its longest path, network hops included,
+    // in milliseconds
+    double rank = 0;
+  };
+
+  /// Contiguous elements of one unit in a plan-wide array
+  template<typename T>
+  struct Slice {
+    const T *first = nullptr;
+    const T *last = nullptr;
+
+    const T *begin() const { return first; }
+    const T *end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+  };
+
+  /// Lower the model DAG for the given device
+  /// @param dag The model DAG; it must outlive the plan
+  /// @param device_id The device the plan is compiled for
+  /// @param memory_plan The arena placement on this device; it must outlive
+  /// the plan
+  /// @param profile Throughput of the devices and links, for the ranks
+  static ExecutionPlan compile(const ModelDAG &dag,
+                               const DeviceID &device_id,
+                               const MemoryPlan &memory_plan,
+                               const ClusterProfile &profile = {});
+
+  size_t size() const { return units_.size(); }
+
+  const Unit &unit(EUHandle handle) const { return units_[handle]; }
+
+  const ExecutionUnit &eu(EUHandle handle) const { return *units_[handle].eu; }
+
+  Slice<Forward> forwards(EUHandle handle) const {
+    const Unit &unit = units_[handle];
+    const Forward *first = forwards_.data() + unit.first_forward;
+    return {first, first + unit.num_forwards};
+  }
+
+  Slice<Input> inputs(EUHandle handle) const {
+    const Unit &unit = units_[handle];
+    const Input *first = inputs_.data() + unit.first_input;
+    return {first, first + unit.num_inputs};
+  }
+
+  /// Total number of inputs of all units
+  size_t num_inputs() const { return inputs_.size(); }
+
+  /// Plan-wide index of an input returned by `inputs` or `find_input`
+  size_t input_index(const Input *input) const {
+    return static_cast<size_t>(input - inputs_.data());
+  }
+
+  /// Find the input of `dest` received from `src`
+  /// @return The input, or nullptr if `dest` takes no input from `src`
+  const Input *find_input(EUHandle dest, EUHandle src) const;
+
+  /// Resolve the string ID of an execution unit, e.g., from the wire
+  /// @return The handle, or kInvalidEUHandle if there is no such unit
+  EUHandle find(const ExecutionUnitID &eu_id) const;
+
+  /// Root execution units assigned to this device
+  const std::vector<EUHandle> &local_roots() const { return local_roots_; }
+
+  /// Predicted time from the start of an inference on this device to its
+  /// end, i.e., the greatest rank of the local roots, in milliseconds
+  double predicted_latency_ms() const { return predicted_latency_ms_; }
+
+  /// Number of execution units assigned to this device
+  size_t num_local_units() const { return num_local_units_; }
+
+  /// Execution units with a backup, assigned to or backed up by this device
+  const std::vector<EUHandle> &speculative_units() const {
+    return speculative_units_;
+  }
+
+  /// Number of execution units backed up by this device
+  size_t num_backup_units() const { return num_backup_units_; }
+
+  /// Number of leaf execution units assigned to this device
+  size_t num_local_leaves() const { return num_local_leaves_; }
+
+  /// Rows of the model output covered by the leaves of this device, i.e.,
+  /// the hull of their output ranges
+  const Range &output_range() const { return output_range_; }
+
+  /// Shape of the output tensor the leaves of this device write into
+  const arm_compute::TensorShape &output_shape() const { return output_shape_; }
+
+  /// Rows of a local leaf in the output tensor
+  Range output_rows(EUHandle handle) const {
+    const Range &range = units_[handle].eu->output_range;
+    return {range.start - output_range_.start, range.end - output_range_.start};
+  }
+
+private:
+  /// Compute the upward rank of every unit, successors first
+  void compute_ranks(const ClusterProfile &profile);
+
+  std::vector<Unit> units_{};
+  std::vector<Forward> forwards_{};
+  std::vector<Input> inputs_{};
+
+  std::vector<EUHandle> local_roots_{};
+  double predicted_latency_ms_ = 0;
+  size_t num_local_units_ = 0;
+  std::vector<EUHandle> speculative_units_{};
+  size_t num_backup_units_ = 0;
+  size_t num_local_leaves_ = 0;
+  Range output_range_{};
+  arm_compute::TensorShape output_shape_{};
+
+  // ExecutionUnitID |-> Handle; only used off the hot path
+  std::unordered_map<ExecutionUnitID, EUHandle> handles_{};
+};
+
+#endif // EDGEFLOW_EXECUTIONPLAN_H
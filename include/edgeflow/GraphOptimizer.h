@@ -0,0 +1,49 @@
+#ifndef EDGEFLOW_GRAPHOPTIMIZER_H
+#define EDGEFLOW_GRAPHOPTIMIZER_H
+
+#include "edgeflow/DataTypes.h"
+#include <unordered_map>
+#include <vector>
+
+/// GraphOptimizer rewrites the execution units of a model DAG to cut the
+/// per-hop overhead (queue round-trip, tensor allocation and dispatch):
+///  1. An activation that only consumes the output of a fully connected or
+///     convolution layer is folded into it through ACL's fused activation.
+///  2. Straight-line chains of execution units on the same device are
+///     merged into a single execution unit that runs back-to-back.
+/// The pass does not depend on the local device, so every device rewrites
+/// the DAG identically and the execution unit IDs stay consistent.
+class GraphOptimizer {
+public:
+  /// Optimize the execution units of the model DAG in place
+  /// @param dag The model DAG
+  static void optimize(ModelDAG &dag);
+
+private:
+  using PredecessorMap =
+      std::unordered_map<ExecutionUnitID, std::vector<ExecutionUnitID>>;
+
+  /// Fold activation units into their producing units
+  /// @return The number of folded execution units
+  static size_t fuse_activations(ModelDAG &dag);
+
+  /// Merge straight-line chains of same-device units into their heads
+  /// @return The number of merged execution units
+  static size_t merge_chains(ModelDAG &dag);
+
+  /// Get the unit `eu` forwards its whole output to, if `eu` can absorb it
+  /// @return The successor, or nullptr if it cannot be merged into `eu`
+  static ExecutionUnit *mergeable_successor(ModelDAG &dag,
+                                            const ExecutionUnit &eu,
+                                            const PredecessorMap &preds);
+
+  /// Remove `absorbed` from the DAG after it was merged into `into`.
+  /// `into` takes over the outputs of `absorbed`.
+  static void absorb(ModelDAG &dag, ExecutionUnit &into,
+                     const ExecutionUnit &absorbed);
+
+  /// Collect the predecessors of every execution unit from the forward tables
+  static PredecessorMap predecessors(const ModelDAG &dag);
+};
+
+#endif // EDGEFLOW_GRAPHOPTIMIZER_H
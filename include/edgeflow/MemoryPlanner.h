@@ -0,0 +1,67 @@
+#ifndef EDGEFLOW_MEMORYPLANNER_H
+#define EDGEFLOW_MEMORYPLANNER_H
+
+#include "edgeflow/DataTypes.h"
+#include <unordered_map>
+#include <vector>
+
+/// Placement of the intermediate tensors of this device in a single arena
+struct MemoryPlan {
+  struct Allocation {
+    size_t offset = 0; // Byte offset in the arena
+    size_t size = 0;   // Size in bytes
+  };
+
+  // ExecutionUnitID |-> Placement of the execution unit's output
+  std::unordered_map<ExecutionUnitID, Allocation> allocations;
+
+  size_t arena_size = 0; // Planned peak memory
+  size_t naive_size = 0; // Memory needed with one allocation per tensor
+
+  /// Get the placement of the execution unit's output
+  /// @return Pointer to the placement if planned, nullptr otherwise
+  const Allocation *find(const ExecutionUnitID &eu_id) const {
+    auto it = allocations.find(eu_id);
+    return it != allocations.end() ? &it->second : nullptr;
+  }
+};
+
+/// MemoryPlanner packs the outputs of the execution units assigned to a
+/// device into one arena. Since the DAG is static, two outputs may share
+/// memory when every consumer of one output finishes before the producer
+/// of the other starts, regardless of how the workers schedule the tasks.
+class MemoryPlanner {
+public:
+  static constexpr size_t kAlignment = 64;
+
+  /// Plan the arena for the execution units assigned to the given device
+  /// @param dag The model DAG
+  /// @param device_id The device to plan for
+  /// @return The memory plan
+  static MemoryPlan plan(const ModelDAG &dag, const DeviceID &device_id);
+
+private:
+  /// Planned tensor i.e., the output of a local execution unit that stays
+  /// on the device
+  struct Buffer {
+    const ExecutionUnit *producer;
+    size_t size;
+
+    // Indices (in topological order) of the execution units reading the
+    // buffer. Empty if the buffer is live until the end of the inference.
+    std::vector<size_t> consumers;
+  };
+
+  /// Sort the execution units topologically using the forward tables
+  /// @return The execution units in topological order, or an empty vector
+  /// if the DAG has a cycle
+  static std::vector<const ExecutionUnit *>
+  topological_order(const ModelDAG &dag);
+
+  /// Check if every consumer of `a` is a strict ancestor of the producer of
+  /// `b`, i.e., `a` is dead before `b` is written.
+  static bool dead_before(const Buffer &a, size_t b_producer,
+                          const std::vector<std::vector<bool>> &reachable);
+};
+
+#endif // EDGEFLOW_MEMORYPLANNER_H
@@ -1,55 +1,423 @@
 #ifndef EDGEFLOW_NETWORKEVENTHANDLER_H
 #define EDGEFLOW_NETWORKEVENTHANDLER_H
 
+#include "BoundedQueue.hpp"
+#include "edgeflow/AutoPartitioner.h"
 #include "edgeflow/ComputationEngine.h"
 #include "edgeflow/DataTypes.h"
-#include "edgeflow/EdgeFlow.h"
 #include "edgeflow/Orchestrator.h"
+#include "edgeflow/SharedMemoryRing.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <optional>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <thread>
 
 class Orchestrator;
 
+/// NetworkEventHandler exchanges the intermediate results and notices of
+/// the inferences with the other devices over TCP.
+/// Every device keeps one persistent connection to each peer it sends to,
+/// opened on the first message, and accepts one from each peer sending to
+/// it. A message is a fixed binary header (see `FrameHeader`), the IDs of
+/// the execution units, and the raw elements of the tensor, which are sent
+/// with scatter-gather I/O straight from its buffer and received straight
+/// into a pooled tensor for the Orchestrator.
+/// A single reactor thread receives on all the accepted connections: the
+/// sockets are non-blocking and watched by an edge-triggered epoll
+/// instance, and each connection keeps the state of its partially
+/// received message between readiness events.
+/// Peers on the same host get the messages through a `SharedMemoryRing`
+/// instead, handed over on a Unix socket next to the TCP port: the tensor
+/// is copied into memory the receiver maps, and used there in place. A
+/// peer that cannot be reached that way, and any message too large for the
+/// ring, goes over TCP.
+/// Several devices can run on one host by giving them distinct ports on
+/// the loopback address in the `DeviceMap`.
+/// The handler outlives the Orchestrators of successive plans. Every
+/// message carries the epoch of the plan it was sent on, and the messages
+/// of a plan this device has not switched to yet are held until it does.
 class NetworkEventHandler {
 public:
-  NetworkEventHandler(Orchestrator &orch,
-                      const DeviceInfo &device_info,
+  NetworkEventHandler(const DeviceInfo &device_info,
                       const DeviceMap &device_map);
   ~NetworkEventHandler();
 
+  /// Pass the messages of the plan epoch to the Orchestrator from now on.
+  /// The messages of a later epoch, and all of them while no Orchestrator
+  /// is attached, are held until one is attached for their epoch; those of
+  /// an earlier epoch are dropped. The messages sent from now on carry the
+  /// epoch.
+  void attach(Orchestrator &orch, uint32_t epoch);
+
+  /// Stop passing messages to the Orchestrator, waiting for those being
+  /// passed to it; the later ones are held
+  void detach();
+
+  /// Block until every message queued so far was transmitted or dropped
+  void flush();
+
   /// Start listening for incoming connections
   /// @param port The port to listen on
-  void start_listening(unsigned int port);
+  /// @return false if the port could not be bound
+  bool start_listening(unsigned int port);
 
   /// Stop listening for incoming connections
   void stop_listening();
 
-  /// Send an intermediate result to another device
+  /// Send an intermediate result to another device.
+  /// The result is queued for the sender thread; the caller blocks while
+  /// the egress queue is full, i.e., while the links cannot keep up.
+  /// A result still queued when its deadline passes is dropped unsent.
+  /// @param request_id The inference the result belongs to
   /// @param dest_device_id The ID of the destination device
+  /// @param src_eu Execution unit that produced the result
   /// @param dest_eu Destination execution unit
   /// @param data The intermediate result tensor to send
-  void send_intermediate_result(const DeviceID &dest_device_id,
+  /// @param rows Rows of the output of `src_eu` in `data`, in the
+  /// coordinates of its layer's whole output
+  /// @param deadline The deadline of the inference, sent along
+  void send_intermediate_result(RequestID request_id,
+                                const DeviceID &dest_device_id,
+                                const ExecutionUnit &src_eu,
                                 const ExecutionUnit &dest_eu,
-                                std::unique_ptr<arm_compute::Tensor> input);
+                                std::unique_ptr<arm_compute::Tensor> input,
+                                const Range &rows,
+                                Deadline deadline = kNoDeadline);
+
+  /// Tell the device of the other copy of an execution unit with a backup
+  /// that the copy on this device completed first. The notice carries no
+  /// data and is queued behind the results, which it follows on the wire.
+  /// @param request_id The inference the notice belongs to
+  /// @param dest_device_id The ID of the device of the other copy
+  /// @param eu The completed execution unit
+  void send_completion_notice(RequestID request_id,
+                              const DeviceID &dest_device_id,
+                              const ExecutionUnit &eu);
+
+  /// Tell another device that the inference started on this device was
+  /// aborted, so that it drops the tasks and results of the inference
+  /// @param request_id The aborted inference
+  /// @param dest_device_id The ID of the device to tell
+  /// @param status Why it was aborted
+  void send_abort_notice(RequestID request_id,
+                         const DeviceID &dest_device_id,
+                         InferenceStatus status);
+
+  /// Messages of the protocol switching the devices to a new plan; see
+  /// `EdgeFlow::plan_loop`
+  enum class PlanMessage : uint8_t {
+    DriftNotice, // The latency drifted on the sender
+    Prepare,     // Stop starting inferences and report for the epoch
+    Ready,       // Started no more inferences; carries the measurements
+    Commit,      // Switch after the inferences below the boundaries
+    Cancel,      // Keep the current plan
+  };
+
+  using PlanCallback = std::function<void(PlanMessage message,
+                                          const DeviceID &sender,
+                                          uint32_t epoch,
+                                          std::vector<uint8_t> payload)>;
+  /// Register the callback invoked, from the reactor thread, for every plan
+  /// message received. It must not block.
+  void register_plan_callback(PlanCallback plan_callback);
+
+  /// Send a plan message to another device; queued behind the results
+  /// @param epoch The epoch of the plan the message is about
+  /// @param payload Opaque to the handler
+  void send_plan_message(const DeviceID &dest_device_id,
+                         PlanMessage message,
+                         uint32_t epoch,
+                         std::vector<uint8_t> payload);
 
   /// Callback function to be called when an intermediate result is received
+  /// @param request_id The inference the result belongs to
+  /// @param src_eu_id The ID of the execution unit that produced the result
   /// @param dest_eu_id The ID of the destination execution unit
   /// @param data The intermediate result tensor received
+  /// @param rows Rows of the output of the source unit in `data`
+  /// @param deadline The deadline of the inference, on the clock of this
+  /// device
   void
-  on_receive_intermediate_result(const ExecutionUnitID &dest_eu_id,
-                                 std::unique_ptr<arm_compute::Tensor> data);
+  on_receive_intermediate_result(RequestID request_id,
+                                 std::unique_ptr<ExecutionUnitID> src_eu_id,
+                                 std::unique_ptr<ExecutionUnitID> dest_eu_id,
+                                 std::unique_ptr<arm_compute::Tensor> data,
+                                 const Range &rows,
+                                 Deadline deadline);
+
+  /// Recent transfer rate and latency of the links from this device,
+  /// measured on the results sent so far: from the acknowledgements of the
+  /// peer over TCP, and from the copies into the ring for same-host peers
+  /// @param profile Updated with every measured link
+  void measure_links(ClusterProfile &profile);
+
+  /// Results exchanged with one wire codec
+  struct WireStats {
+    uint64_t sent = 0, received = 0;
+    uint64_t raw_bytes = 0;     // Of the results sent, before encoding
+    uint64_t encoded_bytes = 0; // Of the results sent, on the wire
+    double encode_ms = 0, decode_ms = 0;
+    float max_error = 0; // Bound on the error of the elements sent
+
+    double compression_ratio() const {
+      return encoded_bytes > 0 ? static_cast<double>(raw_bytes) / encoded_bytes
+                               : 1;
+    }
+  };
+
+  /// Get a snapshot of the results exchanged with the codec so far
+  WireStats wire_stats(WireCodec codec) const;
+
+  /// Log the results exchanged with every codec used so far
+  void log_wire_stats() const;
+
+  /// Callback function to be called when a completion notice is received
+  /// @param request_id The inference the notice belongs to
+  /// @param eu_id The ID of the execution unit completed by the sender
+  void on_receive_completion_notice(RequestID request_id,
+                                    const ExecutionUnitID &eu_id);
+
+  /// Callback function to be called when an abort notice is received
+  /// @param request_id The aborted inference
+  /// @param status Why it was aborted
+  void on_receive_abort_notice(RequestID request_id, InferenceStatus status);
+
+  /// Weight of the latest sample in the moving average of a link's rate
+  static constexpr double kLinkRateSmoothing = 0.1;
+
+  /// Address of the Unix socket of the device listening on the TCP port, in
+  /// the abstract namespace so that nothing is left on the file system
+  /// @return The size of the address
+  static socklen_t ring_address(unsigned int port, sockaddr_un &address);
 
 private:
-  void listener_loop();
-  // void handle_client_connection(Socket client_socket);
+  enum class MessageType : uint8_t {
+    Result,           // Intermediate result of `src_eu` for `dest_eu`
+    CompletionNotice, // `src_eu` completed on this device first
+    AbortNotice,      // The inference was aborted with `status`
+    Plan,             // A `PlanMessage` in `status`, with its payload
+  };
+
+  /// Largest payload of a plan message taken
+  static constexpr size_t kMaxPlanPayload = size_t{1} << 20;
+
+  /// Header of every message on the wire; defined with the wire format
+  struct FrameHeader;
+
+  /// Message waiting in the egress queue.
+  /// Its deadline goes on the wire as the time left, as the clocks of the
+  /// devices are not synchronized.
+  struct OutgoingResult {
+    MessageType type = MessageType::Result;
+    RequestID request_id = 0;
+    uint32_t epoch = 0; // Of the plan it was sent on
+    DeviceID dest_device_id{};
+    const ExecutionUnit *src_eu = nullptr;  // Null for abort notices
+    const ExecutionUnit *dest_eu = nullptr; // Results only
+    std::unique_ptr<arm_compute::Tensor> data{}; // Results only
+    Range rows{};                                // Results only
+    Deadline deadline = kNoDeadline;
+    InferenceStatus status = InferenceStatus::Completed; // Abort notices only
+    PlanMessage plan_message = PlanMessage::DriftNotice; // Plan messages only
+    std::vector<uint8_t> payload{};                      // Plan messages only
+  };
+
+  /// Message received for the Orchestrator, held while it is not attached
+  struct IncomingMessage {
+    MessageType type = MessageType::Result;
+    RequestID request_id = 0;
+    uint32_t epoch = 0;
+    std::unique_ptr<ExecutionUnitID> src_eu_id{}, dest_eu_id{};
+    std::unique_ptr<arm_compute::Tensor> data{}; // Results only
+    Range rows{};                                // Results only
+    Deadline deadline = kNoDeadline;             // Results only
+    InferenceStatus status = InferenceStatus::Completed; // Abort notices only
+  };
+
+  /// Pass the message to the attached Orchestrator if it is of its epoch,
+  /// or hold it
+  void deliver(IncomingMessage message);
+
+  /// Pass the message to the attached Orchestrator; called with
+  /// `receiver_mtx_` held
+  void pass(IncomingMessage &message);
+
+  /// Tell the other devices that a result of the inference was dropped
+  /// unsent, as its deadline passed, so that they abort it instead of
+  /// waiting for the result; sent from the sender thread directly
+  void send_expiry_notices(RequestID request_id, uint32_t epoch);
+
+  /// Queue a message for the sender thread
+  /// @return false if the handler is stopping
+  bool enqueue(std::unique_ptr<OutgoingResult> message);
+
+  /// Sender thread loop.
+  /// Pops the queued results and transmits them to their devices.
+  void sender_loop();
+
+  /// Transmit a single result to its destination device, connecting to
+  /// the device first if there is no connection, or it was lost
+  /// @return false if the result could not be sent
+  bool transmit(const OutgoingResult &result);
+
+  /// Connection to the device, opened if there is none yet.
+  /// Connecting waits for `kConnectTimeout` at most; a device that could
+  /// not be reached is not tried again before its backoff delay passed, so
+  /// that it does not hold up the messages to the other devices.
+  /// @return The socket, or -1 if the device could not be reached
+  int connection_to(const DeviceID &device_id);
+
+  /// Shared-memory ring to the device, opened if there is none yet
+  /// @return The ring, or nullptr if the device is not on this host or
+  /// does not take one
+  SharedMemoryRing *ring_to(const DeviceID &device_id);
+
+  /// Sample the delivery rate and round trip of the TCP connection to the
+  /// device, as estimated by the kernel, after a result was sent on it
+  void sample_tcp_link(const DeviceID &device_id, int peer_socket);
+
+  /// Update the moving averages of the link to the device with a sample
+  /// @param is_lower_bound The sample was limited by the traffic sent, not
+  /// by the link, e.g., as the link was idle in between; it is only taken
+  /// if it is above the average
+  void record_link_sample(const DeviceID &device_id,
+                          double bytes_per_ms,
+                          bool is_lower_bound,
+                          double latency_ms);
+
+  /// Whether the device runs on the same host as this one
+  bool is_same_host(const DeviceInfo &device) const;
+
+  /// Receiving state of an accepted connection; defined with the wire format
+  struct Connection;
+
+  /// Reactor thread loop.
+  /// Waits for the listening socket and the connections to be ready, and
+  /// accepts or receives until they would block.
+  void reactor_loop();
+
+  /// Accept the pending connections of the peers and watch them
+  void accept_connections();
+
+  /// Encode the elements of the result as `header.codec` tells, replacing
+  /// the buffers of the payload after `head_count` in `send_iov_` with the
+  /// encoding. Falls back to the raw elements when the encoding is not
+  /// smaller, which may happen to sparse results.
+  void encode_payload(const OutgoingResult &result, FrameHeader &header,
+                      size_t head_count);
+
+  /// Decode the encoded payload of the result of the connection into a
+  /// pooled tensor of its shape
+  /// @return false if the encoding is malformed
+  bool decode_payload(Connection &connection, const uint8_t *encoded);
+
+  /// Receive what is available on the connection, passing every complete
+  /// message on
+  /// @return false if the connection is closed or lost, or a message is
+  /// malformed
+  bool receive_messages(Connection &connection);
+
+  /// Attach the ring of a same-host peer, or take the records published in
+  /// it, passing every message on
+  /// @param events The readiness events of the Unix socket or the ring
+  /// @return false if the peer hung up, or a message is malformed
+  bool receive_records(Connection &connection, uint32_t events);
+
+  /// Set the info of the tensor of the result announced by the header of
+  /// the connection
+  /// @return false if the header is malformed
+  bool result_info(Connection &connection) const;
+
+  /// Prepare the tensor the payload of the result announced by the header
+  /// of the connection is received into
+  /// @return false if the header is malformed
+  bool begin_result(Connection &connection);
+
+  /// Pass the message completely received on the connection on
+  void dispatch(Connection &connection);
 
   const DeviceInfo &device_info_;
   const DeviceMap &device_map_;
 
-  Orchestrator &orch_;
+  // Receiver of the messages of epoch `epoch_`, or nullptr while plans are
+  // switched; guarded by `receiver_mtx_`, which is held while a message is
+  // passed, so that the Orchestrator is not destroyed under it
+  Orchestrator *orch_ = nullptr;
+  std::atomic<uint32_t> epoch_{0};
+  std::vector<IncomingMessage> held_messages_{};
+  std::mutex receiver_mtx_{};
 
-  // Socket server_socket_;
-  std::thread listener_thread_;
+  PlanCallback plan_callback_ = nullptr;
+
+  int server_socket_ = -1;
+  // Unix socket the same-host peers hand their rings over on
+  int ring_server_socket_ = -1;
+  int epoll_fd_ = -1;
+  // Written to wake the reactor up when it has to stop
+  int wake_fd_ = -1;
+  std::thread reactor_thread_;
   std::atomic<bool> stop_flag_{};
+
+  // Accepted connections, each watched with a pointer to it; used by the
+  // reactor thread only
+  std::vector<std::unique_ptr<Connection>> connections_{};
+
+  // Destination DeviceID |-> Connection; used by the sender thread only
+  std::unordered_map<DeviceID, int> peer_sockets_{};
+
+  /// Device that could not be reached
+  struct Backoff {
+    std::chrono::steady_clock::time_point retry_time{};
+    std::chrono::milliseconds delay{0}; // Doubled with every failure
+  };
+  // Destination DeviceID |-> Backoff; used by the sender thread only
+  std::unordered_map<DeviceID, Backoff> peer_backoffs_{};
+
+  static constexpr std::chrono::milliseconds kConnectTimeout{1000};
+  static constexpr std::chrono::milliseconds kMinRetryDelay{100};
+  static constexpr std::chrono::milliseconds kMaxRetryDelay{5000};
+
+  // Destination DeviceID |-> Ring, or nullptr if the device is reached over
+  // TCP; used by the sender thread only
+  std::unordered_map<DeviceID, std::unique_ptr<SharedMemoryRing>> peer_rings_{};
+  // Scatter-gather list of the message being sent, kept across messages
+  std::vector<iovec> send_iov_{};
+
+  // Encoding of the payload being sent, and its elements gathered first
+  // when they are not contiguous; used by the sender thread only
+  std::vector<uint8_t> encode_buffer_{};
+  std::vector<float> gather_buffer_{};
+
+  static constexpr size_t kRingCapacity = size_t{32} << 20;
+  // Wait for space in a full ring before sending over TCP, e.g., while the
+  // peer holds the records of a plan it did not switch to yet
+  static constexpr std::chrono::milliseconds kRingSpaceTimeout{50};
+
+  static constexpr size_t kEgressQueueCapacity = 64;
+  BoundedQueue<OutgoingResult> egress_queue_{kEgressQueueCapacity,
+                                             OverflowPolicy::Block};
+  std::thread sender_thread_;
+  // Messages queued and not yet transmitted or dropped
+  size_t num_unsent_ = 0;
+  std::mutex unsent_mtx_{};
+  std::condition_variable unsent_cv_{};
+  // Last inference the sender told the other devices has expired; used by
+  // the sender thread only
+  std::optional<RequestID> last_expired_id_{};
+
+  // Destination DeviceID |-> Moving averages of the delivery rate of the
+  // link and of its one-way latency
+  std::unordered_map<DeviceID, ClusterProfile::Link> link_rates_{};
+  std::mutex link_rates_mtx_{};
+
+  // WireCodec |-> Results exchanged with it
+  std::array<WireStats, 4> wire_stats_{};
+  mutable std::mutex wire_stats_mtx_{};
 };
 
 #endif // EDGEFLOW_NETWORKEVENTHANDLER_H
@@ -1,103 +1,528 @@
 #ifndef EDGEFLOW_ORCHESTRATOR_H
 #define EDGEFLOW_ORCHESTRATOR_H
 
+#include "edgeflow/AutoPartitioner.h"
 #include "edgeflow/ComputationEngine.h"
 #include "edgeflow/DataTypes.h"
-#include "edgeflow/EdgeFlow.h"
+#include "edgeflow/ExecutionPlan.h"
+#include "edgeflow/MemoryPlanner.h"
 #include "edgeflow/NetworkEventHandler.h"
+#include <chrono>
+#include <condition_variable>
+#include <optional>
+#include <thread>
 #include <set>
 
 class ComputationEngine;
 class NetworkEventHandler;
 
+/// State of an inference in flight on this device.
+/// Requests are pooled by the Orchestrator; each one has its own input
+/// states and arena, so several inferences overlap without sharing buffers.
+struct InferenceRequest {
+  /// Input state of the execution unit.
+  /// Lock-free: producers write their rows of `input` into the slots
+  /// preassigned by the execution plan, then take them off `num_pending`;
+  /// the one that brings it to zero submits the unit.
+  /// Aligned to a cache line, as different producers update neighbours.
+  struct alignas(64) InputState {
+    // Input of the execution unit; every received intermediate result is
+    // written into its place as soon as it arrives. Owned by the state.
+    std::atomic<arm_compute::Tensor *> input{nullptr};
+
+    // Rows of all inputs; see `ExecutionPlan::Unit::num_input_rows`
+    unsigned int num_expected = 0;
+    // Rows still missing; reset to `num_expected` by the last piece
+    std::atomic<unsigned int> num_pending{0};
+
+    // Set when the complete input is submitted, or when an aborted request
+    // settles the unit without running it; whichever comes first counts
+    // the unit as done
+    std::atomic<bool> submitted{false};
+
+    /* == Speculative execution; used by the units with a backup only == */
+    // Set by the first copy of the unit to complete, here or on the other
+    // device; the other copy is then cancelled, or its result dropped
+    std::atomic<bool> resolved{false};
+    // Backup copy: events left before the unit is done on this device, i.e.,
+    // its input settled (dropped or run) and the unit resolved
+    std::atomic<unsigned int> num_pending_events{0};
+    // Backup copy: steady clock ticks when its input was complete
+    std::atomic<int64_t> ready_time{0};
+
+    ~InputState() { delete input.load(std::memory_order_relaxed); }
+  };
+
+  InferenceRequest(const ExecutionPlan &plan, size_t arena_size);
+
+  RequestID id = 0;
+
+  // The request is aborted once this passes; set by the first result or
+  // notice of the inference that carries it
+  Deadline deadline = kNoDeadline;
+  // Timed out or cancelled; the remaining tasks are dropped
+  std::atomic<bool> aborted{false};
+  // The outcome was passed to the completion callback
+  std::atomic<bool> reported{false};
+
+  // Input state of each execution unit, indexed by its handle;
+  // only those of this device are used
+  std::vector<InputState> input_states;
+
+  // Pieces received, by plan-wide input index; as both copies of a unit
+  // with a backup send their results, the later copy of a piece is dropped
+  std::unique_ptr<std::atomic<bool>[]> received_inputs{};
+
+  // Backing memory of the intermediate tensors placed by the memory plan
+  arm_compute::Tensor arena_tensor{};
+  uint8_t *arena = nullptr;
+
+  // Local and backup execution units yet to complete; the request is
+  // released at zero
+  std::atomic<size_t> num_pending_eus{0};
+
+  // Output of the inference on this device, of `plan.output_shape()`;
+  // every leaf execution unit writes its rows in place
+  arm_compute::Tensor output{};
+
+  // Leaf execution units yet to complete; the callback fires at zero
+  std::atomic<size_t> num_pending_leaf_eus{0};
+
+  // Start time of the inference, for the per-inference latency log
+  std::chrono::steady_clock::time_point start_time{};
+};
+
 class Orchestrator {
 public:
+  /// @param max_in_flight Limit of the inferences in flight on this device;
+  /// each one has its own arena
+  /// @param network_event_handler Handler kept across the plans, which the
+  /// caller attaches the Orchestrator to; if nullptr, the Orchestrator
+  /// listens on the port of the device with a handler of its own
+  /// @param engine_options Threads and ready queues of the computation engine
   Orchestrator(const ModelDAG &dag,
                const DeviceInfo &device_info,
-               const DeviceMap &device_map);
+               const DeviceMap &device_map,
+               const MemoryPlan &memory_plan,
+               const ExecutionPlan &plan,
+               size_t max_in_flight = kDefaultMaxInFlight,
+               NetworkEventHandler *network_event_handler = nullptr,
+               const EngineOptions &engine_options = {});
 
   ~Orchestrator();
 
-  /// Input state of the execution unit
-  struct InputState {
-    // Received intermediate results from the source execution units
-    std::unordered_map<ExecutionUnitID, std::unique_ptr<arm_compute::Tensor>>
-        received{};
-
-    unsigned int num_expected = 0;
-    unsigned int num_received = 0;
-
-    std::mutex mtx{};
-  };
-
-  using Callback = std::function<void(const arm_compute::Tensor &)>;
+  using Callback = std::function<void(RequestID request_id,
+                                      InferenceStatus status,
+                                      const arm_compute::Tensor &)>;
   /// Register the callback function to be called when the inference is
   /// complete i.e., this.inference_complete_callback_ is invoked.
+  /// It is invoked once per inference with the rows of the model output
+  /// produced on this device (see `ExecutionPlan::output_range`); the tensor
+  /// is reused by a later inference once the callback returns. For an
+  /// inference that timed out or was cancelled, the content of the tensor
+  /// is undefined.
   void
   register_inference_complete_callback(Callback inference_complete_callback);
 
-  /// Start the inference process
+  /// Start the inference process.
+  /// Several inferences may be in flight, up to the limit given to the
+  /// constructor.
   /// @param input The input tensor to be used for inference
-  /// @return true if the inference process is started successfully,
-  bool start_inference(std::unique_ptr<arm_compute::Tensor> input);
+  /// @param deadline The inference is aborted on every device once this
+  /// passes. It is rejected up front if the latency the plan predicts for
+  /// it, from here to its end, does not fit before it.
+  /// @return The ID of the inference if it is started successfully; the
+  /// IDs of the inferences started on different devices never collide.
+  /// An inference whose roots cannot get their input is started, and
+  /// aborted as failed right away.
+  std::optional<RequestID>
+  start_inference(std::unique_ptr<arm_compute::Tensor> input,
+                  Deadline deadline = kNoDeadline);
+
+  /// Abort an inference started on this device, here and on the other
+  /// devices. Its queued tasks are dropped, and the devices with leaf units
+  /// report it as cancelled unless it completed already.
+  /// @return false if no such inference was started on this device
+  bool cancel_inference(RequestID request_id);
 
   /// Callback function to be called when
   /// receives an intermediate result from another device or a local device.
   /// This function will be called by the NetworkEventHandler class.
+  /// @param request_id The inference the result belongs to
   /// @param dest_eu The ID of destination execution unit
   /// @param data The intermediate result tensor used as an input
   /// for the dest_eu
+  /// @param rows Rows of the output of the source unit in `data`, in the
+  /// coordinates of its layer's whole output; a part of the required rows
+  /// if the source streams its output
+  /// @param deadline The deadline of the inference
   void
-  on_receive_intermediate_result(std::unique_ptr<ExecutionUnitID> src_eu_id,
+  on_receive_intermediate_result(RequestID request_id,
+                                 std::unique_ptr<ExecutionUnitID> src_eu_id,
                                  std::unique_ptr<ExecutionUnitID> dest_eu_id,
-                                 std::unique_ptr<arm_compute::Tensor> data);
+                                 std::unique_ptr<arm_compute::Tensor> data,
+                                 const Range &rows,
+                                 Deadline deadline = kNoDeadline);
+
+  /// Callback function to be called when the other copy of an execution
+  /// unit with a backup completed first; the copy on this device is
+  /// cancelled if it has not started, otherwise its result is dropped.
+  /// This function will be called by the NetworkEventHandler class.
+  /// @param request_id The inference the notice belongs to
+  /// @param eu_id The ID of the completed execution unit
+  void on_receive_completion_notice(RequestID request_id,
+                                    const ExecutionUnitID &eu_id);
+
+  /// Callback function to be called when the device that started an
+  /// inference aborted it.
+  /// This function will be called by the NetworkEventHandler class.
+  /// @param request_id The aborted inference
+  /// @param status Why it was aborted
+  void on_receive_abort_notice(RequestID request_id, InferenceStatus status);
 
   /// Callback function to be called when the ComputationEngine is finished
   /// the given execution unit. The resulting tensor will be forwarded to the
   /// next execution unit.
-  /// @param completed_eu The completed execution unit
-  /// @param output The output tensor of the execution unit itself
-  void on_computation_complete(const ExecutionUnit &completed_eu,
+  /// @param request The inference the execution unit ran for
+  /// @param completed The completed execution unit
+  /// @param output The output tensor of the execution unit itself, or
+  /// nullptr if it was streamed already with `on_chunk_complete`
+  void on_computation_complete(InferenceRequest &request,
+                               EUHandle completed,
                                std::unique_ptr<arm_compute::Tensor> output);
 
+  /// Callback function to be called when the ComputationEngine is finished
+  /// a band of the output of an execution unit that streams its output.
+  /// The part of the band each next execution unit requires is forwarded
+  /// right away, while the next band computes.
+  /// @param request The inference the execution unit runs for
+  /// @param eu The execution unit
+  /// @param output The whole output tensor of the execution unit, shared
+  /// with the forwarded views of its bands
+  /// @param rows The rows of the band, local to the output tensor
+  void on_chunk_complete(InferenceRequest &request,
+                         EUHandle eu,
+                         const std::shared_ptr<arm_compute::ITensor> &output,
+                         const Range &rows);
+
+  /// Whether the tasks of the request are to be dropped instead of run,
+  /// as its deadline passed or it was cancelled
+  static bool is_expired(const InferenceRequest &request) {
+    return request.aborted.load(std::memory_order_relaxed) ||
+           (request.deadline != kNoDeadline &&
+            std::chrono::steady_clock::now() > request.deadline);
+  }
+
+  /// Callback function to be called when the ComputationEngine dropped the
+  /// task of an expired request instead of running it
+  /// @param request The inference the task was submitted for
+  /// @param eu The execution unit of the task
+  void on_task_dropped(InferenceRequest &request, EUHandle eu);
+
+  /// Callback function to be called when the ComputationEngine could not
+  /// run a task, e.g., as the unit has no prepared operator or its output
+  /// could not be allocated. The inference is aborted as failed on every
+  /// device, so that its state is released and the caller is told.
+  /// @param request The inference the task was submitted for
+  /// @param eu The execution unit of the task
+  void on_task_failed(InferenceRequest &request, EUHandle eu);
+
+  /// Steady-state performance of this device, i.e., of its pipeline stage
+  /// in pipeline-parallel mode
+  struct StageStats {
+    size_t num_completed = 0; // Inferences completed on this device
+    double throughput = 0;    // Inferences per second
+    double utilization = 0;   // Fraction of the time the device was busy
+    double latency_ms = 0;    // Mean latency of the inferences on this device
+  };
+
+  /// Stats of the last full window of `kStatsWindow` inferences.
+  /// The first window, which covers filling the pipeline, is not reported.
+  StageStats stage_stats();
+
+  /// Recent mean run time of the layers run on this device, summed over
+  /// the execution units of each layer, in milliseconds. Merged units
+  /// count their fused stages under their own layer.
+  /// Used as the `layer_costs` of `Partitioner::partition_pipeline`.
+  std::unordered_map<LayerID, double> layer_costs();
+
+  /// Update the profile with what this device measured: its own throughput
+  /// over the execution units it ran, and the transfer rate of its links
+  void measure_profile(ClusterProfile &profile);
+
+  using DriftCallback = std::function<void(double latency_ms, double baseline_ms)>;
+  /// Register the callback invoked when the mean latency of a stats window
+  /// deviates from the first measured window by more than
+  /// `kDriftThreshold`. It is invoked once until the next registration,
+  /// from a worker thread, so it must not block on inferences.
+  void register_drift_callback(DriftCallback drift_callback);
+
+  /// Relative latency deviation that triggers the drift callback
+  static constexpr double kDriftThreshold = 0.25;
+
+  /// ID the next inference started on this device gets
+  RequestID next_request_id();
+
+  /// Block until every inference the devices started below the boundaries
+  /// is settled on this device: released, or known to be aborted. As
+  /// every device with execution units takes part in every inference, no
+  /// message of those inferences comes to it afterwards.
+  /// @param boundaries Per device, in the order of their IDs: the ID of the
+  /// first inference it starts on the next plan
+  void wait_settled(const std::vector<RequestID> &boundaries);
+
+  /// Continue the inference IDs of the previous plan, whose inferences
+  /// below the boundaries are all settled. Called before any inference is
+  /// started or received.
+  /// @param boundaries See `wait_settled`
+  void resume_request_ids(const std::vector<RequestID> &boundaries);
+
+  /// Speculative execution of the units backed up by this device
+  struct SpeculationStats {
+    size_t num_triggered = 0; // Backup copies run past their deadline
+    size_t num_won = 0;       // Backup copies that completed first
+  };
+
+  SpeculationStats speculation_stats();
+
+  /// Percentile of the recent delays of a unit's primary copy that a backup
+  /// copy waits for before it runs
+  static constexpr double kSpeculationPercentile = 0.95;
+
+  /// Delays of the primary copy a backup waits to observe before it
+  /// speculates, and the number of recent delays kept
+  static constexpr size_t kMinLagSamples = 16;
+  static constexpr size_t kLagHistory = 64;
+
 private:
-  void check_and_run_eu(const ExecutionUnitID &eu_id);
+  /// Number of inferences the stage stats are measured over
+  static constexpr size_t kStatsWindow = 32;
+
+  /// Find the request state of an inference, taking one from the pool for
+  /// the first result of the inference on this device. An inference that
+  /// finds the pool empty fails on every device. The request is held from
+  /// being released, e.g., by an abort, until `finish_unit` is called for
+  /// it, as with `pin_request`.
+  /// @param deadline The deadline of the inference, if it is new here
+  /// @return The request, or nullptr if the inference is settled already,
+  /// being released, or the limit of inferences is reached
+  InferenceRequest *acquire_request(RequestID request_id,
+                                    Deadline deadline = kNoDeadline);
+
+  /// Take a request state from the pool for a new inference; called with
+  /// `requests_mtx_` held, and a free state left
+  InferenceRequest *take_request(RequestID request_id, Deadline deadline);
+
+  /// Record that no message of the inference is to be handled here any
+  /// more; called with `requests_mtx_` held
+  void settle(RequestID request_id);
+
+  /// Whether the inference was settled; called with `requests_mtx_` held
+  bool is_settled(RequestID request_id) const;
+
+  /// Find the request of an inference in flight on this device, and hold
+  /// it from being released until `finish_unit` is called for it
+  /// @return The request, or nullptr if the inference is not in flight
+  InferenceRequest *pin_request(RequestID request_id);
+
+  /// Hold the request from being released, unless its last unit is done;
+  /// called with `requests_mtx_` held
+  /// @return false if the request is being released
+  static bool pin(InferenceRequest &request);
+
+  /// Give the request state back to the pool
+  void release_request(InferenceRequest &request);
+
+  /// Count an execution unit of the request as done on this device, and
+  /// release the request after the last one
+  void finish_unit(InferenceRequest &request);
+
+  /// Abort the request on this device: the units not submitted yet are
+  /// settled without running, and the submitted ones are dropped by the
+  /// workers
+  /// @param notify_peers Tell the other devices, as the abort was decided
+  /// here rather than received from one of them
+  /// @return false if the request was aborted already
+  bool abort_request(InferenceRequest &request,
+                     InferenceStatus status,
+                     bool notify_peers);
+
+  /// Tell every other device that the inference was aborted
+  void send_abort_notices(RequestID request_id, InferenceStatus status);
+
+  /// Pass the outcome of the request to the completion callback, unless it
+  /// was passed already
+  void report(InferenceRequest &request, InferenceStatus status);
+
+  /// Thread aborting the requests whose deadline passed
+  void deadline_loop();
 
-  std::unique_ptr<arm_compute::Tensor>
-  assemble_input_for_eu(const ExecutionUnit &eu, InputState &input_state);
+  /// Claim the result of an execution unit with a backup for the copy on
+  /// this device, and notify the device of the other copy
+  /// @return false if the other copy completed first
+  bool claim_result(InferenceRequest &request, EUHandle eu);
+
+  /// Run an execution unit on its complete input, unless the other copy of
+  /// the unit completed first; a backup copy is armed instead
+  void run_eu(InferenceRequest &request,
+              EUHandle eu,
+              std::unique_ptr<arm_compute::Tensor> input);
+
+  /// Drop the backup copy of a unit whose primary copy completed first,
+  /// recording how late the primary copy was
+  void cancel_backup(InferenceRequest &request, EUHandle eu);
+
+  /// Count an event of a backup unit; see `InputState::num_pending_events`
+  void settle_backup(InferenceRequest &request, EUHandle eu);
+
+  /// Hold the complete input of a backup unit until the primary copy is
+  /// late, then run it; dropped if the primary copy completes first
+  void arm_speculation(InferenceRequest &request,
+                       EUHandle eu,
+                       std::unique_ptr<arm_compute::Tensor> input);
+
+  /// Record a delay of the primary copy of a backup unit, from the input of
+  /// the backup copy being complete to the primary copy completing
+  void record_lag(EUHandle eu, double lag_ms);
+
+  /// Thread running the backup copies whose deadline passed
+  void speculation_loop();
+
+  /// Deliver an intermediate result to the execution unit on this device,
+  /// and submit the unit once its input is complete
+  /// @param request The inference the result belongs to
+  /// @param eu The destination execution unit
+  /// @param src_eu The execution unit that produced `data`
+  /// @param data The part of the input of `eu` produced by `src_eu`
+  /// @param rows Rows of the output of `src_eu` in `data`; see
+  /// `on_receive_intermediate_result`
+  void check_and_run_eu(InferenceRequest &request,
+                        EUHandle eu,
+                        EUHandle src_eu,
+                        std::unique_ptr<arm_compute::Tensor> data,
+                        const Range &rows);
+
+  /// Write the intermediate result into its place in the input of the
+  /// execution unit, allocating the input for the first one.
+  /// Rows outside the feature map are never received; the execution unit
+  /// pads them itself.
+  /// @return true if `data` held the last missing rows of the input, false
+  /// if rows are still missing, or nothing if the piece cannot be placed:
+  /// `eu` takes no input from `src_eu`, the rows fall outside the input,
+  /// or the input cannot be allocated
+  std::optional<bool>
+  assemble_input_for_eu(EUHandle eu,
+                        InferenceRequest::InputState &input_state,
+                        EUHandle src_eu,
+                        const arm_compute::Tensor &data,
+                        const Range &rows);
 
   /// Dispatch the output tensor to the next execution unit
+  /// @param request The inference the output belongs to
   /// @param src_eu The execution unit that produced the output
   /// @param output The output tensor to be dispatched
-  void dispatch_output(const ExecutionUnit &src_eu,
+  void dispatch_output(InferenceRequest &request,
+                       EUHandle src_eu,
                        std::unique_ptr<arm_compute::Tensor> output);
 
-  /// Get the execution unit in the model DAG by its ID
-  /// @param eu_id The ID of the execution unit
-  /// @return Pointer to the execution unit if found, nullptr otherwise
-  const ExecutionUnit *
-  get_execution_unit(const ExecutionUnitID &eu_id) const;
+  /// Forward rows of the output tensor to the destination of a forward
+  /// table entry, on this device or another one
+  /// @param rows The rows to forward, local to `output` and within the
+  /// range of `forward`
+  void dispatch_rows(InferenceRequest &request,
+                     EUHandle src_eu,
+                     const ExecutionPlan::Forward &forward,
+                     const std::shared_ptr<arm_compute::ITensor> &output,
+                     const Range &rows);
 
   const ModelDAG &dag_;
   const DeviceInfo &device_info_;
   const DeviceMap &device_map_;
+  const MemoryPlan &memory_plan_;
+  const ExecutionPlan &plan_;
 
   std::unique_ptr<ComputationEngine> computation_engine_ = nullptr;
-  std::unique_ptr<NetworkEventHandler> network_event_handler_ = nullptr;
+  // Either owned, or kept across the plans by the caller
+  std::unique_ptr<NetworkEventHandler> owned_network_event_handler_ = nullptr;
+  NetworkEventHandler *network_event_handler_ = nullptr;
 
   // EdgeFlow::on_inference_complete() will be assigned to this
   Callback inference_complete_callback_ = nullptr;
 
-  // The set of execution units that are responsible for this device
-  std::unordered_map<ExecutionUnitID, InputState> input_states_{};
-  std::mutex orch_mtx_{};
+  // Pool of request states, one per inference in flight
+  std::vector<std::unique_ptr<InferenceRequest>> requests_{};
+  std::vector<InferenceRequest *> free_requests_{};
+  // RequestID |-> Request in flight; looked up for results from the network
+  std::unordered_map<RequestID, InferenceRequest *> active_requests_{};
+  // IDs of the inferences started here: `device_index_` plus multiples of
+  // `num_devices_`, so they never collide with those of the other devices
+  RequestID next_request_id_ = 0;
+  RequestID device_index_ = 0;
+  RequestID num_devices_ = 1;
+  std::mutex requests_mtx_{};
+
+  // Signaled when the settled inferences of a device advance
+  std::condition_variable settled_cv_{};
+
+  // Stage stats, guarded by `requests_mtx_`
+  StageStats stage_stats_{};
+  std::chrono::steady_clock::time_point window_start_{};
+  std::chrono::nanoseconds window_start_busy_time_{0};
+  std::chrono::nanoseconds window_latency_{0};
 
-  // Leaf execution units
-  std::unordered_map<ExecutionUnitID, std::unique_ptr<arm_compute::Tensor>>
-      collected_final_outputs_{};
-  std::mutex collected_final_outputs_mtx_{};
+  // Settled inferences, per device that started them: every ID below
+  // `settled_below_`, and those settled out of order above it. Late results
+  // of an inference, e.g., from the losing copy of a unit, must not take a
+  // new request state. Not kept by a device without execution units.
+  std::vector<RequestID> settled_below_{};
+  std::vector<std::set<RequestID>> settled_ahead_{};
+  bool tracks_settled_ = false;
+
+  // Latency drift detection, guarded by `requests_mtx_`
+  DriftCallback drift_callback_ = nullptr;
+  double baseline_latency_ms_ = 0; // Mean latency of the first window
+
+  /// Backup copy waiting for its deadline
+  struct SpeculativeCopy {
+    std::chrono::steady_clock::time_point deadline;
+    InferenceRequest *request;
+    EUHandle eu;
+    std::unique_ptr<arm_compute::Tensor> input;
+  };
+
+  struct LaterDeadline {
+    bool operator()(const std::unique_ptr<SpeculativeCopy> &a,
+                    const std::unique_ptr<SpeculativeCopy> &b) const {
+      return a->deadline > b->deadline;
+    }
+  };
+
+  // Min-heap of the armed backup copies on their deadline
+  std::vector<std::unique_ptr<SpeculativeCopy>> armed_copies_{};
+  std::mutex speculation_mtx_{};
+  std::condition_variable speculation_cv_{};
+  bool stop_speculation_ = false;
+  std::thread speculation_thread_{};
+  SpeculationStats speculation_stats_{};
+
+  // Min-heap of the deadlines of the requests in flight; stale entries of
+  // released requests are skipped
+  using PendingDeadline = std::pair<Deadline, RequestID>;
+  std::vector<PendingDeadline> deadlines_{};
+  std::mutex deadline_mtx_{};
+  std::condition_variable deadline_cv_{};
+  bool stop_deadlines_ = false;
+  std::thread deadline_thread_{};
+
+  /// Recent delays of the primary copy of a backup unit, in milliseconds
+  struct LagHistory {
+    std::mutex mtx;
+    std::vector<double> samples_ms;
+    size_t next = 0; // Oldest sample once the history is full
+  };
 
-  std::atomic<int> num_pending_leaf_eus_{0};
+  // Indexed by handle; only allocated for the units backed up here
+  std::vector<std::unique_ptr<LagHistory>> lag_histories_{};
 };
 
 #endif // EDGEFLOW_ORCHESTRATOR_H
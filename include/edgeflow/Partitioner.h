@@ -0,0 +1,209 @@
+#ifndef EDGEFLOW_PARTITIONER_H
+#define EDGEFLOW_PARTITIONER_H
+
+#include "edgeflow/DataTypes.h"
+#include <algorithm>
+#include <vector>
+
+/// Partitioner builds the execution units of partitioned layers.
+/// A convolution or pooling layer is split into bands of output rows; each
+/// execution unit receives only the input rows its band depends on (the
+/// halo included) and pads its slice by `prepad_*` so that the result is
+/// identical to running the whole layer.
+class Partitioner {
+public:
+  /// Cost of fused-tile partitioning compared with per-layer partitioning
+  struct TilingReport {
+    size_t fusion_depth = 0;
+
+    double full_macs = 0;  // MACs of the unpartitioned layers
+    double tiled_macs = 0; // MACs computed by all tiles, redundant halo included
+
+    size_t exchanged_bytes = 0;           // Cross-device bytes with fused tiles
+    size_t layerwise_exchanged_bytes = 0; // Cross-device bytes, per-layer bands
+
+    /// Fraction of the MACs computed more than once; negative when the tiles
+    /// skip rows that no later layer reads
+    double redundant_compute() const {
+      return full_macs > 0 ? (tiled_macs - full_macs) / full_macs : 0;
+    }
+
+    /// Cross-device bytes saved by fusing the layers
+    size_t communication_saved() const {
+      return layerwise_exchanged_bytes - exchanged_bytes;
+    }
+  };
+
+  /// Consecutive layers run by one device in pipeline-parallel mode
+  struct PipelineStage {
+    DeviceID device;
+    size_t first_layer = 0, num_layers = 0;
+    double cost = 0; // Sum of the layer costs
+  };
+
+  /// Predicted balance of a pipeline-parallel partitioning
+  struct PipelineReport {
+    std::vector<PipelineStage> stages;
+
+    /// Cost of the slowest stage, which bounds the steady-state throughput
+    double bottleneck_cost() const {
+      double cost = 0;
+      for (const auto &stage: stages) {
+        cost = std::max(cost, stage.cost);
+      }
+      return cost;
+    }
+
+    /// Steady-state inferences per unit of cost, e.g., per millisecond for
+    /// measured costs
+    double throughput() const {
+      const double cost = bottleneck_cost();
+      return cost > 0 ? 1.0 / cost : 0;
+    }
+
+    /// Fraction of the time the stage is busy in steady state
+    double utilization(size_t stage) const {
+      const double cost = bottleneck_cost();
+      return cost > 0 ? stages[stage].cost / cost : 0;
+    }
+  };
+
+  /// Input rows needed to compute `output_rows` of the layer, i.e., the
+  /// receptive field. The range may go outside [0, H) by the layer padding.
+  static Range receptive_rows(const Layer &layer, const Range &output_rows);
+
+  /// Split the output rows of a convolution or pooling layer into bands
+  /// @param layer The layer to split
+  /// @param devices Device of each band, from the top row to the bottom row
+  /// @param shares Relative number of rows of each band; equal if empty
+  /// @return One execution unit per non-empty band, not connected yet
+  static std::vector<ExecutionUnit>
+  partition_rows(const std::shared_ptr<Layer> &layer,
+                 const std::vector<DeviceID> &devices,
+                 const std::vector<float> &shares = {});
+
+  /// Split a stack of consecutive convolution and pooling layers into
+  /// vertical tiles (fused-tile partitioning as in DeepThings). Every group
+  /// of `fusion_depth` layers is partitioned once: each device computes its
+  /// tile through all layers of the group, recomputing the overlapping halo
+  /// rows instead of exchanging them, so data only crosses devices between
+  /// groups. The tile of each layer is a separate execution unit; the
+  /// units of a tile form a same-device chain that `GraphOptimizer` merges.
+  /// The tiles of the first group read the model input, so they are split
+  /// over the devices given it only.
+  /// @param layers The layer stack, from input to output
+  /// @param devices Device of each tile, from the top row to the bottom row
+  /// @param input_devices Devices given the model input, in the same order;
+  /// all of `devices` if empty
+  /// @param fusion_depth Number of layers per group; 1 is per-layer bands
+  /// @param shares Relative number of output rows of each tile, by device
+  /// @param report If not null, filled with the compute/communication cost
+  /// @return The execution units of each layer, connected to each other and
+  /// to the model input; those of the last layer are the leaves
+  static std::vector<std::vector<ExecutionUnit>>
+  partition_fused_tiles(const std::vector<std::shared_ptr<Layer>> &layers,
+                        const std::vector<DeviceID> &devices,
+                        const std::vector<DeviceID> &input_devices,
+                        size_t fusion_depth,
+                        const std::vector<float> &shares = {},
+                        TilingReport *report = nullptr);
+
+  /// Split a chain of layers into consecutive pipeline stages, one stage
+  /// per device, so that consecutive inferences overlap: the first device
+  /// runs inference t+1 while the second runs inference t.
+  /// Stages are balanced by minimizing the cost of the slowest one.
+  /// @param layers The layer chain, from input to output
+  /// @param devices Device of each stage, from the first stage to the last;
+  /// extra devices are left idle if there are fewer layers. The first stage
+  /// reads the model input, so the first device must be given it.
+  /// @param layer_costs Measured cost of each layer, e.g., the mean run time
+  /// reported by `Orchestrator::layer_costs()`; estimated from the MACs if
+  /// it does not cover every layer
+  /// @param report If not null, filled with the predicted stage balance
+  /// @return One whole-layer execution unit per layer, connected to each
+  /// other and to the model input; that of the last layer is the leaf
+  static std::vector<std::vector<ExecutionUnit>>
+  partition_pipeline(const std::vector<std::shared_ptr<Layer>> &layers,
+                     const std::vector<DeviceID> &devices,
+                     const std::vector<double> &layer_costs = {},
+                     PipelineReport *report = nullptr);
+
+  /// Connect two consecutive partitioned layers: each consumer requires
+  /// the overlap of its receptive field with every producer's output band,
+  /// and each producer forwards exactly that overlap.
+  /// @param producers Execution units of the preceding layer
+  /// @param consumers Execution units of the following layer
+  static void connect(std::vector<ExecutionUnit> &producers,
+                      std::vector<ExecutionUnit> &consumers);
+
+  /// Mark the execution units as roots reading their band of the model input
+  static void connect_model_input(std::vector<ExecutionUnit> &consumers);
+
+  /// Pick the backup device of every execution unit for speculative
+  /// execution: the device, other than its own, with the least work
+  /// assigned so far, backups included. Roots and leaves get no backup, as
+  /// the model input and output stay on their devices. Every device derives
+  /// the same backups from the same DAG.
+  /// @param dag The model DAG whose execution units are updated
+  /// @param devices The devices to place the backups on
+  static void assign_backup_devices(ModelDAG &dag, const DeviceMap &devices);
+
+  /// Pick the wire codec of every forward table entry crossing devices.
+  /// A lossy codec applies to all of them when given. Otherwise, results
+  /// of a ReLU are sent sparse, as they are mostly zeros; the sender falls
+  /// back to raw elements when that is not smaller.
+  /// @param dag The model DAG whose forward tables are updated
+  /// @param lossy_codec `WireCodec::FP16` or `WireCodec::Int8` to trade
+  /// accuracy for bandwidth, or `WireCodec::Raw` to keep results exact
+  static void assign_wire_codecs(ModelDAG &dag, WireCodec lossy_codec);
+
+  /// Split the output of the execution units sending to other devices into
+  /// bands of rows computed one after the other, so that a band is on the
+  /// wire while the next one computes; see `ComputationEngine::PreparedOperator`.
+  /// The receivers place each band in the input of the consumer, which
+  /// runs once it has all the rows it requires.
+  /// Only units whose operators can compute a band on their own are split:
+  /// convolution, pooling and ReLU stages, or a single fully connected
+  /// layer, whose bands are output features. Leaves and units with a
+  /// backup are left whole.
+  /// @param dag The model DAG whose execution units are updated
+  /// @param max_chunks Largest number of bands of a unit; 1 leaves them all
+  /// whole. Bands are no smaller than `kMinStreamChunkBytes`.
+  static void assign_stream_chunks(ModelDAG &dag, size_t max_chunks);
+
+  /// Smallest band of a streamed output; below it, the cost of a message
+  /// and of running the operators once more outweighs the overlap
+  static constexpr size_t kMinStreamChunkBytes = 64 * 1024;
+
+  /// Multiply-accumulates to compute `rows` output rows of the layer
+  static double layer_macs(const Layer &layer, int rows);
+
+  /// Multiply-accumulates of the execution unit, fused stages included
+  static double eu_macs(const ExecutionUnit &eu);
+
+private:
+  /// Create the execution unit computing `rows` of the layer's output
+  static ExecutionUnit make_row_eu(const std::shared_ptr<Layer> &layer,
+                                   const Range &rows,
+                                   const DeviceID &device,
+                                   size_t index);
+
+  /// Bytes the producers forward to consumers on other devices
+  static size_t cross_device_bytes(const std::vector<ExecutionUnit> &producers,
+                                   const std::vector<ExecutionUnit> &consumers);
+
+  /// Split `costs` into `num_stages` contiguous non-empty runs minimizing
+  /// the largest sum of a run
+  /// @return The first index of each run
+  static std::vector<size_t> balance_stages(const std::vector<double> &costs,
+                                            size_t num_stages);
+
+  /// Split `total` rows into contiguous bands proportional to `shares`
+  static std::vector<Range> split(int total, size_t num_bands,
+                                  const std::vector<float> &shares);
+
+  /// Rows of the consumer's input band, i.e., its clamped receptive field
+  static Range input_band(const ExecutionUnit &consumer);
+};
+
+#endif // EDGEFLOW_PARTITIONER_H
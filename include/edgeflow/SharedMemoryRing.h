@@ -0,0 +1,154 @@
+#ifndef EDGEFLOW_SHAREDMEMORYRING_H
+#define EDGEFLOW_SHAREDMEMORYRING_H
+
+#include "arm_compute/core/TensorInfo.h"
+#include "arm_compute/runtime/Tensor.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sys/uio.h>
+
+/// SharedMemoryRing carries the messages of one device to another device
+/// running on the same host, through memory mapped by both processes.
+/// The producer creates the ring in a memfd and hands its descriptors to
+/// the consumer, which maps it. Messages are records of a small head and
+/// a payload, laid out one after the other in a circular buffer; the
+/// payload of a record starts on a cache line, so the consumer uses it in
+/// place as the buffer of a tensor. Records are freed in any order, and
+/// their space is reclaimed once all the records before them are freed.
+/// The sides signal each other through two eventfds, and only when the
+/// other side is waiting: the consumer for records, the producer for space.
+class SharedMemoryRing : public std::enable_shared_from_this<SharedMemoryRing> {
+public:
+  /// Alignment of the records, and of their payload
+  static constexpr size_t kAlignment = 64;
+
+  /// Record taken from the ring by the consumer
+  struct Record {
+    const uint8_t *head = nullptr;
+    size_t head_size = 0;
+    uint8_t *payload = nullptr;
+    size_t payload_size = 0;
+  };
+
+  /// Create a ring, on the producer side
+  /// @param capacity Bytes of the records in flight; rounded up to whole
+  /// pages
+  /// @param link_fd Socket to the consumer, which hangs up when the
+  /// consumer is gone; owned by the ring
+  /// @return The ring, or nullptr if the memory could not be mapped
+  static std::unique_ptr<SharedMemoryRing> create(size_t capacity, int link_fd);
+
+  /// Map the ring created by a producer, on the consumer side.
+  /// Takes ownership of the descriptors, also on failure.
+  /// @return The ring, or nullptr if the memory is not a ring
+  static std::shared_ptr<SharedMemoryRing>
+  attach(int memory_fd, int data_fd, int space_fd);
+
+  SharedMemoryRing(const SharedMemoryRing &) = delete;
+  SharedMemoryRing &operator=(const SharedMemoryRing &) = delete;
+  ~SharedMemoryRing();
+
+  /// Descriptors the consumer attaches with, in the order of `attach`
+  int memory_fd() const { return memory_fd_; }
+  int data_fd() const { return data_fd_; }
+  int space_fd() const { return space_fd_; }
+
+  /// Copy a message into the ring and publish it; producer only.
+  /// Waits while the ring is full, for `timeout` at most. Once a wait timed
+  /// out, the ring is congested: the next messages do not wait for space
+  /// until one finds it free again.
+  /// @param head Buffers gathered into the head of the record
+  /// @param payload Buffers gathered into the payload of the record
+  /// @return false if the message cannot fit at the current position of
+  /// the ring, counting the space left before its end, the ring stayed
+  /// full, or the consumer is gone. A record of up to half the capacity
+  /// always fits.
+  bool push(const iovec *head, size_t head_count,
+            const iovec *payload, size_t payload_count,
+            std::chrono::milliseconds timeout);
+
+  /// Whether the consumer hung up; producer only
+  bool closed() const { return closed_; }
+
+  /// Take the next published record; consumer only.
+  /// The record stays in the ring until it is released. The sizes the
+  /// producer wrote are checked before they are used, as it is another
+  /// process: a record that does not fit where it is makes the ring
+  /// corrupt, and no record is taken from it anymore.
+  /// @return false if there is none, or the ring is corrupt
+  bool next(Record &record);
+
+  /// Whether `next` found a malformed record, after which the link is to
+  /// be closed; consumer only
+  bool corrupt() const { return corrupt_; }
+
+  /// Wait for the producer to signal more records; consumer only.
+  /// To be called when `next` found none, before waiting for `data_fd`.
+  /// @return false if records were published meanwhile, so that the
+  /// consumer takes them instead of waiting
+  bool sleep();
+
+  /// Clear the signal of `data_fd` once it fired; consumer only
+  void wake_up();
+
+  /// Give a record back; any thread
+  void release(const Record &record);
+
+  /// Tensor of the given info using the payload of the record in place.
+  /// The record is released when the tensor is destroyed, and the tensor
+  /// keeps the ring mapped until then.
+  /// @return The tensor, or nullptr if the payload is too small for it, in
+  /// which case the record is released right away
+  std::unique_ptr<arm_compute::Tensor>
+  wrap(const Record &record, const arm_compute::TensorInfo &info);
+
+private:
+  struct Control;
+  struct RecordHeader;
+  class RecordTensor;
+
+  SharedMemoryRing() = default;
+
+  /// Bytes of the mapping before the records, which start on a page
+  static size_t control_size();
+
+  /// Map the control block and the records of the memfd
+  bool map(size_t capacity);
+
+  /// Header of the record at a position of the stream
+  RecordHeader *record_at(uint64_t position) const;
+
+  /// Whether a record of `size` bytes fits at `position`, i.e., takes at
+  /// least its header, in whole alignment units, before both the end of
+  /// the buffer and the position `end`
+  bool fits(uint64_t position, uint64_t size, uint64_t end) const;
+
+  /// Wait until `size` bytes past `position` are free, for the timeout at
+  /// most, or the consumer is gone; producer only
+  /// @return false if the space is not free
+  bool wait_for_space(uint64_t position, size_t size,
+                      std::chrono::milliseconds timeout);
+
+  int memory_fd_ = -1;
+  int data_fd_ = -1;  // Signalled by the producer when records are published
+  int space_fd_ = -1; // Signalled by the consumer when space is reclaimed
+  int link_fd_ = -1;  // Producer only
+
+  Control *control_ = nullptr;
+  uint8_t *records_ = nullptr;
+  size_t capacity_ = 0;
+  size_t mapping_size_ = 0;
+
+  // Position of the next record to take; used by the consumer thread only
+  uint64_t read_position_ = 0;
+  bool corrupt_ = false; // Consumer thread only
+  // Serializes the reclaiming of the released records on the consumer side
+  std::mutex reclaim_mtx_{};
+  bool closed_ = false;
+  // The last wait for space timed out; producer only
+  bool congested_ = false;
+};
+
+#endif // EDGEFLOW_SHAREDMEMORYRING_H
@@ -0,0 +1,98 @@
+#ifndef EDGEFLOW_TENSORPOOL_H
+#define EDGEFLOW_TENSORPOOL_H
+
+#include "arm_compute/core/TensorInfo.h"
+#include "arm_compute/runtime/Tensor.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/// TensorPool recycles tensor buffers instead of freeing them.
+/// Buffers are grouped into power-of-two size classes. Each thread keeps a
+/// small cache per size class, so the worker threads rarely touch the
+/// shared free lists. Tensors handed out by the pool import the pooled
+/// buffer, and return it to the pool when they are destroyed.
+class TensorPool {
+public:
+  /// Get the process-wide tensor pool
+  static TensorPool &instance();
+
+  TensorPool(const TensorPool &) = delete;
+  TensorPool &operator=(const TensorPool &) = delete;
+  TensorPool(TensorPool &&) = delete;
+  TensorPool &operator=(TensorPool &&) = delete;
+
+  struct Stats {
+    uint64_t hits = 0;   // Requests served by a recycled buffer
+    uint64_t misses = 0; // Requests that needed a fresh allocation
+
+    size_t bytes_in_use = 0;      // Bytes currently handed out
+    size_t high_water_mark = 0;   // Peak of `bytes_in_use`
+    size_t bytes_reserved = 0;    // Bytes owned by the pool (in use + cached)
+    size_t peak_bytes_reserved = 0;
+  };
+
+  /// Allocate a tensor backed by a pooled buffer
+  /// @param info The tensor info of the tensor to allocate
+  /// @return The tensor, or nullptr if the memory could not be allocated
+  std::unique_ptr<arm_compute::Tensor>
+  allocate(const arm_compute::TensorInfo &info);
+
+  /// Get a snapshot of the pool statistics
+  Stats stats() const;
+
+  /// Log the pool statistics
+  void log_stats() const;
+
+  /// Free all buffers cached in the shared free lists, including those of
+  /// the threads that exited, e.g., once the plan they were recycled for
+  /// is replaced
+  void trim();
+
+private:
+  TensorPool() = default;
+  // Never destroyed; see `instance`
+  ~TensorPool() = default;
+
+  class PooledTensor;
+  struct ThreadCache;
+
+  static constexpr size_t kMinBlockShift = 6; // 64 bytes, also the alignment
+  static constexpr size_t kNumSizeClasses = 26; // Up to 2 GiB
+  static constexpr size_t kThreadCacheCapacity = 4; // Blocks per size class
+
+  /// Get the size class for the given number of bytes
+  static int size_class_of(size_t bytes);
+
+  static constexpr size_t block_size(size_t size_class) {
+    return size_t{1} << (size_class + kMinBlockShift);
+  }
+
+  /// Get the cache of the calling thread
+  static ThreadCache &thread_cache();
+
+  /// Take a buffer of the given size class from the thread cache,
+  /// the shared free list, or the system allocator, in this order
+  void *acquire(size_t size_class);
+
+  /// Give a buffer back to the thread cache, spilling to the shared free list
+  void release(void *block, size_t size_class);
+
+  /// Update `bytes` and its high-water mark `peak` by `delta`
+  static void add_bytes(std::atomic<size_t> &bytes, std::atomic<size_t> &peak,
+                        size_t delta);
+
+  std::array<std::vector<void *>, kNumSizeClasses> free_lists_{};
+  mutable std::mutex free_lists_mtx_{};
+
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<size_t> bytes_in_use_{0};
+  std::atomic<size_t> high_water_mark_{0};
+  std::atomic<size_t> bytes_reserved_{0};
+  std::atomic<size_t> peak_bytes_reserved_{0};
+};
+
+#endif // EDGEFLOW_TENSORPOOL_H
@@ -0,0 +1,46 @@
+#ifndef EDGEFLOW_TENSORUTILS_H
+#define EDGEFLOW_TENSORUTILS_H
+
+#include "edgeflow/DataTypes.h"
+
+/// Axis along which a `Range` partitions a tensor of the given shape:
+/// the rows (dimension 1) of feature maps, the elements of vectors.
+size_t range_axis(const arm_compute::TensorShape &shape);
+
+/// Shape of the slab covering `range` of `shape` along the range axis
+arm_compute::TensorShape slab_shape(const arm_compute::TensorShape &shape,
+                                    const Range &range);
+
+/// Check if the elements of the tensor are densely packed, i.e., the tensor
+/// is not a strided view into a larger one
+bool is_packed(const arm_compute::ITensorInfo &info);
+
+/// Copy the slab `src_range` of `src` into `dst`, starting at `dst_start`
+/// along the range axis. Both ranges are local to their tensors, and either
+/// tensor may be a view returned by `slab_view`.
+void copy_slab(const arm_compute::ITensor &src, const Range &src_range,
+               arm_compute::ITensor &dst, int dst_start);
+
+/// Copy the slab `range` of `src` into a new pooled tensor
+/// @return The tensor, or nullptr if it could not be allocated
+std::unique_ptr<arm_compute::Tensor>
+copy_slab(const arm_compute::ITensor &src, const Range &range);
+
+/// Info of the view of the slab `range` of a tensor described by `info`.
+/// The view keeps the strides of the tensor and starts at the first element
+/// of the slab, `slab_offset(info, range)` bytes into the tensor.
+arm_compute::TensorInfo slab_info(const arm_compute::ITensorInfo &info,
+                                  const Range &range);
+
+/// Offset in bytes of the first element of the slab `range`
+size_t slab_offset(const arm_compute::ITensorInfo &info, const Range &range);
+
+/// Create a zero-copy view of the slab `range` of `src`. The view shares the
+/// ownership of `src`, whose buffer is released with the last view.
+/// A slab of a feature map with several channels is not contiguous, so the
+/// view keeps the strides of `src`; see `is_packed`.
+/// @return The view, or nullptr if `range` is out of the bounds of `src`
+std::unique_ptr<arm_compute::Tensor>
+slab_view(const std::shared_ptr<arm_compute::ITensor> &src, const Range &range);
+
+#endif // EDGEFLOW_TENSORUTILS_H
@@ -0,0 +1,30 @@
+#ifndef EDGEFLOW_WIRECODEC_H
+#define EDGEFLOW_WIRECODEC_H
+
+#include "edgeflow/DataTypes.h"
+
+/// Encodings of the F32 elements of a result on the wire; see `WireCodec`.
+///  - Sparse: a bitmap of the nonzero elements, one bit per element from
+///    the least significant bit of the first byte, then their values
+///  - FP16: the IEEE half-precision values, rounded to nearest even
+///  - Int8: the scale (F32) and zero point (int32) of the tensor, then
+///    `round(x / scale) + zero_point` for every element
+/// Encoding and decoding use NEON on AArch64, unless built with
+/// EDGEFLOW_WIRE_SCALAR.
+
+/// Bytes of the encoding of `count` elements, at most
+size_t max_encoded_size(WireCodec codec, size_t count);
+
+/// Encode `count` elements into `dst`, of `max_encoded_size` bytes
+/// @param max_error If not null, set to a bound on the error of the
+/// elements once decoded
+/// @return The bytes of the encoding
+size_t encode_elements(WireCodec codec, const float *src, size_t count,
+                       uint8_t *dst, float *max_error = nullptr);
+
+/// Decode `count` elements from the `size` bytes of `src` into `dst`
+/// @return false if the encoding is malformed
+bool decode_elements(WireCodec codec, const uint8_t *src, size_t size,
+                     float *dst, size_t count);
+
+#endif // EDGEFLOW_WIRECODEC_H
@@ -0,0 +1,226 @@
+#include "edgeflow/AutoPartitioner.h"
+#include "edgeflow/Partitioner.h"
+#include "edgeflow/TensorUtils.h"
+#include <algorithm>
+#include <android/log.h>
+#include <limits>
+
+bool AutoPartitioner::partition(ModelDAG &dag,
+                                const DeviceMap &devices,
+                                const ClusterProfile &profile,
+                                double *predicted_latency) {
+  if (dag.layer_order.empty() || devices.empty()) {
+    __android_log_print(ANDROID_LOG_ERROR, "AutoPartitioner::partition",
+                        "Model %s has no layer order or there is no device",
+                        dag.name.c_str());
+    return false;
+  }
+
+  std::vector<std::shared_ptr<Layer>> layers;
+  for (const auto &layer_id: dag.layer_order) {
+    const auto it = dag.layers.find(layer_id);
+    if (it == dag.layers.end()) {
+      __android_log_print(ANDROID_LOG_ERROR, "AutoPartitioner::partition",
+                          "Unknown layer %.*s in the layer order",
+                          static_cast<int>(layer_id.size()), layer_id.data());
+      return false;
+    }
+    layers.push_back(it->second);
+  }
+
+  // Sorted, so that every device derives the same units
+  std::vector<DeviceID> device_ids;
+  for (const auto &device: devices) {
+    device_ids.push_back(device.first);
+  }
+  std::sort(device_ids.begin(), device_ids.end());
+  // The root layer runs where the model input is given
+  std::vector<DeviceID> input_device_ids;
+  for (const auto &device_id: device_ids) {
+    if (devices.at(device_id).has_input) {
+      input_device_ids.push_back(device_id);
+    }
+  }
+  if (input_device_ids.empty()) {
+    __android_log_print(ANDROID_LOG_ERROR, "AutoPartitioner::partition",
+                        "No device is given the input of model %s",
+                        dag.name.c_str());
+    return false;
+  }
+
+  /* == Search the placement of each layer == */
+  std::vector<std::vector<Candidate>> placements;
+  for (size_t l = 0; l < layers.size(); ++l) {
+    placements.push_back(candidates(
+        layers[l], l == 0 ? input_device_ids : device_ids, profile));
+    for (auto &candidate: placements[l]) {
+      if (l == 0) {
+        evaluate(nullptr, candidate, 0, profile);
+        continue;
+      }
+      for (size_t p = 0; p < placements[l - 1].size(); ++p) {
+        evaluate(&placements[l - 1][p], candidate, p, profile);
+      }
+    }
+  }
+
+  /* == Generate the execution units of the best placement == */
+  const auto &last = placements.back();
+  size_t best = static_cast<size_t>(
+      std::min_element(last.begin(), last.end(),
+                       [](const Candidate &a, const Candidate &b) {
+                         return a.latency < b.latency;
+                       }) -
+      last.begin());
+  const double latency = last[best].latency;
+  if (predicted_latency) {
+    *predicted_latency = latency;
+  }
+
+  std::vector<std::vector<ExecutionUnit>> eus(layers.size());
+  for (size_t l = layers.size(); l-- > 0;) {
+    const Candidate &candidate = placements[l][best];
+    eus[l] = candidate.eus;
+    best = candidate.prev;
+  }
+  for (size_t l = 1; l < eus.size(); ++l) {
+    Partitioner::connect(eus[l - 1], eus[l]);
+  }
+  Partitioner::connect_model_input(eus.front());
+  for (auto &eu: eus.back()) {
+    eu.is_leaf = true;
+  }
+
+  dag.eus.clear();
+  for (size_t l = 0; l < eus.size(); ++l) {
+    std::string placement;
+    for (auto &eu: eus[l]) {
+      placement += " " + eu.assigned_device + "[" +
+                   std::to_string(eu.output_range.start) + ", " +
+                   std::to_string(eu.output_range.end) + ")";
+      dag.eus.emplace(eu.id, std::move(eu));
+    }
+    __android_log_print(ANDROID_LOG_INFO, "AutoPartitioner::partition",
+                        "Layer %.*s:%s",
+                        static_cast<int>(layers[l]->id.size()),
+                        layers[l]->id.data(), placement.c_str());
+  }
+  __android_log_print(ANDROID_LOG_INFO, "AutoPartitioner::partition",
+                      "Model %s: %zu execution units on %zu devices,"
+                      " predicted latency %.3f ms",
+                      dag.name.c_str(), dag.eus.size(), device_ids.size(),
+                      latency);
+  return true;
+}
+
+std::vector<AutoPartitioner::Candidate>
+AutoPartitioner::candidates(const std::shared_ptr<Layer> &layer,
+                            const std::vector<DeviceID> &devices,
+                            const ClusterProfile &profile) {
+  const auto &out_shape = layer->output_shape;
+  std::vector<Candidate> candidates;
+  for (const auto &device: devices) {
+    candidates.push_back(Candidate{
+        .eus = Partitioner::partition_rows(layer, {device}),
+        .latency = std::numeric_limits<double>::infinity(),
+        .prev = 0,
+        .finish = {},
+        .device_free = {},
+    });
+  }
+
+  // Layers whose rows depend on a band of input rows only, and fully
+  // connected layers, whose rows are their output features
+  bool splittable = false;
+  switch (layer->type) {
+    case LayerType::Convolution:
+    case LayerType::PoolingAvg:
+    case LayerType::PoolingMax:
+    case LayerType::ReLU:
+      splittable = true;
+      break;
+    case LayerType::Linear:
+      splittable = out_shape.num_dimensions() == 1;
+      break;
+    default:
+      break;
+  }
+  const auto out_rows = static_cast<size_t>(out_shape[range_axis(out_shape)]);
+  if (splittable && devices.size() > 1 && out_rows >= devices.size()) {
+    std::vector<float> shares;
+    for (const auto &device: devices) {
+      shares.push_back(static_cast<float>(profile.throughput(device)));
+    }
+    candidates.push_back(Candidate{
+        .eus = Partitioner::partition_rows(layer, devices, shares),
+        .latency = std::numeric_limits<double>::infinity(),
+        .prev = 0,
+        .finish = {},
+        .device_free = {},
+    });
+  }
+  return candidates;
+}
+
+void AutoPartitioner::evaluate(const Candidate *producer,
+                               Candidate &consumer,
+                               size_t prev,
+                               const ClusterProfile &profile) {
+  std::vector<ExecutionUnit> consumers = consumer.eus;
+  std::unordered_map<DeviceID, double> device_free;
+  // ExecutionUnitID |-> Arrival of the last input piece
+  std::unordered_map<ExecutionUnitID, double> ready;
+
+  if (producer) {
+    std::vector<ExecutionUnit> producers = producer->eus;
+    Partitioner::connect(producers, consumers);
+    device_free = producer->device_free;
+
+    // Each device sends its results one after another, in completion order
+    std::vector<size_t> order(producers.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return producer->finish[a] < producer->finish[b];
+    });
+
+    std::unordered_map<DeviceID, double> egress_free;
+    for (const size_t i: order) {
+      const ExecutionUnit &src = producers[i];
+      const size_t row_bytes =
+          slab_shape(src.layer->output_shape, {0, 1}).total_size() * sizeof(float);
+      for (const auto &entry: src.forward_table) {
+        const auto dest = std::find_if(
+            consumers.begin(), consumers.end(),
+            [&](const ExecutionUnit &eu) { return eu.id == entry.dest_eu_id; });
+        double arrival = producer->finish[i];
+        if (dest->assigned_device != src.assigned_device) {
+          const auto &link = profile.link(src.assigned_device, dest->assigned_device);
+          double &sender = egress_free[src.assigned_device];
+          sender = std::max(sender, producer->finish[i]) +
+                   static_cast<double>(row_bytes * entry.required_range.num_elements()) /
+                       link.bytes_per_ms;
+          arrival = sender + link.latency_ms;
+        }
+        ready[dest->id] = std::max(ready[dest->id], arrival);
+      }
+    }
+  }
+
+  double latency = 0;
+  std::vector<double> finish;
+  for (const auto &eu: consumers) {
+    double &free = device_free[eu.assigned_device];
+    const double start = std::max(ready[eu.id], free);
+    free = start + Partitioner::layer_macs(*eu.layer, eu.output_range.num_elements()) /
+                       profile.throughput(eu.assigned_device);
+    finish.push_back(free);
+    latency = std::max(latency, free);
+  }
+
+  if (latency < consumer.latency) {
+    consumer.latency = latency;
+    consumer.prev = prev;
+    consumer.finish = std::move(finish);
+    consumer.device_free = std::move(device_free);
+  }
+}
@@ -10,22 +10,55 @@
 #include "arm_compute/runtime/NEON/functions/NEPoolingLayer.h"
 #include "arm_compute/runtime/NEON/functions/NESoftmaxLayer.h"
 #include "edgeflow/ComputationEngine.h"
+#include "edgeflow/Partitioner.h"
+#include "edgeflow/TensorPool.h"
+#include "edgeflow/TensorUtils.h"
 
 ComputationEngine::ComputationEngine(Orchestrator &orch,
-                                     const ModelDAG &dag)
+                                     const ExecutionPlan &plan,
+                                     const EngineOptions &options)
     : orch_(orch),
-      dag_(dag),
-      num_workers_(std::max(1u, static_cast<unsigned>(std::thread::hardware_concurrency() * 0.75))) {
+      plan_(plan),
+      num_workers_(options.num_workers > 0
+                       ? options.num_workers
+                       : std::max(1u, static_cast<unsigned>(std::thread::hardware_concurrency() * 0.75))) {
+  // Operators must be ready before any worker can pick up a task
+  prepare_operators();
+
+  if (options.per_worker_queues) {
+    for (EUHandle eu = 0; eu < plan_.size(); ++eu) {
+      max_rank_ = std::max(max_rank_, plan_.unit(eu).rank);
+    }
+    // A bucket gains one for every bucket width of rank it waits; at least
+    // a millisecond, for plans whose ranks are all small
+    const double bucket_ms =
+        std::max(1.0, max_rank_ / kNumRankBuckets) / kAgingRate;
+    const auto promotion =
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(bucket_ms));
+    for (unsigned int i = 0; i < num_workers_; ++i) {
+      worker_queues_.push_back(std::make_unique<WorkerQueue>(promotion));
+    }
+  } else {
+    shared_queue_ = std::make_unique<SharedQueue>();
+  }
   for (unsigned int i = 0; i < num_workers_; ++i) {
-    worker_threads_.emplace_back(&ComputationEngine::worker_thread_loop, this);
+    worker_threads_.emplace_back(&ComputationEngine::worker_thread_loop, this, i);
   }
   __android_log_print(ANDROID_LOG_INFO, "ComputationEngine::ComputationEngine",
-                      "ComputationEngine initialized with %u worker threads",
-                      num_workers_);
+                      "ComputationEngine initialized with %u worker threads"
+                      " and %s ready queues",
+                      num_workers_, shared_queue_ ? "shared" : "per-worker");
 }
 
 ComputationEngine::~ComputationEngine() {
-  stop_ = true;
+  {
+    std::lock_guard<std::mutex> lock(idle_mtx_);
+    stop_ = true;
+  }
+  idle_cv_.notify_all();
+  // Release producers blocked on a full injection queue
+  injection_queue_.close();
   for (auto &worker: worker_threads_) {
     if (worker.joinable()) {
       worker.join();
@@ -33,29 +66,95 @@ ComputationEngine::~ComputationEngine() {
   }
 }
 
+/// The engine of the calling worker thread, and the index of the worker
+static thread_local const ComputationEngine *tls_engine_ = nullptr;
+static thread_local unsigned int tls_worker_ = 0;
+
 void ComputationEngine::submit_task(
-    const ExecutionUnit &eu,
+    InferenceRequest &request,
+    EUHandle eu,
     std::unique_ptr<arm_compute::Tensor> input) {
-  auto task = std::make_unique<Task>(eu, std::move(input));
-  task_queue_.push(std::move(task));
+  // Aging: a task submitted later needs that much more rank to go first
+  const std::chrono::duration<double, std::milli> submitted =
+      std::chrono::steady_clock::now() - start_time_;
+  auto task = std::make_unique<Task>(
+      request, eu, std::move(input),
+      plan_.unit(eu).rank - kAgingRate * submitted.count());
+  // Counted before it is visible so that `num_queued_` never underflows
+  num_queued_.fetch_add(1, std::memory_order_seq_cst);
+  if (tls_engine_ == this) {
+    push_ready(tls_worker_, std::move(task));
+  } else if (!injection_queue_.push(std::move(task))) {
+    num_queued_.fetch_sub(1, std::memory_order_relaxed);
+    const auto &eu_id = plan_.eu(eu).id;
+    __android_log_print(
+        ANDROID_LOG_WARN, "ComputationEngine::submit_task",
+        "Task for execution unit %.*s dropped; the engine is stopping",
+        static_cast<int>(eu_id.size()), eu_id.data());
+    return;
+  }
+
+  // Wake up a sleeping worker, if any.
+  // Pairs with the `num_idle_` increment in `next_task`.
+  if (num_idle_.load(std::memory_order_seq_cst) > 0) {
+    { std::lock_guard<std::mutex> lock(idle_mtx_); }
+    idle_cv_.notify_one();
+  }
 }
 
-void ComputationEngine::worker_thread_loop() {
-  while (!stop_) {
-    const auto task = task_queue_.pop();
+void ComputationEngine::worker_thread_loop(unsigned int worker) {
+  tls_engine_ = this;
+  tls_worker_ = worker;
+
+  while (const auto task = next_task(worker)) {
+    // A task of a timed-out or cancelled inference only frees its input
+    if (Orchestrator::is_expired(task->request)) {
+      task->input.reset();
+      orch_.on_task_dropped(task->request, task->eu);
+      continue;
+    }
 
     // 1. Pre-process input tensor
     // TODO: Pre-process input tensor if needed
 
     // 2. Execute the operator for the execution unit
-    auto output = execute_operator(task->eu, std::move(task->input));
-    if (output) {
-      orch_.on_computation_complete(task->eu, std::move(output));
+    {
+      std::lock_guard<std::mutex> lock(busy_mtx_);
+      if (num_running_++ == 0) {
+        busy_since_ = std::chrono::steady_clock::now();
+      }
+    }
+    std::unique_ptr<arm_compute::Tensor> output;
+    bool completed = false;
+    bool expired = false;
+    if (prepared_ops_[task->eu] && !prepared_ops_[task->eu]->chunks.empty()) {
+      // The bands were forwarded as they completed
+      const ChunksResult result =
+          execute_chunks(task->request, task->eu, std::move(task->input));
+      completed = result == ChunksResult::Completed;
+      expired = result == ChunksResult::Expired;
     } else {
+      output = execute_operator(task->request, task->eu, std::move(task->input));
+      completed = output != nullptr;
+    }
+    {
+      std::lock_guard<std::mutex> lock(busy_mtx_);
+      if (--num_running_ == 0) {
+        busy_time_ += std::chrono::steady_clock::now() - busy_since_;
+      }
+    }
+    if (completed) {
+      orch_.on_computation_complete(task->request, task->eu, std::move(output));
+    } else if (expired) {
+      // Some bands were forwarded, but the output is not complete
+      orch_.on_task_dropped(task->request, task->eu);
+    } else {
+      const auto &eu_id = plan_.eu(task->eu).id;
       __android_log_print(
           ANDROID_LOG_ERROR, "ComputationEngine::worker_thread_loop",
-          "No output produced for execution unit %.*s",
-          static_cast<int>(task->eu.id.size()), task->eu.id.data());
+          "No output produced for execution unit %.*s; aborting inference %u",
+          static_cast<int>(eu_id.size()), eu_id.data(), task->request.id);
+      orch_.on_task_failed(task->request, task->eu);
     }
   }
 
@@ -63,46 +162,564 @@ void ComputationEngine::worker_thread_loop() {
                       "Worker thread stopped");
 }
 
-std::unique_ptr<arm_compute::Tensor>
-ComputationEngine::execute_operator(const ExecutionUnit &eu,
-                                    std::unique_ptr<arm_compute::Tensor> input) {
-  auto output = std::make_unique<arm_compute::Tensor>();
-  output->allocator()->init(arm_compute::TensorInfo(
-      eu.expected_output_shape, 1, arm_compute::DataType::F32));
-  output->allocator()->allocate();
+std::unique_ptr<ComputationEngine::Task>
+ComputationEngine::next_task(unsigned int worker) {
+  while (!stop_) {
+    if (auto task = try_take_task(worker)) {
+      num_queued_.fetch_sub(1, std::memory_order_relaxed);
+      return task;
+    }
+
+    // No work anywhere; sleep until a task is submitted
+    std::unique_lock<std::mutex> lock(idle_mtx_);
+    num_idle_.fetch_add(1, std::memory_order_seq_cst);
+    idle_cv_.wait(lock, [this] {
+      return stop_ || num_queued_.load(std::memory_order_seq_cst) > 0;
+    });
+    num_idle_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  return nullptr;
+}
+
+std::unique_ptr<ComputationEngine::Task>
+ComputationEngine::try_take_task(unsigned int worker) {
+  while (auto task = injection_queue_.try_pop()) {
+    push_ready(worker, std::move(task));
+  }
+  if (shared_queue_) {
+    return shared_queue_->try_pop();
+  }
+  if (auto task =
+          worker_queues_[worker]->pop(std::chrono::steady_clock::now())) {
+    return task;
+  }
+
+  // Steal, starting from the next worker so that the thieves spread out
+  for (unsigned int i = 1; i < num_workers_; ++i) {
+    WorkerQueue &victim = *worker_queues_[(worker + i) % num_workers_];
+    if (victim.size() == 0) {
+      continue;
+    }
+    if (auto task = victim.steal()) {
+      return task;
+    }
+  }
+  return nullptr;
+}
 
-  switch (eu.get_type()) {
+void ComputationEngine::push_ready(unsigned int worker,
+                                   std::unique_ptr<Task> task) {
+  if (shared_queue_) {
+    shared_queue_->push(std::move(task));
+    return;
+  }
+  const size_t bucket = rank_bucket(task->eu);
+  worker_queues_[worker]->push(bucket, std::move(task));
+}
+
+size_t ComputationEngine::rank_bucket(EUHandle eu) const {
+  if (max_rank_ <= 0) {
+    return 0;
+  }
+  const auto bucket = static_cast<size_t>(plan_.unit(eu).rank / max_rank_ *
+                                          kNumRankBuckets);
+  return std::min(bucket, kNumRankBuckets - 1);
+}
+
+void ComputationEngine::prepare_operators() {
+  prepared_ops_.resize(plan_.size());
+  size_t num_prepared = 0;
+  for (EUHandle handle = 0; handle < plan_.size(); ++handle) {
+    // Backup units are prepared too, to run their speculative copies
+    if (!plan_.unit(handle).is_local && !plan_.unit(handle).is_backup) {
+      continue;
+    }
+
+    const ExecutionUnit &eu = plan_.eu(handle);
+    arm_compute::TensorInfo output_info(eu.expected_output_shape, 1,
+                                        arm_compute::DataType::F32);
+    if (eu.is_leaf) {
+      // The functions write the rows of the leaf straight into the output
+      // of the request, so they are configured with its strides
+      output_info = slab_info(
+          arm_compute::TensorInfo(plan_.output_shape(), 1,
+                                  arm_compute::DataType::F32),
+          plan_.output_rows(handle));
+    }
+    prepared_ops_[handle] = prepare_operator(eu, output_info);
+    if (!prepared_ops_[handle]) {
+      __android_log_print(
+          ANDROID_LOG_ERROR, "ComputationEngine::prepare_operators",
+          "Failed to prepare the operator for execution unit %.*s",
+          static_cast<int>(eu.id.size()), eu.id.data());
+      continue;
+    }
+    ++num_prepared;
+  }
+
+  __android_log_print(ANDROID_LOG_INFO, "ComputationEngine::prepare_operators",
+                      "%zu operators prepared", num_prepared);
+}
+
+/// View of the band `range` of a parameter, e.g., of the weights of some
+/// output features
+static std::unique_ptr<arm_compute::Tensor>
+param_band(const arm_compute::Tensor &param, const Range &range) {
+  auto band = std::make_unique<arm_compute::Tensor>();
+  band->allocator()->init(slab_info(*param.info(), range));
+  band->allocator()->import_memory(param.buffer() +
+                                   slab_offset(*param.info(), range));
+  return band;
+}
+
+/// Fully connected layer computing the band `features` of the output
+/// features of `layer`, with the same band of its weights and bias
+static std::shared_ptr<Layer> feature_band(const Layer &layer,
+                                           const Range &features) {
+  auto band = std::make_shared<Layer>(Layer{
+      .id = layer.id,
+      .type = layer.type,
+      .params = {},
+      .hparams = layer.hparams,
+      .input_shape = layer.input_shape,
+      .output_shape = slab_shape(layer.output_shape, features),
+  });
+  for (const char *name: {"weight", "bias"}) {
+    if (const arm_compute::Tensor *param = layer.get_param(name)) {
+      band->params[name] = param_band(*param, features);
+    }
+  }
+  return band;
+}
+
+std::unique_ptr<ComputationEngine::PreparedOperator>
+ComputationEngine::prepare_operator(const ExecutionUnit &eu,
+                                    const arm_compute::TensorInfo &output_info) {
+  auto op = std::make_unique<PreparedOperator>();
+  // Only the tensor info is needed to configure the functions;
+  // the memory is imported on every run.
+  op->input.allocator()->init(arm_compute::TensorInfo(
+      eu.expected_input_shape, 1, arm_compute::DataType::F32));
+  op->output.allocator()->init(output_info);
+
+  // The unit's own operator is the first stage
+  std::vector<FusedStage> stages;
+  stages.push_back(FusedStage{
+      .original_eu_id = eu.id,
+      .layer = eu.layer,
+      .expected_input_shape = eu.expected_input_shape,
+      .expected_output_shape = eu.fused_stages.empty()
+                                   ? eu.expected_output_shape
+                                   : eu.fused_stages.front().expected_input_shape,
+      .fused_activation = eu.fused_activation,
+      .prepad_top = eu.prepad_top,
+      .prepad_bottom = eu.prepad_bottom,
+      .prepad_left = eu.prepad_left,
+      .prepad_right = eu.prepad_right,
+  });
+  stages.insert(stages.end(), eu.fused_stages.begin(), eu.fused_stages.end());
+
+  // A fully connected unit computing some of the output features takes
+  // the band of the weights of its features
+  const auto &features = eu.layer->output_shape;
+  if (eu.get_type() == LayerType::Linear && features.num_dimensions() == 1 &&
+      eu.output_range.num_elements() != static_cast<int>(features[0])) {
+    op->layers.push_back(feature_band(*eu.layer, eu.output_range));
+    stages.front().layer = op->layers.back();
+  }
+
+  if (eu.num_stream_chunks > 1 && !eu.is_leaf) {
+    if (prepare_chunks(eu, stages, *op)) {
+      return op;
+    }
+    __android_log_print(
+        ANDROID_LOG_WARN, "ComputationEngine::prepare_operator",
+        "Execution unit %.*s cannot compute its output in bands;"
+        " it is sent at once",
+        static_cast<int>(eu.id.size()), eu.id.data());
+  }
+
+  if (!configure_stages(eu, stages, &op->input, &op->output, op->functions,
+                        op->intermediates)) {
+    return nullptr;
+  }
+  return op;
+}
+
+bool ComputationEngine::configure_stages(
+    const ExecutionUnit &eu,
+    const std::vector<FusedStage> &stages,
+    arm_compute::ITensor *input,
+    arm_compute::ITensor *output,
+    std::vector<std::unique_ptr<arm_compute::IFunction>> &functions,
+    std::vector<std::unique_ptr<arm_compute::Tensor>> &intermediates) {
+  arm_compute::ITensor *stage_input = input;
+  for (size_t i = 0; i < stages.size(); ++i) {
+    arm_compute::ITensor *stage_output = output;
+    if (i + 1 < stages.size()) {
+      auto intermediate = std::make_unique<arm_compute::Tensor>();
+      intermediate->allocator()->init(arm_compute::TensorInfo(
+          stages[i].expected_output_shape, 1, arm_compute::DataType::F32));
+      stage_output = intermediate.get();
+      intermediates.push_back(std::move(intermediate));
+    }
+
+    auto function = configure_function(stages[i], stage_input, stage_output);
+    if (!function) {
+      __android_log_print(
+          ANDROID_LOG_ERROR, "ComputationEngine::configure_stages",
+          "Unsupported operator type for execution unit %.*s (stage %.*s)",
+          static_cast<int>(eu.id.size()), eu.id.data(),
+          static_cast<int>(stages[i].original_eu_id.size()),
+          stages[i].original_eu_id.data());
+      return false;
+    }
+    functions.push_back(std::move(function));
+    stage_input = stage_output;
+  }
+
+  // Memory of the intermediates is allocated after configuration
+  for (auto &intermediate: intermediates) {
+    intermediate->allocator()->allocate();
+  }
+  return true;
+}
+
+/// Stages computing the band `rows` of the output of the unit, local to
+/// it. Walking back from the last stage, each stage computes the rows the
+/// next one reads, and pads the part of its receptive field outside the
+/// feature map, as `Partitioner` does for the bands of a layer.
+/// @param input_rows Set to the rows of the input of the first stage read,
+/// in the coordinates of its layer's whole input
+static std::vector<FusedStage> band_stages(const ExecutionUnit &eu,
+                                           const std::vector<FusedStage> &stages,
+                                           const Range &rows,
+                                           Range &input_rows) {
+  std::vector<FusedStage> band = stages;
+  Range output_rows = {rows.start + eu.output_range.start,
+                       rows.end + eu.output_range.start};
+  for (size_t i = band.size(); i-- > 0;) {
+    FusedStage &stage = band[i];
+    const Layer &layer = *stage.layer;
+    const auto &in_shape = layer.input_shape;
+    const int in_rows = static_cast<int>(in_shape[range_axis(in_shape)]);
+    const Range field = Partitioner::receptive_rows(layer, output_rows);
+    const Range input = {std::max(0, field.start), std::min(in_rows, field.end)};
+    stage.expected_input_shape = slab_shape(in_shape, input);
+    stage.expected_output_shape = slab_shape(layer.output_shape, output_rows);
+    stage.prepad_top = std::max(0, -field.start);
+    stage.prepad_bottom = std::max(0, field.end - in_rows);
+    output_rows = input;
+  }
+  input_rows = output_rows;
+  return band;
+}
+
+bool ComputationEngine::prepare_chunks(const ExecutionUnit &eu,
+                                       const std::vector<FusedStage> &stages,
+                                       PreparedOperator &op) {
+  const auto &out_shape = eu.expected_output_shape;
+  const int out_rows = static_cast<int>(out_shape[range_axis(out_shape)]);
+  const auto &in_shape = eu.expected_input_shape;
+  const int in_rows = static_cast<int>(in_shape[range_axis(in_shape)]);
+  // The bands of a fully connected layer are its output features
+  const bool is_linear = eu.get_type() == LayerType::Linear;
+  if (is_linear && (stages.size() != 1 || out_shape.num_dimensions() != 1)) {
+    return false;
+  }
+
+  // The bands only add up to the output if the whole output reads the
+  // input band and padding of the unit
+  int input_start = 0;
+  if (!is_linear) {
+    Range input_rows;
+    const auto whole = band_stages(eu, stages, {0, out_rows}, input_rows);
+    if (input_rows.num_elements() != in_rows) {
+      return false;
+    }
+    for (size_t i = 0; i < stages.size(); ++i) {
+      if (whole[i].prepad_top != stages[i].prepad_top ||
+          whole[i].prepad_bottom != stages[i].prepad_bottom) {
+        return false;
+      }
+    }
+    input_start = input_rows.start;
+  }
+
+  const arm_compute::ITensorInfo &input_info = *op.input.info();
+  const arm_compute::ITensorInfo &output_info = *op.output.info();
+  const int num_chunks =
+      std::min(out_rows, static_cast<int>(eu.num_stream_chunks));
+  for (int c = 0; c < num_chunks; ++c) {
+    auto chunk = std::make_unique<PreparedOperator::Chunk>();
+    chunk->rows = {out_rows * c / num_chunks, out_rows * (c + 1) / num_chunks};
+
+    std::vector<FusedStage> band;
+    if (is_linear) {
+      const Range features = {chunk->rows.start + eu.output_range.start,
+                              chunk->rows.end + eu.output_range.start};
+      auto layer = feature_band(*eu.layer, features);
+      band = stages;
+      band.front().layer = layer;
+      band.front().expected_output_shape = slab_shape(out_shape, chunk->rows);
+      chunk->layers.push_back(std::move(layer));
+      chunk->input_rows = {0, in_rows};
+    } else {
+      Range input_rows;
+      band = band_stages(eu, stages, chunk->rows, input_rows);
+      chunk->input_rows = {input_rows.start - input_start,
+                           input_rows.end - input_start};
+    }
+
+    // A band of a multi-channel feature map is strided; the functions
+    // expect a packed input, so such a band is copied
+    const arm_compute::TensorInfo band_input = slab_info(input_info, chunk->input_rows);
+    chunk->copies_input = !is_packed(band_input);
+    chunk->input.allocator()->init(
+        chunk->copies_input
+            ? arm_compute::TensorInfo(band_input.tensor_shape(), 1,
+                                      arm_compute::DataType::F32)
+            : band_input);
+    chunk->output.allocator()->init(slab_info(output_info, chunk->rows));
+    if (!configure_stages(eu, band, &chunk->input, &chunk->output,
+                          chunk->functions, chunk->intermediates)) {
+      op.chunks.clear();
+      return false;
+    }
+    if (chunk->copies_input) {
+      chunk->input.allocator()->allocate();
+    }
+    op.chunks.push_back(std::move(chunk));
+  }
+  return true;
+}
+
+std::unique_ptr<arm_compute::IFunction>
+ComputationEngine::configure_function(const FusedStage &stage,
+                                      arm_compute::ITensor *input,
+                                      arm_compute::ITensor *output) {
+  const Layer &layer = *stage.layer;
+  // The slice is padded by the pre-padding of the execution unit, which
+  // equals the layer padding only at the border of the feature map.
+  const auto pad_stride_info = arm_compute::PadStrideInfo(
+      layer.get_hparam_int("stride_w", 1), layer.get_hparam_int("stride_h", 1),
+      stage.prepad_left, stage.prepad_right,
+      stage.prepad_top, stage.prepad_bottom,
+      arm_compute::DimensionRoundingType::FLOOR);
+
+  switch (layer.type) {
     case LayerType::ReLU: {
-      arm_compute::NEActivationLayer activation_layer;
-      activation_layer.configure(
-          input.get(),
-          output.get(),
+      auto activation_layer = std::make_unique<arm_compute::NEActivationLayer>();
+      activation_layer->configure(
+          input,
+          output,
           arm_compute::ActivationFunction::RELU);
-      activation_layer.run();
-      break;
+      return activation_layer;
+    }
+    case LayerType::Convolution: {
+      auto conv_layer = std::make_unique<arm_compute::NEConvolutionLayer>();
+      // No fast math: Winograd tiles would make partitioned outputs differ
+      // from the unpartitioned layer in the last bits
+      conv_layer->configure(
+          input,
+          layer.get_param("weight"),
+          layer.get_param("bias"),
+          output,
+          pad_stride_info,
+          arm_compute::WeightsInfo(),
+          arm_compute::Size2D(1U, 1U),
+          stage.fused_activation,
+          /* enable_fast_math */ false);
+      conv_layer->prepare();
+      return conv_layer;
     }
     case LayerType::Linear: {
-      arm_compute::NEFullyConnectedLayer fc_layer;
-      fc_layer.configure(
-          input.get(),
-          eu.get_param("weight"),
-          eu.get_param("bias"),
-          output.get());
-      fc_layer.run();
-      break;
+      arm_compute::FullyConnectedLayerInfo fc_info;
+      fc_info.activation_info = stage.fused_activation;
+      auto fc_layer = std::make_unique<arm_compute::NEFullyConnectedLayer>();
+      fc_layer->configure(
+          input,
+          layer.get_param("weight"),
+          layer.get_param("bias"),
+          output,
+          fc_info);
+      // Reshape the weights now instead of on the first inference
+      fc_layer->prepare();
+      return fc_layer;
+    }
+    case LayerType::PoolingAvg:
+    case LayerType::PoolingMax: {
+      const auto pool_info = arm_compute::PoolingLayerInfo(
+          layer.type == LayerType::PoolingMax ? arm_compute::PoolingType::MAX
+                                              : arm_compute::PoolingType::AVG,
+          arm_compute::Size2D(layer.get_hparam_int("kernel_w", 1),
+                              layer.get_hparam_int("kernel_h", 1)),
+          arm_compute::DataLayout::NCHW,
+          pad_stride_info,
+          layer.get_hparam_int("exclude_padding") != 0);
+      auto pooling_layer = std::make_unique<arm_compute::NEPoolingLayer>();
+      pooling_layer->configure(input, output, pool_info);
+      return pooling_layer;
     }
     default: {
-      __android_log_print(
-          ANDROID_LOG_ERROR, "ComputationEngine::execute_operator",
-          "Unsupported operator type for execution unit %.*s",
-          static_cast<int>(eu.id.size()), eu.id.data());
       return nullptr;
     }
   }
+}
+
+/// A view of a band of a multi-channel feature map is strided; the
+/// functions expect a packed input
+/// @return The input, packed, or nullptr if it could not be copied
+static std::unique_ptr<arm_compute::Tensor>
+packed(std::unique_ptr<arm_compute::Tensor> input) {
+  if (is_packed(*input->info())) {
+    return input;
+  }
+  const auto &shape = input->info()->tensor_shape();
+  return copy_slab(*input, {0, static_cast<int>(shape[range_axis(shape)])});
+}
+
+/// Add a run of the functions of the operator to its moving average
+static void record_run_time(ComputationEngine::PreparedOperator &op,
+                            std::chrono::steady_clock::duration elapsed) {
+  const std::chrono::duration<double, std::milli> run_time = elapsed;
+  op.run_time_ms = op.num_runs++ == 0
+                       ? run_time.count()
+                       : op.run_time_ms +
+                             ComputationEngine::kRunTimeSmoothing *
+                                 (run_time.count() - op.run_time_ms);
+}
+
+std::unique_ptr<arm_compute::Tensor>
+ComputationEngine::execute_operator(InferenceRequest &request,
+                                    EUHandle eu,
+                                    std::unique_ptr<arm_compute::Tensor> input) {
+  if (!prepared_ops_[eu]) {
+    const auto &eu_id = plan_.eu(eu).id;
+    __android_log_print(
+        ANDROID_LOG_ERROR, "ComputationEngine::execute_operator",
+        "No prepared operator for execution unit %.*s",
+        static_cast<int>(eu_id.size()), eu_id.data());
+    return nullptr;
+  }
+  PreparedOperator &op = *prepared_ops_[eu];
+
+  input = packed(std::move(input));
+  if (!input) {
+    return nullptr;
+  }
+
+  auto output = allocate_output(request, eu, op.output.allocator()->info());
+  if (!output) {
+    return nullptr;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(op.mtx);
+    // Rebind the buffers of this task to the configured function
+    op.input.allocator()->import_memory(input->buffer());
+    op.output.allocator()->import_memory(output->buffer());
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto &function: op.functions) {
+      function->run();
+    }
+    record_run_time(op, std::chrono::steady_clock::now() - start);
+  }
 
   return output;
 }
 
+ComputationEngine::ChunksResult
+ComputationEngine::execute_chunks(InferenceRequest &request,
+                                  EUHandle eu,
+                                  std::unique_ptr<arm_compute::Tensor> input) {
+  PreparedOperator &op = *prepared_ops_[eu];
+
+  input = packed(std::move(input));
+  if (!input) {
+    return ChunksResult::Failed;
+  }
+
+  auto allocated = allocate_output(request, eu, op.output.allocator()->info());
+  if (!allocated) {
+    return ChunksResult::Failed;
+  }
+  // Shared with the views of the bands forwarded by the Orchestrator
+  const std::shared_ptr<arm_compute::ITensor> output = std::move(allocated);
+
+  std::chrono::steady_clock::duration run_time{0};
+  for (const auto &chunk: op.chunks) {
+    if (Orchestrator::is_expired(request)) {
+      return ChunksResult::Expired;
+    }
+    {
+      // Other tasks of the unit run their bands in between; each band
+      // rebinds the buffers of its task
+      std::lock_guard<std::mutex> lock(op.mtx);
+      if (chunk->copies_input) {
+        copy_slab(*input, chunk->input_rows, chunk->input, 0);
+      } else {
+        chunk->input.allocator()->import_memory(
+            input->buffer() + slab_offset(*input->info(), chunk->input_rows));
+      }
+      chunk->output.allocator()->import_memory(
+          output->buffer() + slab_offset(*output->info(), chunk->rows));
+      const auto start = std::chrono::steady_clock::now();
+      for (const auto &function: chunk->functions) {
+        function->run();
+      }
+      run_time += std::chrono::steady_clock::now() - start;
+    }
+
+    // The band is on its way while the next one computes. Forwarding may
+    // block on the egress queue, so the functions are not held meanwhile.
+    orch_.on_chunk_complete(request, eu, output, chunk->rows);
+  }
+
+  std::lock_guard<std::mutex> lock(op.mtx);
+  record_run_time(op, run_time);
+  return ChunksResult::Completed;
+}
+
+double ComputationEngine::mean_run_time(EUHandle eu) {
+  if (!prepared_ops_[eu]) {
+    return 0;
+  }
+  PreparedOperator &op = *prepared_ops_[eu];
+  std::lock_guard<std::mutex> lock(op.mtx);
+  return op.run_time_ms;
+}
+
+std::chrono::nanoseconds ComputationEngine::busy_time() {
+  std::lock_guard<std::mutex> lock(busy_mtx_);
+  auto busy_time = busy_time_;
+  if (num_running_ > 0) {
+    busy_time += std::chrono::steady_clock::now() - busy_since_;
+  }
+  return busy_time;
+}
+
+std::unique_ptr<arm_compute::Tensor>
+ComputationEngine::allocate_output(InferenceRequest &request,
+                                   EUHandle eu,
+                                   const arm_compute::TensorInfo &info) {
+  if (plan_.eu(eu).is_leaf) {
+    // Not owned; the request outlives the view
+    return slab_view(std::shared_ptr<arm_compute::ITensor>(
+                         std::shared_ptr<void>(), &request.output),
+                     plan_.output_rows(eu));
+  }
+
+  const MemoryPlan::Allocation *allocation = plan_.unit(eu).allocation;
+  if (request.arena && allocation) {
+    auto output = std::make_unique<arm_compute::Tensor>();
+    output->allocator()->init(info);
+    output->allocator()->import_memory(request.arena + allocation->offset);
+    return output;
+  }
+  return TensorPool::instance().allocate(info);
+}
+
 /*
 std::unique_ptr<arm_compute::Tensor>
 _execute_operator(const ExecutionUnit &eu,
@@ -1,9 +1,121 @@
 #include "edgeflow/EdgeFlow.h"
 #include "edgeflow/ComputationEngine.h"
+#include "edgeflow/GraphOptimizer.h"
+#include "edgeflow/Partitioner.h"
+#include "edgeflow/TensorPool.h"
+#include <algorithm>
 #include <android/log.h>
+#include <cstring>
+#include <string>
 
 #include <utility>
 
+using PlanMessage = NetworkEventHandler::PlanMessage;
+
+/// Payload of the plan messages, in the byte order of the devices, which
+/// are all little-endian
+class PlanWriter {
+public:
+  template<typename T>
+  void put(T value) {
+    const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+  }
+
+  void put_id(const DeviceID &id) {
+    put(static_cast<uint16_t>(id.size()));
+    buffer.insert(buffer.end(), id.begin(), id.end());
+  }
+
+  std::vector<uint8_t> buffer{};
+};
+
+class PlanReader {
+public:
+  explicit PlanReader(const std::vector<uint8_t> &buffer) : buffer_(buffer) {}
+
+  /// @return false once reading past the end
+  template<typename T>
+  bool get(T &value) {
+    if (buffer_.size() - offset_ < sizeof(value)) {
+      return false;
+    }
+    std::memcpy(&value, buffer_.data() + offset_, sizeof(value));
+    offset_ += sizeof(value);
+    return true;
+  }
+
+  bool get_id(DeviceID &id) {
+    uint16_t size = 0;
+    if (!get(size) || buffer_.size() - offset_ < size) {
+      return false;
+    }
+    id.assign(reinterpret_cast<const char *>(buffer_.data() + offset_), size);
+    offset_ += size;
+    return true;
+  }
+
+private:
+  const std::vector<uint8_t> &buffer_;
+  size_t offset_ = 0;
+};
+
+static void put_profile(PlanWriter &writer, const ClusterProfile &profile) {
+  writer.put(profile.default_macs_per_ms);
+  writer.put(profile.default_link.bytes_per_ms);
+  writer.put(profile.default_link.latency_ms);
+  writer.put(static_cast<uint32_t>(profile.macs_per_ms.size()));
+  for (const auto &device: profile.macs_per_ms) {
+    writer.put_id(device.first);
+    writer.put(device.second);
+  }
+  uint32_t num_links = 0;
+  for (const auto &src: profile.links) {
+    num_links += static_cast<uint32_t>(src.second.size());
+  }
+  writer.put(num_links);
+  for (const auto &src: profile.links) {
+    for (const auto &dest: src.second) {
+      writer.put_id(src.first);
+      writer.put_id(dest.first);
+      writer.put(dest.second.bytes_per_ms);
+      writer.put(dest.second.latency_ms);
+    }
+  }
+}
+
+/// @return false if the payload is malformed
+static bool get_profile(PlanReader &reader, ClusterProfile &profile) {
+  uint32_t num_devices = 0, num_links = 0;
+  if (!reader.get(profile.default_macs_per_ms) ||
+      !reader.get(profile.default_link.bytes_per_ms) ||
+      !reader.get(profile.default_link.latency_ms) ||
+      !reader.get(num_devices)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < num_devices; ++i) {
+    DeviceID id;
+    double macs_per_ms = 0;
+    if (!reader.get_id(id) || !reader.get(macs_per_ms)) {
+      return false;
+    }
+    profile.macs_per_ms[id] = macs_per_ms;
+  }
+  if (!reader.get(num_links)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < num_links; ++i) {
+    DeviceID src, dest;
+    ClusterProfile::Link link{};
+    if (!reader.get_id(src) || !reader.get_id(dest) ||
+        !reader.get(link.bytes_per_ms) || !reader.get(link.latency_ms)) {
+      return false;
+    }
+    profile.links[src][dest] = link;
+  }
+  return true;
+}
+
 void print_tensor(const arm_compute::Tensor &tensor, const std::string &name) {
   arm_compute::Window window;
   window.use_tensor_dimensions(tensor.info()->tensor_shape());
@@ -34,7 +146,8 @@ void print_tensor(const arm_compute::Tensor &tensor, const std::string &name) {
 
 bool EdgeFlow::initialize(std::unique_ptr<ModelDAG> dag,
                           std::unique_ptr<DeviceInfo> device_info,
-                          const std::vector<DeviceInfo> &devices) {
+                          const std::vector<DeviceInfo> &devices,
+                          const EdgeFlowOptions &options) {
   if (is_initialized_) {
     __android_log_print(
         ANDROID_LOG_ERROR, "EdgeFlow::initialize",
@@ -42,6 +155,19 @@ bool EdgeFlow::initialize(std::unique_ptr<ModelDAG> dag,
     return false;
   }
 
+  // A failed call leaves the instance as it found it, so that it can be
+  // initialized again
+  const auto fail = [this]() -> bool {
+    network_event_handler_.reset();
+    coordinator_id_.clear();
+    eus_generated_ = false;
+    options_ = {};
+    device_map_.reset();
+    device_info_.reset();
+    dag_.reset();
+    return false;
+  };
+
   /* Store the model DAG and device information */
   // TODO: Validate the model DAG and device information
   dag_ = std::move(dag);
@@ -52,12 +178,45 @@ bool EdgeFlow::initialize(std::unique_ptr<ModelDAG> dag,
     device_map_->emplace(device.id, device);
   }
 
-  orch_ = std::make_unique<Orchestrator>(
-      *dag_, *device_info_, *device_map_);
-  orch_->register_inference_complete_callback(
-      [&](const arm_compute::Tensor &output) -> void {
-        on_inference_complete(output);
-      });
+  options_ = options;
+
+  // A layer-level DAG gets its execution units generated
+  if (dag_->eus.empty()) {
+    if (!generate_eus(*dag_)) {
+      __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::initialize",
+                          "Failed to partition the model DAG");
+      return fail();
+    }
+    eus_generated_ = true;
+  }
+
+  // The lowest ID decides on the plan switches; this device is a candidate
+  // even if the list of devices leaves it out, or is empty
+  coordinator_id_ = device_info_->id;
+  for (const auto &device: *device_map_) {
+    coordinator_id_ = std::min(coordinator_id_, device.first);
+  }
+  network_event_handler_ =
+      std::make_unique<NetworkEventHandler>(*device_info_, *device_map_);
+  if (eus_generated_) {
+    network_event_handler_->register_plan_callback(
+        [this](PlanMessage message, const DeviceID &sender, uint32_t epoch,
+               std::vector<uint8_t> payload) -> void {
+          {
+            std::lock_guard<std::mutex> lock(plan_mtx_);
+            plan_events_.push_back(
+                PlanEvent{message, sender, epoch, std::move(payload)});
+          }
+          plan_cv_.notify_one();
+        });
+  }
+  if (!network_event_handler_->start_listening(device_info_->port)) {
+    return fail();
+  }
+  start_orchestrator();
+  if (eus_generated_) {
+    plan_thread_ = std::thread(&EdgeFlow::plan_loop, this);
+  }
 
   is_initialized_ = true;
   __android_log_print(ANDROID_LOG_INFO, "EdgeFlow::initialize",
@@ -68,6 +227,354 @@ bool EdgeFlow::initialize(std::unique_ptr<ModelDAG> dag,
   return true;
 }
 
+EdgeFlow::~EdgeFlow() {
+  {
+    std::lock_guard<std::mutex> lock(plan_mtx_);
+    stop_plan_ = true;
+  }
+  plan_cv_.notify_all();
+  if (plan_thread_.joinable()) {
+    plan_thread_.join();
+  }
+  orch_.reset();
+  network_event_handler_.reset();
+  TensorPool::instance().trim();
+}
+
+bool EdgeFlow::generate_eus(ModelDAG &dag) const {
+  if (options_.partitioning == Partitioning::CostModel) {
+    return AutoPartitioner::partition(dag, *device_map_, options_.profile);
+  }
+
+  std::vector<std::shared_ptr<Layer>> layers;
+  for (const auto &layer_id: dag.layer_order) {
+    const auto it = dag.layers.find(layer_id);
+    if (it == dag.layers.end()) {
+      __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::generate_eus",
+                          "Unknown layer %.*s in the layer order",
+                          static_cast<int>(layer_id.size()), layer_id.data());
+      return false;
+    }
+    layers.push_back(it->second);
+  }
+
+  // Sorted, so that every device derives the same units; those given the
+  // model input go first, as the first units run there
+  std::vector<DeviceID> device_ids;
+  for (const auto &device: *device_map_) {
+    device_ids.push_back(device.first);
+  }
+  std::sort(device_ids.begin(), device_ids.end());
+  std::stable_partition(device_ids.begin(), device_ids.end(),
+                        [this](const DeviceID &device_id) {
+                          return device_map_->at(device_id).has_input;
+                        });
+  std::vector<DeviceID> input_device_ids;
+  for (const auto &device_id: device_ids) {
+    if (device_map_->at(device_id).has_input) {
+      input_device_ids.push_back(device_id);
+    }
+  }
+  if (layers.empty() || input_device_ids.empty()) {
+    __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::generate_eus",
+                        "Model %s has no layer order or no device is given"
+                        " its input", dag.name.c_str());
+    return false;
+  }
+
+  std::vector<std::vector<ExecutionUnit>> eus;
+  if (options_.partitioning == Partitioning::FusedTiles) {
+    std::vector<float> shares;
+    for (const auto &device_id: device_ids) {
+      shares.push_back(
+          static_cast<float>(options_.profile.throughput(device_id)));
+    }
+    Partitioner::TilingReport report;
+    eus = Partitioner::partition_fused_tiles(layers, device_ids,
+                                             input_device_ids,
+                                             options_.fusion_depth, shares,
+                                             &report);
+  } else {
+    Partitioner::PipelineReport report;
+    eus = Partitioner::partition_pipeline(layers, device_ids, {}, &report);
+  }
+
+  dag.eus.clear();
+  for (auto &layer_eus: eus) {
+    for (auto &eu: layer_eus) {
+      dag.eus.emplace(eu.id, std::move(eu));
+    }
+  }
+  __android_log_print(ANDROID_LOG_INFO, "EdgeFlow::generate_eus",
+                      "Model %s: %zu execution units on %zu devices",
+                      dag.name.c_str(), dag.eus.size(), device_ids.size());
+  return true;
+}
+
+void EdgeFlow::start_orchestrator(const std::vector<RequestID> &boundaries) {
+  // Fold activations and merge local chains before anything is planned
+  GraphOptimizer::optimize(*dag_);
+  if (options_.speculative) {
+    Partitioner::assign_backup_devices(*dag_, *device_map_);
+  }
+  Partitioner::assign_wire_codecs(*dag_, options_.wire_codec);
+  Partitioner::assign_stream_chunks(*dag_, options_.stream_chunks);
+
+  // The DAG is static, so the lifetime of every intermediate is known now
+  memory_plan_ = std::make_unique<MemoryPlan>(
+      MemoryPlanner::plan(*dag_, device_info_->id));
+
+  execution_plan_ = std::make_unique<ExecutionPlan>(
+      ExecutionPlan::compile(*dag_, device_info_->id, *memory_plan_,
+                             options_.profile));
+
+  orch_ = std::make_unique<Orchestrator>(
+      *dag_, *device_info_, *device_map_, *memory_plan_, *execution_plan_,
+      options_.max_in_flight, network_event_handler_.get(),
+      options_.engine_options);
+  if (!boundaries.empty()) {
+    orch_->resume_request_ids(boundaries);
+  }
+  orch_->register_inference_complete_callback(
+      [&](RequestID request_id, InferenceStatus status,
+          const arm_compute::Tensor &output) -> void {
+        on_inference_complete(request_id, status, output);
+      });
+  register_drift_callback();
+
+  // The messages that arrived for this plan ahead of it are passed now
+  network_event_handler_->attach(*orch_, plan_epoch_);
+}
+
+void EdgeFlow::register_drift_callback() {
+  // Only the generated execution units can be generated again, and the
+  // stages of a pipeline do not depend on the measurements
+  if (!eus_generated_ || options_.partitioning == Partitioning::Pipeline) {
+    return;
+  }
+  const uint32_t epoch = plan_epoch_;
+  orch_->register_drift_callback([this, epoch](double, double) -> void {
+    post_plan_message(coordinator_id_, PlanMessage::DriftNotice, epoch);
+  });
+}
+
+void EdgeFlow::post_plan_message(const DeviceID &dest_device_id,
+                                 PlanMessage message,
+                                 uint32_t epoch,
+                                 std::vector<uint8_t> payload) {
+  if (dest_device_id != device_info_->id) {
+    network_event_handler_->send_plan_message(dest_device_id, message, epoch,
+                                              std::move(payload));
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(plan_mtx_);
+    plan_events_.push_back(
+        PlanEvent{message, device_info_->id, epoch, std::move(payload)});
+  }
+  plan_cv_.notify_one();
+}
+
+void EdgeFlow::plan_loop() {
+  std::unique_lock<std::mutex> lock(plan_mtx_);
+  while (!stop_plan_) {
+    if (plan_events_.empty()) {
+      if (!preparing_epoch_) {
+        plan_cv_.wait(lock);
+        continue;
+      }
+      // A device that does not reply in time holds up no one
+      if (plan_cv_.wait_until(lock, prepare_time_ + kPlanTimeout) ==
+              std::cv_status::timeout &&
+          plan_events_.empty()) {
+        const uint32_t epoch = *preparing_epoch_;
+        preparing_epoch_.reset();
+        lock.unlock();
+        __android_log_print(ANDROID_LOG_WARN, "EdgeFlow::plan_loop",
+                            "Only %zu of %zu devices are ready for plan %u;"
+                            " cancelled", ready_payloads_.size(),
+                            device_map_->size(), epoch);
+        for (const auto &device: *device_map_) {
+          post_plan_message(device.first, PlanMessage::Cancel, epoch);
+        }
+        lock.lock();
+      }
+      continue;
+    }
+
+    PlanEvent event = std::move(plan_events_.front());
+    plan_events_.pop_front();
+    lock.unlock();
+    handle_plan_event(event);
+    lock.lock();
+  }
+}
+
+void EdgeFlow::handle_plan_event(PlanEvent &event) {
+  const uint32_t next_epoch = plan_epoch_ + 1;
+  switch (event.message) {
+    case PlanMessage::DriftNotice: {
+      // Coordinator: one switch at a time, from the running plan
+      bool paused;
+      {
+        std::lock_guard<std::mutex> lock(inference_mtx_);
+        paused = plan_paused_;
+      }
+      if (coordinator_id_ != device_info_->id || preparing_epoch_ || paused ||
+          event.epoch != plan_epoch_) {
+        return;
+      }
+      __android_log_print(ANDROID_LOG_INFO, "EdgeFlow::handle_plan_event",
+                          "Latency drifted on %.*s; preparing plan %u",
+                          static_cast<int>(event.sender.size()),
+                          event.sender.data(), next_epoch);
+      preparing_epoch_ = next_epoch;
+      ready_payloads_.clear();
+      prepare_time_ = std::chrono::steady_clock::now();
+      for (const auto &device: *device_map_) {
+        post_plan_message(device.first, PlanMessage::Prepare, next_epoch);
+      }
+      return;
+    }
+    case PlanMessage::Prepare: {
+      if (event.epoch != next_epoch) {
+        return;
+      }
+      // The inferences started up to now run on the current plan
+      PlanWriter writer;
+      {
+        std::lock_guard<std::mutex> lock(inference_mtx_);
+        plan_paused_ = true;
+        writer.put(orch_->next_request_id());
+      }
+      ClusterProfile measured;
+      orch_->measure_profile(measured);
+      put_profile(writer, measured);
+      post_plan_message(coordinator_id_, PlanMessage::Ready, event.epoch,
+                        std::move(writer.buffer));
+      return;
+    }
+    case PlanMessage::Ready: {
+      // Coordinator
+      if (!preparing_epoch_ || event.epoch != *preparing_epoch_ ||
+          device_map_->find(event.sender) == device_map_->end()) {
+        return;
+      }
+      ready_payloads_[event.sender] = std::move(event.payload);
+      if (ready_payloads_.size() < device_map_->size()) {
+        return;
+      }
+
+      // In the order of the IDs, as the Orchestrators number the devices
+      std::vector<DeviceID> device_ids;
+      for (const auto &device: *device_map_) {
+        device_ids.push_back(device.first);
+      }
+      std::sort(device_ids.begin(), device_ids.end());
+      ClusterProfile profile = options_.profile;
+      std::vector<RequestID> boundaries;
+      for (const auto &device_id: device_ids) {
+        PlanReader reader(ready_payloads_[device_id]);
+        RequestID next_request_id = 0;
+        ClusterProfile measured;
+        if (!reader.get(next_request_id) || !get_profile(reader, measured)) {
+          __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::handle_plan_event",
+                              "Malformed measurements from %.*s",
+                              static_cast<int>(device_id.size()),
+                              device_id.data());
+          return;
+        }
+        boundaries.push_back(next_request_id);
+        for (const auto &device: measured.macs_per_ms) {
+          profile.macs_per_ms[device.first] = device.second;
+        }
+        for (const auto &src: measured.links) {
+          for (const auto &dest: src.second) {
+            profile.links[src.first][dest.first] = dest.second;
+          }
+        }
+      }
+
+      PlanWriter writer;
+      writer.put(static_cast<uint32_t>(boundaries.size()));
+      for (const RequestID boundary: boundaries) {
+        writer.put(boundary);
+      }
+      put_profile(writer, profile);
+      preparing_epoch_.reset();
+      for (const auto &device: *device_map_) {
+        post_plan_message(device.first, PlanMessage::Commit, event.epoch,
+                          writer.buffer);
+      }
+      return;
+    }
+    case PlanMessage::Commit: {
+      if (event.epoch != next_epoch) {
+        return;
+      }
+      PlanReader reader(event.payload);
+      uint32_t num_boundaries = 0;
+      std::vector<RequestID> boundaries;
+      ClusterProfile profile;
+      bool valid = reader.get(num_boundaries) &&
+                   num_boundaries == device_map_->size();
+      for (uint32_t i = 0; valid && i < num_boundaries; ++i) {
+        valid = reader.get(boundaries.emplace_back());
+      }
+      if (!valid || !get_profile(reader, profile)) {
+        // Switching without the boundaries could lose inferences
+        __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::handle_plan_event",
+                            "Malformed commit of plan %u", event.epoch);
+        return;
+      }
+      switch_plan(event.epoch, profile, boundaries);
+      return;
+    }
+    case PlanMessage::Cancel: {
+      if (event.epoch != next_epoch) {
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(inference_mtx_);
+        plan_paused_ = false;
+      }
+      register_drift_callback();
+      return;
+    }
+  }
+}
+
+void EdgeFlow::switch_plan(uint32_t epoch,
+                           const ClusterProfile &profile,
+                           const std::vector<RequestID> &boundaries) {
+  // The inferences started before finish on the plan they started with;
+  // those of the devices switched already are held by the handler
+  orch_->wait_settled(boundaries);
+
+  std::lock_guard<std::mutex> lock(inference_mtx_);
+  orch_.reset();
+  // The results still queued point into the DAG of the plan
+  network_event_handler_->flush();
+  // The buffers recycled for the plan, including those the workers cached,
+  // may not suit the next one
+  TensorPool::instance().trim();
+
+  options_.profile = profile;
+  ModelDAG dag = *dag_;
+  if (!generate_eus(dag)) {
+    // Every device fails alike on the same profile
+    __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::switch_plan",
+                        "Failed to re-partition; keeping the current plan");
+  } else {
+    *dag_ = std::move(dag);
+  }
+  plan_epoch_ = epoch;
+  start_orchestrator(boundaries);
+  plan_paused_ = false;
+  __android_log_print(ANDROID_LOG_INFO, "EdgeFlow::switch_plan",
+                      "Switched to plan %u", epoch);
+}
+
 void EdgeFlow::register_jni_callback(JNIEnv *env, jobject thiz,
                                      jmethodID callback) {
   if (!is_initialized_) {
@@ -104,39 +611,53 @@ void EdgeFlow::register_jni_callback(JNIEnv *env, jobject thiz,
                       "JNI callback registered successfully");
 }
 
-bool EdgeFlow::inference(std::unique_ptr<arm_compute::Tensor> input) {
+std::optional<RequestID>
+EdgeFlow::inference(std::unique_ptr<arm_compute::Tensor> input,
+                    Deadline deadline) {
   if (!is_initialized_) {
     __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::inference",
                         "EdgeFlow is not initialized");
-    return false;
+    return std::nullopt;
   }
 
   // print_tensor(*input, "Input tensor");
-  {
-    std::lock_guard<std::mutex> lock(inference_state_mtx_);
-    if (inference_active_) {
-      __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::inference",
-                          "Inference is already in progress");
-      return false;
-    }
-    inference_active_ = true;
+
+  // No inference starts while the devices switch plans
+  std::lock_guard<std::mutex> lock(inference_mtx_);
+  if (plan_paused_) {
+    __android_log_print(ANDROID_LOG_WARN, "EdgeFlow::inference",
+                        "Inference rejected; switching to a new plan");
+    return std::nullopt;
   }
 
   // Start the inference process
-  if (!orch_->start_inference(std::move(input))) {
+  const auto request_id = orch_->start_inference(std::move(input), deadline);
+  if (!request_id) {
     __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::inference",
                         "Failed to start inference");
-    std::lock_guard<std::mutex> lock(inference_state_mtx_);
-    inference_active_ = false;
-    return false;
+    return std::nullopt;
   }
 
   __android_log_print(ANDROID_LOG_INFO, "EdgeFlow::inference",
-                      "Inference started successfully");
-  return true;
+                      "Inference %u started successfully", *request_id);
+  return request_id;
 }
 
-void EdgeFlow::on_inference_complete(const arm_compute::Tensor &output) {
+bool EdgeFlow::cancel(RequestID request_id) {
+  if (!is_initialized_) {
+    __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::cancel",
+                        "EdgeFlow is not initialized");
+    return false;
+  }
+
+  // The inferences started before a plan switch are settled by then
+  std::lock_guard<std::mutex> lock(inference_mtx_);
+  return orch_->cancel_inference(request_id);
+}
+
+void EdgeFlow::on_inference_complete(RequestID request_id,
+                                     InferenceStatus status,
+                                     const arm_compute::Tensor &output) {
   if (java_callback_obj_ == nullptr || java_callback_method_ == nullptr) {
     __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::on_inference_complete",
                         "JNI callback is not registered");
@@ -162,9 +683,13 @@ void EdgeFlow::on_inference_complete(const arm_compute::Tensor &output) {
   }
 
   /* Build an array of floats from the output tensor */
+  // An inference that did not complete has no output
+  const bool completed = status == InferenceStatus::Completed;
   const auto *output_data = reinterpret_cast<const float *>(output.buffer());
-  const auto output_size = static_cast<jsize>(output.info()->total_size() /
-                                              output.info()->element_size());
+  const auto output_size =
+      completed ? static_cast<jsize>(output.info()->total_size() /
+                                     output.info()->element_size())
+                : 0;
   jfloatArray j_output_arr = env->NewFloatArray(output_size);
   if (j_output_arr == nullptr) {
     __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::on_inference_complete",
@@ -180,8 +705,8 @@ void EdgeFlow::on_inference_complete(const arm_compute::Tensor &output) {
   }
 
   /* Build an information string about the output tensor */
-  std::string info = "{}";
-  // TODO: Fill the info string with relevant details about the output tensor
+  std::string info = "{\"request_id\": " + std::to_string(request_id) +
+                     ", \"status\": \"" + status_name(status) + "\"}";
   jstring j_info_str = env->NewStringUTF(info.c_str());
   if (j_info_str == nullptr) {
     __android_log_print(ANDROID_LOG_ERROR, "EdgeFlow::on_inference_complete",
@@ -200,11 +725,12 @@ void EdgeFlow::on_inference_complete(const arm_compute::Tensor &output) {
                         "Exception occurred while calling Java callback method");
   }
 
-  {
-    std::lock_guard<std::mutex> lock(inference_state_mtx_);
-    inference_active_ = false;
-    __android_log_print(ANDROID_LOG_INFO, "EdgeFlow::on_inference_complete",
-                        "Inference completed successfully");
-    print_tensor(output, "EdgeFlow::on_inference_complete::output");
+  if (!completed) {
+    __android_log_print(ANDROID_LOG_WARN, "EdgeFlow::on_inference_complete",
+                        "Inference %u %s", request_id, status_name(status));
+    return;
   }
+  __android_log_print(ANDROID_LOG_INFO, "EdgeFlow::on_inference_complete",
+                      "Inference %u completed successfully", request_id);
+  print_tensor(output, "EdgeFlow::on_inference_complete::output");
 }
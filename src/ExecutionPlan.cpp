@@ -0,0 +1,202 @@
+#include "edgeflow/ExecutionPlan.h"
+#include "edgeflow/Partitioner.h"
+#include "edgeflow/TensorUtils.h"
+#include <algorithm>
+#include <android/log.h>
+
+ExecutionPlan ExecutionPlan::compile(const ModelDAG &dag,
+                                     const DeviceID &device_id,
+                                     const MemoryPlan &memory_plan,
+                                     const ClusterProfile &profile) {
+  ExecutionPlan plan;
+
+  // Handles follow the order of the IDs, so every device numbers the units
+  // the same way
+  std::vector<const ExecutionUnit *> eus;
+  eus.reserve(dag.eus.size());
+  for (const auto &eu_map: dag.eus) {
+    eus.push_back(&eu_map.second);
+  }
+  std::sort(eus.begin(), eus.end(),
+            [](const ExecutionUnit *a, const ExecutionUnit *b) {
+              return a->id < b->id;
+            });
+  for (EUHandle handle = 0; handle < eus.size(); ++handle) {
+    plan.handles_.emplace(eus[handle]->id, handle);
+  }
+
+  for (EUHandle handle = 0; handle < eus.size(); ++handle) {
+    const ExecutionUnit &eu = *eus[handle];
+    Unit unit{
+        .eu = &eu,
+        .is_local = eu.assigned_device == device_id,
+        .has_backup = !eu.backup_device.empty(),
+        .is_backup = eu.backup_device == device_id,
+        .allocation = memory_plan.find(eu.id),
+        .first_forward = static_cast<uint32_t>(plan.forwards_.size()),
+        .num_forwards = 0,
+        .first_input = static_cast<uint32_t>(plan.inputs_.size()),
+        .num_inputs = 0,
+        .num_input_rows = 0,
+    };
+
+    for (const auto &entry: eu.forward_table) {
+      const EUHandle dest = plan.find(entry.dest_eu_id);
+      if (dest == kInvalidEUHandle) {
+        __android_log_print(ANDROID_LOG_ERROR, "ExecutionPlan::compile",
+                            "Invalid destination execution unit %.*s for source execution unit %.*s",
+                            static_cast<int>(entry.dest_eu_id.size()), entry.dest_eu_id.data(),
+                            static_cast<int>(eu.id.size()), eu.id.data());
+        continue;
+      }
+      plan.forwards_.push_back(Forward{
+          .dest = dest,
+          .range = {entry.required_range.start - eu.output_range.start,
+                    entry.required_range.end - eu.output_range.start},
+      });
+      ++unit.num_forwards;
+    }
+
+    // Rows outside the feature map are padded by the unit, so the input
+    // starts at the first row inside it
+    int input_start = std::numeric_limits<int>::max();
+    for (const auto &requirement: eu.input_requirements) {
+      input_start =
+          std::min(input_start, std::max(0, requirement.second.src_range.start));
+    }
+    for (const auto &requirement: eu.input_requirements) {
+      const auto &src_eu_id = requirement.second.src_eu_id;
+      const EUHandle src =
+          src_eu_id == kModelInputID ? kInvalidEUHandle : plan.find(src_eu_id);
+      if (src == kInvalidEUHandle && src_eu_id != kModelInputID) {
+        __android_log_print(ANDROID_LOG_ERROR, "ExecutionPlan::compile",
+                            "Invalid source execution unit %.*s for execution unit %.*s",
+                            static_cast<int>(src_eu_id.size()), src_eu_id.data(),
+                            static_cast<int>(eu.id.size()), eu.id.data());
+        continue;
+      }
+      // Rows past the end of the source, e.g., of a hand-written range
+      // reaching into the padding, never arrive either
+      const int src_end =
+          src == kInvalidEUHandle
+              ? static_cast<int>(dag.input_shape[range_axis(dag.input_shape)])
+              : eus[src]->output_range.end;
+      const Range src_rows = {std::max(0, requirement.second.src_range.start),
+                              std::min(src_end, requirement.second.src_range.end)};
+      plan.inputs_.push_back(Input{
+          .src = src,
+          .src_rows = src_rows,
+          .dst_start = src_rows.start - input_start,
+      });
+      ++unit.num_inputs;
+      unit.num_input_rows += std::max(0, src_rows.num_elements());
+    }
+
+    if (unit.is_local) {
+      ++plan.num_local_units_;
+    }
+    if (unit.is_backup) {
+      ++plan.num_backup_units_;
+    }
+    if (unit.has_backup && (unit.is_local || unit.is_backup)) {
+      plan.speculative_units_.push_back(handle);
+    }
+    if (unit.is_local && eu.is_root) {
+      plan.local_roots_.push_back(handle);
+    }
+    if (unit.is_local && eu.is_leaf) {
+      // The last stage of a fused leaf produces the model output
+      const Layer &output_layer =
+          eu.fused_stages.empty() ? *eu.layer : *eu.fused_stages.back().layer;
+      plan.output_range_ =
+          plan.num_local_leaves_ == 0
+              ? eu.output_range
+              : Range{std::min(plan.output_range_.start, eu.output_range.start),
+                      std::max(plan.output_range_.end, eu.output_range.end)};
+      plan.output_shape_ = slab_shape(output_layer.output_shape, plan.output_range_);
+      ++plan.num_local_leaves_;
+    }
+    plan.units_.push_back(unit);
+  }
+  plan.compute_ranks(profile);
+  for (const EUHandle root: plan.local_roots_) {
+    plan.predicted_latency_ms_ =
+        std::max(plan.predicted_latency_ms_, plan.units_[root].rank);
+  }
+
+  __android_log_print(ANDROID_LOG_INFO, "ExecutionPlan::compile",
+                      "Compiled %zu execution units (%zu roots, %zu leaves,"
+                      " %zu backups on this device), %zu forwards, %zu inputs",
+                      plan.units_.size(), plan.local_roots_.size(),
+                      plan.num_local_leaves_, plan.num_backup_units_,
+                      plan.forwards_.size(),
+                      plan.inputs_.size());
+  return plan;
+}
+
+void ExecutionPlan::compute_ranks(const ClusterProfile &profile) {
+  // Kahn's algorithm on the forwards, from the leaves up
+  std::vector<uint32_t> num_pending(units_.size(), 0);
+  for (EUHandle handle = 0; handle < units_.size(); ++handle) {
+    num_pending[handle] = units_[handle].num_forwards;
+  }
+  std::vector<std::vector<EUHandle>> predecessors(units_.size());
+  for (EUHandle handle = 0; handle < units_.size(); ++handle) {
+    for (const Forward &forward: forwards(handle)) {
+      predecessors[forward.dest].push_back(handle);
+    }
+  }
+  std::vector<EUHandle> ready;
+  for (EUHandle handle = 0; handle < units_.size(); ++handle) {
+    if (num_pending[handle] == 0) {
+      ready.push_back(handle);
+    }
+  }
+
+  while (!ready.empty()) {
+    const EUHandle handle = ready.back();
+    ready.pop_back();
+    Unit &unit = units_[handle];
+    const ExecutionUnit &eu = *unit.eu;
+
+    const auto &out_shape = eu.expected_output_shape;
+    const double row_bytes =
+        static_cast<double>(out_shape.total_size() * sizeof(float)) /
+        std::max<size_t>(1, out_shape[range_axis(out_shape)]);
+    double successor_rank = 0;
+    for (const Forward &forward: forwards(handle)) {
+      const Unit &dest = units_[forward.dest];
+      double hop = 0;
+      if (dest.eu->assigned_device != eu.assigned_device) {
+        const auto &link = profile.link(eu.assigned_device, dest.eu->assigned_device);
+        hop = link.latency_ms +
+              row_bytes * forward.range.num_elements() / link.bytes_per_ms;
+      }
+      successor_rank = std::max(successor_rank, hop + dest.rank);
+    }
+    unit.rank = Partitioner::eu_macs(eu) / profile.throughput(eu.assigned_device) +
+                successor_rank;
+
+    for (const EUHandle predecessor: predecessors[handle]) {
+      if (--num_pending[predecessor] == 0) {
+        ready.push_back(predecessor);
+      }
+    }
+  }
+}
+
+const ExecutionPlan::Input *
+ExecutionPlan::find_input(EUHandle dest, EUHandle src) const {
+  // A unit has a handful of inputs; a linear scan beats hashing
+  for (const Input &input: inputs(dest)) {
+    if (input.src == src) {
+      return &input;
+    }
+  }
+  return nullptr;
+}
+
+EUHandle ExecutionPlan::find(const ExecutionUnitID &eu_id) const {
+  const auto it = handles_.find(eu_id);
+  return it != handles_.end() ? it->second : kInvalidEUHandle;
+}
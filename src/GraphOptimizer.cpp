@@ -0,0 +1,157 @@
+#include "edgeflow/GraphOptimizer.h"
+#include <android/log.h>
+
+void GraphOptimizer::optimize(ModelDAG &dag) {
+  const size_t num_eus = dag.eus.size();
+  const size_t num_fused = fuse_activations(dag);
+  const size_t num_merged = merge_chains(dag);
+
+  __android_log_print(ANDROID_LOG_INFO, "GraphOptimizer::optimize",
+                      "%zu execution units -> %zu"
+                      " (%zu activations fused, %zu units merged)",
+                      num_eus, dag.eus.size(), num_fused, num_merged);
+}
+
+size_t GraphOptimizer::fuse_activations(ModelDAG &dag) {
+  size_t num_fused = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    const auto preds = predecessors(dag);
+    for (auto &eu_map: dag.eus) {
+      ExecutionUnit &eu = eu_map.second;
+      // FC and convolution support a fused activation
+      const bool supports_fused_activation =
+          eu.get_type() == LayerType::Linear ||
+          eu.get_type() == LayerType::Convolution;
+      if (!supports_fused_activation || !eu.fused_stages.empty() ||
+          eu.fused_activation.enabled()) {
+        continue;
+      }
+
+      ExecutionUnit *next = mergeable_successor(dag, eu, preds);
+      if (!next || next->get_type() != LayerType::ReLU ||
+          !next->fused_stages.empty()) {
+        continue;
+      }
+
+      eu.fused_activation = arm_compute::ActivationLayerInfo(
+          arm_compute::ActivationFunction::RELU);
+      absorb(dag, eu, *next);
+      ++num_fused;
+      changed = true;
+      break; // `dag.eus` was modified
+    }
+  }
+  return num_fused;
+}
+
+size_t GraphOptimizer::merge_chains(ModelDAG &dag) {
+  size_t num_merged = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    const auto preds = predecessors(dag);
+    for (auto &eu_map: dag.eus) {
+      ExecutionUnit &eu = eu_map.second;
+      ExecutionUnit *next = mergeable_successor(dag, eu, preds);
+      if (!next) {
+        continue;
+      }
+
+      eu.fused_stages.push_back(FusedStage{
+          .original_eu_id = next->id,
+          .layer = next->layer,
+          .expected_input_shape = eu.expected_output_shape,
+          // `next` may have absorbed its own successors already
+          .expected_output_shape =
+              next->fused_stages.empty()
+                  ? next->expected_output_shape
+                  : next->fused_stages.front().expected_input_shape,
+          .fused_activation = next->fused_activation,
+          .prepad_top = next->prepad_top,
+          .prepad_bottom = next->prepad_bottom,
+          .prepad_left = next->prepad_left,
+          .prepad_right = next->prepad_right,
+      });
+      eu.fused_stages.insert(eu.fused_stages.end(),
+                             next->fused_stages.begin(),
+                             next->fused_stages.end());
+      absorb(dag, eu, *next);
+      ++num_merged;
+      changed = true;
+      break; // `dag.eus` was modified
+    }
+  }
+  return num_merged;
+}
+
+ExecutionUnit *
+GraphOptimizer::mergeable_successor(ModelDAG &dag, const ExecutionUnit &eu,
+                                    const PredecessorMap &preds) {
+  if (eu.is_leaf || eu.forward_table.size() != 1) {
+    return nullptr;
+  }
+
+  // The successor must consume the whole output of `eu` and nothing else
+  const ForwardTableEntry &entry = eu.forward_table.front();
+  if (!(entry.required_range == eu.output_range)) {
+    return nullptr;
+  }
+  const auto it = dag.eus.find(entry.dest_eu_id);
+  if (it == dag.eus.end()) {
+    return nullptr;
+  }
+  ExecutionUnit &next = it->second;
+  const auto pred_it = preds.find(next.id);
+  if (next.is_root || next.assigned_device != eu.assigned_device ||
+      pred_it == preds.end() || pred_it->second.size() != 1 ||
+      next.input_requirements.size() > 1 ||
+      next.expected_input_shape.total_size() !=
+          eu.expected_output_shape.total_size()) {
+    return nullptr;
+  }
+  return &next;
+}
+
+void GraphOptimizer::absorb(ModelDAG &dag, ExecutionUnit &into,
+                            const ExecutionUnit &absorbed) {
+  into.forward_table = absorbed.forward_table;
+  into.output_range = absorbed.output_range;
+  into.expected_output_shape = absorbed.expected_output_shape;
+  into.is_leaf = absorbed.is_leaf;
+
+  // The successors of `absorbed` now receive their input from `into`
+  for (const auto &entry: absorbed.forward_table) {
+    const auto it = dag.eus.find(entry.dest_eu_id);
+    if (it == dag.eus.end()) {
+      continue;
+    }
+    auto &requirements = it->second.input_requirements;
+    for (auto req_it = requirements.begin(); req_it != requirements.end();) {
+      if (req_it->second.src_eu_id != absorbed.id) {
+        ++req_it;
+        continue;
+      }
+      InputRequirement requirement = req_it->second;
+      requirement.src_eu_id = into.id;
+      req_it = requirements.erase(req_it);
+      requirements.emplace(into.id, requirement);
+      break;
+    }
+  }
+
+  const ExecutionUnitID absorbed_id = absorbed.id;
+  dag.eus.erase(absorbed_id);
+}
+
+GraphOptimizer::PredecessorMap
+GraphOptimizer::predecessors(const ModelDAG &dag) {
+  PredecessorMap preds;
+  for (const auto &eu_map: dag.eus) {
+    for (const auto &entry: eu_map.second.forward_table) {
+      preds[entry.dest_eu_id].push_back(eu_map.first);
+    }
+  }
+  return preds;
+}
@@ -0,0 +1,180 @@
+#include "edgeflow/MemoryPlanner.h"
+#include <algorithm>
+#include <android/log.h>
+#include <queue>
+
+static size_t align_up(size_t bytes, size_t alignment) {
+  return (bytes + alignment - 1) / alignment * alignment;
+}
+
+MemoryPlan MemoryPlanner::plan(const ModelDAG &dag, const DeviceID &device_id) {
+  MemoryPlan plan;
+
+  const auto order = topological_order(dag);
+  if (order.size() != dag.eus.size()) {
+    __android_log_print(ANDROID_LOG_ERROR, "MemoryPlanner::plan",
+                        "The model DAG is not acyclic; no memory is planned");
+    return plan;
+  }
+
+  std::unordered_map<ExecutionUnitID, size_t> index_of;
+  for (size_t i = 0; i < order.size(); ++i) {
+    index_of[order[i]->id] = i;
+  }
+
+  // reachable[i][j]: execution unit j depends (transitively) on i.
+  // Visiting in reverse topological order sees every successor first.
+  const size_t n = order.size();
+  std::vector<std::vector<bool>> reachable(n, std::vector<bool>(n, false));
+  for (size_t k = n; k-- > 0;) {
+    for (const auto &entry: order[k]->forward_table) {
+      const size_t next = index_of.at(entry.dest_eu_id);
+      reachable[k][next] = true;
+      for (size_t j = 0; j < n; ++j) {
+        if (reachable[next][j]) reachable[k][j] = true;
+      }
+    }
+  }
+
+  /* == Collect the buffers and their live ranges == */
+  std::vector<Buffer> buffers;
+  for (size_t i = 0; i < n; ++i) {
+    const ExecutionUnit &eu = *order[i];
+    // Leaves write into the output tensor of the request instead
+    if (eu.assigned_device != device_id || eu.is_leaf) {
+      continue;
+    }
+    // Outputs leaving the device are taken from the tensor pool instead:
+    // the sender may still read them after the request was released and
+    // its arena reused by the next inference
+    const bool leaves_device = std::any_of(
+        eu.forward_table.begin(), eu.forward_table.end(), [&](const auto &entry) {
+          const ExecutionUnit &dest = *order[index_of.at(entry.dest_eu_id)];
+          return dest.assigned_device != device_id || !dest.backup_device.empty();
+        });
+    if (leaves_device) {
+      continue;
+    }
+
+    Buffer buffer{
+        .producer = &eu,
+        .size = align_up(arm_compute::TensorInfo(eu.expected_output_shape, 1,
+                                                 arm_compute::DataType::F32)
+                             .total_size(),
+                         kAlignment),
+        .consumers = {},
+    };
+
+    // Outputs leaving the DAG stay live to the end
+    for (const auto &entry: eu.forward_table) {
+      buffer.consumers.push_back(index_of.at(entry.dest_eu_id));
+    }
+
+    plan.naive_size += buffer.size;
+    buffers.push_back(std::move(buffer));
+  }
+
+  /* == Greedy-by-size placement == */
+  std::vector<size_t> by_size(buffers.size());
+  for (size_t i = 0; i < by_size.size(); ++i) by_size[i] = i;
+  std::stable_sort(by_size.begin(), by_size.end(), [&](size_t a, size_t b) {
+    return buffers[a].size > buffers[b].size;
+  });
+
+  std::vector<size_t> placed;
+  std::vector<MemoryPlan::Allocation> allocations(buffers.size());
+  for (const size_t cur: by_size) {
+    const Buffer &buffer = buffers[cur];
+    const size_t cur_producer = index_of.at(buffer.producer->id);
+
+    // Placed buffers that may be live at the same time as this one
+    std::vector<MemoryPlan::Allocation> conflicts;
+    for (const size_t other: placed) {
+      const size_t other_producer = index_of.at(buffers[other].producer->id);
+      if (dead_before(buffers[other], cur_producer, reachable) ||
+          dead_before(buffer, other_producer, reachable)) {
+        continue;
+      }
+      conflicts.push_back(allocations[other]);
+    }
+    std::sort(conflicts.begin(), conflicts.end(),
+              [](const auto &a, const auto &b) { return a.offset < b.offset; });
+
+    // Take the first gap large enough
+    size_t offset = 0;
+    for (const auto &conflict: conflicts) {
+      if (conflict.offset >= offset + buffer.size) {
+        break;
+      }
+      offset = std::max(offset, conflict.offset + conflict.size);
+    }
+
+    allocations[cur] = {.offset = offset, .size = buffer.size};
+    plan.arena_size = std::max(plan.arena_size, offset + buffer.size);
+    placed.push_back(cur);
+  }
+
+  for (size_t i = 0; i < buffers.size(); ++i) {
+    plan.allocations[buffers[i].producer->id] = allocations[i];
+  }
+
+  __android_log_print(ANDROID_LOG_INFO, "MemoryPlanner::plan",
+                      "Planned %zu intermediate tensors: arena %zu bytes"
+                      " (naive per-tensor allocation: %zu bytes)",
+                      buffers.size(), plan.arena_size, plan.naive_size);
+  return plan;
+}
+
+std::vector<const ExecutionUnit *>
+MemoryPlanner::topological_order(const ModelDAG &dag) {
+  std::unordered_map<ExecutionUnitID, unsigned int> in_degree;
+  for (const auto &eu_map: dag.eus) {
+    in_degree.emplace(eu_map.first, 0);
+  }
+  for (const auto &eu_map: dag.eus) {
+    for (const auto &entry: eu_map.second.forward_table) {
+      ++in_degree[entry.dest_eu_id];
+    }
+  }
+
+  std::queue<const ExecutionUnit *> ready;
+  for (const auto &eu_map: dag.eus) {
+    if (in_degree[eu_map.first] == 0) {
+      ready.push(&eu_map.second);
+    }
+  }
+
+  std::vector<const ExecutionUnit *> order;
+  while (!ready.empty()) {
+    const ExecutionUnit *eu = ready.front();
+    ready.pop();
+    order.push_back(eu);
+    for (const auto &entry: eu->forward_table) {
+      if (--in_degree[entry.dest_eu_id] == 0) {
+        const auto it = dag.eus.find(entry.dest_eu_id);
+        if (it == dag.eus.end()) {
+          __android_log_print(ANDROID_LOG_ERROR,
+                              "MemoryPlanner::topological_order",
+                              "Unknown destination execution unit %.*s",
+                              static_cast<int>(entry.dest_eu_id.size()),
+                              entry.dest_eu_id.data());
+          return {};
+        }
+        ready.push(&it->second);
+      }
+    }
+  }
+  return order;
+}
+
+bool MemoryPlanner::dead_before(
+    const Buffer &a, size_t b_producer,
+    const std::vector<std::vector<bool>> &reachable) {
+  if (a.consumers.empty()) {
+    return false; // Live to the end
+  }
+  return std::all_of(a.consumers.begin(), a.consumers.end(),
+                     [&](size_t consumer) {
+                       return reachable[consumer][b_producer];
+                     });
+}
@@ -1,34 +1,1433 @@
 #include "edgeflow/NetworkEventHandler.h"
+#include "edgeflow/TensorPool.h"
+#include "edgeflow/TensorUtils.h"
+#include "edgeflow/WireCodec.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/// Wire format of a message, in the byte order of the devices, which are
+/// all little-endian: this header, the IDs of the source and destination
+/// execution units, then `payload_bytes` of packed tensor elements, encoded
+/// with `codec`. A plan message carries the ID of the sending device as its
+/// source ID, and the opaque payload of the plan protocol.
+struct NetworkEventHandler::FrameHeader {
+  static constexpr uint32_t kMagic = 0x574C4645; // "EFLW" on the wire
+  static constexpr size_t kMaxDims = 6;
+
+  uint32_t magic;
+  RequestID request_id;
+  int64_t time_left_us; // Before the deadline of the inference; -1 if none
+  uint64_t payload_bytes;
+  // Rows of the source output carried by a result
+  int32_t range_start, range_end;
+  uint32_t dims[kMaxDims]; // Shape of the tensor
+  uint8_t type;            // MessageType
+  uint8_t status;          // InferenceStatus of an abort notice
+  uint8_t data_type;       // arm_compute::DataType of the tensor
+  uint8_t num_dims;
+  uint16_t src_eu_id_size, dest_eu_id_size;
+  uint8_t codec; // WireCodec of the payload
+  uint8_t reserved[3];
+  uint32_t plan_epoch; // Epoch of the plan the message was sent on
+
+  /// Whether the fields of the header are in range; the sizes of the IDs
+  /// are checked against what holds them
+  bool well_formed() const {
+    return magic == kMagic && num_dims <= kMaxDims &&
+           type <= static_cast<uint8_t>(MessageType::Plan) &&
+           codec <= static_cast<uint8_t>(WireCodec::Int8) &&
+           (type != static_cast<uint8_t>(MessageType::AbortNotice) ||
+            status <= static_cast<uint8_t>(InferenceStatus::Failed));
+  }
+};
+
+/// Receiving state of an accepted connection.
+/// The header and the IDs of a message are parsed from a staging buffer
+/// filled with whatever the socket has, so that a burst of small messages
+/// takes a single `recv`. The payload of a result is received straight
+/// into its tensor; only the bytes that arrived along with the header are
+/// copied from the staging buffer.
+struct NetworkEventHandler::Connection {
+  enum class Stage { Header, Ids, Payload };
+  static constexpr size_t kStagingBytes = 4096;
+
+  int socket = -1;
+  Stage stage = Stage::Header;
+  std::array<uint8_t, kStagingBytes> staging{};
+  size_t begin = 0, end = 0; // Bytes of the staging buffer not parsed yet
+  FrameHeader header{};
+  std::unique_ptr<ExecutionUnitID> src_eu_id{}, dest_eu_id{};
+  arm_compute::TensorInfo info{};
+  std::unique_ptr<arm_compute::Tensor> data{};
+  std::vector<uint8_t> encoded{}; // Payload of an encoded result or a plan message
+  uint8_t *payload = nullptr;     // Next byte of the payload to receive
+  size_t payload_left = 0;
+
+  // The Unix socket of a same-host peer, with its ring once attached
+  bool is_ring_link = false;
+  std::shared_ptr<SharedMemoryRing> ring{};
+  // Closed by the reactor, and destroyed once it handled all the events
+  // it got along, which may still point to it
+  bool closed = false;
+
+  size_t buffered() const { return end - begin; }
+};
+
+/// Pending connections of the peers not accepted yet
+static constexpr int kListenBacklog = 16;
+/// Buffers handed to a single `sendmsg` call
+static constexpr size_t kSendBatch = 64;
+/// Readiness events handled per `epoll_wait` call
+static constexpr int kMaxEvents = 64;
+/// Descriptors of a ring handed over to a same-host peer
+static constexpr size_t kRingFds = 3;
+
+socklen_t NetworkEventHandler::ring_address(unsigned int port,
+                                            sockaddr_un &address) {
+  address = {};
+  address.sun_family = AF_UNIX;
+  // The leading NUL of `sun_path` selects the abstract namespace
+  const int length = std::snprintf(address.sun_path + 1,
+                                   sizeof(address.sun_path) - 1,
+                                   "edgeflow.%u", port);
+  return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + length);
+}
+
+/// Open a TCP connection, waiting for it to be established for the timeout
+/// at most
+/// @return The blocking socket, or -1 with `errno` set
+static int connect_within(const sockaddr_in &address,
+                          std::chrono::milliseconds timeout) {
+  const int peer_socket =
+      socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (peer_socket < 0) {
+    return -1;
+  }
+  int error = 0;
+  if (connect(peer_socket, reinterpret_cast<const sockaddr *>(&address),
+              sizeof(address)) < 0) {
+    error = errno;
+  }
+  if (error == EINPROGRESS) {
+    pollfd fd{peer_socket, POLLOUT, 0};
+    int ready;
+    do {
+      ready = poll(&fd, 1, static_cast<int>(timeout.count()));
+    } while (ready < 0 && errno == EINTR);
+    socklen_t size = sizeof(error);
+    if (ready == 0) {
+      error = ETIMEDOUT;
+    } else if (ready < 0 || getsockopt(peer_socket, SOL_SOCKET, SO_ERROR,
+                                       &error, &size) < 0) {
+      error = errno;
+    }
+  }
+  // The sender writes whole messages; it blocks while the link is busy
+  if (error != 0 ||
+      fcntl(peer_socket, F_SETFL,
+            fcntl(peer_socket, F_GETFL) & ~O_NONBLOCK) < 0) {
+    error = error != 0 ? error : errno;
+    close(peer_socket);
+    errno = error;
+    return -1;
+  }
+  return peer_socket;
+}
+
+/// Send all the buffers, resuming after partial sends
+/// @return false if the connection is lost
+static bool send_all(int socket, const iovec *iov, size_t iov_count) {
+  size_t first = 0;  // First buffer not completely sent
+  size_t offset = 0; // Bytes of it sent already
+  while (first < iov_count) {
+    iovec batch[kSendBatch];
+    size_t batch_size = 0;
+    for (; batch_size < kSendBatch && first + batch_size < iov_count; ++batch_size) {
+      batch[batch_size] = iov[first + batch_size];
+    }
+    batch[0].iov_base = static_cast<uint8_t *>(batch[0].iov_base) + offset;
+    batch[0].iov_len -= offset;
+
+    msghdr message{};
+    message.msg_iov = batch;
+    message.msg_iovlen = batch_size;
+    // A peer that went away must not raise SIGPIPE in the app
+    const ssize_t sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    for (size_t left = static_cast<size_t>(sent); left > 0;) {
+      const size_t remaining = iov[first].iov_len - offset;
+      if (left < remaining) {
+        offset += left;
+        break;
+      }
+      left -= remaining;
+      ++first;
+      offset = 0;
+    }
+  }
+  return true;
+}
+
+/// Append the contiguous blocks of the elements of the tensor to `iov`, in
+/// the order of a packed copy. A view of a band of a multi-channel feature
+/// map has one block per channel; see `copy_slab`.
+static void append_blocks(const arm_compute::ITensor &tensor,
+                          std::vector<iovec> &iov) {
+  const arm_compute::ITensorInfo &info = *tensor.info();
+  const auto &shape = info.tensor_shape();
+  uint8_t *base = tensor.buffer() + info.offset_first_element_in_bytes();
+  if (shape.total_size() == 0) {
+    return;
+  }
+  if (is_packed(info)) {
+    iov.push_back({base, shape.total_size() * info.element_size()});
+    return;
+  }
+
+  // Views only slice the range axis, so the elements up to it are contiguous
+  const auto &strides = info.strides_in_bytes();
+  const size_t axis = range_axis(shape);
+  size_t block_bytes = info.element_size();
+  for (size_t d = 0; d <= axis; ++d) block_bytes *= shape[d];
+  size_t outer = 1;
+  for (size_t d = axis + 1; d < shape.num_dimensions(); ++d) {
+    outer *= shape[d];
+  }
+  for (size_t o = 0; o < outer; ++o) {
+    size_t offset = 0;
+    size_t index = o;
+    for (size_t d = axis + 1; d < shape.num_dimensions(); ++d) {
+      offset += (index % shape[d]) * strides[d];
+      index /= shape[d];
+    }
+    iov.push_back({base + offset, block_bytes});
+  }
+}
 
 NetworkEventHandler::NetworkEventHandler(
-    Orchestrator &orch,
     const DeviceInfo &device_info,
     const DeviceMap &device_map)
-    : orch_(orch), device_info_(device_info),
-      device_map_(device_map) {
-  // TODO
+    : device_info_(device_info), device_map_(device_map) {
+  sender_thread_ = std::thread(&NetworkEventHandler::sender_loop, this);
 }
 
 NetworkEventHandler::~NetworkEventHandler() {
   stop_listening();
-  if (listener_thread_.joinable()) {
-    listener_thread_.join();
+  if (reactor_thread_.joinable()) {
+    reactor_thread_.join();
+  }
+  for (const auto &connection: connections_) {
+    close(connection->socket);
   }
+  for (const int fd: {server_socket_, ring_server_socket_, epoll_fd_, wake_fd_}) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  // Let the sender drain the queued results, then stop
+  egress_queue_.close();
+  if (sender_thread_.joinable()) {
+    sender_thread_.join();
+  }
+  for (const auto &peer_socket: peer_sockets_) {
+    close(peer_socket.second);
+  }
+  log_wire_stats();
   __android_log_print(ANDROID_LOG_INFO, "NetworkEventHandler::~NetworkEventHandler",
                       "NetworkEventHandler destroyed");
 }
 
-void NetworkEventHandler::start_listening(unsigned int port) {}
+bool NetworkEventHandler::start_listening(unsigned int port) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd_ < 0 || wake_fd_ < 0) {
+    __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::start_listening",
+                        "Failed to create the reactor: %s", std::strerror(errno));
+    return false;
+  }
+
+  server_socket_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (server_socket_ < 0) {
+    __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::start_listening",
+                        "Failed to create the socket: %s", std::strerror(errno));
+    return false;
+  }
+  // Rebind right away after the app restarted
+  const int reuse = 1;
+  setsockopt(server_socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  if (bind(server_socket_, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) < 0 ||
+      listen(server_socket_, kListenBacklog) < 0) {
+    __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::start_listening",
+                        "Failed to listen on port %u: %s", port,
+                        std::strerror(errno));
+    close(server_socket_);
+    server_socket_ = -1;
+    return false;
+  }
+
+  // Neither has a connection. The wake-up stays readable once written, so
+  // it is level-triggered.
+  epoll_event server_event{};
+  server_event.events = EPOLLIN | EPOLLET;
+  server_event.data.ptr = nullptr;
+  epoll_event wake_event{};
+  wake_event.events = EPOLLIN;
+  wake_event.data.ptr = nullptr;
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_socket_, &server_event) < 0 ||
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &wake_event) < 0) {
+    __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::start_listening",
+                        "Failed to watch the socket: %s", std::strerror(errno));
+    return false;
+  }
+
+  // Same-host peers that cannot hand their rings over use TCP
+  sockaddr_un ring_server_address{};
+  const socklen_t ring_server_address_size =
+      ring_address(port, ring_server_address);
+  ring_server_socket_ =
+      socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (ring_server_socket_ < 0 ||
+      bind(ring_server_socket_,
+           reinterpret_cast<sockaddr *>(&ring_server_address),
+           ring_server_address_size) < 0 ||
+      listen(ring_server_socket_, kListenBacklog) < 0 ||
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, ring_server_socket_, &server_event) < 0) {
+    __android_log_print(ANDROID_LOG_WARN, "NetworkEventHandler::start_listening",
+                        "Shared memory is not available to the peers on this"
+                        " host: %s", std::strerror(errno));
+    if (ring_server_socket_ >= 0) {
+      close(ring_server_socket_);
+      ring_server_socket_ = -1;
+    }
+  }
+
+  reactor_thread_ = std::thread(&NetworkEventHandler::reactor_loop, this);
+  __android_log_print(ANDROID_LOG_INFO, "NetworkEventHandler::start_listening",
+                      "Listening on port %u", port);
+  return true;
+}
+
+void NetworkEventHandler::stop_listening() {
+  stop_flag_ = true;
+  if (wake_fd_ >= 0) {
+    const uint64_t wake_up = 1;
+    write(wake_fd_, &wake_up, sizeof(wake_up));
+  }
+}
+
+void NetworkEventHandler::attach(Orchestrator &orch, uint32_t epoch) {
+  std::lock_guard<std::mutex> lock(receiver_mtx_);
+  orch_ = &orch;
+  epoch_ = epoch;
+
+  // Replay the messages that arrived ahead of the switch, in order
+  std::vector<IncomingMessage> held = std::move(held_messages_);
+  held_messages_.clear();
+  for (auto &message: held) {
+    if (message.epoch == epoch) {
+      pass(message);
+    } else if (message.epoch > epoch) {
+      held_messages_.push_back(std::move(message));
+    }
+  }
+}
+
+void NetworkEventHandler::detach() {
+  std::lock_guard<std::mutex> lock(receiver_mtx_);
+  orch_ = nullptr;
+}
+
+void NetworkEventHandler::flush() {
+  std::unique_lock<std::mutex> lock(unsent_mtx_);
+  unsent_cv_.wait(lock, [this] { return num_unsent_ == 0; });
+}
+
+void NetworkEventHandler::register_plan_callback(PlanCallback plan_callback) {
+  plan_callback_ = std::move(plan_callback);
+}
+
+bool NetworkEventHandler::enqueue(std::unique_ptr<OutgoingResult> message) {
+  {
+    std::lock_guard<std::mutex> lock(unsent_mtx_);
+    ++num_unsent_;
+  }
+  if (egress_queue_.push(std::move(message))) {
+    return true;
+  }
+  std::lock_guard<std::mutex> lock(unsent_mtx_);
+  if (--num_unsent_ == 0) {
+    unsent_cv_.notify_all();
+  }
+  return false;
+}
 
-void NetworkEventHandler::stop_listening() {}
+void NetworkEventHandler::send_plan_message(const DeviceID &dest_device_id,
+                                            PlanMessage message,
+                                            uint32_t epoch,
+                                            std::vector<uint8_t> payload) {
+  auto outgoing = std::make_unique<OutgoingResult>(OutgoingResult{
+      .type = MessageType::Plan,
+      .epoch = epoch,
+      .dest_device_id = dest_device_id,
+      .plan_message = message,
+      .payload = std::move(payload),
+  });
+  if (!enqueue(std::move(outgoing))) {
+    __android_log_print(
+        ANDROID_LOG_WARN, "NetworkEventHandler::send_plan_message",
+        "Plan message for epoch %u dropped; the handler is stopping", epoch);
+  }
+}
 
 void NetworkEventHandler::send_intermediate_result(
+    RequestID request_id,
     const DeviceID &dest_device_id,
+    const ExecutionUnit &src_eu,
     const ExecutionUnit &dest_eu,
-    std::unique_ptr<arm_compute::Tensor> input) {}
+    std::unique_ptr<arm_compute::Tensor> input,
+    const Range &rows,
+    Deadline deadline) {
+  auto result = std::make_unique<OutgoingResult>(OutgoingResult{
+      .type = MessageType::Result,
+      .request_id = request_id,
+      .epoch = epoch_,
+      .dest_device_id = dest_device_id,
+      .src_eu = &src_eu,
+      .dest_eu = &dest_eu,
+      .data = std::move(input),
+      .rows = rows,
+      .deadline = deadline,
+  });
+  if (!enqueue(std::move(result))) {
+    __android_log_print(
+        ANDROID_LOG_WARN, "NetworkEventHandler::send_intermediate_result",
+        "Result for execution unit %.*s dropped; the handler is stopping",
+        static_cast<int>(dest_eu.id.size()), dest_eu.id.data());
+  }
+}
+
+void NetworkEventHandler::send_completion_notice(RequestID request_id,
+                                                 const DeviceID &dest_device_id,
+                                                 const ExecutionUnit &eu) {
+  auto notice = std::make_unique<OutgoingResult>(OutgoingResult{
+      .type = MessageType::CompletionNotice,
+      .request_id = request_id,
+      .epoch = epoch_,
+      .dest_device_id = dest_device_id,
+      .src_eu = &eu,
+  });
+  if (!enqueue(std::move(notice))) {
+    __android_log_print(
+        ANDROID_LOG_WARN, "NetworkEventHandler::send_completion_notice",
+        "Completion notice for execution unit %.*s dropped; the handler is"
+        " stopping",
+        static_cast<int>(eu.id.size()), eu.id.data());
+  }
+}
+
+void NetworkEventHandler::send_abort_notice(RequestID request_id,
+                                            const DeviceID &dest_device_id,
+                                            InferenceStatus status) {
+  auto notice = std::make_unique<OutgoingResult>(OutgoingResult{
+      .type = MessageType::AbortNotice,
+      .request_id = request_id,
+      .epoch = epoch_,
+      .dest_device_id = dest_device_id,
+      .status = status,
+  });
+  if (!enqueue(std::move(notice))) {
+    __android_log_print(
+        ANDROID_LOG_WARN, "NetworkEventHandler::send_abort_notice",
+        "Abort notice for inference %u dropped; the handler is stopping",
+        request_id);
+  }
+}
+
+void NetworkEventHandler::on_receive_abort_notice(RequestID request_id,
+                                                  InferenceStatus status) {
+  orch_->on_receive_abort_notice(request_id, status);
+}
+
+void NetworkEventHandler::on_receive_completion_notice(
+    RequestID request_id,
+    const ExecutionUnitID &eu_id) {
+  orch_->on_receive_completion_notice(request_id, eu_id);
+}
 
 void NetworkEventHandler::on_receive_intermediate_result(
-    const ExecutionUnitID &dest_eu_id,
-    std::unique_ptr<arm_compute::Tensor> data) {}
+    RequestID request_id,
+    std::unique_ptr<ExecutionUnitID> src_eu_id,
+    std::unique_ptr<ExecutionUnitID> dest_eu_id,
+    std::unique_ptr<arm_compute::Tensor> data,
+    const Range &rows,
+    Deadline deadline) {
+  orch_->on_receive_intermediate_result(request_id, std::move(src_eu_id),
+                                        std::move(dest_eu_id), std::move(data),
+                                        rows, deadline);
+}
+
+void NetworkEventHandler::deliver(IncomingMessage message) {
+  std::lock_guard<std::mutex> lock(receiver_mtx_);
+  if (message.epoch < epoch_) {
+    __android_log_print(ANDROID_LOG_WARN, "NetworkEventHandler::deliver",
+                        "Message of inference %u dropped; its plan %u was"
+                        " replaced", message.request_id, message.epoch);
+    return;
+  }
+  if (!orch_ || message.epoch > epoch_) {
+    held_messages_.push_back(std::move(message));
+    return;
+  }
+  pass(message);
+}
+
+void NetworkEventHandler::pass(IncomingMessage &message) {
+  switch (message.type) {
+    case MessageType::Result: {
+      on_receive_intermediate_result(
+          message.request_id, std::move(message.src_eu_id),
+          std::move(message.dest_eu_id), std::move(message.data), message.rows,
+          message.deadline);
+      break;
+    }
+    case MessageType::CompletionNotice: {
+      on_receive_completion_notice(message.request_id, *message.src_eu_id);
+      break;
+    }
+    case MessageType::AbortNotice: {
+      on_receive_abort_notice(message.request_id, message.status);
+      break;
+    }
+    case MessageType::Plan: {
+      break;
+    }
+  }
+}
+
+void NetworkEventHandler::sender_loop() {
+  while (const auto result = egress_queue_.pop()) {
+    // A result too late to be of use would only hold up the fresh ones
+    if (result->type == MessageType::Result &&
+        std::chrono::steady_clock::now() > result->deadline) {
+      __android_log_print(ANDROID_LOG_DEBUG, "NetworkEventHandler::sender_loop",
+                          "Result of inference %u dropped; its deadline passed",
+                          result->request_id);
+      send_expiry_notices(result->request_id, result->epoch);
+    } else {
+      transmit(*result);
+    }
+
+    std::lock_guard<std::mutex> lock(unsent_mtx_);
+    if (--num_unsent_ == 0) {
+      unsent_cv_.notify_all();
+    }
+  }
+}
+
+void NetworkEventHandler::send_expiry_notices(RequestID request_id,
+                                              uint32_t epoch) {
+  // The devices waiting for the result may never have seen the inference,
+  // and would not know it timed out; once is enough for all its results
+  if (last_expired_id_ == request_id) {
+    return;
+  }
+  last_expired_id_ = request_id;
+  for (const auto &device: device_map_) {
+    if (device.first == device_info_.id) {
+      continue;
+    }
+    // Not queued, as the sender thread would wait for itself
+    transmit(OutgoingResult{
+        .type = MessageType::AbortNotice,
+        .request_id = request_id,
+        .epoch = epoch,
+        .dest_device_id = device.first,
+        .status = InferenceStatus::TimedOut,
+    });
+  }
+}
+
+void NetworkEventHandler::sample_tcp_link(const DeviceID &device_id,
+                                          int peer_socket) {
+  // The kernel estimates the rate from the acknowledgements of the peer,
+  // over the data in flight, whatever the size of the messages
+  tcp_info info{};
+  socklen_t size = sizeof(info);
+  if (getsockopt(peer_socket, IPPROTO_TCP, TCP_INFO, &info, &size) < 0 ||
+      size < offsetof(tcp_info, tcpi_delivery_rate) +
+                 sizeof(info.tcpi_delivery_rate) ||
+      info.tcpi_delivery_rate == 0) {
+    return;
+  }
+  // Bytes per second to bytes per millisecond; the round trip in us
+  record_link_sample(device_id,
+                     static_cast<double>(info.tcpi_delivery_rate) / 1e3,
+                     info.tcpi_delivery_rate_app_limited != 0,
+                     static_cast<double>(info.tcpi_rtt) / 2e3);
+}
 
-void NetworkEventHandler::listener_loop() {}
+void NetworkEventHandler::record_link_sample(const DeviceID &device_id,
+                                             double bytes_per_ms,
+                                             bool is_lower_bound,
+                                             double latency_ms) {
+  std::lock_guard<std::mutex> lock(link_rates_mtx_);
+  const auto it = link_rates_.find(device_id);
+  if (it == link_rates_.end()) {
+    link_rates_.emplace(device_id, ClusterProfile::Link{
+        .bytes_per_ms = bytes_per_ms,
+        .latency_ms = latency_ms,
+    });
+    return;
+  }
+  ClusterProfile::Link &link = it->second;
+  // A sample limited by the traffic only shows the link is at least as fast
+  if (!is_lower_bound || bytes_per_ms > link.bytes_per_ms) {
+    link.bytes_per_ms += kLinkRateSmoothing * (bytes_per_ms - link.bytes_per_ms);
+  }
+  link.latency_ms += kLinkRateSmoothing * (latency_ms - link.latency_ms);
+}
+
+void NetworkEventHandler::measure_links(ClusterProfile &profile) {
+  std::lock_guard<std::mutex> lock(link_rates_mtx_);
+  for (const auto &link_rate: link_rates_) {
+    profile.links[device_info_.id][link_rate.first] = link_rate.second;
+  }
+}
+
+NetworkEventHandler::WireStats
+NetworkEventHandler::wire_stats(WireCodec codec) const {
+  std::lock_guard<std::mutex> lock(wire_stats_mtx_);
+  return wire_stats_[static_cast<size_t>(codec)];
+}
+
+void NetworkEventHandler::log_wire_stats() const {
+  static constexpr const char *kCodecNames[] = {"raw", "sparse", "fp16", "int8"};
+  for (size_t codec = 0; codec < std::size(kCodecNames); ++codec) {
+    const WireStats s = wire_stats(static_cast<WireCodec>(codec));
+    if (s.sent == 0 && s.received == 0) {
+      continue;
+    }
+    __android_log_print(
+        ANDROID_LOG_INFO, "NetworkEventHandler::log_wire_stats",
+        "%s: sent=%llu received=%llu ratio=%.2f encode=%.3f ms"
+        " decode=%.3f ms max_error=%g",
+        kCodecNames[codec], static_cast<unsigned long long>(s.sent),
+        static_cast<unsigned long long>(s.received), s.compression_ratio(),
+        s.encode_ms, s.decode_ms, s.max_error);
+  }
+}
+
+void NetworkEventHandler::encode_payload(const OutgoingResult &result,
+                                         FrameHeader &header,
+                                         size_t head_count) {
+  const arm_compute::ITensorInfo &info = *result.data->info();
+  const size_t raw_bytes = header.payload_bytes;
+  float max_error = 0;
+  double encode_ms = 0;
+  if (info.data_type() != arm_compute::DataType::F32) {
+    header.codec = static_cast<uint8_t>(WireCodec::Raw);
+  }
+
+  const auto codec = static_cast<WireCodec>(header.codec);
+  if (codec != WireCodec::Raw) {
+    const auto start = std::chrono::steady_clock::now();
+    const size_t count = info.tensor_shape().total_size();
+    const float *elements = nullptr;
+    if (send_iov_.size() == head_count + 1) {
+      elements = static_cast<const float *>(send_iov_[head_count].iov_base);
+    } else {
+      // A band of a multi-channel feature map; see `append_blocks`
+      gather_buffer_.resize(count);
+      auto *dst = reinterpret_cast<uint8_t *>(gather_buffer_.data());
+      for (size_t i = head_count; i < send_iov_.size(); ++i) {
+        std::memcpy(dst, send_iov_[i].iov_base, send_iov_[i].iov_len);
+        dst += send_iov_[i].iov_len;
+      }
+      elements = gather_buffer_.data();
+    }
+    encode_buffer_.resize(max_encoded_size(codec, count));
+    const size_t size = encode_elements(codec, elements, count,
+                                        encode_buffer_.data(), &max_error);
+    const std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    encode_ms = elapsed.count();
+
+    if (size < raw_bytes) {
+      send_iov_.resize(head_count);
+      send_iov_.push_back({encode_buffer_.data(), size});
+      header.payload_bytes = size;
+    } else {
+      header.codec = static_cast<uint8_t>(WireCodec::Raw);
+      max_error = 0;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(wire_stats_mtx_);
+  auto &stats = wire_stats_[header.codec];
+  ++stats.sent;
+  stats.raw_bytes += raw_bytes;
+  stats.encoded_bytes += header.payload_bytes;
+  stats.encode_ms += encode_ms;
+  stats.max_error = std::max(stats.max_error, max_error);
+}
+
+bool NetworkEventHandler::transmit(const OutgoingResult &result) {
+  static_assert(sizeof(FrameHeader) == 72,
+                "The frame header is part of the wire format");
+  FrameHeader header{};
+  header.magic = FrameHeader::kMagic;
+  header.type = static_cast<uint8_t>(result.type);
+  header.status = static_cast<uint8_t>(result.status);
+  header.request_id = result.request_id;
+  header.plan_epoch = result.epoch;
+  header.time_left_us = -1;
+  if (result.deadline != kNoDeadline) {
+    header.time_left_us = std::max<int64_t>(
+        0, std::chrono::duration_cast<std::chrono::microseconds>(
+               result.deadline - std::chrono::steady_clock::now())
+               .count());
+  }
+
+  send_iov_.clear();
+  send_iov_.push_back({&header, sizeof(header)});
+  if (result.type == MessageType::Plan) {
+    // The receiver tells the sender by its ID
+    header.status = static_cast<uint8_t>(result.plan_message);
+    header.src_eu_id_size = static_cast<uint16_t>(device_info_.id.size());
+    send_iov_.push_back({const_cast<char *>(device_info_.id.data()),
+                         device_info_.id.size()});
+  } else if (result.src_eu && !result.src_eu->id.empty()) {
+    header.src_eu_id_size = static_cast<uint16_t>(result.src_eu->id.size());
+    send_iov_.push_back({const_cast<char *>(result.src_eu->id.data()),
+                         result.src_eu->id.size()});
+  }
+  if (result.dest_eu && !result.dest_eu->id.empty()) {
+    header.dest_eu_id_size = static_cast<uint16_t>(result.dest_eu->id.size());
+    send_iov_.push_back({const_cast<char *>(result.dest_eu->id.data()),
+                         result.dest_eu->id.size()});
+  }
+
+  // The header and the IDs make the head of a ring record
+  const size_t head_count = send_iov_.size();
+
+  if (result.data) {
+    const arm_compute::ITensorInfo &info = *result.data->info();
+    const auto &shape = info.tensor_shape();
+    if (shape.num_dimensions() > FrameHeader::kMaxDims) {
+      __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::transmit",
+                          "Result of %zu dimensions cannot be sent",
+                          shape.num_dimensions());
+      return false;
+    }
+    header.data_type = static_cast<uint8_t>(info.data_type());
+    header.num_dims = static_cast<uint8_t>(shape.num_dimensions());
+    for (size_t d = 0; d < shape.num_dimensions(); ++d) {
+      header.dims[d] = static_cast<uint32_t>(shape[d]);
+    }
+    header.payload_bytes = shape.total_size() * info.element_size();
+    header.range_start = result.rows.start;
+    header.range_end = result.rows.end;
+    for (const auto &entry: result.src_eu->forward_table) {
+      if (entry.dest_eu_id == result.dest_eu->id) {
+        header.codec = static_cast<uint8_t>(entry.codec);
+        break;
+      }
+    }
+    // Straight from the buffer of the result; it stays alive until sent
+    append_blocks(*result.data, send_iov_);
+    encode_payload(result, header, head_count);
+  } else if (!result.payload.empty()) {
+    header.payload_bytes = result.payload.size();
+    send_iov_.push_back({const_cast<uint8_t *>(result.payload.data()),
+                         result.payload.size()});
+  }
+
+  if (SharedMemoryRing *ring = ring_to(result.dest_device_id)) {
+    // The message is delivered once it is copied into the ring
+    const auto start = std::chrono::steady_clock::now();
+    if (ring->push(send_iov_.data(), head_count, send_iov_.data() + head_count,
+                   send_iov_.size() - head_count, kRingSpaceTimeout)) {
+      const std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      if (result.type == MessageType::Result && elapsed.count() > 0) {
+        size_t bytes = 0;
+        for (const iovec &buffer: send_iov_) {
+          bytes += buffer.iov_len;
+        }
+        record_link_sample(result.dest_device_id,
+                           static_cast<double>(bytes) / elapsed.count(),
+                           false, 0);
+      }
+      return true;
+    }
+    if (ring->closed()) {
+      // Opened again with the next message, e.g., after the peer restarted
+      __android_log_print(ANDROID_LOG_WARN, "NetworkEventHandler::transmit",
+                          "Device %.*s hung up its ring; sending over TCP",
+                          static_cast<int>(result.dest_device_id.size()),
+                          result.dest_device_id.data());
+      peer_rings_.erase(result.dest_device_id);
+    } else {
+      __android_log_print(ANDROID_LOG_DEBUG, "NetworkEventHandler::transmit",
+                          "Message of inference %u does not fit in the ring,"
+                          " or the ring stayed full; sending over TCP",
+                          result.request_id);
+    }
+  }
+
+  // A lost connection is opened again once, e.g., after the peer restarted
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    const int peer_socket = connection_to(result.dest_device_id);
+    if (peer_socket < 0) {
+      return false;
+    }
+    if (send_all(peer_socket, send_iov_.data(), send_iov_.size())) {
+      // Notices are too small to keep the link busy
+      if (result.type == MessageType::Result) {
+        sample_tcp_link(result.dest_device_id, peer_socket);
+      }
+      return true;
+    }
+    close(peer_socket);
+    peer_sockets_.erase(result.dest_device_id);
+  }
+  __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::transmit",
+                      "Failed to send a message of inference %u to %.*s: %s",
+                      result.request_id,
+                      static_cast<int>(result.dest_device_id.size()),
+                      result.dest_device_id.data(), std::strerror(errno));
+  return false;
+}
+
+int NetworkEventHandler::connection_to(const DeviceID &device_id) {
+  const auto it = peer_sockets_.find(device_id);
+  if (it != peer_sockets_.end()) {
+    return it->second;
+  }
+
+  // Messages to a device that could not be reached are dropped meanwhile
+  const auto now = std::chrono::steady_clock::now();
+  const auto backoff = peer_backoffs_.find(device_id);
+  if (backoff != peer_backoffs_.end() && now < backoff->second.retry_time) {
+    __android_log_print(ANDROID_LOG_DEBUG, "NetworkEventHandler::connection_to",
+                        "Device %.*s is unreachable; message dropped",
+                        static_cast<int>(device_id.size()), device_id.data());
+    return -1;
+  }
+
+  const auto device = device_map_.find(device_id);
+  if (device == device_map_.end()) {
+    __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::connection_to",
+                        "Unknown device %.*s",
+                        static_cast<int>(device_id.size()), device_id.data());
+    return -1;
+  }
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<uint16_t>(device->second.port));
+  if (inet_pton(AF_INET, device->second.ip_address.c_str(),
+                &address.sin_addr) != 1) {
+    __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::connection_to",
+                        "Invalid address of device %.*s: %s",
+                        static_cast<int>(device_id.size()), device_id.data(),
+                        device->second.ip_address.c_str());
+    return -1;
+  }
+
+  const int peer_socket = connect_within(address, kConnectTimeout);
+  if (peer_socket < 0) {
+    Backoff &failed = peer_backoffs_[device_id];
+    failed.delay = std::clamp(failed.delay * 2, kMinRetryDelay, kMaxRetryDelay);
+    failed.retry_time = std::chrono::steady_clock::now() + failed.delay;
+    __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::connection_to",
+                        "Failed to connect to device %.*s at %s:%u: %s;"
+                        " retrying in %lld ms",
+                        static_cast<int>(device_id.size()), device_id.data(),
+                        device->second.ip_address.c_str(), device->second.port,
+                        std::strerror(errno),
+                        static_cast<long long>(failed.delay.count()));
+    return -1;
+  }
+  peer_backoffs_.erase(device_id);
+  // Notices are tiny; do not hold them back to coalesce
+  const int no_delay = 1;
+  setsockopt(peer_socket, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+  peer_sockets_.emplace(device_id, peer_socket);
+  return peer_socket;
+}
+
+SharedMemoryRing *NetworkEventHandler::ring_to(const DeviceID &device_id) {
+  const auto it = peer_rings_.find(device_id);
+  if (it != peer_rings_.end()) {
+    return it->second.get();
+  }
+  // Remembered either way, so that a device reached over TCP is not
+  // tried again with every message
+  auto &ring = peer_rings_[device_id];
+  const auto device = device_map_.find(device_id);
+  if (device == device_map_.end() || !is_same_host(device->second)) {
+    return nullptr;
+  }
+
+  sockaddr_un address{};
+  const socklen_t address_size = ring_address(device->second.port, address);
+  const int link = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (link < 0 ||
+      connect(link, reinterpret_cast<sockaddr *>(&address), address_size) < 0) {
+    __android_log_print(ANDROID_LOG_INFO, "NetworkEventHandler::ring_to",
+                        "Device %.*s takes no shared memory; sending over TCP",
+                        static_cast<int>(device_id.size()), device_id.data());
+    if (link >= 0) {
+      close(link);
+    }
+    return nullptr;
+  }
+  auto created = SharedMemoryRing::create(kRingCapacity, link);
+  if (!created) {
+    return nullptr;
+  }
+
+  // The descriptors go along a single byte, as a message needs some data
+  const int fds[kRingFds] = {created->memory_fd(), created->data_fd(),
+                             created->space_fd()};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+  char byte = 0;
+  iovec iov{&byte, sizeof(byte)};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  if (sendmsg(link, &message, MSG_NOSIGNAL) < 0) {
+    __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::ring_to",
+                        "Failed to hand the ring to device %.*s: %s",
+                        static_cast<int>(device_id.size()), device_id.data(),
+                        std::strerror(errno));
+    return nullptr;
+  }
+  __android_log_print(ANDROID_LOG_INFO, "NetworkEventHandler::ring_to",
+                      "Sending to device %.*s through shared memory",
+                      static_cast<int>(device_id.size()), device_id.data());
+  ring = std::move(created);
+  return ring.get();
+}
+
+bool NetworkEventHandler::is_same_host(const DeviceInfo &device) const {
+  return device.ip_address == device_info_.ip_address ||
+         device.ip_address.rfind("127.", 0) == 0;
+}
+
+void NetworkEventHandler::reactor_loop() {
+  epoll_event events[kMaxEvents];
+  while (!stop_flag_) {
+    const int num_events = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (num_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::reactor_loop",
+                          "Failed to wait for the sockets: %s",
+                          std::strerror(errno));
+      return;
+    }
+
+    bool any_closed = false;
+    for (int i = 0; i < num_events; ++i) {
+      auto *connection = static_cast<Connection *>(events[i].data.ptr);
+      // The listening socket, or the wake-up when stopping, which finds no
+      // pending connection
+      if (!connection) {
+        accept_connections();
+        continue;
+      }
+      // A ring link is watched twice, on its socket and on its ring, and
+      // both may be in the batch
+      if (connection->closed) {
+        continue;
+      }
+      // Hang-ups and errors surface as a failed `recv`
+      if (connection->is_ring_link
+              ? receive_records(*connection, events[i].events)
+              : receive_messages(*connection)) {
+        continue;
+      }
+      // Tensors still using the ring keep its eventfd open
+      if (connection->ring) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection->ring->data_fd(), nullptr);
+      }
+      close(connection->socket); // Also removes it from the epoll instance
+      connection->closed = true;
+      any_closed = true;
+    }
+
+    if (any_closed) {
+      connections_.erase(
+          std::remove_if(connections_.begin(), connections_.end(),
+                         [](const auto &accepted) { return accepted->closed; }),
+          connections_.end());
+    }
+  }
+}
+
+void NetworkEventHandler::accept_connections() {
+  for (const int listening_socket: {server_socket_, ring_server_socket_}) {
+    if (listening_socket < 0) {
+      continue;
+    }
+    // Edge-triggered: accept until there is no pending connection left
+    while (true) {
+      const int client_socket = accept4(listening_socket, nullptr, nullptr,
+                                        SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (client_socket < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) {
+          continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          __android_log_print(ANDROID_LOG_ERROR,
+                              "NetworkEventHandler::accept_connections",
+                              "Failed to accept a connection: %s",
+                              std::strerror(errno));
+        }
+        break;
+      }
+
+      auto connection = std::make_unique<Connection>();
+      connection->socket = client_socket;
+      connection->is_ring_link = listening_socket == ring_server_socket_;
+      epoll_event event{};
+      event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+      event.data.ptr = connection.get();
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_socket, &event) < 0) {
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "NetworkEventHandler::accept_connections",
+                            "Failed to watch a connection: %s",
+                            std::strerror(errno));
+        close(client_socket);
+        continue;
+      }
+      connections_.push_back(std::move(connection));
+    }
+  }
+}
+
+bool NetworkEventHandler::receive_messages(Connection &connection) {
+  using Stage = Connection::Stage;
+  // Edge-triggered: receive until the socket would block
+  while (true) {
+    switch (connection.stage) {
+      case Stage::Header: {
+        if (connection.buffered() < sizeof(FrameHeader)) {
+          break;
+        }
+        FrameHeader &header = connection.header;
+        std::memcpy(&header, connection.staging.data() + connection.begin,
+                    sizeof(header));
+        connection.begin += sizeof(header);
+        if (!header.well_formed() ||
+            size_t{header.src_eu_id_size} + header.dest_eu_id_size >
+                Connection::kStagingBytes) {
+          __android_log_print(ANDROID_LOG_ERROR,
+                              "NetworkEventHandler::receive_messages",
+                              "Malformed frame; closing the connection");
+          return false;
+        }
+        connection.stage = Stage::Ids;
+        continue;
+      }
+      case Stage::Ids: {
+        const FrameHeader &header = connection.header;
+        if (connection.buffered() <
+            size_t{header.src_eu_id_size} + header.dest_eu_id_size) {
+          break;
+        }
+        const char *ids = reinterpret_cast<const char *>(
+            connection.staging.data() + connection.begin);
+        connection.src_eu_id =
+            std::make_unique<ExecutionUnitID>(ids, header.src_eu_id_size);
+        connection.dest_eu_id = std::make_unique<ExecutionUnitID>(
+            ids + header.src_eu_id_size, header.dest_eu_id_size);
+        connection.begin += header.src_eu_id_size + header.dest_eu_id_size;
+
+        if (static_cast<MessageType>(header.type) == MessageType::Plan &&
+            header.payload_bytes > 0) {
+          if (header.payload_bytes > kMaxPlanPayload) {
+            __android_log_print(ANDROID_LOG_ERROR,
+                                "NetworkEventHandler::receive_messages",
+                                "Plan message of %llu bytes; closing the"
+                                " connection",
+                                static_cast<unsigned long long>(header.payload_bytes));
+            return false;
+          }
+          connection.encoded.resize(header.payload_bytes);
+          connection.payload = connection.encoded.data();
+          connection.payload_left = header.payload_bytes;
+          connection.stage = Stage::Payload;
+          continue;
+        }
+        if (static_cast<MessageType>(header.type) != MessageType::Result) {
+          // An empty plan payload, not what is left of an encoded result
+          connection.encoded.clear();
+          dispatch(connection);
+          connection.stage = Stage::Header;
+          continue;
+        }
+        if (!begin_result(connection)) {
+          return false;
+        }
+        connection.stage = Stage::Payload;
+        continue;
+      }
+      case Stage::Payload: {
+        const size_t staged =
+            std::min(connection.buffered(), connection.payload_left);
+        std::memcpy(connection.payload,
+                    connection.staging.data() + connection.begin, staged);
+        connection.begin += staged;
+        connection.payload += staged;
+        connection.payload_left -= staged;
+        if (connection.payload_left == 0) {
+          if (static_cast<MessageType>(connection.header.type) ==
+                  MessageType::Result &&
+              connection.header.codec != static_cast<uint8_t>(WireCodec::Raw) &&
+              !decode_payload(connection, connection.encoded.data())) {
+            return false;
+          }
+          dispatch(connection);
+          connection.stage = Stage::Header;
+          continue;
+        }
+
+        // The rest lands in the tensor directly
+        const ssize_t received = recv(connection.socket, connection.payload,
+                                      connection.payload_left, 0);
+        if (received > 0) {
+          connection.payload += received;
+          connection.payload_left -= static_cast<size_t>(received);
+          continue;
+        }
+        if (received < 0 && errno == EINTR) {
+          continue;
+        }
+        return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+      }
+    }
+
+    // The header or the IDs are incomplete; refill the staging buffer
+    if (connection.begin > 0) {
+      std::memmove(connection.staging.data(),
+                   connection.staging.data() + connection.begin,
+                   connection.buffered());
+      connection.end -= connection.begin;
+      connection.begin = 0;
+    }
+    const ssize_t received =
+        recv(connection.socket, connection.staging.data() + connection.end,
+             connection.staging.size() - connection.end, 0);
+    if (received > 0) {
+      connection.end += static_cast<size_t>(received);
+      continue;
+    }
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  }
+}
+
+bool NetworkEventHandler::receive_records(Connection &connection,
+                                          uint32_t events) {
+  if (!connection.ring) {
+    // The peer hands its ring over right after connecting
+    int fds[kRingFds] = {-1, -1, -1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    char byte = 0;
+    iovec iov{&byte, sizeof(byte)};
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    const ssize_t received =
+        recvmsg(connection.socket, &message, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return true;
+    }
+    const cmsghdr *cmsg = received > 0 ? CMSG_FIRSTHDR(&message) : nullptr;
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+      __android_log_print(ANDROID_LOG_ERROR,
+                          "NetworkEventHandler::receive_records",
+                          "No ring from a peer; closing the connection");
+      return false;
+    }
+    std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    connection.ring = SharedMemoryRing::attach(fds[0], fds[1], fds[2]);
+    if (!connection.ring) {
+      return false;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = &connection;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, connection.ring->data_fd(),
+                  &event) < 0) {
+      __android_log_print(ANDROID_LOG_ERROR,
+                          "NetworkEventHandler::receive_records",
+                          "Failed to watch a ring: %s", std::strerror(errno));
+      connection.ring.reset();
+      return false;
+    }
+  } else if (events & EPOLLIN) {
+    connection.ring->wake_up();
+  }
+
+  // Take the records until the ring is empty and the producer knows that
+  // the reactor waits for it
+  SharedMemoryRing &ring = *connection.ring;
+  do {
+    SharedMemoryRing::Record record;
+    while (ring.next(record)) {
+      if (record.head_size < sizeof(FrameHeader)) {
+        ring.release(record);
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "NetworkEventHandler::receive_records",
+                            "Malformed record; closing the connection");
+        return false;
+      }
+      FrameHeader &header = connection.header;
+      std::memcpy(&header, record.head, sizeof(header));
+      if (!header.well_formed() ||
+          sizeof(header) + header.src_eu_id_size + header.dest_eu_id_size !=
+              record.head_size) {
+        ring.release(record);
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "NetworkEventHandler::receive_records",
+                            "Malformed record; closing the connection");
+        return false;
+      }
+      const char *ids =
+          reinterpret_cast<const char *>(record.head + sizeof(header));
+      connection.src_eu_id =
+          std::make_unique<ExecutionUnitID>(ids, header.src_eu_id_size);
+      connection.dest_eu_id = std::make_unique<ExecutionUnitID>(
+          ids + header.src_eu_id_size, header.dest_eu_id_size);
+
+      if (static_cast<MessageType>(header.type) == MessageType::Plan) {
+        const bool valid = record.payload_size == header.payload_bytes &&
+                           header.payload_bytes <= kMaxPlanPayload;
+        if (valid) {
+          connection.encoded.assign(record.payload,
+                                    record.payload + record.payload_size);
+        }
+        ring.release(record);
+        if (!valid) {
+          return false;
+        }
+        dispatch(connection);
+        continue;
+      }
+      if (static_cast<MessageType>(header.type) != MessageType::Result) {
+        ring.release(record);
+        dispatch(connection);
+        continue;
+      }
+      if (!result_info(connection)) {
+        ring.release(record);
+        return false;
+      }
+      if (header.codec != static_cast<uint8_t>(WireCodec::Raw)) {
+        const bool decoded = record.payload_size == header.payload_bytes &&
+                             decode_payload(connection, record.payload);
+        ring.release(record);
+        if (!decoded) {
+          return false;
+        }
+        dispatch(connection);
+        continue;
+      }
+      if (record.payload_size != header.payload_bytes) {
+        ring.release(record);
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "NetworkEventHandler::receive_records",
+                            "Payload of %zu bytes where %llu are announced;"
+                            " closing the connection",
+                            record.payload_size,
+                            static_cast<unsigned long long>(header.payload_bytes));
+        return false;
+      }
+      // The Orchestrator gets the payload in place
+      connection.data = ring.wrap(record, connection.info);
+      if (connection.data) {
+        dispatch(connection);
+      }
+    }
+    if (ring.corrupt()) {
+      __android_log_print(ANDROID_LOG_ERROR,
+                          "NetworkEventHandler::receive_records",
+                          "Malformed ring; closing the connection");
+      return false;
+    }
+  } while (!ring.sleep());
+
+  // Nothing but the hang-up comes on the Unix socket
+  return (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) == 0;
+}
+
+bool NetworkEventHandler::result_info(Connection &connection) const {
+  const FrameHeader &header = connection.header;
+  arm_compute::TensorShape shape;
+  for (size_t d = 0; d < header.num_dims; ++d) {
+    shape.set(d, header.dims[d]);
+  }
+  arm_compute::TensorInfo &info = connection.info;
+  info = arm_compute::TensorInfo(
+      shape, 1, static_cast<arm_compute::DataType>(header.data_type));
+  // Only F32 results are encoded, and never to more than the raw elements
+  const auto codec = static_cast<WireCodec>(header.codec);
+  const size_t raw_bytes = shape.total_size() * info.element_size();
+  if (codec == WireCodec::Raw
+          ? header.payload_bytes != raw_bytes
+          : info.data_type() != arm_compute::DataType::F32 ||
+                header.payload_bytes >= raw_bytes) {
+    __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::result_info",
+                        "Payload of %llu bytes does not match its shape;"
+                        " closing the connection",
+                        static_cast<unsigned long long>(header.payload_bytes));
+    return false;
+  }
+  const Range range{header.range_start, header.range_end};
+  if (shape.num_dimensions() > 0 &&
+      range.num_elements() != static_cast<int>(shape[range_axis(shape)])) {
+    const ExecutionUnitID &src_eu_id = *connection.src_eu_id;
+    const ExecutionUnitID &dest_eu_id = *connection.dest_eu_id;
+    __android_log_print(ANDROID_LOG_WARN, "NetworkEventHandler::result_info",
+                        "Result of %.*s for %.*s covers rows [%d, %d), but"
+                        " has %zu",
+                        static_cast<int>(src_eu_id.size()), src_eu_id.data(),
+                        static_cast<int>(dest_eu_id.size()), dest_eu_id.data(),
+                        range.start, range.end, shape[range_axis(shape)]);
+  }
+  return true;
+}
+
+bool NetworkEventHandler::begin_result(Connection &connection) {
+  if (!result_info(connection)) {
+    return false;
+  }
+  connection.payload_left = connection.header.payload_bytes;
+  // An encoded result is decoded into its tensor once complete
+  if (connection.header.codec != static_cast<uint8_t>(WireCodec::Raw)) {
+    connection.encoded.resize(connection.payload_left);
+    connection.payload = connection.encoded.data();
+    return true;
+  }
+
+  // The elements land in the tensor handed to the Orchestrator
+  connection.data = TensorPool::instance().allocate(connection.info);
+  if (!connection.data) {
+    return false;
+  }
+  connection.payload = connection.data->buffer() +
+                       connection.data->info()->offset_first_element_in_bytes();
+  return true;
+}
+
+bool NetworkEventHandler::decode_payload(Connection &connection,
+                                         const uint8_t *encoded) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto codec = static_cast<WireCodec>(connection.header.codec);
+  connection.data = TensorPool::instance().allocate(connection.info);
+  if (!connection.data) {
+    return false;
+  }
+  auto *elements = reinterpret_cast<float *>(
+      connection.data->buffer() +
+      connection.data->info()->offset_first_element_in_bytes());
+  if (!decode_elements(codec, encoded, connection.header.payload_bytes,
+                       elements, connection.info.tensor_shape().total_size())) {
+    __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::decode_payload",
+                        "Malformed encoding of a result; closing the connection");
+    connection.data.reset();
+    return false;
+  }
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::lock_guard<std::mutex> lock(wire_stats_mtx_);
+  auto &stats = wire_stats_[static_cast<size_t>(codec)];
+  ++stats.received;
+  stats.decode_ms += elapsed.count();
+  return true;
+}
+
+void NetworkEventHandler::dispatch(Connection &connection) {
+  const FrameHeader &header = connection.header;
+  const auto type = static_cast<MessageType>(header.type);
+  if (type == MessageType::Plan) {
+    // The protocol runs between the plans, so it is never held
+    if (header.status > static_cast<uint8_t>(PlanMessage::Cancel)) {
+      __android_log_print(ANDROID_LOG_ERROR, "NetworkEventHandler::dispatch",
+                          "Unknown plan message %u dropped", header.status);
+      return;
+    }
+    if (plan_callback_) {
+      std::vector<uint8_t> payload;
+      payload.swap(connection.encoded);
+      plan_callback_(static_cast<PlanMessage>(header.status),
+                     *connection.src_eu_id, header.plan_epoch,
+                     std::move(payload));
+    }
+    return;
+  }
+
+  IncomingMessage message{
+      .type = type,
+      .request_id = header.request_id,
+      .epoch = header.plan_epoch,
+      .src_eu_id = std::move(connection.src_eu_id),
+      .dest_eu_id = std::move(connection.dest_eu_id),
+      .status = static_cast<InferenceStatus>(header.status),
+  };
+  if (type == MessageType::Result) {
+    message.data = std::move(connection.data);
+    message.rows = Range{header.range_start, header.range_end};
+    message.deadline = header.time_left_us < 0
+                           ? kNoDeadline
+                           : std::chrono::steady_clock::now() +
+                                 std::chrono::microseconds(header.time_left_us);
+  }
+  deliver(std::move(message));
+}
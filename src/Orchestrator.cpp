@@ -1,202 +1,1161 @@
 #include "edgeflow/Orchestrator.h"
+#include "edgeflow/Partitioner.h"
+#include "edgeflow/TensorPool.h"
+#include "edgeflow/TensorUtils.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+InferenceRequest::InferenceRequest(const ExecutionPlan &plan,
+                                   size_t arena_size)
+    : input_states(plan.size()),
+      received_inputs(std::make_unique<std::atomic<bool>[]>(plan.num_inputs())) {
+  for (EUHandle handle = 0; handle < plan.size(); ++handle) {
+    auto &input_state = input_states[handle];
+    input_state.num_expected = plan.unit(handle).num_input_rows;
+    input_state.num_pending.store(input_state.num_expected,
+                                  std::memory_order_relaxed);
+  }
+
+  // Allocate the arena for the intermediate tensors
+  if (arena_size > 0) {
+    arena_tensor.allocator()->init(arm_compute::TensorInfo(
+        arm_compute::TensorShape(arena_size), 1, arm_compute::DataType::U8));
+    arena_tensor.allocator()->allocate();
+    arena = arena_tensor.buffer();
+  }
+
+  if (plan.num_local_leaves() > 0) {
+    output.allocator()->init(arm_compute::TensorInfo(
+        plan.output_shape(), 1, arm_compute::DataType::F32));
+    output.allocator()->allocate();
+  }
+}
 
 Orchestrator::Orchestrator(const ModelDAG &dag,
                            const DeviceInfo &device_info,
-                           const DeviceMap &device_map)
+                           const DeviceMap &device_map,
+                           const MemoryPlan &memory_plan,
+                           const ExecutionPlan &plan,
+                           size_t max_in_flight,
+                           NetworkEventHandler *network_event_handler,
+                           const EngineOptions &engine_options)
     : dag_(std::move(dag)), device_info_(std::move(device_info)),
-      device_map_(std::move(device_map)) {
+      device_map_(std::move(device_map)), memory_plan_(memory_plan),
+      plan_(plan), network_event_handler_(network_event_handler) {
+  // Every request state is allocated up front, arena included
+  for (size_t i = 0; i < std::max<size_t>(1, max_in_flight); ++i) {
+    requests_.push_back(
+        std::make_unique<InferenceRequest>(plan_, memory_plan_.arena_size));
+    free_requests_.push_back(requests_.back().get());
+  }
+
+  // The devices hand out the IDs of their inferences in interleaved
+  // sequences, in the order of their IDs, so that no two collide
+  std::vector<DeviceID> device_ids;
+  for (const auto &device: device_map_) {
+    device_ids.push_back(device.first);
+  }
+  std::sort(device_ids.begin(), device_ids.end());
+  const auto it = std::find(device_ids.begin(), device_ids.end(), device_info_.id);
+  num_devices_ = static_cast<RequestID>(std::max<size_t>(1, device_ids.size()));
+  device_index_ = it != device_ids.end()
+                      ? static_cast<RequestID>(it - device_ids.begin())
+                      : 0;
+  next_request_id_ = device_index_;
+
+  // Every device with execution units takes part in every inference
+  tracks_settled_ = plan_.num_local_units() + plan_.num_backup_units() > 0;
+  settled_ahead_.resize(num_devices_);
+  for (RequestID index = 0; index < num_devices_; ++index) {
+    settled_below_.push_back(index);
+  }
+
   // Initialize the computation engine
-  computation_engine_ = std::make_unique<ComputationEngine>(*this, dag_);
+  computation_engine_ =
+      std::make_unique<ComputationEngine>(*this, plan_, engine_options);
 
   // Initialize the network listener
-  network_event_handler_ = std::make_unique<NetworkEventHandler>(
-      *this, device_info_, device_map_);
-  network_event_handler_->start_listening(device_info_.port);
+  if (!network_event_handler_) {
+    owned_network_event_handler_ =
+        std::make_unique<NetworkEventHandler>(device_info_, device_map_);
+    network_event_handler_ = owned_network_event_handler_.get();
+    network_event_handler_->attach(*this, 0);
+    network_event_handler_->start_listening(device_info_.port);
+  }
 
-  // Initialize the input states for each execution unit
-  for (const auto &eu_map: dag_.eus) {
-    const ExecutionUnit &eu = eu_map.second;
-    if (eu.assigned_device == device_info_.id) {
-      // Initialize the input state for the execution unit
-      input_states_[eu.id].num_expected = eu.input_requirements.size();
+  // Backup copies wait for the primary copy on their own thread
+  if (plan_.num_backup_units() > 0) {
+    lag_histories_.resize(plan_.size());
+    for (EUHandle handle = 0; handle < plan_.size(); ++handle) {
+      if (plan_.unit(handle).is_backup) {
+        lag_histories_[handle] = std::make_unique<LagHistory>();
+      }
     }
+    speculation_thread_ = std::thread(&Orchestrator::speculation_loop, this);
   }
+  deadline_thread_ = std::thread(&Orchestrator::deadline_loop, this);
 }
 
-Orchestrator::~Orchestrator() = default;
+Orchestrator::~Orchestrator() {
+  // No message reaches the Orchestrator once it is being destroyed
+  network_event_handler_->detach();
+
+  // Stop the workers before the request states they use are destroyed
+  {
+    std::lock_guard<std::mutex> lock(deadline_mtx_);
+    stop_deadlines_ = true;
+  }
+  deadline_cv_.notify_all();
+  if (deadline_thread_.joinable()) {
+    deadline_thread_.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(speculation_mtx_);
+    stop_speculation_ = true;
+  }
+  speculation_cv_.notify_all();
+  if (speculation_thread_.joinable()) {
+    speculation_thread_.join();
+  }
+  computation_engine_.reset();
+  owned_network_event_handler_.reset();
+}
 
 void Orchestrator::register_inference_complete_callback(
     Orchestrator::Callback inference_complete_callback) {
   inference_complete_callback_ = std::move(inference_complete_callback);
 }
 
-bool Orchestrator::start_inference(std::unique_ptr<arm_compute::Tensor> input) {
-  std::lock_guard<std::mutex> lock(orch_mtx_);
+std::optional<RequestID>
+Orchestrator::start_inference(std::unique_ptr<arm_compute::Tensor> input,
+                              Deadline deadline) {
+  // Check the root execution units before anything runs, so that a
+  // malformed one does not leave a request half started
+  const auto &root_eus = plan_.local_roots();
+  for (const EUHandle root: root_eus) {
+    const ExecutionUnit &eu = plan_.eu(root);
+    // The whole input, or a band of it for a partitioned root layer
+    if (!eu.input_requirements.empty() &&
+        !(eu.input_requirements.size() == 1 &&
+          eu.input_requirements.begin()->second.src_eu_id == kModelInputID)) {
+      __android_log_print(
+          ANDROID_LOG_ERROR, "Orchestrator::start_inference",
+          "Input requirements for execution unit %.*s are not empty: %zu"
+          " which should be empty or a band of the model input for the"
+          " root execution unit",
+          static_cast<int>(eu.id.size()), eu.id.data(),
+          eu.input_requirements.size());
+      return std::nullopt;
+    }
+  }
 
-  // Clean up the previous outputs
-  collected_final_outputs_.clear();
-  int exit_eu_on_this_device = 0;
-  for (std::pair<const ExecutionUnitID, InputState> &eu_state: input_states_) {
-    const auto &eu_id = eu_state.first;
-    const auto eu = get_execution_unit(eu_id);
-    if (!eu) {
+  InferenceRequest *request;
+  RequestID request_id;
+  {
+    std::lock_guard<std::mutex> lock(requests_mtx_);
+    // Reject an inference that would time out anyway rather than let it
+    // hold up the others. The plan predicts it end to end, network hops
+    // included, from the latest measurements of the devices and links.
+    if (deadline != kNoDeadline) {
+      const std::chrono::duration<double, std::milli> time_left =
+          deadline - std::chrono::steady_clock::now();
+      if (time_left.count() <= plan_.predicted_latency_ms()) {
+        __android_log_print(ANDROID_LOG_WARN, "Orchestrator::start_inference",
+                            "Inference rejected; %.3f ms left before its"
+                            " deadline, %.3f ms predicted",
+                            time_left.count(), plan_.predicted_latency_ms());
+        return std::nullopt;
+      }
+    }
+    if (free_requests_.empty()) {
       __android_log_print(ANDROID_LOG_ERROR, "Orchestrator::start_inference",
-                          "Execution unit %.*s not found in the DAG",
-                          static_cast<int>(eu_id.size()), eu_id.data());
+                          "Inference rejected; too many inferences in flight"
+                          " (limit: %zu)", requests_.size());
+      return std::nullopt;
+    }
+    // Only the inferences started take an ID, so that every device sees
+    // all of them
+    request_id = next_request_id_;
+    next_request_id_ += num_devices_;
+    request = take_request(request_id, deadline);
+    // Held until the roots are submitted, as the deadline may pass meanwhile
+    request->num_pending_eus.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (plan_.num_local_leaves() == 0) {
+    __android_log_print(ANDROID_LOG_WARN, "Orchestrator::start_inference",
+                        "No leaf execution units on this device!");
+  }
+
+  // Initiate the inference on the root execution units
+  const auto &input_shape = input->info()->tensor_shape();
+  const Range whole_input = {
+      0, static_cast<int>(input_shape[range_axis(input_shape)])};
+  for (size_t i = 0; i < root_eus.size(); ++i) {
+    const ExecutionUnit &eu = plan_.eu(root_eus[i]);
+    std::unique_ptr<arm_compute::Tensor> eu_input;
+
+    // Handle the root execution unit (i.e., input layer)
+    if (eu.input_requirements.empty()) {
+      // The whole input; the last root takes the caller's tensor
+      eu_input = (i + 1 == root_eus.size()) ? std::move(input)
+                                             : copy_slab(*input, whole_input);
+    } else {
+      // A band of the input for a partitioned root layer, within the input
+      eu_input = copy_slab(*input, plan_.inputs(root_eus[i]).begin()->src_rows);
+    }
+    if (!eu_input) {
+      // The roots not submitted yet are settled without running
+      __android_log_print(ANDROID_LOG_ERROR, "Orchestrator::start_inference",
+                          "Failed to allocate the input of execution unit"
+                          " %.*s; aborting inference %u",
+                          static_cast<int>(eu.id.size()), eu.id.data(),
+                          request_id);
+      abort_request(*request, InferenceStatus::Failed, true);
+      break;
+    }
+
+    // Start the inference on the root execution unit, unless an abort
+    // settled it already
+    if (!request->input_states[root_eus[i]].submitted.exchange(
+            true, std::memory_order_acq_rel)) {
+      computation_engine_->submit_task(*request, root_eus[i], std::move(eu_input));
+    }
+  }
+  finish_unit(*request);
+
+  return request_id;
+}
+
+bool Orchestrator::cancel_inference(RequestID request_id) {
+  {
+    std::lock_guard<std::mutex> lock(requests_mtx_);
+    // Only the IDs this device handed out
+    if (request_id % num_devices_ != device_index_ ||
+        request_id >= next_request_id_) {
       return false;
     }
+  }
+
+  InferenceRequest *request = pin_request(request_id);
+  if (request) {
+    abort_request(*request, InferenceStatus::Cancelled, true);
+    finish_unit(*request);
+    return true;
+  }
 
-    // Clean up the input state
-    auto &input_state = eu_state.second;
-    input_state.received.clear();
-    input_state.num_received = 0;
+  // Done on this device; the others may still run it
+  send_abort_notices(request_id, InferenceStatus::Cancelled);
+  return true;
+}
 
-    // Find the number of leaf execution units on this device
-    if (eu->is_leaf && eu->assigned_device == device_info_.id) {
-      ++exit_eu_on_this_device;
+InferenceRequest *Orchestrator::pin_request(RequestID request_id) {
+  std::lock_guard<std::mutex> lock(requests_mtx_);
+  const auto it = active_requests_.find(request_id);
+  if (it == active_requests_.end()) {
+    return nullptr;
+  }
+  return pin(*it->second) ? it->second : nullptr;
+}
+
+bool Orchestrator::pin(InferenceRequest &request) {
+  // The last unit may be completing; a released request is not revived
+  size_t num_pending = request.num_pending_eus.load(std::memory_order_acquire);
+  do {
+    if (num_pending == 0) {
+      return false;
+    }
+  } while (!request.num_pending_eus.compare_exchange_weak(
+      num_pending, num_pending + 1, std::memory_order_acq_rel,
+      std::memory_order_acquire));
+  return true;
+}
+
+InferenceRequest *Orchestrator::acquire_request(RequestID request_id,
+                                                Deadline deadline) {
+  {
+    std::lock_guard<std::mutex> lock(requests_mtx_);
+    const auto it = active_requests_.find(request_id);
+    if (it != active_requests_.end()) {
+      return pin(*it->second) ? it->second : nullptr;
+    }
+    if (is_settled(request_id)) {
+      // A late result, e.g., of the losing copy of a unit
+      __android_log_print(ANDROID_LOG_DEBUG, "Orchestrator::acquire_request",
+                          "Inference %u is already settled; message dropped",
+                          request_id);
+      return nullptr;
+    }
+    if (!free_requests_.empty()) {
+      InferenceRequest *request = take_request(request_id, deadline);
+      request->num_pending_eus.fetch_add(1, std::memory_order_relaxed);
+      return request;
     }
+    // Its later messages are dropped as well
+    settle(request_id);
   }
-  num_pending_leaf_eus_.store(exit_eu_on_this_device);
-  if (num_pending_leaf_eus_ == 0) {
-    __android_log_print(ANDROID_LOG_WARN, "Orchestrator::start_inference", "No leaf execution units on this device!");
+
+  // The inference cannot complete without this device
+  __android_log_print(ANDROID_LOG_ERROR, "Orchestrator::acquire_request",
+                      "Inference %u failed; too many inferences in flight"
+                      " (limit: %zu)",
+                      request_id, requests_.size());
+  if (plan_.num_local_leaves() > 0 && inference_complete_callback_) {
+    // This device reports the inference, and there is no request to do it
+    const arm_compute::Tensor no_output;
+    inference_complete_callback_(request_id, InferenceStatus::Failed, no_output);
   }
+  send_abort_notices(request_id, InferenceStatus::Failed);
+  return nullptr;
+}
 
-  // Initiate the inference by checking the root execution units
-  for (std::pair<const ExecutionUnitID, InputState> &eu_state: input_states_) {
-    const auto &eu_id = eu_state.first;
-    const auto eu = get_execution_unit(eu_id);
+InferenceRequest *Orchestrator::take_request(RequestID request_id,
+                                             Deadline deadline) {
+  InferenceRequest *request = free_requests_.back();
+  free_requests_.pop_back();
 
-    // Handle the root execution unit (i.e., input layer)
-    if (eu->is_root && eu->assigned_device == device_info_.id) {
-      if (eu->input_requirements.empty()) {
-        // Start the inference on the root execution unit
-        computation_engine_->submit_task(*eu, std::move(input));
-      } else {
-        __android_log_print(
-            ANDROID_LOG_ERROR, "Orchestrator::start_inference",
-            "Input requirements for execution unit %.*s are not empty: %zu"
-            " which should be empty for the root execution unit",
-            static_cast<int>(eu_id.size()), eu_id.data(),
-            eu->input_requirements.size());
+  // The input states were re-armed by the previous inference, unless it
+  // was aborted with inputs partly assembled
+  request->id = request_id;
+  request->deadline = deadline;
+  const bool was_aborted = request->aborted.exchange(false, std::memory_order_relaxed);
+  for (auto &input_state: request->input_states) {
+    if (was_aborted) {
+      delete input_state.input.exchange(nullptr, std::memory_order_relaxed);
+      input_state.num_pending.store(input_state.num_expected,
+                                    std::memory_order_relaxed);
+    }
+    input_state.submitted.store(false, std::memory_order_relaxed);
+  }
+  request->reported.store(false, std::memory_order_relaxed);
+  if (!plan_.speculative_units().empty()) {
+    for (size_t i = 0; i < plan_.num_inputs(); ++i) {
+      request->received_inputs[i].store(false, std::memory_order_relaxed);
+    }
+    for (const EUHandle handle: plan_.speculative_units()) {
+      auto &input_state = request->input_states[handle];
+      input_state.resolved.store(false, std::memory_order_relaxed);
+      // The input settled, and the unit resolved
+      input_state.num_pending_events.store(2, std::memory_order_relaxed);
+      input_state.ready_time.store(0, std::memory_order_relaxed);
+    }
+  }
+  request->num_pending_eus.store(plan_.num_local_units() +
+                                 plan_.num_backup_units());
+  request->num_pending_leaf_eus.store(plan_.num_local_leaves());
+  request->start_time = std::chrono::steady_clock::now();
+  active_requests_.emplace(request_id, request);
+
+  if (deadline != kNoDeadline) {
+    {
+      std::lock_guard<std::mutex> deadline_lock(deadline_mtx_);
+      deadlines_.emplace_back(deadline, request_id);
+      std::push_heap(deadlines_.begin(), deadlines_.end(),
+                     std::greater<PendingDeadline>());
+    }
+    deadline_cv_.notify_one();
+  }
+  return request;
+}
+
+void Orchestrator::settle(RequestID request_id) {
+  if (!tracks_settled_) {
+    return;
+  }
+  const RequestID origin = request_id % num_devices_;
+  RequestID &below = settled_below_[origin];
+  std::set<RequestID> &ahead = settled_ahead_[origin];
+  if (request_id < below) {
+    return;
+  }
+  ahead.insert(request_id);
+  if (request_id != below) {
+    return;
+  }
+  // The IDs of a device are `num_devices_` apart
+  while (!ahead.empty() && *ahead.begin() == below) {
+    ahead.erase(ahead.begin());
+    below += num_devices_;
+  }
+  settled_cv_.notify_all();
+}
+
+bool Orchestrator::is_settled(RequestID request_id) const {
+  if (!tracks_settled_) {
+    return false;
+  }
+  const RequestID origin = request_id % num_devices_;
+  return request_id < settled_below_[origin] ||
+         settled_ahead_[origin].count(request_id) > 0;
+}
+
+void Orchestrator::release_request(InferenceRequest &request) {
+  DriftCallback drift_callback = nullptr;
+  double latency_ms = 0, baseline_ms = 0;
+  {
+    std::lock_guard<std::mutex> lock(requests_mtx_);
+    active_requests_.erase(request.id);
+    settle(request.id);
+    free_requests_.push_back(&request);
+
+    // Measure the stage over windows of completed inferences; the state is
+    // not taken again before the lock is released
+    if (request.aborted.load(std::memory_order_relaxed)) {
+      return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    window_latency_ += now - request.start_time;
+    if (++stage_stats_.num_completed % kStatsWindow != 0) {
+      return;
+    }
+    const auto busy_time = computation_engine_->busy_time();
+    if (stage_stats_.num_completed > kStatsWindow) {
+      const std::chrono::duration<double> elapsed = now - window_start_;
+      const std::chrono::duration<double> busy = busy_time - window_start_busy_time_;
+      const std::chrono::duration<double, std::milli> latency = window_latency_;
+      stage_stats_.throughput = static_cast<double>(kStatsWindow) / elapsed.count();
+      stage_stats_.utilization = busy.count() / elapsed.count();
+      stage_stats_.latency_ms = latency.count() / static_cast<double>(kStatsWindow);
+      __android_log_print(ANDROID_LOG_INFO, "Orchestrator::release_request",
+                          "Stage throughput: %.2f inferences/s,"
+                          " utilization: %.1f%%, latency: %.3f ms",
+                          stage_stats_.throughput,
+                          stage_stats_.utilization * 100.0,
+                          stage_stats_.latency_ms);
+      if (plan_.num_backup_units() > 0) {
+        const SpeculationStats speculation = speculation_stats();
+        __android_log_print(ANDROID_LOG_INFO, "Orchestrator::release_request",
+                            "Speculation: %zu backup copies run, %zu won",
+                            speculation.num_triggered, speculation.num_won);
+      }
+
+      // The first window after filling the pipeline is the baseline
+      if (baseline_latency_ms_ == 0) {
+        baseline_latency_ms_ = stage_stats_.latency_ms;
+      } else if (drift_callback_ &&
+                 std::abs(stage_stats_.latency_ms - baseline_latency_ms_) >
+                     kDriftThreshold * baseline_latency_ms_) {
+        drift_callback = std::move(drift_callback_);
+        drift_callback_ = nullptr;
+        latency_ms = stage_stats_.latency_ms;
+        baseline_ms = baseline_latency_ms_;
+      }
+    }
+    window_start_ = now;
+    window_start_busy_time_ = busy_time;
+    window_latency_ = std::chrono::nanoseconds(0);
+  }
+
+  if (drift_callback) {
+    __android_log_print(ANDROID_LOG_WARN, "Orchestrator::release_request",
+                        "Latency drifted from %.3f ms to %.3f ms",
+                        baseline_ms, latency_ms);
+    drift_callback(latency_ms, baseline_ms);
+  }
+}
+
+Orchestrator::StageStats Orchestrator::stage_stats() {
+  std::lock_guard<std::mutex> lock(requests_mtx_);
+  return stage_stats_;
+}
+
+void Orchestrator::measure_profile(ClusterProfile &profile) {
+  double macs = 0, run_time_ms = 0;
+  for (EUHandle handle = 0; handle < plan_.size(); ++handle) {
+    const double eu_run_time_ms = computation_engine_->mean_run_time(handle);
+    if (!plan_.unit(handle).is_local || eu_run_time_ms <= 0) {
+      continue;
+    }
+    macs += Partitioner::eu_macs(plan_.eu(handle));
+    run_time_ms += eu_run_time_ms;
+  }
+  if (run_time_ms > 0) {
+    profile.macs_per_ms[device_info_.id] = macs / run_time_ms;
+  }
+
+  network_event_handler_->measure_links(profile);
+}
+
+void Orchestrator::register_drift_callback(DriftCallback drift_callback) {
+  std::lock_guard<std::mutex> lock(requests_mtx_);
+  drift_callback_ = std::move(drift_callback);
+}
+
+RequestID Orchestrator::next_request_id() {
+  std::lock_guard<std::mutex> lock(requests_mtx_);
+  return next_request_id_;
+}
+
+void Orchestrator::wait_settled(const std::vector<RequestID> &boundaries) {
+  std::unique_lock<std::mutex> lock(requests_mtx_);
+  if (!tracks_settled_ || boundaries.size() != num_devices_) {
+    return;
+  }
+  settled_cv_.wait(lock, [&] {
+    for (RequestID index = 0; index < num_devices_; ++index) {
+      if (settled_below_[index] < boundaries[index]) {
         return false;
       }
     }
+    return true;
+  });
+}
+
+void Orchestrator::resume_request_ids(const std::vector<RequestID> &boundaries) {
+  std::lock_guard<std::mutex> lock(requests_mtx_);
+  if (boundaries.size() != num_devices_) {
+    return;
   }
+  settled_below_ = boundaries;
+  next_request_id_ = boundaries[device_index_];
+}
 
-  return true;
+std::unordered_map<LayerID, double> Orchestrator::layer_costs() {
+  std::unordered_map<LayerID, double> costs;
+  for (EUHandle handle = 0; handle < plan_.size(); ++handle) {
+    if (plan_.unit(handle).is_local) {
+      costs[plan_.eu(handle).layer->id] +=
+          computation_engine_->mean_run_time(handle);
+    }
+  }
+  return costs;
 }
 
 void Orchestrator::on_receive_intermediate_result(
+    RequestID request_id,
     std::unique_ptr<ExecutionUnitID> src_eu_id,
     std::unique_ptr<ExecutionUnitID> dest_eu_id,
-    std::unique_ptr<arm_compute::Tensor> data) {
-  // TODO: handle the received intermediate result
+    std::unique_ptr<arm_compute::Tensor> data,
+    const Range &rows,
+    Deadline deadline) {
+  // The wire carries string IDs; resolve them once per message
+  const EUHandle dest = plan_.find(*dest_eu_id);
+  const EUHandle src = plan_.find(*src_eu_id);
+  if (dest == kInvalidEUHandle ||
+      !(plan_.unit(dest).is_local || plan_.unit(dest).is_backup) ||
+      src == kInvalidEUHandle) {
+    __android_log_print(ANDROID_LOG_ERROR,
+                        "Orchestrator::on_receive_intermediate_result",
+                        "Invalid intermediate result from %.*s to %.*s",
+                        static_cast<int>(src_eu_id->size()), src_eu_id->data(),
+                        static_cast<int>(dest_eu_id->size()), dest_eu_id->data());
+    return;
+  }
+
+  InferenceRequest *request = acquire_request(request_id, deadline);
+  if (!request) {
+    return;
+  }
+  check_and_run_eu(*request, dest, src, std::move(data), rows);
+  finish_unit(*request);
+}
+
+void Orchestrator::on_receive_abort_notice(RequestID request_id,
+                                           InferenceStatus status) {
+  // A device with leaf units takes the request, if it has not yet, to
+  // report it; one settled already is done here
+  InferenceRequest *request = plan_.num_local_leaves() > 0
+                                  ? acquire_request(request_id)
+                                  : pin_request(request_id);
+  if (!request) {
+    if (plan_.num_local_leaves() > 0) {
+      return;
+    }
+    // The results of the inference may never come; none is waited for
+    std::lock_guard<std::mutex> lock(requests_mtx_);
+    if (active_requests_.find(request_id) == active_requests_.end()) {
+      settle(request_id);
+    }
+    return;
+  }
+  abort_request(*request, status, false);
+  finish_unit(*request);
+}
+
+void Orchestrator::on_receive_completion_notice(RequestID request_id,
+                                                const ExecutionUnitID &eu_id) {
+  const EUHandle eu = plan_.find(eu_id);
+  if (eu == kInvalidEUHandle || !plan_.unit(eu).has_backup ||
+      !(plan_.unit(eu).is_local || plan_.unit(eu).is_backup)) {
+    __android_log_print(ANDROID_LOG_ERROR,
+                        "Orchestrator::on_receive_completion_notice",
+                        "Invalid completion notice for %.*s",
+                        static_cast<int>(eu_id.size()), eu_id.data());
+    return;
+  }
+
+  InferenceRequest *request = acquire_request(request_id);
+  if (!request) {
+    return;
+  }
+  // Unless the copy on this device completed first; the primary copy is
+  // cancelled when its input is complete
+  if (!request->input_states[eu].resolved.exchange(true, std::memory_order_acq_rel) &&
+      plan_.unit(eu).is_backup) {
+    cancel_backup(*request, eu);
+  }
+  finish_unit(*request);
+}
+
+void Orchestrator::cancel_backup(InferenceRequest &request, EUHandle eu) {
+  // The primary copy was not late; if its input was not complete yet, the
+  // backup copy would not have run anyway
+  const auto &input_state = request.input_states[eu];
+  const int64_t ready_time = input_state.ready_time.load(std::memory_order_acquire);
+  const auto now = std::chrono::steady_clock::now();
+  const std::chrono::duration<double, std::milli> lag =
+      ready_time == 0 ? std::chrono::steady_clock::duration::zero()
+                      : now.time_since_epoch() -
+                            std::chrono::steady_clock::duration(ready_time);
+  record_lag(eu, lag.count());
+
+  // Drop the backup copy if it waits for its deadline
+  std::unique_ptr<SpeculativeCopy> disarmed;
+  {
+    std::lock_guard<std::mutex> lock(speculation_mtx_);
+    const auto it = std::find_if(
+        armed_copies_.begin(), armed_copies_.end(),
+        [&](const auto &copy) { return copy->request == &request && copy->eu == eu; });
+    if (it != armed_copies_.end()) {
+      disarmed = std::move(*it);
+      *it = std::move(armed_copies_.back());
+      armed_copies_.pop_back();
+      std::make_heap(armed_copies_.begin(), armed_copies_.end(), LaterDeadline());
+    }
+  }
+  if (disarmed) {
+    // Its input settled without running
+    disarmed.reset();
+    settle_backup(request, eu);
+  }
+  // The unit resolved
+  settle_backup(request, eu);
 }
 
 void Orchestrator::on_computation_complete(
-    const ExecutionUnit &completed_eu,
+    InferenceRequest &request,
+    EUHandle completed,
     std::unique_ptr<arm_compute::Tensor> output) {
+  const ExecutionPlan::Unit &unit = plan_.unit(completed);
+  if (unit.has_backup && !claim_result(request, completed)) {
+    // The other copy completed first and sent its result already
+    output.reset();
+    unit.is_backup ? settle_backup(request, completed) : finish_unit(request);
+    return;
+  }
+
+  const ExecutionUnit &completed_eu = plan_.eu(completed);
   // Check if the output is from a leaf execution unit
   if (completed_eu.is_leaf) {
-    std::lock_guard<std::mutex> lock(collected_final_outputs_mtx_);
-
-    // Store the output tensor for the leaf execution unit
-    collected_final_outputs_[completed_eu.id] = std::move(output);
-
-    int remaining = num_pending_leaf_eus_.fetch_sub(1) - 1;
+    // The output is a view of the rows of the unit in `request.output`;
+    // the data is already in place
+    output.reset();
+    // The last leaf sees the writes of the others
+    const size_t remaining =
+        request.num_pending_leaf_eus.fetch_sub(1, std::memory_order_acq_rel) - 1;
     __android_log_print(
         ANDROID_LOG_INFO, "Orchestrator::on_computation_complete",
         "A single leaf execution unit is completed;"
-        " %d remaining leaf units",
+        " %zu remaining leaf units",
         remaining);
 
     if (remaining == 0) {
-      if (inference_complete_callback_) {
-        __android_log_print(
-            ANDROID_LOG_INFO, "Orchestrator::on_computation_complete",
-            "All leaf execution units completed; invoking callback");
-        // Invoke the callback with the collected final outputs
-        // TODO: Combine the outputs before invoking the callback
-        for (const auto &output_pair: collected_final_outputs_) {
-          const auto &eu_id = output_pair.first;
-          const auto &output_tensor = output_pair.second;
-          inference_complete_callback_(*output_tensor);
-        }
-      } else {
-        __android_log_print(ANDROID_LOG_ERROR,
-                            "Orchestrator::on_computation_complete",
-                            "Inference completed, but no callback registered");
-      }
+      const std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - request.start_time;
+      __android_log_print(
+          ANDROID_LOG_INFO, "Orchestrator::on_computation_complete",
+          "Inference %u latency: %.3f ms", request.id, elapsed.count());
+      TensorPool::instance().log_stats();
+
+      // Invoked before the request is released, as the output is reused
+      // by the next inference
+      __android_log_print(
+          ANDROID_LOG_INFO, "Orchestrator::on_computation_complete",
+          "All leaf execution units completed; invoking callback");
+      report(request, InferenceStatus::Completed);
     }
-  } else { // If the execution unit is not a leaf
+  } else if (output) {
+    // If the execution unit is not a leaf, and did not forward its output
+    // band by band already
     // Check the forward table
-    if (completed_eu.forward_table.empty()) {
+    if (plan_.unit(completed).num_forwards == 0) {
       __android_log_print(ANDROID_LOG_ERROR, "Orchestrator::dispatch_output",
                           "No forward table entries for non-leaf execution unit %.*s",
                           static_cast<int>(completed_eu.id.size()), completed_eu.id.data());
     } else {
       // Dispatch the output to the next execution units
-      dispatch_output(completed_eu, std::move(output));
+      dispatch_output(request, completed, std::move(output));
     }
   }
+
+  if (unit.is_backup) {
+    settle_backup(request, completed);
+  } else {
+    finish_unit(request);
+  }
 }
 
-void Orchestrator::check_and_run_eu(const ExecutionUnitID &eu_id) {
-  // TODO: What to do here?
+void Orchestrator::finish_unit(InferenceRequest &request) {
+  // The last unit of the inference gives its state back to the pool
+  if (request.num_pending_eus.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    release_request(request);
+  }
 }
 
-std::unique_ptr<arm_compute::Tensor>
-Orchestrator::assemble_input_for_eu(const ExecutionUnit &eu,
-                                    InputState &input_state) {
-  // TODO: Assemble the input tensor for the execution unit
-  return nullptr;
+void Orchestrator::on_task_dropped(InferenceRequest &request, EUHandle eu) {
+  // The task holds the request until its unit is settled
+  if (!request.aborted.load(std::memory_order_relaxed)) {
+    abort_request(request, InferenceStatus::TimedOut, true);
+  }
+  if (plan_.unit(eu).is_backup) {
+    settle_backup(request, eu);
+  } else {
+    finish_unit(request);
+  }
 }
 
-void Orchestrator::dispatch_output(
-    const ExecutionUnit &src_eu,
-    std::unique_ptr<arm_compute::Tensor> output) {
-  for (const auto &entry: src_eu.forward_table) {
-    const auto &dest_eu_id = entry.dest_eu_id;
+void Orchestrator::on_task_failed(InferenceRequest &request, EUHandle eu) {
+  abort_request(request, InferenceStatus::Failed, true);
+  if (plan_.unit(eu).is_backup) {
+    settle_backup(request, eu);
+  } else {
+    finish_unit(request);
+  }
+}
 
-    // Range of this unit's output, required by the destination execution unit
-    const auto &required_range = entry.required_range;
+bool Orchestrator::abort_request(InferenceRequest &request,
+                                 InferenceStatus status,
+                                 bool notify_peers) {
+  if (request.aborted.exchange(true, std::memory_order_acq_rel)) {
+    return false;
+  }
+  __android_log_print(ANDROID_LOG_WARN, "Orchestrator::abort_request",
+                      "Inference %u %s; dropping its remaining tasks",
+                      request.id, status_name(status));
+  if (plan_.num_local_leaves() > 0) {
+    report(request, status);
+  }
 
-    // Find the destination execution unit
-    const auto dest_eu = get_execution_unit(dest_eu_id);
-    if (!dest_eu) {
-      __android_log_print(ANDROID_LOG_ERROR, "Orchestrator::dispatch_output",
-                          "Invalid destination execution unit %.*s for source execution unit %.*s",
-                          static_cast<int>(dest_eu_id.size()), dest_eu_id.data(),
-                          static_cast<int>(src_eu.id.size()), src_eu.id.data());
+  // The caller holds the request, so it is not released midway
+  for (EUHandle handle = 0; handle < plan_.size(); ++handle) {
+    const ExecutionPlan::Unit &unit = plan_.unit(handle);
+    if (!unit.is_local && !unit.is_backup) {
       continue;
     }
+    auto &input_state = request.input_states[handle];
+    if (!input_state.submitted.exchange(true, std::memory_order_acq_rel)) {
+      unit.is_backup ? settle_backup(request, handle) : finish_unit(request);
+    }
+    if (unit.is_backup &&
+        !input_state.resolved.exchange(true, std::memory_order_acq_rel)) {
+      settle_backup(request, handle);
+    }
+  }
 
-    // TODO: Check if the output range matches the required range
-    // Currently, dispatch the entire output tensor
-    // In the future, we may need to slice the output tensor according to the required range
+  // The devices that have not seen the inference yet wait for it otherwise
+  if (notify_peers) {
+    send_abort_notices(request.id, status);
+  }
+  return true;
+}
 
-    // Check if the destination unit is on this device
-    if (device_info_.id == dest_eu->assigned_device) {
-      // Directly submit the task to the computation engine of this device
-      computation_engine_->submit_task(
-          *dest_eu, std::move(output));
+void Orchestrator::send_abort_notices(RequestID request_id,
+                                      InferenceStatus status) {
+  for (const auto &device: device_map_) {
+    if (device.first != device_info_.id) {
+      network_event_handler_->send_abort_notice(request_id, device.first,
+                                                status);
+    }
+  }
+}
+
+void Orchestrator::report(InferenceRequest &request, InferenceStatus status) {
+  if (request.reported.exchange(true, std::memory_order_acq_rel)) {
+    return;
+  }
+  if (inference_complete_callback_) {
+    inference_complete_callback_(request.id, status, request.output);
+  } else {
+    __android_log_print(ANDROID_LOG_ERROR, "Orchestrator::report",
+                        "Inference %u finished, but no callback registered",
+                        request.id);
+  }
+}
+
+void Orchestrator::deadline_loop() {
+  std::unique_lock<std::mutex> lock(deadline_mtx_);
+  while (!stop_deadlines_) {
+    if (deadlines_.empty()) {
+      deadline_cv_.wait(lock);
+      continue;
+    }
+    const Deadline deadline = deadlines_.front().first;
+    if (std::chrono::steady_clock::now() <= deadline) {
+      deadline_cv_.wait_until(lock, deadline);
+      continue;
+    }
+
+    std::pop_heap(deadlines_.begin(), deadlines_.end(),
+                  std::greater<PendingDeadline>());
+    const RequestID request_id = deadlines_.back().second;
+    deadlines_.pop_back();
+    lock.unlock();
+
+    // Skipped if the request completed in time
+    if (InferenceRequest *request = pin_request(request_id)) {
+      abort_request(*request, InferenceStatus::TimedOut, true);
+      finish_unit(*request);
+    }
+    lock.lock();
+  }
+}
+
+bool Orchestrator::claim_result(InferenceRequest &request, EUHandle eu) {
+  auto &input_state = request.input_states[eu];
+  if (input_state.resolved.exchange(true, std::memory_order_acq_rel)) {
+    return false;
+  }
+
+  const ExecutionUnit &claimed = plan_.eu(eu);
+  if (plan_.unit(eu).is_backup) {
+    // The primary copy is later than this, at least
+    const std::chrono::duration<double, std::milli> lag =
+        std::chrono::steady_clock::now().time_since_epoch() -
+        std::chrono::steady_clock::duration(
+            input_state.ready_time.load(std::memory_order_acquire));
+    record_lag(eu, lag.count());
+    {
+      std::lock_guard<std::mutex> lock(speculation_mtx_);
+      ++speculation_stats_.num_won;
+    }
+    __android_log_print(ANDROID_LOG_INFO, "Orchestrator::claim_result",
+                        "Backup copy of %.*s won inference %u",
+                        static_cast<int>(claimed.id.size()), claimed.id.data(),
+                        request.id);
+    settle_backup(request, eu);
+  }
+
+  // Cancel the other copy
+  network_event_handler_->send_completion_notice(
+      request.id,
+      plan_.unit(eu).is_backup ? claimed.assigned_device : claimed.backup_device,
+      claimed);
+  return true;
+}
+
+void Orchestrator::settle_backup(InferenceRequest &request, EUHandle eu) {
+  auto &input_state = request.input_states[eu];
+  if (input_state.num_pending_events.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    finish_unit(request);
+  }
+}
+
+void Orchestrator::run_eu(InferenceRequest &request,
+                          EUHandle eu,
+                          std::unique_ptr<arm_compute::Tensor> input) {
+  const ExecutionPlan::Unit &unit = plan_.unit(eu);
+  if (unit.has_backup) {
+    if (request.input_states[eu].resolved.load(std::memory_order_acquire)) {
+      // Cancelled; the other copy completed first
+      input.reset();
+      unit.is_backup ? settle_backup(request, eu) : finish_unit(request);
+      return;
+    }
+    if (unit.is_backup) {
+      arm_speculation(request, eu, std::move(input));
+      return;
+    }
+  }
+  computation_engine_->submit_task(request, eu, std::move(input));
+}
+
+void Orchestrator::arm_speculation(InferenceRequest &request,
+                                   EUHandle eu,
+                                   std::unique_ptr<arm_compute::Tensor> input) {
+  const auto now = std::chrono::steady_clock::now();
+  request.input_states[eu].ready_time.store(now.time_since_epoch().count(),
+                                            std::memory_order_release);
+
+  // Wait for the usual delay of the primary copy, up to the percentile
+  double deadline_ms = -1;
+  {
+    LagHistory &history = *lag_histories_[eu];
+    std::lock_guard<std::mutex> lock(history.mtx);
+    if (history.samples_ms.size() >= kMinLagSamples) {
+      std::vector<double> samples = history.samples_ms;
+      const auto nth = samples.begin() + static_cast<std::ptrdiff_t>(
+          kSpeculationPercentile * static_cast<double>(samples.size() - 1));
+      std::nth_element(samples.begin(), nth, samples.end());
+      deadline_ms = *nth;
+    }
+  }
+  if (deadline_ms < 0) {
+    // Too few delays observed to tell a late primary copy
+    input.reset();
+    settle_backup(request, eu);
+    return;
+  }
+
+  auto copy = std::make_unique<SpeculativeCopy>(SpeculativeCopy{
+      .deadline = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double, std::milli>(deadline_ms)),
+      .request = &request,
+      .eu = eu,
+      .input = std::move(input),
+  });
+  {
+    std::lock_guard<std::mutex> lock(speculation_mtx_);
+    armed_copies_.push_back(std::move(copy));
+    std::push_heap(armed_copies_.begin(), armed_copies_.end(), LaterDeadline());
+  }
+  speculation_cv_.notify_one();
+}
+
+void Orchestrator::record_lag(EUHandle eu, double lag_ms) {
+  LagHistory &history = *lag_histories_[eu];
+  std::lock_guard<std::mutex> lock(history.mtx);
+  if (history.samples_ms.size() < kLagHistory) {
+    history.samples_ms.push_back(std::max(0.0, lag_ms));
+  } else {
+    history.samples_ms[history.next] = std::max(0.0, lag_ms);
+    history.next = (history.next + 1) % kLagHistory;
+  }
+}
+
+void Orchestrator::speculation_loop() {
+  std::unique_lock<std::mutex> lock(speculation_mtx_);
+  while (!stop_speculation_) {
+    if (armed_copies_.empty()) {
+      speculation_cv_.wait(lock);
+      continue;
+    }
+    const auto deadline = armed_copies_.front()->deadline;
+    if (std::chrono::steady_clock::now() < deadline) {
+      speculation_cv_.wait_until(lock, deadline);
+      continue;
+    }
+
+    std::pop_heap(armed_copies_.begin(), armed_copies_.end(), LaterDeadline());
+    std::unique_ptr<SpeculativeCopy> copy = std::move(armed_copies_.back());
+    armed_copies_.pop_back();
+    const bool resolved =
+        copy->request->input_states[copy->eu].resolved.load(std::memory_order_acquire);
+    if (!resolved) {
+      ++speculation_stats_.num_triggered;
+    }
+    lock.unlock();
+
+    if (resolved) {
+      settle_backup(*copy->request, copy->eu);
     } else {
-      // Send the output tensor over the network to the destination device
-      network_event_handler_->send_intermediate_result(
-          dest_eu->assigned_device,
-          *dest_eu, std::move(output));
+      const auto &eu_id = plan_.eu(copy->eu).id;
+      __android_log_print(ANDROID_LOG_INFO, "Orchestrator::speculation_loop",
+                          "Primary copy of %.*s is late for inference %u;"
+                          " running the backup copy",
+                          static_cast<int>(eu_id.size()), eu_id.data(),
+                          copy->request->id);
+      computation_engine_->submit_task(*copy->request, copy->eu,
+                                       std::move(copy->input));
     }
+    lock.lock();
   }
 }
 
-const ExecutionUnit *
-Orchestrator::get_execution_unit(const ExecutionUnitID &eu_id) const {
-  auto it = dag_.eus.find(eu_id);
-  if (it != dag_.eus.end()) {
-    return &it->second;
+Orchestrator::SpeculationStats Orchestrator::speculation_stats() {
+  std::lock_guard<std::mutex> lock(speculation_mtx_);
+  return speculation_stats_;
+}
+
+void Orchestrator::check_and_run_eu(InferenceRequest &request,
+                                    EUHandle eu,
+                                    EUHandle src_eu,
+                                    std::unique_ptr<arm_compute::Tensor> data,
+                                    const Range &rows) {
+  const auto &expected_input_shape = plan_.eu(eu).expected_input_shape;
+
+  // Both copies of a unit with a backup may send the piece; the first wins
+  if (plan_.unit(src_eu).has_backup) {
+    const ExecutionPlan::Input *slot = plan_.find_input(eu, src_eu);
+    if (slot && request.received_inputs[plan_.input_index(slot)].exchange(
+                    true, std::memory_order_relaxed)) {
+      return;
+    }
+  }
+
+  // A single piece covering the whole input is the input itself;
+  // an aborted request settled the unit already
+  auto &input_state = request.input_states[eu];
+  if (plan_.unit(eu).num_inputs <= 1 &&
+      data->info()->tensor_shape().total_size() ==
+          expected_input_shape.total_size()) {
+    if (!input_state.submitted.exchange(true, std::memory_order_acq_rel)) {
+      run_eu(request, eu, std::move(data));
+    }
+    return;
+  }
+
+  const std::optional<bool> complete =
+      assemble_input_for_eu(eu, input_state, src_eu, *data, rows);
+  if (!complete) {
+    // The unit can never run, so neither can the inference
+    abort_request(request, InferenceStatus::Failed, true);
+    return;
+  }
+  if (*complete) {
+    // The last rows landed; the acquire of their decrement made the rows
+    // of all other pieces visible
+    std::unique_ptr<arm_compute::Tensor> input(
+        input_state.input.exchange(nullptr, std::memory_order_relaxed));
+    input_state.num_pending.store(input_state.num_expected,
+                                  std::memory_order_relaxed);
+    if (!input_state.submitted.exchange(true, std::memory_order_acq_rel)) {
+      run_eu(request, eu, std::move(input));
+    }
+  }
+}
+
+std::optional<bool> Orchestrator::assemble_input_for_eu(
+    EUHandle eu,
+    InferenceRequest::InputState &input_state,
+    EUHandle src_eu,
+    const arm_compute::Tensor &data,
+    const Range &rows) {
+  const ExecutionUnit &dest = plan_.eu(eu);
+  const ExecutionPlan::Input *slot = plan_.find_input(eu, src_eu);
+  if (!slot) {
+    const auto &src_eu_id = plan_.eu(src_eu).id;
+    __android_log_print(ANDROID_LOG_ERROR,
+                        "Orchestrator::assemble_input_for_eu",
+                        "Execution unit %.*s does not take input from %.*s",
+                        static_cast<int>(dest.id.size()), dest.id.data(),
+                        static_cast<int>(src_eu_id.size()), src_eu_id.data());
+    return std::nullopt;
+  }
+
+  // The first piece to arrive allocates the input; if another one wins
+  // the race, its tensor is used instead
+  arm_compute::Tensor *input = input_state.input.load(std::memory_order_acquire);
+  if (!input) {
+    auto allocated = TensorPool::instance().allocate(arm_compute::TensorInfo(
+        dest.expected_input_shape, 1, data.info()->data_type()));
+    if (!allocated) {
+      __android_log_print(ANDROID_LOG_ERROR,
+                          "Orchestrator::assemble_input_for_eu",
+                          "Failed to allocate the input of execution unit %.*s",
+                          static_cast<int>(dest.id.size()), dest.id.data());
+      return std::nullopt;
+    }
+    if (input_state.input.compare_exchange_strong(
+            input, allocated.get(), std::memory_order_acq_rel,
+            std::memory_order_acquire)) {
+      input = allocated.release();
+    }
+  }
+
+  // The pieces occupy disjoint rows, so they are copied concurrently
+  const auto &data_shape = data.info()->tensor_shape();
+  const int data_rows = static_cast<int>(data_shape[range_axis(data_shape)]);
+  const int input_rows = static_cast<int>(
+      dest.expected_input_shape[range_axis(dest.expected_input_shape)]);
+  const Range piece = {std::max(rows.start, slot->src_rows.start),
+                       std::min({rows.end, slot->src_rows.end,
+                                 rows.start + data_rows})};
+  const int dst_start = slot->dst_start + piece.start - slot->src_rows.start;
+  if (!piece.valid() || dst_start < 0 ||
+      dst_start + piece.num_elements() > input_rows) {
+    const auto &src_eu_id = plan_.eu(src_eu).id;
+    __android_log_print(ANDROID_LOG_ERROR,
+                        "Orchestrator::assemble_input_for_eu",
+                        "Rows [%d, %d) from %.*s fall outside the input of %.*s",
+                        rows.start, rows.end,
+                        static_cast<int>(src_eu_id.size()), src_eu_id.data(),
+                        static_cast<int>(dest.id.size()), dest.id.data());
+    return std::nullopt;
+  }
+  copy_slab(data, {piece.start - rows.start, piece.end - rows.start}, *input,
+            dst_start);
+
+  // Release the rows to the producer of the last piece
+  const auto num_rows = static_cast<unsigned int>(piece.num_elements());
+  return input_state.num_pending.fetch_sub(num_rows, std::memory_order_acq_rel) ==
+         num_rows;
+}
+
+void Orchestrator::dispatch_output(
+    InferenceRequest &request,
+    EUHandle src_eu,
+    std::unique_ptr<arm_compute::Tensor> output) {
+  // Every destination gets a view of the output; the buffer is released
+  // when the last view is destroyed
+  const std::shared_ptr<arm_compute::ITensor> shared_output = std::move(output);
+
+  for (const auto &forward: plan_.forwards(src_eu)) {
+    // `forward.range` is required by the destination execution unit,
+    // in the coordinates of the output tensor
+    dispatch_rows(request, src_eu, forward, shared_output, forward.range);
+  }
+}
+
+void Orchestrator::on_chunk_complete(
+    InferenceRequest &request,
+    EUHandle eu,
+    const std::shared_ptr<arm_compute::ITensor> &output,
+    const Range &rows) {
+  // Every destination gets its part of the band; it starts once it has
+  // all the rows it requires
+  for (const auto &forward: plan_.forwards(eu)) {
+    const Range overlap = {std::max(rows.start, forward.range.start),
+                           std::min(rows.end, forward.range.end)};
+    if (overlap.valid()) {
+      dispatch_rows(request, eu, forward, output, overlap);
+    }
+  }
+}
+
+void Orchestrator::dispatch_rows(
+    InferenceRequest &request,
+    EUHandle src_eu,
+    const ExecutionPlan::Forward &forward,
+    const std::shared_ptr<arm_compute::ITensor> &output,
+    const Range &rows) {
+  auto view = slab_view(output, rows);
+  if (!view) {
+    const auto &src_eu_id = plan_.eu(src_eu).id;
+    const auto &dest_eu_id = plan_.eu(forward.dest).id;
+    __android_log_print(ANDROID_LOG_ERROR, "Orchestrator::dispatch_rows",
+                        "Range [%d, %d) required by %.*s is outside the output of %.*s",
+                        rows.start, rows.end,
+                        static_cast<int>(dest_eu_id.size()), dest_eu_id.data(),
+                        static_cast<int>(src_eu_id.size()), src_eu_id.data());
+    return;
+  }
+
+  // The receivers place the rows by the coordinates of the whole layer
+  const ExecutionUnit &src = plan_.eu(src_eu);
+  const Range layer_rows = {rows.start + src.output_range.start,
+                            rows.end + src.output_range.start};
+
+  // Check if the destination unit is on this device
+  const ExecutionPlan::Unit &dest = plan_.unit(forward.dest);
+  const ExecutionUnit &dest_eu = plan_.eu(forward.dest);
+  if (dest.has_backup) {
+    // The backup copy gets the input too, to be ready to speculate
+    auto backup_view = slab_view(output, rows);
+    if (dest.is_backup) {
+      check_and_run_eu(request, forward.dest, src_eu, std::move(backup_view),
+                       layer_rows);
+    } else {
+      network_event_handler_->send_intermediate_result(
+          request.id, dest_eu.backup_device, src, dest_eu,
+          std::move(backup_view), layer_rows, request.deadline);
+    }
+  }
+  if (dest.is_local) {
+    check_and_run_eu(request, forward.dest, src_eu, std::move(view), layer_rows);
+  } else {
+    // Send the output tensor over the network to the destination device
+    network_event_handler_->send_intermediate_result(
+        request.id, dest_eu.assigned_device, src, dest_eu, std::move(view),
+        layer_rows, request.deadline);
   }
-  __android_log_print(ANDROID_LOG_ERROR, "Orchestrator::get_execution_unit",
-                      "Execution unit %.*s not found",
-                      static_cast<int>(eu_id.size()), eu_id.data());
-  return nullptr;
 }
@@ -0,0 +1,543 @@
+#include "edgeflow/Partitioner.h"
+#include "edgeflow/TensorUtils.h"
+#include <algorithm>
+#include <android/log.h>
+#include <limits>
+#include <numeric>
+
+Range Partitioner::receptive_rows(const Layer &layer, const Range &output_rows) {
+  switch (layer.type) {
+    case LayerType::Convolution:
+    case LayerType::PoolingAvg:
+    case LayerType::PoolingMax:
+      break;
+    case LayerType::Linear: {
+      // Every output depends on the whole input
+      const auto &in_shape = layer.input_shape;
+      return {0, static_cast<int>(in_shape[range_axis(in_shape)])};
+    }
+    default:
+      // Element-wise: the same rows
+      return output_rows;
+  }
+
+  const int kernel_h = layer.get_hparam_int("kernel_h", 1);
+  const int stride_h = layer.get_hparam_int("stride_h", 1);
+  const int pad_top = layer.get_hparam_int("pad_top");
+  return Range{
+      .start = output_rows.start * stride_h - pad_top,
+      .end = (output_rows.end - 1) * stride_h - pad_top + kernel_h,
+  };
+}
+
+std::vector<ExecutionUnit>
+Partitioner::partition_rows(const std::shared_ptr<Layer> &layer,
+                            const std::vector<DeviceID> &devices,
+                            const std::vector<float> &shares) {
+  const auto &out_shape = layer->output_shape;
+  const int out_rows = static_cast<int>(out_shape[range_axis(out_shape)]);
+
+  std::vector<ExecutionUnit> eus;
+  const auto bands = split(out_rows, devices.size(), shares);
+  for (size_t i = 0; i < bands.size(); ++i) {
+    if (bands[i].valid()) {
+      eus.push_back(make_row_eu(layer, bands[i], devices[i], i));
+    }
+  }
+  return eus;
+}
+
+std::vector<std::vector<ExecutionUnit>>
+Partitioner::partition_fused_tiles(
+    const std::vector<std::shared_ptr<Layer>> &layers,
+    const std::vector<DeviceID> &devices,
+    const std::vector<DeviceID> &input_devices,
+    size_t fusion_depth,
+    const std::vector<float> &shares,
+    TilingReport *report) {
+  fusion_depth = std::max<size_t>(1, fusion_depth);
+  std::vector<std::vector<ExecutionUnit>> eus(layers.size());
+  if (layers.empty() || devices.empty()) {
+    return eus;
+  }
+
+  // The first group reads the model input where it is given
+  const std::vector<DeviceID> &root_devices =
+      input_devices.empty() ? devices : input_devices;
+  std::vector<float> root_shares;
+  if (shares.size() == devices.size()) {
+    for (const auto &device: root_devices) {
+      const auto it = std::find(devices.begin(), devices.end(), device);
+      root_shares.push_back(it != devices.end() ? shares[it - devices.begin()] : 1.0f);
+    }
+  }
+
+  for (size_t group = 0; group < layers.size(); group += fusion_depth) {
+    const size_t last = std::min(layers.size(), group + fusion_depth) - 1;
+    const auto &group_devices = group == 0 ? root_devices : devices;
+    const auto &last_shape = layers[last]->output_shape;
+    const auto bands = split(static_cast<int>(last_shape[range_axis(last_shape)]),
+                             group_devices.size(), group == 0 ? root_shares : shares);
+
+    for (size_t t = 0; t < bands.size(); ++t) {
+      if (!bands[t].valid()) {
+        continue;
+      }
+      // Walk the tile backwards: each layer computes exactly the rows the
+      // next layer's tile reads, halo included
+      Range rows = bands[t];
+      for (size_t l = last + 1; l-- > group;) {
+        if (l < last) {
+          const auto &out_shape = layers[l]->output_shape;
+          const Range field = receptive_rows(*layers[l + 1], rows);
+          rows = {std::max(0, field.start),
+                  std::min(static_cast<int>(out_shape[range_axis(out_shape)]),
+                           field.end)};
+        }
+        eus[l].push_back(make_row_eu(layers[l], rows, group_devices[t], t));
+      }
+
+      // Chain the tile; its layers run on the same device
+      for (size_t l = group; l < last; ++l) {
+        ExecutionUnit &producer = eus[l].back();
+        ExecutionUnit &consumer = eus[l + 1].back();
+        producer.forward_table.push_back(ForwardTableEntry{
+            .dest_eu_id = consumer.id,
+            .required_range = producer.output_range,
+        });
+        consumer.input_requirements[producer.id] = InputRequirement{
+            .src_eu_id = producer.id,
+            .src_range = producer.output_range,
+        };
+      }
+    }
+
+    // Data crosses devices only between the groups
+    if (group > 0) {
+      connect(eus[group - 1], eus[group]);
+    }
+  }
+  connect_model_input(eus.front());
+  for (auto &eu: eus.back()) {
+    eu.is_leaf = true;
+  }
+
+  if (report) {
+    *report = TilingReport{.fusion_depth = fusion_depth};
+    std::vector<std::vector<ExecutionUnit>> layerwise;
+    for (size_t l = 0; l < layers.size(); ++l) {
+      const auto &out_shape = layers[l]->output_shape;
+      report->full_macs += layer_macs(
+          *layers[l], static_cast<int>(out_shape[range_axis(out_shape)]));
+      for (const auto &eu: eus[l]) {
+        report->tiled_macs += layer_macs(*layers[l], eu.output_range.num_elements());
+      }
+
+      layerwise.push_back(l == 0 ? partition_rows(layers[l], root_devices, root_shares)
+                                 : partition_rows(layers[l], devices, shares));
+      if (l > 0) {
+        connect(layerwise[l - 1], layerwise[l]);
+        report->exchanged_bytes += cross_device_bytes(eus[l - 1], eus[l]);
+        report->layerwise_exchanged_bytes +=
+            cross_device_bytes(layerwise[l - 1], layerwise[l]);
+      }
+    }
+
+    __android_log_print(
+        ANDROID_LOG_INFO, "Partitioner::partition_fused_tiles",
+        "Fusion depth %zu over %zu layers: %.1f%% redundant compute,"
+        " %zu of %zu cross-device bytes saved",
+        fusion_depth, layers.size(), report->redundant_compute() * 100.0,
+        report->communication_saved(), report->layerwise_exchanged_bytes);
+  }
+  return eus;
+}
+
+std::vector<std::vector<ExecutionUnit>>
+Partitioner::partition_pipeline(
+    const std::vector<std::shared_ptr<Layer>> &layers,
+    const std::vector<DeviceID> &devices,
+    const std::vector<double> &layer_costs,
+    PipelineReport *report) {
+  std::vector<std::vector<ExecutionUnit>> eus;
+  if (layers.empty() || devices.empty()) {
+    return eus;
+  }
+
+  // Measured and estimated costs are not comparable; use one or the other
+  std::vector<double> costs = layer_costs;
+  if (costs.size() != layers.size()) {
+    costs.clear();
+    for (const auto &layer: layers) {
+      const auto &out_shape = layer->output_shape;
+      costs.push_back(layer_macs(
+          *layer, static_cast<int>(out_shape[range_axis(out_shape)])));
+    }
+  }
+
+  const size_t num_stages = std::min(layers.size(), devices.size());
+  const auto first_layers = balance_stages(costs, num_stages);
+
+  std::vector<PipelineStage> stages;
+  for (size_t s = 0; s < num_stages; ++s) {
+    PipelineStage stage{
+        .device = devices[s],
+        .first_layer = first_layers[s],
+        .num_layers = (s + 1 < num_stages ? first_layers[s + 1] : layers.size()) -
+                      first_layers[s],
+    };
+    for (size_t l = stage.first_layer; l < stage.first_layer + stage.num_layers; ++l) {
+      // The whole layer runs on the stage's device
+      eus.push_back(partition_rows(layers[l], {stage.device}));
+      if (l > 0) {
+        connect(eus[l - 1], eus[l]);
+      }
+      stage.cost += costs[l];
+    }
+    stages.push_back(std::move(stage));
+  }
+  connect_model_input(eus.front());
+  for (auto &eu: eus.back()) {
+    eu.is_leaf = true;
+  }
+
+  if (report) {
+    *report = PipelineReport{.stages = std::move(stages)};
+    for (size_t s = 0; s < report->stages.size(); ++s) {
+      const auto &stage = report->stages[s];
+      __android_log_print(
+          ANDROID_LOG_INFO, "Partitioner::partition_pipeline",
+          "Stage %zu on %.*s: layers [%zu, %zu), cost %.3f,"
+          " %.1f%% utilization",
+          s, static_cast<int>(stage.device.size()), stage.device.data(),
+          stage.first_layer, stage.first_layer + stage.num_layers, stage.cost,
+          report->utilization(s) * 100.0);
+    }
+  }
+  return eus;
+}
+
+void Partitioner::connect(std::vector<ExecutionUnit> &producers,
+                          std::vector<ExecutionUnit> &consumers) {
+  for (auto &consumer: consumers) {
+    const Range needed = input_band(consumer);
+    for (auto &producer: producers) {
+      const Range overlap = {std::max(needed.start, producer.output_range.start),
+                             std::min(needed.end, producer.output_range.end)};
+      if (!overlap.valid()) {
+        continue;
+      }
+      consumer.input_requirements[producer.id] = InputRequirement{
+          .src_eu_id = producer.id,
+          .src_range = overlap,
+      };
+      producer.forward_table.push_back(ForwardTableEntry{
+          .dest_eu_id = consumer.id,
+          .required_range = overlap,
+      });
+    }
+  }
+}
+
+void Partitioner::connect_model_input(std::vector<ExecutionUnit> &consumers) {
+  for (auto &consumer: consumers) {
+    consumer.is_root = true;
+    consumer.input_requirements[kModelInputID] = InputRequirement{
+        .src_eu_id = kModelInputID,
+        .src_range = input_band(consumer),
+    };
+  }
+}
+
+ExecutionUnit Partitioner::make_row_eu(const std::shared_ptr<Layer> &layer,
+                                       const Range &rows,
+                                       const DeviceID &device,
+                                       size_t index) {
+  const auto &in_shape = layer->input_shape;
+  const int in_rows = static_cast<int>(in_shape[range_axis(in_shape)]);
+
+  // Eq. (5) & (6): the part of the receptive field outside the feature
+  // map is padded by the execution unit itself
+  const Range field = receptive_rows(*layer, rows);
+  const Range input = {std::max(0, field.start), std::min(in_rows, field.end)};
+
+  return ExecutionUnit{
+      .id = layer->id + "::eu" + std::to_string(index),
+      .layer = layer,
+      .assigned_device = device,
+      .input_requirements = {},
+      .output_range = rows,
+      .forward_table = {},
+      .expected_input_shape = slab_shape(in_shape, input),
+      .expected_output_shape = slab_shape(layer->output_shape, rows),
+      .is_leaf = false,
+      .is_root = false,
+      .prepad_top = std::max(0, -field.start),
+      .prepad_bottom = std::max(0, field.end - in_rows),
+      .prepad_left = layer->get_hparam_int("pad_left"),
+      .prepad_right = layer->get_hparam_int("pad_right"),
+  };
+}
+
+double Partitioner::layer_macs(const Layer &layer, int rows) {
+  const auto &out_shape = layer.output_shape;
+  const double outputs =
+      static_cast<double>(slab_shape(out_shape, {0, rows}).total_size());
+  switch (layer.type) {
+    case LayerType::Convolution: {
+      const auto &in_shape = layer.input_shape;
+      const double in_channels =
+          in_shape.num_dimensions() > 2 ? static_cast<double>(in_shape[2]) : 1.0;
+      return outputs * in_channels * layer.get_hparam_int("kernel_h", 1) *
+             layer.get_hparam_int("kernel_w", 1);
+    }
+    case LayerType::PoolingAvg:
+    case LayerType::PoolingMax:
+      return outputs * layer.get_hparam_int("kernel_h", 1) *
+             layer.get_hparam_int("kernel_w", 1);
+    case LayerType::Linear:
+      return outputs * static_cast<double>(layer.input_shape.total_size());
+    default:
+      return outputs;
+  }
+}
+
+void Partitioner::assign_backup_devices(ModelDAG &dag,
+                                        const DeviceMap &devices) {
+  std::vector<DeviceID> device_ids;
+  for (const auto &device: devices) {
+    device_ids.push_back(device.first);
+  }
+  std::sort(device_ids.begin(), device_ids.end());
+
+  std::vector<ExecutionUnit *> eus;
+  for (auto &eu_map: dag.eus) {
+    eus.push_back(&eu_map.second);
+  }
+  std::sort(eus.begin(), eus.end(),
+            [](const ExecutionUnit *a, const ExecutionUnit *b) {
+              return a->id < b->id;
+            });
+
+  // DeviceID |-> MACs of the units it runs or backs up
+  std::unordered_map<DeviceID, double> load;
+  for (const ExecutionUnit *eu: eus) {
+    load[eu->assigned_device] += eu_macs(*eu);
+  }
+
+  size_t num_backups = 0;
+  for (ExecutionUnit *eu: eus) {
+    eu->backup_device.clear();
+    if (eu->is_root || eu->is_leaf) {
+      continue;
+    }
+    const DeviceID *backup = nullptr;
+    for (const auto &device: device_ids) {
+      if (device != eu->assigned_device &&
+          (!backup || load[device] < load[*backup])) {
+        backup = &device;
+      }
+    }
+    if (!backup) {
+      continue;
+    }
+    eu->backup_device = *backup;
+    load[*backup] += eu_macs(*eu);
+    ++num_backups;
+  }
+  __android_log_print(ANDROID_LOG_INFO, "Partitioner::assign_backup_devices",
+                      "%zu of %zu execution units have a backup device",
+                      num_backups, eus.size());
+}
+
+/// Check if the last operator of the unit is a ReLU, whose output is
+/// mostly zeros
+static bool ends_with_relu(const ExecutionUnit &eu) {
+  const LayerType type =
+      eu.fused_stages.empty() ? eu.layer->type : eu.fused_stages.back().layer->type;
+  const auto &activation = eu.fused_stages.empty()
+                               ? eu.fused_activation
+                               : eu.fused_stages.back().fused_activation;
+  using ActivationFunction = arm_compute::ActivationLayerInfo::ActivationFunction;
+  return type == LayerType::ReLU ||
+         (activation.enabled() &&
+          (activation.activation() == ActivationFunction::RELU ||
+           activation.activation() == ActivationFunction::BOUNDED_RELU));
+}
+
+void Partitioner::assign_wire_codecs(ModelDAG &dag, WireCodec lossy_codec) {
+  size_t num_encoded = 0, num_edges = 0;
+  for (auto &eu_map: dag.eus) {
+    ExecutionUnit &producer = eu_map.second;
+    const bool sparse = ends_with_relu(producer);
+    for (auto &entry: producer.forward_table) {
+      const auto consumer = dag.eus.find(entry.dest_eu_id);
+      // Backups always run on another device
+      if (consumer == dag.eus.end() ||
+          (consumer->second.assigned_device == producer.assigned_device &&
+           consumer->second.backup_device.empty())) {
+        entry.codec = WireCodec::Raw;
+        continue;
+      }
+      entry.codec = lossy_codec != WireCodec::Raw ? lossy_codec
+                    : sparse                      ? WireCodec::Sparse
+                                                  : WireCodec::Raw;
+      num_encoded += entry.codec != WireCodec::Raw;
+      ++num_edges;
+    }
+  }
+  __android_log_print(ANDROID_LOG_INFO, "Partitioner::assign_wire_codecs",
+                      "%zu of %zu cross-device edges are encoded",
+                      num_encoded, num_edges);
+}
+
+/// Check if every operator of the unit computes a band of its output from
+/// a band of its input, or if the unit is a single fully connected layer
+static bool is_streamable(const ExecutionUnit &eu) {
+  if (eu.get_type() == LayerType::Linear) {
+    return eu.fused_stages.empty();
+  }
+  const auto is_row_wise = [](LayerType type) {
+    return type == LayerType::Convolution || type == LayerType::PoolingAvg ||
+           type == LayerType::PoolingMax || type == LayerType::ReLU;
+  };
+  return is_row_wise(eu.get_type()) &&
+         std::all_of(eu.fused_stages.begin(), eu.fused_stages.end(),
+                     [&](const FusedStage &stage) {
+                       return is_row_wise(stage.layer->type);
+                     });
+}
+
+void Partitioner::assign_stream_chunks(ModelDAG &dag, size_t max_chunks) {
+  size_t num_streamed = 0;
+  for (auto &eu_map: dag.eus) {
+    ExecutionUnit &eu = eu_map.second;
+    eu.num_stream_chunks = 1;
+    if (max_chunks <= 1 || eu.is_leaf || !eu.backup_device.empty() ||
+        !is_streamable(eu)) {
+      continue;
+    }
+    // Only the bands sent to another device overlap with anything
+    const bool sends = std::any_of(
+        eu.forward_table.begin(), eu.forward_table.end(),
+        [&](const ForwardTableEntry &entry) {
+          const auto consumer = dag.eus.find(entry.dest_eu_id);
+          return consumer != dag.eus.end() &&
+                 consumer->second.assigned_device != eu.assigned_device;
+        });
+    if (!sends) {
+      continue;
+    }
+
+    const auto &out_shape = eu.expected_output_shape;
+    const size_t rows = out_shape[range_axis(out_shape)];
+    const size_t bytes = out_shape.total_size() * sizeof(float);
+    eu.num_stream_chunks =
+        std::min({max_chunks, rows, bytes / kMinStreamChunkBytes});
+    eu.num_stream_chunks = std::max<size_t>(1, eu.num_stream_chunks);
+    num_streamed += eu.num_stream_chunks > 1;
+  }
+  __android_log_print(ANDROID_LOG_INFO, "Partitioner::assign_stream_chunks",
+                      "%zu of %zu execution units stream their output",
+                      num_streamed, dag.eus.size());
+}
+
+double Partitioner::eu_macs(const ExecutionUnit &eu) {
+  // The unit's own layer, then its fused stages
+  const auto &head_output = eu.fused_stages.empty()
+                                ? eu.expected_output_shape
+                                : eu.fused_stages.front().expected_input_shape;
+  double macs = layer_macs(
+      *eu.layer, static_cast<int>(head_output[range_axis(head_output)]));
+  for (const auto &stage: eu.fused_stages) {
+    const auto &output = stage.expected_output_shape;
+    macs += layer_macs(*stage.layer,
+                       static_cast<int>(output[range_axis(output)]));
+  }
+  return macs;
+}
+
+size_t Partitioner::cross_device_bytes(
+    const std::vector<ExecutionUnit> &producers,
+    const std::vector<ExecutionUnit> &consumers) {
+  size_t bytes = 0;
+  for (const auto &producer: producers) {
+    const size_t row_bytes =
+        slab_shape(producer.layer->output_shape, {0, 1}).total_size() *
+        sizeof(float);
+    for (const auto &entry: producer.forward_table) {
+      for (const auto &consumer: consumers) {
+        if (consumer.id == entry.dest_eu_id &&
+            consumer.assigned_device != producer.assigned_device) {
+          bytes += row_bytes * entry.required_range.num_elements();
+        }
+      }
+    }
+  }
+  return bytes;
+}
+
+std::vector<size_t> Partitioner::balance_stages(const std::vector<double> &costs,
+                                                size_t num_stages) {
+  const size_t n = costs.size();
+  std::vector<double> prefix(n + 1, 0);
+  for (size_t i = 0; i < n; ++i) {
+    prefix[i + 1] = prefix[i] + costs[i];
+  }
+
+  // best[k][i]: the smallest bottleneck of the first i costs in k runs;
+  // cut[k][i]: the first index of the last of those runs
+  const double kInf = std::numeric_limits<double>::infinity();
+  std::vector<std::vector<double>> best(num_stages + 1,
+                                        std::vector<double>(n + 1, kInf));
+  std::vector<std::vector<size_t>> cut(num_stages + 1,
+                                       std::vector<size_t>(n + 1, 0));
+  best[0][0] = 0;
+  for (size_t k = 1; k <= num_stages; ++k) {
+    for (size_t i = k; i <= n; ++i) {
+      for (size_t j = k - 1; j < i; ++j) {
+        const double bottleneck = std::max(best[k - 1][j], prefix[i] - prefix[j]);
+        if (bottleneck < best[k][i]) {
+          best[k][i] = bottleneck;
+          cut[k][i] = j;
+        }
+      }
+    }
+  }
+
+  std::vector<size_t> firsts(num_stages);
+  for (size_t k = num_stages, i = n; k > 0; --k) {
+    firsts[k - 1] = cut[k][i];
+    i = cut[k][i];
+  }
+  return firsts;
+}
+
+std::vector<Range> Partitioner::split(int total, size_t num_bands,
+                                      const std::vector<float> &shares) {
+  std::vector<float> weights = shares;
+  if (weights.size() != num_bands) {
+    weights.assign(num_bands, 1.0f);
+  }
+  const float sum = std::accumulate(weights.begin(), weights.end(), 0.0f);
+
+  std::vector<Range> bands;
+  float acc = 0.0f;
+  int start = 0;
+  for (size_t i = 0; i < num_bands; ++i) {
+    acc += weights[i];
+    const int end = (i + 1 == num_bands)
+                        ? total
+                        : static_cast<int>(static_cast<float>(total) * acc / sum + 0.5f);
+    bands.push_back({start, std::max(start, end)});
+    start = std::max(start, end);
+  }
+  return bands;
+}
+
+Range Partitioner::input_band(const ExecutionUnit &consumer) {
+  const auto &in_shape = consumer.layer->input_shape;
+  const int in_rows = static_cast<int>(in_shape[range_axis(in_shape)]);
+  const Range field = receptive_rows(*consumer.layer, consumer.output_range);
+  return {std::max(0, field.start), std::min(in_rows, field.end)};
+}
@@ -0,0 +1,368 @@
+#include "edgeflow/SharedMemoryRing.h"
+#include <android/log.h>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Shared state of the two sides, at the start of the mapping
+struct SharedMemoryRing::Control {
+  static constexpr uint32_t kMagic = 0x474E5245; // "ERNG" in memory
+
+  uint32_t magic = kMagic;
+  uint64_t capacity = 0;
+  // Positions in the stream of records, which wraps around the buffer.
+  // Each is written by one side only, so they get a cache line each.
+  alignas(kAlignment) std::atomic<uint64_t> head{}; // End of the published
+  alignas(kAlignment) std::atomic<uint64_t> tail{}; // End of the reclaimed
+  // Set by a side before it waits, so that the other one signals it
+  alignas(kAlignment) std::atomic<uint32_t> consumer_waiting{};
+  alignas(kAlignment) std::atomic<uint32_t> producer_waiting{};
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "The atomics are shared with another process");
+
+/// Header of a record. A record never wraps around the end of the buffer;
+/// a filler record takes the space left there instead.
+struct SharedMemoryRing::RecordHeader {
+  uint64_t size; // Including this header and the padding
+  uint64_t payload_size;
+  uint32_t head_size;
+  uint32_t filler;
+  std::atomic<uint32_t> released;
+};
+
+/// Tensor using the payload of a record in place, which it releases when
+/// it is destroyed
+class SharedMemoryRing::RecordTensor : public arm_compute::Tensor {
+public:
+  RecordTensor(std::shared_ptr<SharedMemoryRing> ring, const Record &record)
+      : ring_(std::move(ring)), record_(record) {}
+
+  ~RecordTensor() override { ring_->release(record_); }
+
+private:
+  std::shared_ptr<SharedMemoryRing> ring_;
+  Record record_;
+};
+
+static constexpr size_t align_up(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+size_t SharedMemoryRing::control_size() {
+  return align_up(sizeof(Control),
+                  static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+}
+
+/// Offset of the payload in a record with a head of the given size
+static size_t payload_offset(size_t head_size, size_t record_header_size) {
+  return align_up(record_header_size + head_size, SharedMemoryRing::kAlignment);
+}
+
+std::unique_ptr<SharedMemoryRing> SharedMemoryRing::create(size_t capacity,
+                                                           int link_fd) {
+  std::unique_ptr<SharedMemoryRing> ring(new SharedMemoryRing());
+  ring->link_fd_ = link_fd;
+  capacity = align_up(capacity, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+
+  ring->memory_fd_ = memfd_create("edgeflow-ring", MFD_CLOEXEC);
+  ring->data_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  ring->space_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ring->memory_fd_ < 0 || ring->data_fd_ < 0 || ring->space_fd_ < 0 ||
+      ftruncate(ring->memory_fd_,
+                static_cast<off_t>(control_size() + capacity)) < 0 ||
+      !ring->map(capacity)) {
+    __android_log_print(ANDROID_LOG_ERROR, "SharedMemoryRing::create",
+                        "Failed to create a ring of %zu bytes: %s", capacity,
+                        std::strerror(errno));
+    return nullptr;
+  }
+  ring->control_ = new (ring->control_) Control();
+  ring->control_->capacity = capacity;
+  return ring;
+}
+
+std::shared_ptr<SharedMemoryRing>
+SharedMemoryRing::attach(int memory_fd, int data_fd, int space_fd) {
+  std::shared_ptr<SharedMemoryRing> ring(new SharedMemoryRing());
+  ring->memory_fd_ = memory_fd;
+  ring->data_fd_ = data_fd;
+  ring->space_fd_ = space_fd;
+
+  struct stat memory_stat{};
+  if (fstat(memory_fd, &memory_stat) < 0 ||
+      static_cast<size_t>(memory_stat.st_size) <= control_size() ||
+      !ring->map(static_cast<size_t>(memory_stat.st_size) - control_size())) {
+    __android_log_print(ANDROID_LOG_ERROR, "SharedMemoryRing::attach",
+                        "Failed to map the ring: %s", std::strerror(errno));
+    return nullptr;
+  }
+  if (ring->control_->magic != Control::kMagic ||
+      ring->control_->capacity != ring->capacity_) {
+    __android_log_print(ANDROID_LOG_ERROR, "SharedMemoryRing::attach",
+                        "The shared memory is not a ring");
+    return nullptr;
+  }
+  // Records published before the consumer attached
+  ring->read_position_ = ring->control_->tail.load(std::memory_order_acquire);
+  if (ring->read_position_ % kAlignment != 0) {
+    __android_log_print(ANDROID_LOG_ERROR, "SharedMemoryRing::attach",
+                        "The tail of the ring is not aligned");
+    return nullptr;
+  }
+  return ring;
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+  if (control_) {
+    munmap(control_, mapping_size_);
+  }
+  for (const int fd: {memory_fd_, data_fd_, space_fd_, link_fd_}) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+bool SharedMemoryRing::map(size_t capacity) {
+  mapping_size_ = control_size() + capacity;
+  void *mapping = mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, memory_fd_, 0);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  control_ = static_cast<Control *>(mapping);
+  records_ = static_cast<uint8_t *>(mapping) + control_size();
+  capacity_ = capacity;
+  return true;
+}
+
+SharedMemoryRing::RecordHeader *
+SharedMemoryRing::record_at(uint64_t position) const {
+  return reinterpret_cast<RecordHeader *>(records_ + position % capacity_);
+}
+
+bool SharedMemoryRing::fits(uint64_t position, uint64_t size,
+                            uint64_t end) const {
+  return size >= sizeof(RecordHeader) && size % kAlignment == 0 &&
+         size <= capacity_ - position % capacity_ && size <= end - position;
+}
+
+bool SharedMemoryRing::push(const iovec *head, size_t head_count,
+                            const iovec *payload, size_t payload_count,
+                            std::chrono::milliseconds timeout) {
+  size_t head_size = 0;
+  for (size_t i = 0; i < head_count; ++i) head_size += head[i].iov_len;
+  size_t payload_size = 0;
+  for (size_t i = 0; i < payload_count; ++i) payload_size += payload[i].iov_len;
+  const size_t offset = payload_offset(head_size, sizeof(RecordHeader));
+  const size_t size = align_up(offset + payload_size, kAlignment);
+  if (closed_) {
+    return false;
+  }
+
+  // The producer is the only writer of the head
+  uint64_t position = control_->head.load(std::memory_order_relaxed);
+  const size_t left = capacity_ - position % capacity_;
+  const size_t filler = size > left ? left : 0;
+  // The space is never free if the record and the filler before it take
+  // more than the whole buffer
+  if (filler + size > capacity_) {
+    return false;
+  }
+  if (!wait_for_space(position, filler + size,
+                      congested_ ? std::chrono::milliseconds(0) : timeout)) {
+    return false;
+  }
+  if (filler > 0) {
+    RecordHeader *header = record_at(position);
+    header->size = filler;
+    header->payload_size = 0;
+    header->head_size = 0;
+    header->filler = 1;
+    // Released by the consumer once it passed it, as reclaiming it earlier
+    // lets this overwrite it before it is read
+    header->released.store(0, std::memory_order_relaxed);
+    position += filler;
+  }
+
+  RecordHeader *header = record_at(position);
+  header->size = size;
+  header->payload_size = payload_size;
+  header->head_size = static_cast<uint32_t>(head_size);
+  header->filler = 0;
+  header->released.store(0, std::memory_order_relaxed);
+  uint8_t *dst = reinterpret_cast<uint8_t *>(header) + sizeof(RecordHeader);
+  for (size_t i = 0; i < head_count; ++i) {
+    std::memcpy(dst, head[i].iov_base, head[i].iov_len);
+    dst += head[i].iov_len;
+  }
+  dst = reinterpret_cast<uint8_t *>(header) + offset;
+  for (size_t i = 0; i < payload_count; ++i) {
+    std::memcpy(dst, payload[i].iov_base, payload[i].iov_len);
+    dst += payload[i].iov_len;
+  }
+
+  // Pairs with `sleep`: either the consumer sees the record, or this sees
+  // it waiting
+  control_->head.store(position + size, std::memory_order_seq_cst);
+  if (control_->consumer_waiting.load(std::memory_order_seq_cst) &&
+      control_->consumer_waiting.exchange(0, std::memory_order_seq_cst)) {
+    const uint64_t signal = 1;
+    write(data_fd_, &signal, sizeof(signal));
+  }
+  return true;
+}
+
+bool SharedMemoryRing::wait_for_space(uint64_t position, size_t size,
+                                      std::chrono::milliseconds timeout) {
+  const auto has_space = [&] {
+    return capacity_ - (position - control_->tail.load(std::memory_order_seq_cst)) >=
+           size;
+  };
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!has_space()) {
+    const auto left = std::chrono::ceil<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now());
+    if (left.count() <= 0) {
+      // A signal sent meanwhile only wakes the next wait up early
+      control_->producer_waiting.store(0, std::memory_order_relaxed);
+      congested_ = true;
+      return false;
+    }
+    // Pairs with `release`: either the consumer sees this waiting, or this
+    // sees the reclaimed space
+    control_->producer_waiting.store(1, std::memory_order_seq_cst);
+    if (has_space()) {
+      control_->producer_waiting.store(0, std::memory_order_relaxed);
+      break;
+    }
+    // Nothing is sent on the link; it only becomes readable on hang-up
+    pollfd fds[] = {{space_fd_, POLLIN, 0}, {link_fd_, POLLIN, 0}};
+    const int ready = poll(fds, 2, static_cast<int>(left.count()));
+    if (ready == 0) {
+      continue;
+    }
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      closed_ = true;
+      return false;
+    }
+    if (fds[1].revents != 0) {
+      closed_ = true;
+      return false;
+    }
+    uint64_t signals = 0;
+    read(space_fd_, &signals, sizeof(signals));
+  }
+  congested_ = false;
+  return true;
+}
+
+bool SharedMemoryRing::next(Record &record) {
+  if (corrupt_) {
+    return false;
+  }
+  const uint64_t head = control_->head.load(std::memory_order_acquire);
+  while (read_position_ != head) {
+    RecordHeader *header = record_at(read_position_);
+    // Read once, as the producer may write them meanwhile
+    const uint64_t size = header->size;
+    const uint64_t payload_size = header->payload_size;
+    const size_t head_size = header->head_size;
+    const bool filler = header->filler != 0;
+    const size_t offset = payload_offset(head_size, sizeof(RecordHeader));
+    if (!fits(read_position_, size, head) ||
+        (!filler && (offset > size || payload_size > size - offset))) {
+      __android_log_print(ANDROID_LOG_ERROR, "SharedMemoryRing::next",
+                          "Malformed record of %llu bytes at %llu",
+                          static_cast<unsigned long long>(size),
+                          static_cast<unsigned long long>(read_position_));
+      corrupt_ = true;
+      return false;
+    }
+    read_position_ += size;
+    if (filler) {
+      // Reclaimed along with the record after it
+      header->released.store(1, std::memory_order_release);
+      continue;
+    }
+    auto *start = reinterpret_cast<uint8_t *>(header);
+    record.head = start + sizeof(RecordHeader);
+    record.head_size = head_size;
+    record.payload = start + offset;
+    record.payload_size = payload_size;
+    return true;
+  }
+  return false;
+}
+
+bool SharedMemoryRing::sleep() {
+  // Pairs with `push`
+  control_->consumer_waiting.store(1, std::memory_order_seq_cst);
+  if (control_->head.load(std::memory_order_seq_cst) != read_position_) {
+    control_->consumer_waiting.store(0, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+void SharedMemoryRing::wake_up() {
+  uint64_t signals = 0;
+  read(data_fd_, &signals, sizeof(signals));
+}
+
+void SharedMemoryRing::release(const Record &record) {
+  auto *header = reinterpret_cast<RecordHeader *>(
+      const_cast<uint8_t *>(record.head) - sizeof(RecordHeader));
+  header->released.store(1, std::memory_order_release);
+
+  // Reclaim the released records at the tail; the ones past the head may
+  // hold stale flags from the previous lap. A size that does not fit stops
+  // the reclaiming, and `next` finds the ring corrupt there.
+  std::lock_guard<std::mutex> lock(reclaim_mtx_);
+  const uint64_t head = control_->head.load(std::memory_order_acquire);
+  const uint64_t start = control_->tail.load(std::memory_order_relaxed);
+  uint64_t tail = start;
+  while (tail != head) {
+    const RecordHeader *reclaimed = record_at(tail);
+    const uint64_t size = reclaimed->size;
+    if (!reclaimed->released.load(std::memory_order_acquire) ||
+        !fits(tail, size, head)) {
+      break;
+    }
+    tail += size;
+  }
+  if (tail == start) {
+    return;
+  }
+
+  // Pairs with `wait_for_space`
+  control_->tail.store(tail, std::memory_order_seq_cst);
+  if (control_->producer_waiting.load(std::memory_order_seq_cst) &&
+      control_->producer_waiting.exchange(0, std::memory_order_seq_cst)) {
+    const uint64_t signal = 1;
+    write(space_fd_, &signal, sizeof(signal));
+  }
+}
+
+std::unique_ptr<arm_compute::Tensor>
+SharedMemoryRing::wrap(const Record &record,
+                       const arm_compute::TensorInfo &info) {
+  if (info.total_size() > record.payload_size) {
+    release(record);
+    return nullptr;
+  }
+  auto tensor = std::make_unique<RecordTensor>(shared_from_this(), record);
+  tensor->allocator()->init(info);
+  tensor->allocator()->import_memory(record.payload);
+  return tensor;
+}
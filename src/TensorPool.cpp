@@ -0,0 +1,172 @@
+#include "edgeflow/TensorPool.h"
+#include <android/log.h>
+#include <cstdlib>
+
+/// Tensor that imports a pooled buffer and returns it on destruction
+class TensorPool::PooledTensor : public arm_compute::Tensor {
+public:
+  PooledTensor(TensorPool &pool, void *block, size_t size_class)
+      : pool_(pool), block_(block), size_class_(size_class) {}
+
+  ~PooledTensor() override { pool_.release(block_, size_class_); }
+
+private:
+  TensorPool &pool_;
+  void *block_;
+  size_t size_class_;
+};
+
+/// Per-thread cache of free blocks
+struct TensorPool::ThreadCache {
+  std::array<std::vector<void *>, kNumSizeClasses> blocks{};
+
+  ~ThreadCache() {
+    // Hand the cached blocks back to the shared free lists on thread exit
+    TensorPool &pool = TensorPool::instance();
+    std::lock_guard<std::mutex> lock(pool.free_lists_mtx_);
+    for (size_t size_class = 0; size_class < kNumSizeClasses; ++size_class) {
+      auto &free_list = pool.free_lists_[size_class];
+      free_list.insert(free_list.end(),
+                       blocks[size_class].begin(), blocks[size_class].end());
+    }
+  }
+};
+
+TensorPool &TensorPool::instance() {
+  // Intentionally leaked: thread caches may flush into the pool while the
+  // static objects are being destroyed at process exit.
+  static auto *pool = new TensorPool();
+  return *pool;
+}
+
+TensorPool::ThreadCache &TensorPool::thread_cache() {
+  static thread_local ThreadCache cache;
+  return cache;
+}
+
+std::unique_ptr<arm_compute::Tensor>
+TensorPool::allocate(const arm_compute::TensorInfo &info) {
+  const int size_class = size_class_of(info.total_size());
+  if (size_class < 0) {
+    __android_log_print(ANDROID_LOG_ERROR, "TensorPool::allocate",
+                        "Tensor of %zu bytes exceeds the largest size class",
+                        info.total_size());
+    return nullptr;
+  }
+
+  void *block = acquire(size_class);
+  if (!block) {
+    __android_log_print(ANDROID_LOG_ERROR, "TensorPool::allocate",
+                        "Failed to allocate %zu bytes", block_size(size_class));
+    return nullptr;
+  }
+
+  auto tensor = std::make_unique<PooledTensor>(*this, block, size_class);
+  tensor->allocator()->init(info);
+  tensor->allocator()->import_memory(block);
+  return tensor;
+}
+
+TensorPool::Stats TensorPool::stats() const {
+  Stats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.bytes_in_use = bytes_in_use_.load(std::memory_order_relaxed);
+  stats.high_water_mark = high_water_mark_.load(std::memory_order_relaxed);
+  stats.bytes_reserved = bytes_reserved_.load(std::memory_order_relaxed);
+  stats.peak_bytes_reserved =
+      peak_bytes_reserved_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void TensorPool::log_stats() const {
+  const Stats s = stats();
+  __android_log_print(
+      ANDROID_LOG_INFO, "TensorPool::log_stats",
+      "hits=%llu misses=%llu in_use=%zu high_water_mark=%zu"
+      " reserved=%zu peak_reserved=%zu",
+      static_cast<unsigned long long>(s.hits),
+      static_cast<unsigned long long>(s.misses),
+      s.bytes_in_use, s.high_water_mark,
+      s.bytes_reserved, s.peak_bytes_reserved);
+}
+
+void TensorPool::trim() {
+  std::lock_guard<std::mutex> lock(free_lists_mtx_);
+  for (size_t size_class = 0; size_class < kNumSizeClasses; ++size_class) {
+    for (void *block: free_lists_[size_class]) {
+      std::free(block);
+      bytes_reserved_.fetch_sub(block_size(size_class),
+                                std::memory_order_relaxed);
+    }
+    free_lists_[size_class].clear();
+  }
+}
+
+int TensorPool::size_class_of(size_t bytes) {
+  size_t size_class = 0;
+  while (block_size(size_class) < bytes) {
+    if (++size_class == kNumSizeClasses) {
+      return -1;
+    }
+  }
+  return static_cast<int>(size_class);
+}
+
+void *TensorPool::acquire(size_t size_class) {
+  const size_t size = block_size(size_class);
+  void *block = nullptr;
+
+  // 1. Thread-local cache
+  auto &cached = thread_cache().blocks[size_class];
+  if (!cached.empty()) {
+    block = cached.back();
+    cached.pop_back();
+  }
+
+  // 2. Shared free list
+  if (!block) {
+    std::lock_guard<std::mutex> lock(free_lists_mtx_);
+    auto &free_list = free_lists_[size_class];
+    if (!free_list.empty()) {
+      block = free_list.back();
+      free_list.pop_back();
+    }
+  }
+
+  if (block) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    // 3. System allocator
+    if (posix_memalign(&block, block_size(0), size) != 0) {
+      return nullptr;
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    add_bytes(bytes_reserved_, peak_bytes_reserved_, size);
+  }
+
+  add_bytes(bytes_in_use_, high_water_mark_, size);
+  return block;
+}
+
+void TensorPool::release(void *block, size_t size_class) {
+  bytes_in_use_.fetch_sub(block_size(size_class), std::memory_order_relaxed);
+
+  auto &cached = thread_cache().blocks[size_class];
+  if (cached.size() < kThreadCacheCapacity) {
+    cached.push_back(block);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(free_lists_mtx_);
+  free_lists_[size_class].push_back(block);
+}
+
+void TensorPool::add_bytes(std::atomic<size_t> &bytes,
+                           std::atomic<size_t> &peak, size_t delta) {
+  const size_t now = bytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+  size_t prev = peak.load(std::memory_order_relaxed);
+  while (now > prev &&
+         !peak.compare_exchange_weak(prev, now, std::memory_order_relaxed)) {
+  }
+}
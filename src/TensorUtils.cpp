@@ -0,0 +1,115 @@
+#include "edgeflow/TensorUtils.h"
+#include "edgeflow/TensorPool.h"
+#include <cstring>
+
+size_t range_axis(const arm_compute::TensorShape &shape) {
+  return shape.num_dimensions() >= 2 ? 1 : 0;
+}
+
+arm_compute::TensorShape slab_shape(const arm_compute::TensorShape &shape,
+                                    const Range &range) {
+  arm_compute::TensorShape slab = shape;
+  slab.set(range_axis(shape), range.num_elements());
+  return slab;
+}
+
+/// A view sharing the buffer of the tensor it slices
+class SlabView : public arm_compute::Tensor {
+public:
+  explicit SlabView(std::shared_ptr<arm_compute::ITensor> source)
+      : source_(std::move(source)) {}
+
+private:
+  std::shared_ptr<arm_compute::ITensor> source_;
+};
+
+bool is_packed(const arm_compute::ITensorInfo &info) {
+  const auto &shape = info.tensor_shape();
+  const auto &strides = info.strides_in_bytes();
+  size_t stride = info.element_size();
+  for (size_t d = 0; d < shape.num_dimensions(); ++d) {
+    if (shape[d] > 1 && strides[d] != stride) {
+      return false;
+    }
+    stride *= shape[d];
+  }
+  return true;
+}
+
+void copy_slab(const arm_compute::ITensor &src, const Range &src_range,
+               arm_compute::ITensor &dst, int dst_start) {
+  const auto &src_shape = src.info()->tensor_shape();
+  const auto &src_strides = src.info()->strides_in_bytes();
+  const auto &dst_strides = dst.info()->strides_in_bytes();
+  const size_t axis = range_axis(src_shape);
+  const size_t element_size = src.info()->element_size();
+
+  // Elements up to the axis are contiguous, as views only slice the axis;
+  // the dimensions above it repeat with their own strides
+  size_t inner = 1;
+  for (size_t d = 0; d < axis; ++d) inner *= src_shape[d];
+  size_t outer = 1;
+  for (size_t d = axis + 1; d < src_shape.num_dimensions(); ++d) {
+    outer *= src_shape[d];
+  }
+  const size_t block_bytes = inner * src_range.num_elements() * element_size;
+
+  const uint8_t *src_base = src.buffer() +
+                            src.info()->offset_first_element_in_bytes() +
+                            src_range.start * src_strides[axis];
+  uint8_t *dst_base = dst.buffer() + dst.info()->offset_first_element_in_bytes() +
+                      dst_start * dst_strides[axis];
+  for (size_t o = 0; o < outer; ++o) {
+    size_t src_offset = 0;
+    size_t dst_offset = 0;
+    size_t index = o;
+    for (size_t d = axis + 1; d < src_shape.num_dimensions(); ++d) {
+      src_offset += (index % src_shape[d]) * src_strides[d];
+      dst_offset += (index % src_shape[d]) * dst_strides[d];
+      index /= src_shape[d];
+    }
+    std::memcpy(dst_base + dst_offset, src_base + src_offset, block_bytes);
+  }
+}
+
+std::unique_ptr<arm_compute::Tensor>
+copy_slab(const arm_compute::ITensor &src, const Range &range) {
+  auto slab = TensorPool::instance().allocate(arm_compute::TensorInfo(
+      slab_shape(src.info()->tensor_shape(), range), 1,
+      src.info()->data_type()));
+  if (slab) {
+    copy_slab(src, range, *slab, 0);
+  }
+  return slab;
+}
+
+size_t slab_offset(const arm_compute::ITensorInfo &info, const Range &range) {
+  const size_t axis = range_axis(info.tensor_shape());
+  return info.offset_first_element_in_bytes() +
+         range.start * info.strides_in_bytes()[axis];
+}
+
+arm_compute::TensorInfo slab_info(const arm_compute::ITensorInfo &info,
+                                  const Range &range) {
+  arm_compute::TensorInfo view_info;
+  view_info.init(slab_shape(info.tensor_shape(), range), 1, info.data_type(),
+                 info.strides_in_bytes(), 0,
+                 info.total_size() - slab_offset(info, range));
+  return view_info;
+}
+
+std::unique_ptr<arm_compute::Tensor>
+slab_view(const std::shared_ptr<arm_compute::ITensor> &src, const Range &range) {
+  const arm_compute::ITensorInfo &info = *src->info();
+  const auto &shape = info.tensor_shape();
+  const size_t axis = range_axis(shape);
+  if (!range.valid() || range.start < 0 ||
+      range.end > static_cast<int>(shape[axis])) {
+    return nullptr;
+  }
+
+  auto view = std::make_unique<SlabView>(src);
+  view->allocator()->init(slab_info(info, range));
+  view->allocator()->import_memory(src->buffer() + slab_offset(info, range));
+  return view;
+}
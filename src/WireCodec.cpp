@@ -0,0 +1,333 @@
+#include "edgeflow/WireCodec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON) && defined(__aarch64__) && !defined(EDGEFLOW_WIRE_SCALAR)
+#include <arm_neon.h>
+#define EDGEFLOW_WIRE_NEON 1
+#endif
+
+/// Bytes of the scale and zero point before the Int8 elements
+static constexpr size_t kInt8Header = sizeof(float) + sizeof(int32_t);
+
+static uint16_t float_to_half(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const uint32_t magnitude = bits & 0x7FFFFFFF;
+  if (magnitude >= 0x7F800000) { // Infinity, or NaN kept quiet
+    return static_cast<uint16_t>(sign | 0x7C00 |
+                                 (magnitude > 0x7F800000 ? 0x200 : 0));
+  }
+  if (magnitude >= 0x477FF000) { // Rounds past the largest half
+    return static_cast<uint16_t>(sign | 0x7C00);
+  }
+  if (magnitude < 0x38800000) { // Subnormal half; exact in F32 times 2^24
+    float subnormal;
+    std::memcpy(&subnormal, &magnitude, sizeof(subnormal));
+    return static_cast<uint16_t>(
+        sign | static_cast<uint32_t>(std::nearbyint(subnormal * 16777216.0f)));
+  }
+  // Rebias the exponent, and round the dropped mantissa bits to nearest even
+  const uint32_t rebiased = magnitude - 0x38000000;
+  return static_cast<uint16_t>(
+      sign | ((rebiased + 0x0FFF + ((rebiased >> 13) & 1)) >> 13));
+}
+
+static float half_to_float(uint16_t half) {
+  const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1F;
+  const uint32_t mantissa = half & 0x3FF;
+  if (exponent == 0) {
+    const float magnitude = static_cast<float>(mantissa) / 16777216.0f;
+    return sign ? -magnitude : magnitude;
+  }
+  const uint32_t bits =
+      exponent == 0x1F ? sign | 0x7F800000 | (mantissa << 13)
+                       : sign | ((exponent + 112) << 23) | (mantissa << 13);
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static size_t encode_fp16(const float *src, size_t count, uint16_t *dst) {
+  size_t i = 0;
+#ifdef EDGEFLOW_WIRE_NEON
+  for (; i + 8 <= count; i += 8) {
+    const float16x8_t half = vcombine_f16(vcvt_f16_f32(vld1q_f32(src + i)),
+                                          vcvt_f16_f32(vld1q_f32(src + i + 4)));
+    vst1q_u16(dst + i, vreinterpretq_u16_f16(half));
+  }
+#endif
+  for (; i < count; ++i) dst[i] = float_to_half(src[i]);
+  return count * sizeof(uint16_t);
+}
+
+static void decode_fp16(const uint16_t *src, size_t count, float *dst) {
+  size_t i = 0;
+#ifdef EDGEFLOW_WIRE_NEON
+  for (; i + 8 <= count; i += 8) {
+    const float16x8_t half = vreinterpretq_f16_u16(vld1q_u16(src + i));
+    vst1q_f32(dst + i, vcvt_f32_f16(vget_low_f16(half)));
+    vst1q_f32(dst + i + 4, vcvt_high_f32_f16(half));
+  }
+#endif
+  for (; i < count; ++i) dst[i] = half_to_float(src[i]);
+}
+
+/// Smallest and largest element, zero included so that it stays exact
+static void min_max(const float *src, size_t count, float &min, float &max) {
+  min = 0;
+  max = 0;
+  size_t i = 0;
+#ifdef EDGEFLOW_WIRE_NEON
+  float32x4_t min4 = vdupq_n_f32(0), max4 = vdupq_n_f32(0);
+  for (; i + 4 <= count; i += 4) {
+    const float32x4_t v = vld1q_f32(src + i);
+    min4 = vminq_f32(min4, v);
+    max4 = vmaxq_f32(max4, v);
+  }
+  min = vminvq_f32(min4);
+  max = vmaxvq_f32(max4);
+#endif
+  for (; i < count; ++i) {
+    min = std::min(min, src[i]);
+    max = std::max(max, src[i]);
+  }
+}
+
+static size_t encode_int8(const float *src, size_t count, uint8_t *dst,
+                          float &scale) {
+  float min, max;
+  min_max(src, count, min, max);
+  scale = max > min ? (max - min) / 255.0f : 1.0f;
+  const auto zero_point = static_cast<int32_t>(std::clamp(
+      std::nearbyint(-128.0f - min / scale), -128.0f, 127.0f));
+  std::memcpy(dst, &scale, sizeof(scale));
+  std::memcpy(dst + sizeof(scale), &zero_point, sizeof(zero_point));
+  auto *quantized = reinterpret_cast<int8_t *>(dst + kInt8Header);
+
+  const float inverse_scale = 1.0f / scale;
+  size_t i = 0;
+#ifdef EDGEFLOW_WIRE_NEON
+  const float32x4_t inverse4 = vdupq_n_f32(inverse_scale);
+  const int32x4_t zero_point4 = vdupq_n_s32(zero_point);
+  const auto quantize = [&](size_t at) {
+    return vaddq_s32(vcvtnq_s32_f32(vmulq_f32(vld1q_f32(src + at), inverse4)),
+                     zero_point4);
+  };
+  for (; i + 16 <= count; i += 16) {
+    // Saturating narrowing clamps to [-128, 127]
+    const int16x8_t low =
+        vcombine_s16(vqmovn_s32(quantize(i)), vqmovn_s32(quantize(i + 4)));
+    const int16x8_t high =
+        vcombine_s16(vqmovn_s32(quantize(i + 8)), vqmovn_s32(quantize(i + 12)));
+    vst1q_s8(quantized + i, vcombine_s8(vqmovn_s16(low), vqmovn_s16(high)));
+  }
+#endif
+  for (; i < count; ++i) {
+    const float q = std::nearbyint(src[i] * inverse_scale) +
+                    static_cast<float>(zero_point);
+    quantized[i] = static_cast<int8_t>(std::clamp(q, -128.0f, 127.0f));
+  }
+  return kInt8Header + count;
+}
+
+static void decode_int8(const uint8_t *src, size_t count, float *dst) {
+  float scale;
+  int32_t zero_point;
+  std::memcpy(&scale, src, sizeof(scale));
+  std::memcpy(&zero_point, src + sizeof(scale), sizeof(zero_point));
+  const auto *quantized = reinterpret_cast<const int8_t *>(src + kInt8Header);
+
+  size_t i = 0;
+#ifdef EDGEFLOW_WIRE_NEON
+  const float32x4_t scale4 = vdupq_n_f32(scale);
+  const int32x4_t zero_point4 = vdupq_n_s32(zero_point);
+  const auto dequantize = [&](int32x4_t q) {
+    return vmulq_f32(vcvtq_f32_s32(vsubq_s32(q, zero_point4)), scale4);
+  };
+  for (; i + 16 <= count; i += 16) {
+    const int8x16_t q = vld1q_s8(quantized + i);
+    const int16x8_t low = vmovl_s8(vget_low_s8(q));
+    const int16x8_t high = vmovl_high_s8(q);
+    vst1q_f32(dst + i, dequantize(vmovl_s16(vget_low_s16(low))));
+    vst1q_f32(dst + i + 4, dequantize(vmovl_high_s16(low)));
+    vst1q_f32(dst + i + 8, dequantize(vmovl_s16(vget_low_s16(high))));
+    vst1q_f32(dst + i + 12, dequantize(vmovl_high_s16(high)));
+  }
+#endif
+  for (; i < count; ++i) {
+    dst[i] = static_cast<float>(quantized[i] - zero_point) * scale;
+  }
+}
+
+/// Bit `k` of the mask is set if element `k` of the 8 is nonzero
+static uint8_t nonzero_mask(const float *src) {
+#ifdef EDGEFLOW_WIRE_NEON
+  static const uint32_t kLowBits[4] = {1, 2, 4, 8};
+  static const uint32_t kHighBits[4] = {16, 32, 64, 128};
+  const float32x4_t zero = vdupq_n_f32(0);
+  const uint32x4_t low = vbicq_u32(vld1q_u32(kLowBits),
+                                   vceqq_f32(vld1q_f32(src), zero));
+  const uint32x4_t high = vbicq_u32(vld1q_u32(kHighBits),
+                                    vceqq_f32(vld1q_f32(src + 4), zero));
+  return static_cast<uint8_t>(vaddvq_u32(vorrq_u32(low, high)));
+#else
+  uint8_t mask = 0;
+  for (int k = 0; k < 8; ++k) {
+    mask |= static_cast<uint8_t>(src[k] != 0) << k;
+  }
+  return mask;
+#endif
+}
+
+static size_t encode_sparse(const float *src, size_t count, uint8_t *dst) {
+  const size_t bitmap_size = (count + 7) / 8;
+  uint8_t *bitmap = dst;
+  uint8_t *values = dst + bitmap_size; // Not aligned
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint8_t mask = nonzero_mask(src + i);
+    bitmap[i / 8] = mask;
+    // Dense and empty groups are common in ReLU outputs
+    if (mask == 0xFF) {
+      std::memcpy(values, src + i, 8 * sizeof(float));
+      values += 8 * sizeof(float);
+    } else if (mask != 0) {
+      for (int k = 0; k < 8; ++k) {
+        if (mask & (1 << k)) {
+          std::memcpy(values, src + i + k, sizeof(float));
+          values += sizeof(float);
+        }
+      }
+    }
+  }
+  if (i < count) {
+    uint8_t mask = 0;
+    for (size_t k = 0; i + k < count; ++k) {
+      if (src[i + k] != 0) {
+        mask |= static_cast<uint8_t>(1 << k);
+        std::memcpy(values, src + i + k, sizeof(float));
+        values += sizeof(float);
+      }
+    }
+    bitmap[i / 8] = mask;
+  }
+  return static_cast<size_t>(values - dst);
+}
+
+static bool decode_sparse(const uint8_t *src, size_t size, float *dst,
+                          size_t count) {
+  const size_t bitmap_size = (count + 7) / 8;
+  if (size < bitmap_size || (size - bitmap_size) % sizeof(float) != 0) {
+    return false;
+  }
+  const uint8_t *bitmap = src;
+  const uint8_t *values = src + bitmap_size;
+  const size_t num_values = (size - bitmap_size) / sizeof(float);
+  size_t num_read = 0;
+
+  for (size_t i = 0; i < count; i += 8) {
+    const uint8_t mask = bitmap[i / 8];
+    const size_t group = std::min<size_t>(8, count - i);
+    const size_t num_set = static_cast<size_t>(__builtin_popcount(mask));
+    // The bits past the last element are clear
+    if (num_read + num_set > num_values || (group < 8 && (mask >> group) != 0)) {
+      return false;
+    }
+    if (mask == 0xFF) {
+      std::memcpy(dst + i, values + num_read * sizeof(float), 8 * sizeof(float));
+    } else {
+      std::memset(dst + i, 0, group * sizeof(float));
+      const uint8_t *value = values + num_read * sizeof(float);
+      for (size_t k = 0; k < group; ++k) {
+        if (mask & (1 << k)) {
+          std::memcpy(dst + i + k, value, sizeof(float));
+          value += sizeof(float);
+        }
+      }
+    }
+    num_read += num_set;
+  }
+  return num_read == num_values;
+}
+
+size_t max_encoded_size(WireCodec codec, size_t count) {
+  switch (codec) {
+    case WireCodec::Sparse:
+      return (count + 7) / 8 + count * sizeof(float);
+    case WireCodec::FP16:
+      return count * sizeof(uint16_t);
+    case WireCodec::Int8:
+      return kInt8Header + count;
+    case WireCodec::Raw:
+      break;
+  }
+  return count * sizeof(float);
+}
+
+size_t encode_elements(WireCodec codec, const float *src, size_t count,
+                       uint8_t *dst, float *max_error) {
+  float error = 0;
+  size_t size = 0;
+  switch (codec) {
+    case WireCodec::Sparse: {
+      size = encode_sparse(src, count, dst);
+      break;
+    }
+    case WireCodec::FP16: {
+      size = encode_fp16(src, count, reinterpret_cast<uint16_t *>(dst));
+      if (max_error) {
+        // Half of the unit in the last place of the largest magnitude
+        float min, max;
+        min_max(src, count, min, max);
+        error = std::max(-min, max) * std::ldexp(1.0f, -11);
+      }
+      break;
+    }
+    case WireCodec::Int8: {
+      float scale;
+      size = encode_int8(src, count, dst, scale);
+      error = scale / 2;
+      break;
+    }
+    case WireCodec::Raw: {
+      size = count * sizeof(float);
+      std::memcpy(dst, src, size);
+      break;
+    }
+  }
+  if (max_error) {
+    *max_error = error;
+  }
+  return size;
+}
+
+bool decode_elements(WireCodec codec, const uint8_t *src, size_t size,
+                     float *dst, size_t count) {
+  switch (codec) {
+    case WireCodec::Sparse:
+      return decode_sparse(src, size, dst, count);
+    case WireCodec::FP16:
+      if (size != count * sizeof(uint16_t)) {
+        return false;
+      }
+      decode_fp16(reinterpret_cast<const uint16_t *>(src), count, dst);
+      return true;
+    case WireCodec::Int8:
+      if (size != kInt8Header + count) {
+        return false;
+      }
+      decode_int8(src, count, dst);
+      return true;
+    case WireCodec::Raw:
+      break;
+  }
+  if (size != count * sizeof(float)) {
+    return false;
+  }
+  std::memcpy(dst, src, size);
+  return true;
+}
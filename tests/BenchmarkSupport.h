@@ -0,0 +1,47 @@
+#ifndef EDGEFLOW_BENCHMARKSUPPORT_H
+#define EDGEFLOW_BENCHMARKSUPPORT_H
+
+#include "edgeflow/NetworkEventHandler.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+/// Milliseconds elapsed since the time point
+inline double ms_since(std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/// Percentile of the samples, e.g., 0.5 for the median
+inline double percentile(std::vector<double> samples, double fraction) {
+  if (samples.empty()) {
+    return 0;
+  }
+  const size_t index = std::min(
+      samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+  return samples[index];
+}
+
+/// Count given as the first argument of the benchmark, e.g., of iterations
+/// or inferences, or the default
+inline size_t count_argument(int argc, char **argv, size_t default_count) {
+  return argc > 1 ? std::strtoul(argv[1], nullptr, 10) : default_count;
+}
+
+/// Take the address the device listening on the port would take the rings
+/// of its peers on, so that its same-host peers send to it over TCP
+/// @return The socket holding the address; closing it gives it back
+inline int hold_ring_address(unsigned int port) {
+  sockaddr_un address;
+  const socklen_t length = NetworkEventHandler::ring_address(port, address);
+  const int holder = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  CHECK(holder >= 0 &&
+        bind(holder, reinterpret_cast<sockaddr *>(&address), length) == 0);
+  return holder;
+}
+
+#endif // EDGEFLOW_BENCHMARKSUPPORT_H
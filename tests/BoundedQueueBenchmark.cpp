@@ -0,0 +1,64 @@
+#include "BoundedQueue.hpp"
+#include "BenchmarkSupport.h"
+#include "TestSupport.h"
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+/// Items per millisecond through the queue, from the producers to the
+/// consumers, each producer pushing `items_per_producer` with `push`
+static double measure(size_t capacity, unsigned int num_producers,
+                      unsigned int num_consumers, size_t items_per_producer) {
+  BoundedQueue<size_t> queue(capacity, OverflowPolicy::Block);
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> consumers;
+  std::vector<size_t> popped(num_consumers, 0);
+  for (unsigned int c = 0; c < num_consumers; ++c) {
+    consumers.emplace_back([&, c] {
+      while (queue.pop()) {
+        ++popped[c];
+      }
+    });
+  }
+  std::vector<std::thread> producers;
+  for (unsigned int p = 0; p < num_producers; ++p) {
+    producers.emplace_back([&] {
+      for (size_t i = 0; i < items_per_producer; ++i) {
+        CHECK(queue.push(std::make_unique<size_t>(i)));
+      }
+    });
+  }
+  for (auto &producer: producers) producer.join();
+  // Consumers drain what is left, then see the queue closed
+  queue.close();
+  for (auto &consumer: consumers) consumer.join();
+  const double elapsed_ms = ms_since(start);
+
+  size_t total = 0;
+  for (const size_t count: popped) {
+    total += count;
+  }
+  CHECK(total == num_producers * items_per_producer);
+  return total / elapsed_ms;
+}
+
+/// Throughput of the queue by the number of producers and consumers, for a
+/// small queue, on which both sides block often, and a large one
+int main(int argc, char **argv) {
+  const size_t items = count_argument(argc, argv, 200000);
+  const unsigned int max_threads =
+      std::max(4u, std::thread::hardware_concurrency());
+  std::printf("%9s %10s %10s %14s\n", "capacity", "producers", "consumers",
+              "Mitem/s");
+  for (const size_t capacity: {16, 1024}) {
+    for (unsigned int producers = 1; producers <= max_threads; producers *= 2) {
+      for (unsigned int consumers = 1; consumers <= max_threads;
+           consumers *= 2) {
+        std::printf("%9zu %10u %10u %14.3f\n", capacity, producers, consumers,
+                    measure(capacity, producers, consumers,
+                            items / producers) / 1e3);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,130 @@
+#include "BoundedQueue.hpp"
+#include "TestSupport.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+/// Every item pushed by several producers is popped exactly once by several
+/// consumers, through a queue small enough that both sides block
+static void test_mpmc_exactly_once() {
+  constexpr int kProducers = 4, kConsumers = 4, kItemsPerProducer = 20000;
+  BoundedQueue<int> queue(8);
+  std::vector<std::atomic<int>> seen(kProducers * kItemsPerProducer);
+
+  std::vector<std::thread> consumers;
+  for (int c = 0; c < kConsumers; ++c) {
+    consumers.emplace_back([&] {
+      while (auto item = queue.pop()) {
+        seen[*item].fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; ++p) {
+    producers.emplace_back([&, p] {
+      for (int i = 0; i < kItemsPerProducer; ++i) {
+        CHECK(queue.push(std::make_unique<int>(p * kItemsPerProducer + i)));
+      }
+    });
+  }
+  for (auto &producer: producers) producer.join();
+  // Consumers drain what is left, then see the queue closed
+  queue.close();
+  for (auto &consumer: consumers) consumer.join();
+
+  for (const auto &count: seen) {
+    CHECK(count.load() == 1);
+  }
+  CHECK(queue.empty());
+}
+
+/// A producer waits on a full queue until an item is popped
+static void test_block_until_space() {
+  BoundedQueue<int> queue(2, OverflowPolicy::Block);
+  CHECK(queue.push(std::make_unique<int>(0)));
+  CHECK(queue.push(std::make_unique<int>(1)));
+  CHECK(queue.full());
+
+  std::atomic<bool> pushed{false};
+  std::thread producer([&] {
+    CHECK(queue.push(std::make_unique<int>(2)));
+    pushed = true;
+  });
+  std::this_thread::sleep_for(50ms);
+  CHECK(!pushed);
+
+  auto first = queue.pop();
+  CHECK(first && *first == 0);
+  producer.join();
+  CHECK(pushed);
+  CHECK(*queue.pop() == 1);
+  CHECK(*queue.pop() == 2);
+}
+
+/// Closing the queue releases a blocked producer, which fails, and lets the
+/// consumers drain the items left
+static void test_close_releases_producer() {
+  BoundedQueue<int> queue(2, OverflowPolicy::Block);
+  CHECK(queue.push(std::make_unique<int>(0)));
+  CHECK(queue.push(std::make_unique<int>(1)));
+
+  std::atomic<int> result{-1};
+  std::thread producer([&] {
+    result = queue.push(std::make_unique<int>(2)) ? 1 : 0;
+  });
+  std::this_thread::sleep_for(50ms);
+  CHECK(result == -1);
+  queue.close();
+  producer.join();
+  CHECK(result == 0);
+
+  CHECK(*queue.pop() == 0);
+  CHECK(*queue.pop() == 1);
+  CHECK(queue.pop() == nullptr);
+  std::unique_ptr<int> item = std::make_unique<int>(3);
+  CHECK(!queue.try_push(item) && item);
+}
+
+/// The other policies discard an item instead of waiting, and count it
+static void test_overflow_policies() {
+  BoundedQueue<int> rejecting(2, OverflowPolicy::Reject);
+  for (int i = 0; i < 3; ++i) {
+    CHECK(rejecting.push(std::make_unique<int>(i)) == (i < 2));
+  }
+  CHECK(rejecting.rejected() == 1);
+  CHECK(*rejecting.try_pop() == 0);
+
+  BoundedQueue<int> dropping(2, OverflowPolicy::DropOldest);
+  for (int i = 0; i < 3; ++i) {
+    CHECK(dropping.push(std::make_unique<int>(i)));
+  }
+  CHECK(dropping.dropped() == 1);
+  CHECK(*dropping.try_pop() == 1);
+  CHECK(*dropping.try_pop() == 2);
+  CHECK(dropping.try_pop() == nullptr);
+}
+
+/// The timed operations give up once the timeout passes
+static void test_timeouts() {
+  BoundedQueue<int> queue(2);
+  const auto start = std::chrono::steady_clock::now();
+  CHECK(queue.try_pop_for(20ms) == nullptr);
+  CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+
+  CHECK(queue.push(std::make_unique<int>(0)));
+  CHECK(queue.push(std::make_unique<int>(1)));
+  std::unique_ptr<int> item = std::make_unique<int>(2);
+  CHECK(!queue.try_push_for(item, 20ms) && item);
+}
+
+int main() {
+  RUN(test_mpmc_exactly_once);
+  RUN(test_block_until_space);
+  RUN(test_close_releases_producer);
+  RUN(test_overflow_policies);
+  RUN(test_timeouts);
+  return 0;
+}
@@ -0,0 +1,195 @@
+#include "arm_compute/runtime/NEON/NEFunctions.h"
+#include "edgeflow/ExecutionPlan.h"
+#include "edgeflow/MemoryPlanner.h"
+#include "edgeflow/Orchestrator.h"
+#include "edgeflow/Partitioner.h"
+#include "BenchmarkSupport.h"
+#include "TestSupport.h"
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+static std::unique_ptr<arm_compute::Tensor> make_tensor(
+    const arm_compute::TensorShape &shape) {
+  auto tensor = std::make_unique<arm_compute::Tensor>();
+  tensor->allocator()->init(
+      arm_compute::TensorInfo(shape, 1, arm_compute::DataType::F32));
+  tensor->allocator()->allocate();
+  return tensor;
+}
+
+static std::shared_ptr<Layer> make_linear(const std::string &id,
+                                          size_t in_features,
+                                          size_t out_features,
+                                          std::mt19937 &rng) {
+  auto layer = std::make_shared<Layer>(Layer{
+      .id = id,
+      .type = LayerType::Linear,
+      .params = {},
+      .hparams = {},
+      .input_shape = arm_compute::TensorShape(in_features),
+      .output_shape = arm_compute::TensorShape(out_features),
+  });
+  std::uniform_real_distribution<float> value(-0.1f, 0.1f);
+  auto weight = make_tensor(arm_compute::TensorShape(in_features, out_features));
+  auto bias = make_tensor(arm_compute::TensorShape(out_features));
+  for (auto *param: {weight.get(), bias.get()}) {
+    auto *values = reinterpret_cast<float *>(param->buffer());
+    for (size_t i = 0; i < param->info()->tensor_shape().total_size(); ++i) {
+      values[i] = value(rng);
+    }
+  }
+  layer->params["weight"] = std::move(weight);
+  layer->params["bias"] = std::move(bias);
+  layer->hparams["in_features"] = static_cast<float>(in_features);
+  layer->hparams["out_features"] = static_cast<float>(out_features);
+  return layer;
+}
+
+static std::shared_ptr<Layer> make_relu(const std::string &id, size_t features) {
+  return std::make_shared<Layer>(Layer{
+      .id = id,
+      .type = LayerType::ReLU,
+      .params = {},
+      .hparams = {},
+      .input_shape = arm_compute::TensorShape(features),
+      .output_shape = arm_compute::TensorShape(features),
+  });
+}
+
+/// MLP of Linear and ReLU layers, run whole on "device0"
+/// @param widths Features of the input, then of the output of every Linear
+static ModelDAG make_mlp(const std::string &name,
+                         const std::vector<size_t> &widths) {
+  std::mt19937 rng(1);
+  ModelDAG dag;
+  dag.name = name;
+  dag.input_shape = arm_compute::TensorShape(widths.front());
+  dag.output_shape = arm_compute::TensorShape(widths.back());
+  std::vector<std::shared_ptr<Layer>> layers;
+  for (size_t i = 1; i < widths.size(); ++i) {
+    layers.push_back(make_linear("layer" + std::to_string(i - 1), widths[i - 1],
+                                 widths[i], rng));
+    layers.push_back(make_relu("relu" + std::to_string(i - 1), widths[i]));
+  }
+  for (const auto &layer: layers) {
+    dag.layers[layer->id] = layer;
+    dag.layer_order.push_back(layer->id);
+  }
+  for (auto &layer_eus: Partitioner::partition_pipeline(layers, {"device0"})) {
+    for (auto &eu: layer_eus) {
+      dag.eus.emplace(eu.id, std::move(eu));
+    }
+  }
+  return dag;
+}
+
+/// Function of the layer, configured on the tensors
+static std::unique_ptr<arm_compute::IFunction>
+configure(const Layer &layer, arm_compute::ITensor *input,
+          arm_compute::ITensor *output) {
+  if (layer.type == LayerType::Linear) {
+    auto fc_layer = std::make_unique<arm_compute::NEFullyConnectedLayer>();
+    fc_layer->configure(input, layer.get_param("weight"),
+                        layer.get_param("bias"), output,
+                        arm_compute::FullyConnectedLayerInfo());
+    return fc_layer;
+  }
+  auto activation_layer = std::make_unique<arm_compute::NEActivationLayer>();
+  activation_layer->configure(input, output,
+                              arm_compute::ActivationFunction::RELU);
+  return activation_layer;
+}
+
+/// Per-inference time of the operators of the model, in milliseconds
+/// @param prepared Whether the functions are configured once up front, as
+/// the ComputationEngine does, or for every inference, as it did before
+static double run_operators(const ModelDAG &dag, size_t inferences,
+                            bool prepared) {
+  std::vector<std::unique_ptr<arm_compute::Tensor>> tensors;
+  tensors.push_back(make_tensor(dag.input_shape));
+  for (const auto &layer_id: dag.layer_order) {
+    tensors.push_back(make_tensor(dag.layers.at(layer_id)->output_shape));
+  }
+  std::vector<std::unique_ptr<arm_compute::IFunction>> functions;
+  const auto configure_all = [&] {
+    functions.clear();
+    for (size_t i = 0; i < dag.layer_order.size(); ++i) {
+      functions.push_back(configure(*dag.layers.at(dag.layer_order[i]),
+                                    tensors[i].get(), tensors[i + 1].get()));
+    }
+  };
+  if (prepared) {
+    configure_all();
+    for (auto &function: functions) {
+      function->prepare();
+    }
+  }
+
+  std::vector<double> latencies;
+  for (size_t n = 0; n < inferences; ++n) {
+    const auto start = std::chrono::steady_clock::now();
+    if (!prepared) {
+      configure_all();
+    }
+    for (auto &function: functions) {
+      function->run();
+    }
+    latencies.push_back(ms_since(start));
+  }
+  return percentile(latencies, 0.5);
+}
+
+/// Per-inference latency of the model through the Orchestrator
+static double run_orchestrator(const ModelDAG &dag, size_t inferences) {
+  const DeviceInfo info{"device0", "127.0.0.1", free_port()};
+  const DeviceMap map = {{"device0", info}};
+  const MemoryPlan memory_plan = MemoryPlanner::plan(dag, info.id);
+  const ExecutionPlan plan = ExecutionPlan::compile(dag, info.id, memory_plan);
+  std::mutex mtx;
+  std::condition_variable cv;
+  size_t completed = 0;
+  Orchestrator orch(dag, info, map, memory_plan, plan, 1);
+  orch.register_inference_complete_callback(
+      [&](RequestID, InferenceStatus status, const arm_compute::Tensor &) {
+        CHECK(status == InferenceStatus::Completed);
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          ++completed;
+        }
+        cv.notify_one();
+      });
+
+  std::vector<double> latencies;
+  for (size_t n = 0; n < inferences; ++n) {
+    const auto start = std::chrono::steady_clock::now();
+    // The state of the previous inference is given back after its report
+    while (!orch.start_inference(make_tensor(dag.input_shape))) {
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    CHECK(cv.wait_for(lock, 10s, [&] { return completed == n + 1; }));
+    latencies.push_back(ms_since(start));
+  }
+  return percentile(latencies, 0.5);
+}
+
+/// Median latency of an inference with the operators configured for every
+/// inference, and configured once, on their own and through the
+/// Orchestrator: on the sample XOR model of the app, and on a larger MLP
+int main(int argc, char **argv) {
+  const size_t inferences = count_argument(argc, argv, 200);
+  std::printf("%-10s %12s %12s %16s\n", "model", "per_call_ms", "prepared_ms",
+              "orchestrator_ms");
+  for (const auto &dag: {make_mlp("xor", {2, 2, 1}),
+                         make_mlp("mlp", {1024, 2048, 2048, 1024, 10})}) {
+    std::printf("%-10s %12.3f %12.3f %16.3f\n", dag.name.c_str(),
+                run_operators(dag, inferences, false),
+                run_operators(dag, inferences, true),
+                run_orchestrator(dag, inferences));
+  }
+  return 0;
+}
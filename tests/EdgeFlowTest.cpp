@@ -0,0 +1,45 @@
+#include "edgeflow/EdgeFlow.h"
+#include "TestSupport.h"
+
+static constexpr size_t kElements = 1024;
+
+static std::unique_ptr<arm_compute::Tensor> make_input() {
+  auto input = std::make_unique<arm_compute::Tensor>();
+  input->allocator()->init(arm_compute::TensorInfo(
+      arm_compute::TensorShape(kElements), 1, arm_compute::DataType::F32));
+  input->allocator()->allocate();
+  return input;
+}
+
+/// A device that cannot listen on its port is not initialized, and can be
+/// initialized again
+static void test_listen_failure() {
+  unsigned int port;
+  const int taken = listen_on_loopback(port);
+  auto dag = std::make_unique<ModelDAG>(
+      make_relu_chain(arm_compute::TensorShape(kElements), {"device0"}));
+  auto info = std::make_unique<DeviceInfo>(
+      DeviceInfo{"device0", "127.0.0.1", port});
+  CHECK(!EdgeFlow::instance().initialize(std::move(dag), std::move(info), {}));
+  CHECK(!EdgeFlow::instance().inference(make_input()).has_value());
+  close(taken);
+}
+
+/// A device given no peers, as the app does, runs the model alone and
+/// coordinates itself
+static void test_no_peers() {
+  auto dag = std::make_unique<ModelDAG>(
+      make_relu_chain(arm_compute::TensorShape(kElements), {"device0"}));
+  auto info = std::make_unique<DeviceInfo>(
+      DeviceInfo{"device0", "127.0.0.1", free_port()});
+  auto &edgeflow = EdgeFlow::instance();
+  CHECK(edgeflow.initialize(std::move(dag), std::move(info), {}));
+  CHECK(edgeflow.inference(make_input()).has_value());
+}
+
+int main() {
+  // The instance is initialized once it succeeds
+  RUN(test_listen_failure);
+  RUN(test_no_peers);
+  return 0;
+}
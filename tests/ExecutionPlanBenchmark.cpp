@@ -0,0 +1,147 @@
+#include "edgeflow/AutoPartitioner.h"
+#include "edgeflow/ExecutionPlan.h"
+#include "edgeflow/MemoryPlanner.h"
+#include "edgeflow/Orchestrator.h"
+#include "edgeflow/Partitioner.h"
+#include "BenchmarkSupport.h"
+#include "TestSupport.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+static constexpr int kCols = 4096;
+static constexpr int kRows = 256;
+// Units of the long branch, one after the other
+static constexpr int kLongDepth = 3;
+// Units of the short branches, side by side
+static constexpr size_t kShortBranches = 8;
+
+static std::shared_ptr<Layer> make_relu(const std::string &id) {
+  return std::make_shared<Layer>(Layer{
+      .id = id,
+      .type = LayerType::ReLU,
+      .params = {},
+      .hparams = {},
+      .input_shape = arm_compute::TensorShape(kCols, kRows),
+      .output_shape = arm_compute::TensorShape(kCols, kRows),
+  });
+}
+
+/// A stem unit, then two branches computing halves of the output: a long
+/// chain of units on the top half, and short units side by side on the
+/// bottom half. The short units are ready first, so that in submission
+/// order they run ahead of the chain, which is the critical path.
+static ModelDAG make_branched_dag() {
+  ModelDAG dag;
+  dag.name = "branched_relu";
+  dag.input_shape = arm_compute::TensorShape(kCols, kRows);
+  dag.output_shape = dag.input_shape;
+  const auto add_layer = [&dag](const std::string &id) {
+    auto layer = make_relu(id);
+    dag.layers[layer->id] = layer;
+    dag.layer_order.push_back(layer->id);
+    return layer;
+  };
+
+  auto stem = Partitioner::partition_rows(add_layer("stem"), {"device0"});
+  Partitioner::connect_model_input(stem);
+
+  // The first band of the short layer is the top half, which the long
+  // branch computes; the others split the bottom half
+  std::vector<DeviceID> short_devices(kShortBranches + 1, "device0");
+  std::vector<float> short_shares(kShortBranches + 1, 1.0f);
+  short_shares[0] = kShortBranches;
+  auto shorts = Partitioner::partition_rows(add_layer("short"), short_devices,
+                                            short_shares);
+  shorts.erase(shorts.begin());
+  Partitioner::connect(stem, shorts);
+
+  std::vector<std::vector<ExecutionUnit>> chain;
+  for (int i = 0; i < kLongDepth; ++i) {
+    auto halves = Partitioner::partition_rows(add_layer("long" + std::to_string(i)),
+                                              {"device0", "device0"});
+    halves.pop_back();
+    Partitioner::connect(chain.empty() ? stem : chain.back(), halves);
+    chain.push_back(std::move(halves));
+  }
+
+  for (auto &eu: shorts) {
+    eu.is_leaf = true;
+  }
+  chain.back().front().is_leaf = true;
+  chain.push_back(std::move(stem));
+  chain.push_back(std::move(shorts));
+  for (auto &layer_eus: chain) {
+    for (auto &eu: layer_eus) {
+      dag.eus.emplace(eu.id, std::move(eu));
+    }
+  }
+  return dag;
+}
+
+/// Latencies of inferences run one at a time on the DAG
+/// @param by_rank Whether the units are scheduled by their upward rank, or
+/// in submission order, as with a profile in which all of them are free
+static std::vector<double> measure(const ModelDAG &dag, size_t inferences,
+                                   bool by_rank) {
+  const DeviceInfo info{"device0", "127.0.0.1", free_port()};
+  const DeviceMap map = {{"device0", info}};
+  ClusterProfile profile;
+  if (!by_rank) {
+    profile.default_macs_per_ms = 1e30;
+  }
+  const MemoryPlan memory_plan = MemoryPlanner::plan(dag, info.id);
+  const ExecutionPlan plan =
+      ExecutionPlan::compile(dag, info.id, memory_plan, profile);
+  std::mutex mtx;
+  std::condition_variable cv;
+  size_t completed = 0;
+  Orchestrator orch(dag, info, map, memory_plan, plan, 1);
+  orch.register_inference_complete_callback(
+      [&](RequestID, InferenceStatus status, const arm_compute::Tensor &) {
+        CHECK(status == InferenceStatus::Completed);
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          ++completed;
+        }
+        cv.notify_one();
+      });
+
+  const auto make_input = [] {
+    auto input = std::make_unique<arm_compute::Tensor>();
+    input->allocator()->init(arm_compute::TensorInfo(
+        arm_compute::TensorShape(kCols, kRows), 1, arm_compute::DataType::F32));
+    input->allocator()->allocate();
+    return input;
+  };
+  std::vector<double> latencies;
+  for (size_t n = 0; n < inferences; ++n) {
+    const auto start = std::chrono::steady_clock::now();
+    // The state of the previous inference is given back after its report
+    while (!orch.start_inference(make_input())) {
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    CHECK(cv.wait_for(lock, 10s, [&] { return completed == n + 1; }));
+    latencies.push_back(ms_since(start));
+  }
+  return latencies;
+}
+
+/// Latency of an inference on a branched DAG, with the ready units run in
+/// the order they were submitted and by their critical-path rank. The
+/// ranks only pay off with several workers, i.e., on a device with more
+/// than one core.
+int main(int argc, char **argv) {
+  const size_t inferences = count_argument(argc, argv, 200);
+  const ModelDAG dag = make_branched_dag();
+  std::printf("%10s %10s %10s\n", "order", "p50_ms", "p99_ms");
+  for (const bool by_rank: {false, true}) {
+    const auto latencies = measure(dag, inferences, by_rank);
+    std::printf("%10s %10.3f %10.3f\n", by_rank ? "rank" : "submission",
+                percentile(latencies, 0.5), percentile(latencies, 0.99));
+  }
+  return 0;
+}
@@ -0,0 +1,145 @@
+#include "edgeflow/Orchestrator.h"
+#include "BenchmarkSupport.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+static constexpr int kRows = 3072;
+static constexpr size_t kProducers = 700;
+static constexpr size_t kConsumers = 256;
+static constexpr size_t kMaxInFlight = 4;
+// Threads delivering the results of "device1", as the receive paths of
+// the network handler would
+static constexpr size_t kSenders = 4;
+
+/// Result of a band of the first layer for a unit of the second
+struct Piece {
+  RequestID request_id;
+  ExecutionUnitID src_eu_id, dest_eu_id;
+  Range rows;
+  std::unique_ptr<arm_compute::Tensor> data;
+};
+
+static std::unique_ptr<arm_compute::Tensor> make_input(int num_rows) {
+  auto input = std::make_unique<arm_compute::Tensor>();
+  input->allocator()->init(arm_compute::TensorInfo(
+      arm_compute::TensorShape(num_rows), 1, arm_compute::DataType::F32));
+  input->allocator()->allocate();
+  return input;
+}
+
+struct Measurement {
+  double p50_ms, p99_ms; // Of a round of inferences
+  double pieces_per_ms;
+};
+
+/// Rounds of as many inferences as the Orchestrator takes at once, from the
+/// first piece delivered to the last inference reported. The pieces are
+/// allocated up front, so that the round times the input states, the
+/// scheduling and the leaf units, not the allocator.
+static Measurement measure(const EngineOptions &engine_options,
+                           size_t rounds) {
+  const DeviceInfo info{"device0", "127.0.0.1", free_port()};
+  // Nothing is sent to "device1"
+  const Deployment deployment(
+      make_wide_dag(kRows, kProducers, kConsumers), info,
+      {{"device0", info},
+       {"device1", DeviceInfo{"device1", "127.0.0.1", free_port()}}});
+  std::mutex mtx;
+  std::condition_variable cv;
+  size_t completed = 0;
+  Orchestrator orch(deployment.dag, deployment.info, deployment.map,
+                    deployment.memory_plan, deployment.plan, kMaxInFlight,
+                    nullptr, engine_options);
+  orch.register_inference_complete_callback(
+      [&](RequestID, InferenceStatus status, const arm_compute::Tensor &) {
+        CHECK(status == InferenceStatus::Completed);
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          ++completed;
+        }
+        cv.notify_one();
+      });
+
+  std::mt19937 rng(12);
+  std::vector<double> round_ms;
+  size_t num_pieces = 0;
+  for (size_t round = 0; round < rounds; ++round) {
+    std::vector<Piece> pieces;
+    for (size_t i = 0; i < kMaxInFlight; ++i) {
+      std::optional<RequestID> request_id;
+      // The states of the last round are given back right after the reports
+      while (!(request_id = orch.start_inference(make_input(kRows)))) {
+        std::this_thread::sleep_for(50us);
+      }
+      for (const auto &[id, eu]: deployment.dag.eus) {
+        for (const auto &entry: eu.forward_table) {
+          pieces.push_back({*request_id, id, entry.dest_eu_id,
+                            entry.required_range,
+                            make_input(entry.required_range.end -
+                                       entry.required_range.start)});
+        }
+      }
+    }
+    std::shuffle(pieces.begin(), pieces.end(), rng);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> senders;
+    for (size_t t = 0; t < kSenders; ++t) {
+      senders.emplace_back([&, t] {
+        for (size_t i = t; i < pieces.size(); i += kSenders) {
+          Piece &piece = pieces[i];
+          orch.on_receive_intermediate_result(
+              piece.request_id,
+              std::make_unique<ExecutionUnitID>(std::move(piece.src_eu_id)),
+              std::make_unique<ExecutionUnitID>(std::move(piece.dest_eu_id)),
+              std::move(piece.data), piece.rows, kNoDeadline);
+        }
+      });
+    }
+    for (auto &sender: senders) {
+      sender.join();
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    CHECK(cv.wait_for(lock, 60s, [&] {
+      return completed == (round + 1) * kMaxInFlight;
+    }));
+    round_ms.push_back(ms_since(start));
+    num_pieces += pieces.size();
+  }
+
+  double total_ms = 0;
+  for (const double ms: round_ms) {
+    total_ms += ms;
+  }
+  return {percentile(round_ms, 0.5), percentile(round_ms, 0.99),
+          num_pieces / total_ms};
+}
+
+/// Time to take in the results of 700 bands for 256 leaf units, several
+/// for most of them, and to run the leaves, by the number of workers of
+/// the computation engine, with one ready queue shared by the workers and
+/// with one per worker
+int main(int argc, char **argv) {
+  const size_t rounds = count_argument(argc, argv, 50);
+  const unsigned int max_workers =
+      std::max(4u, std::thread::hardware_concurrency());
+  std::printf("%8s %11s %10s %10s %14s\n", "workers", "queues", "p50_ms",
+              "p99_ms", "Kpieces/s");
+  for (unsigned int workers = 1; workers <= max_workers; workers *= 2) {
+    for (const bool per_worker: {false, true}) {
+      const Measurement m = measure(EngineOptions{workers, per_worker}, rounds);
+      std::printf("%8u %11s %10.3f %10.3f %14.1f\n", workers,
+                  per_worker ? "per_worker" : "shared", m.p50_ms, m.p99_ms,
+                  m.pieces_per_ms);
+    }
+  }
+  return 0;
+}
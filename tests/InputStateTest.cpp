@@ -0,0 +1,164 @@
+#include "edgeflow/Orchestrator.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+static constexpr int kRows = 3072;
+// Thin bands, so that most units take their input from several of them,
+// and some bands feed two units
+static constexpr size_t kProducers = 700;
+static constexpr size_t kConsumers = 256;
+static constexpr size_t kMaxInFlight = 4;
+
+/// Row of the output of the first layer for the inference; differs between
+/// the inferences that take turns on a request state
+static float value_at(RequestID request_id, int row) {
+  return static_cast<float>((row * 7 + static_cast<int>(request_id) * 13) % 50) -
+         25;
+}
+
+static std::unique_ptr<arm_compute::Tensor> make_input(int num_rows) {
+  auto input = std::make_unique<arm_compute::Tensor>();
+  input->allocator()->init(arm_compute::TensorInfo(
+      arm_compute::TensorShape(num_rows), 1, arm_compute::DataType::F32));
+  input->allocator()->allocate();
+  return input;
+}
+
+/// Result of a band of the first layer for a unit of the second
+struct Piece {
+  ExecutionUnitID src_eu_id, dest_eu_id;
+  Range rows;
+};
+
+/// Inferences completed with the ReLU of their own pieces
+class Reports {
+public:
+  Orchestrator::Callback callback() {
+    return [this](RequestID request_id, InferenceStatus status,
+                  const arm_compute::Tensor &output) {
+      bool matches = status == InferenceStatus::Completed;
+      const auto *values = reinterpret_cast<const float *>(
+          output.buffer() + output.info()->offset_first_element_in_bytes());
+      for (int row = 0; matches && row < kRows; ++row) {
+        matches = values[row] == std::max(0.0f, value_at(request_id, row));
+      }
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        // Reported once, as every leaf unit ran once
+        CHECK(matches_.emplace(request_id, matches).second);
+      }
+      cv_.notify_all();
+    };
+  }
+
+  /// Wait for the inference, and check its output
+  void check(RequestID request_id) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    CHECK(cv_.wait_for(lock, 10s, [&] { return matches_.count(request_id); }));
+    CHECK(matches_.at(request_id));
+  }
+
+private:
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::map<RequestID, bool> matches_;
+};
+
+/// The pieces of several inferences arrive from many threads, in random
+/// order. Each unit runs exactly once, once the last of its pieces is in:
+/// the first piece allocates its input, and the one that completes it
+/// submits it. The next inferences take the states the units re-armed.
+static void check_concurrent_pieces(const EngineOptions &engine_options) {
+  constexpr size_t kRounds = 30;
+  constexpr size_t kThreads = 8;
+  const DeviceInfo info{"device0", "127.0.0.1", free_port()};
+  // Nothing is sent to "device1"
+  const Deployment deployment(
+      make_wide_dag(kRows, kProducers, kConsumers), info,
+      {{"device0", info},
+       {"device1", DeviceInfo{"device1", "127.0.0.1", free_port()}}});
+  Reports reports;
+  Orchestrator orch(deployment.dag, deployment.info, deployment.map,
+                    deployment.memory_plan, deployment.plan, kMaxInFlight,
+                    nullptr, engine_options);
+  orch.register_inference_complete_callback(reports.callback());
+
+  std::vector<Piece> pieces;
+  for (const auto &[id, eu]: deployment.dag.eus) {
+    for (const auto &entry: eu.forward_table) {
+      pieces.push_back({id, entry.dest_eu_id, entry.required_range});
+    }
+  }
+  CHECK(pieces.size() > kProducers);
+
+  std::mt19937 rng(12);
+  for (size_t round = 0; round < kRounds; ++round) {
+    std::vector<RequestID> request_ids;
+    std::vector<std::pair<RequestID, const Piece *>> deliveries;
+    for (size_t i = 0; i < kMaxInFlight; ++i) {
+      std::optional<RequestID> request_id;
+      // The states of the last round are given back right after the reports
+      for (int attempt = 0; !request_id && attempt < 2000; ++attempt) {
+        if (!(request_id = orch.start_inference(make_input(kRows)))) {
+          std::this_thread::sleep_for(1ms);
+        }
+      }
+      CHECK(request_id.has_value());
+      request_ids.push_back(*request_id);
+      for (const Piece &piece: pieces) {
+        deliveries.emplace_back(*request_id, &piece);
+      }
+    }
+    std::shuffle(deliveries.begin(), deliveries.end(), rng);
+
+    std::vector<std::thread> senders;
+    for (size_t t = 0; t < kThreads; ++t) {
+      senders.emplace_back([&, t] {
+        for (size_t i = t; i < deliveries.size(); i += kThreads) {
+          const auto &[request_id, piece] = deliveries[i];
+          const int num_rows = piece->rows.end - piece->rows.start;
+          auto data = make_input(num_rows);
+          auto *values = reinterpret_cast<float *>(data->buffer());
+          for (int row = 0; row < num_rows; ++row) {
+            values[row] = value_at(request_id, piece->rows.start + row);
+          }
+          orch.on_receive_intermediate_result(
+              request_id, std::make_unique<ExecutionUnitID>(piece->src_eu_id),
+              std::make_unique<ExecutionUnitID>(piece->dest_eu_id),
+              std::move(data), piece->rows, kNoDeadline);
+        }
+      });
+    }
+    for (auto &sender: senders) {
+      sender.join();
+    }
+    for (const RequestID request_id: request_ids) {
+      reports.check(request_id);
+    }
+  }
+}
+
+static void test_concurrent_pieces() {
+  check_concurrent_pieces(EngineOptions{4});
+}
+
+/// The same, with the workers sharing one ready queue rather than moving
+/// the leaves they take from the injection queue to queues of their own
+static void test_concurrent_pieces_shared_queue() {
+  check_concurrent_pieces(EngineOptions{4, false});
+}
+
+int main() {
+  RUN(test_concurrent_pieces);
+  RUN(test_concurrent_pieces_shared_queue);
+  return 0;
+}
@@ -0,0 +1,122 @@
+#include "edgeflow/Orchestrator.h"
+#include "BenchmarkSupport.h"
+#include "TestSupport.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+/// Inferences completed by "device0"
+class Completions {
+public:
+  Orchestrator::Callback callback() {
+    return [this](RequestID, InferenceStatus status, const arm_compute::Tensor &) {
+      CHECK(status == InferenceStatus::Completed);
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        ++completed_;
+      }
+      cv_.notify_all();
+    };
+  }
+
+  /// Wait for the number of inferences to be completed so far
+  void wait_for(size_t count) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    CHECK(cv_.wait_for(lock, 60s, [&] { return completed_ >= count; }));
+  }
+
+private:
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  size_t completed_ = 0;
+};
+
+struct Measurement {
+  double p50_ms, p99_ms;  // Of one inference alone
+  double bytes_per_ms;    // Of the results, with several inferences in flight
+};
+
+/// @param over_tcp Whether the results go over TCP rather than the rings
+static Measurement measure(size_t elements, size_t inferences, bool over_tcp) {
+  constexpr size_t kMaxInFlight = 4;
+  const DeviceInfo info0{"device0", "127.0.0.1", free_port()};
+  const DeviceInfo info1{"device1", "127.0.0.1", free_port()};
+  const DeviceMap map = {{"device0", info0}, {"device1", info1}};
+  std::vector<int> holders;
+  if (over_tcp) {
+    holders = {hold_ring_address(info0.port), hold_ring_address(info1.port)};
+  }
+
+  // Three ReLU layers; the middle one runs on "device1", so that every
+  // inference sends two results of the size across
+  const arm_compute::TensorShape shape(elements);
+  const std::vector<DeviceID> devices = {"device0", "device1", "device0"};
+  const Deployment device0(make_relu_chain(shape, devices), info0, map);
+  const Deployment device1(make_relu_chain(shape, devices), info1, map);
+  Completions completions;
+  Orchestrator orch0(device0.dag, device0.info, device0.map,
+                     device0.memory_plan, device0.plan, kMaxInFlight);
+  Orchestrator orch1(device1.dag, device1.info, device1.map,
+                     device1.memory_plan, device1.plan, kMaxInFlight);
+  orch0.register_inference_complete_callback(completions.callback());
+
+  const auto make_input = [elements] {
+    auto input = std::make_unique<arm_compute::Tensor>();
+    input->allocator()->init(arm_compute::TensorInfo(
+        arm_compute::TensorShape(elements), 1, arm_compute::DataType::F32));
+    input->allocator()->allocate();
+    return input;
+  };
+  const auto start_when_free = [&] {
+    while (!orch0.start_inference(make_input())) {
+      std::this_thread::sleep_for(50us);
+    }
+  };
+
+  // One at a time, after one opening the connections
+  size_t started = 0;
+  std::vector<double> latencies;
+  for (size_t i = 0; i <= inferences; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    start_when_free();
+    completions.wait_for(++started);
+    if (i > 0) {
+      latencies.push_back(ms_since(start));
+    }
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < inferences; ++i) {
+    start_when_free();
+  }
+  started += inferences;
+  completions.wait_for(started);
+  const double elapsed_ms = ms_since(start);
+
+  for (const int holder: holders) {
+    close(holder);
+  }
+  return {percentile(latencies, 0.5), percentile(latencies, 0.99),
+          2.0 * inferences * elements * sizeof(float) / elapsed_ms};
+}
+
+/// Latency and throughput of the results sent between two devices on this
+/// host through the shared-memory rings and over TCP, by the size of the
+/// results
+int main(int argc, char **argv) {
+  const size_t inferences = count_argument(argc, argv, 100);
+  std::printf("%10s %5s %10s %10s %12s\n", "bytes", "link", "p50_ms",
+              "p99_ms", "MB/s");
+  for (size_t bytes = 1024; bytes <= (size_t{4} << 20); bytes *= 4) {
+    for (const bool over_tcp: {false, true}) {
+      const Measurement m = measure(bytes / sizeof(float), inferences, over_tcp);
+      std::printf("%10zu %5s %10.3f %10.3f %12.1f\n", bytes,
+                  over_tcp ? "tcp" : "ring", m.p50_ms, m.p99_ms,
+                  m.bytes_per_ms / 1e3);
+    }
+  }
+  return 0;
+}
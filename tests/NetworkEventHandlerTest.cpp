@@ -0,0 +1,548 @@
+#include "edgeflow/NetworkEventHandler.h"
+#include "edgeflow/Orchestrator.h"
+#include "edgeflow/Partitioner.h"
+#include "TestSupport.h"
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using PlanMessage = NetworkEventHandler::PlanMessage;
+
+struct ReceivedPlanMessage {
+  PlanMessage message;
+  DeviceID sender;
+  uint32_t epoch;
+  std::vector<uint8_t> payload;
+};
+
+/// Payload of message `index`; sized to end in the header, the IDs, the
+/// staging buffer of the receiver, and well past it
+static std::vector<uint8_t> payload_of(size_t index) {
+  static const size_t kSizes[] = {0, 1, 3, 71, 72, 4095, 4096, 5000, 70000};
+  std::vector<uint8_t> payload(kSizes[index % std::size(kSizes)]);
+  for (size_t i = 0; i < payload.size(); ++i) {
+    payload[i] = static_cast<uint8_t>(index * 13 + i * 7);
+  }
+  return payload;
+}
+
+/// Read everything the peer sends until it hangs up
+static std::vector<uint8_t> read_all(int socket) {
+  std::vector<uint8_t> bytes;
+  uint8_t buffer[65536];
+  while (true) {
+    pollfd fd{socket, POLLIN, 0};
+    CHECK(poll(&fd, 1, 10000) == 1);
+    const ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+    CHECK(received >= 0);
+    if (received == 0) {
+      return bytes;
+    }
+    bytes.insert(bytes.end(), buffer, buffer + received);
+  }
+}
+
+/// Record the TCP stream "device0" sends to "device1"
+/// @param send Sends the messages with the handler of "device0"
+static std::vector<uint8_t>
+record_stream(const std::function<void(NetworkEventHandler &)> &send) {
+  unsigned int tap_port;
+  const int tap = listen_on_loopback(tap_port);
+
+  // The sender reaches "device1" at the tap, which records the stream over
+  // TCP as nothing takes a ring on its port
+  std::vector<uint8_t> stream;
+  std::thread tap_thread([&] {
+    const int connection = accept(tap, nullptr, nullptr);
+    CHECK(connection >= 0);
+    stream = read_all(connection);
+    close(connection);
+  });
+  {
+    const DeviceInfo sender_info{"device0", "127.0.0.1", free_port()};
+    const DeviceMap sender_map = {
+        {"device0", sender_info},
+        {"device1", DeviceInfo{"device1", "127.0.0.1", tap_port}},
+    };
+    NetworkEventHandler sender(sender_info, sender_map);
+    send(sender);
+    sender.flush();
+  }
+  // The sender hung up on the tap when it was destroyed
+  tap_thread.join();
+  close(tap);
+  CHECK(!stream.empty());
+  return stream;
+}
+
+/// Handler of "device1" recording the plan messages it receives
+class PlanReceiver {
+public:
+  PlanReceiver()
+      : info_{"device1", "127.0.0.1", free_port()},
+        map_{{"device0", DeviceInfo{"device0", "127.0.0.1", free_port()}},
+             {"device1", info_}},
+        handler_(info_, map_) {
+    handler_.register_plan_callback(
+        [this](PlanMessage message, const DeviceID &sender, uint32_t epoch,
+               std::vector<uint8_t> payload) {
+          {
+            std::lock_guard<std::mutex> lock(mtx_);
+            received_.push_back({message, sender, epoch, std::move(payload)});
+          }
+          cv_.notify_one();
+        });
+    CHECK(handler_.start_listening(info_.port));
+  }
+
+  unsigned int port() const { return info_.port; }
+
+  /// Wait for the number of plan messages, and get them
+  std::vector<ReceivedPlanMessage> wait_for(size_t num_messages) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    CHECK(cv_.wait_for(lock, 10s,
+                       [&] { return received_.size() == num_messages; }));
+    return received_;
+  }
+
+private:
+  DeviceInfo info_;
+  DeviceMap map_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::vector<ReceivedPlanMessage> received_;
+  // Destroyed first, so that its reactor no longer records messages
+  NetworkEventHandler handler_;
+};
+
+/// Messages reach the receiver in fragments of a few bytes, split at every
+/// point of the header, the IDs and the payload, or in larger chunks holding
+/// several messages; the receiver reassembles each of them
+static void test_partial_reads() {
+  constexpr size_t kMessages = 40;
+  const std::vector<uint8_t> stream = record_stream([](NetworkEventHandler &sender) {
+    for (size_t i = 0; i < kMessages; ++i) {
+      sender.send_plan_message("device1", static_cast<PlanMessage>(i % 5),
+                               static_cast<uint32_t>(i), payload_of(i));
+    }
+  });
+
+  PlanReceiver receiver;
+  const int connection = connect_to(receiver.port());
+
+  std::mt19937 rng(5);
+  std::uniform_int_distribution<size_t> small(1, 13), large(1, 9000);
+  std::uniform_int_distribution<int> kind(0, 9);
+  for (size_t sent = 0; sent < stream.size();) {
+    const size_t fragment =
+        std::min(stream.size() - sent, kind(rng) == 0 ? large(rng) : small(rng));
+    CHECK(send(connection, stream.data() + sent, fragment, MSG_NOSIGNAL) ==
+          static_cast<ssize_t>(fragment));
+    sent += fragment;
+    // Lets the receiver take the fragment on its own
+    std::this_thread::sleep_for(20us);
+  }
+
+  const auto received = receiver.wait_for(kMessages);
+  for (size_t i = 0; i < kMessages; ++i) {
+    CHECK(received[i].message == static_cast<PlanMessage>(i % 5));
+    CHECK(received[i].sender == "device0");
+    CHECK(received[i].epoch == i);
+    CHECK(received[i].payload == payload_of(i));
+  }
+  close(connection);
+}
+
+/// A plan message without a payload that follows an encoded result on the
+/// connection carries no payload, rather than the encoding of the result
+static void test_empty_plan_payload() {
+  ExecutionUnit src{}, dest{};
+  src.id = "relu0::eu0";
+  dest.id = "relu1::eu0";
+  src.forward_table.push_back(ForwardTableEntry{
+      .dest_eu_id = dest.id,
+      .required_range = {0, 256},
+      .codec = WireCodec::FP16,
+  });
+  const std::vector<uint8_t> stream = record_stream([&](NetworkEventHandler &sender) {
+    auto data = std::make_unique<arm_compute::Tensor>();
+    data->allocator()->init(arm_compute::TensorInfo(
+        arm_compute::TensorShape(256), 1, arm_compute::DataType::F32));
+    data->allocator()->allocate();
+    auto *values = reinterpret_cast<float *>(data->buffer());
+    for (size_t i = 0; i < 256; ++i) {
+      values[i] = static_cast<float>(i) * 0.5f;
+    }
+    sender.send_intermediate_result(1, "device1", src, dest, std::move(data),
+                                    {0, 256});
+    sender.send_plan_message("device1", PlanMessage::DriftNotice, 3, {});
+  });
+
+  // The result is held, as no Orchestrator is attached
+  PlanReceiver receiver;
+  const int connection = connect_to(receiver.port());
+  CHECK(send(connection, stream.data(), stream.size(), MSG_NOSIGNAL) ==
+        static_cast<ssize_t>(stream.size()));
+  const auto received = receiver.wait_for(1);
+  CHECK(received[0].message == PlanMessage::DriftNotice);
+  CHECK(received[0].epoch == 3);
+  CHECK(received[0].payload.empty());
+  close(connection);
+}
+
+/// A frame that is not a message closes the connection
+static void test_malformed_frame() {
+  const unsigned int receiver_port = free_port();
+  const DeviceInfo receiver_info{"device1", "127.0.0.1", receiver_port};
+  const DeviceMap receiver_map = {{"device1", receiver_info}};
+  NetworkEventHandler receiver(receiver_info, receiver_map);
+  CHECK(receiver.start_listening(receiver_port));
+
+  const int connection = connect_to(receiver_port);
+  const std::vector<uint8_t> garbage(256, 0xAB);
+  CHECK(send(connection, garbage.data(), garbage.size(), MSG_NOSIGNAL) ==
+        static_cast<ssize_t>(garbage.size()));
+  // The receiver hangs up
+  uint8_t byte;
+  pollfd fd{connection, POLLIN, 0};
+  CHECK(poll(&fd, 1, 10000) == 1);
+  CHECK(recv(connection, &byte, 1, 0) <= 0);
+  close(connection);
+}
+
+/// An abort notice of a status the receiver does not know is malformed, as
+/// the receiver could not say why the inference was aborted
+static void test_unknown_abort_status() {
+  const auto record_abort = [](InferenceStatus status) {
+    return record_stream([status](NetworkEventHandler &sender) {
+      sender.send_abort_notice(7, "device1", status);
+    });
+  };
+  // The notices differ in the status only
+  std::vector<uint8_t> stream = record_abort(InferenceStatus::TimedOut);
+  const std::vector<uint8_t> failed = record_abort(InferenceStatus::Failed);
+  CHECK(stream.size() == failed.size());
+  size_t num_differing = 0;
+  for (size_t i = 0; i < stream.size(); ++i) {
+    if (stream[i] != failed[i]) {
+      stream[i] = 0xFF;
+      ++num_differing;
+    }
+  }
+  CHECK(num_differing == 1);
+
+  const unsigned int receiver_port = free_port();
+  const DeviceInfo receiver_info{"device1", "127.0.0.1", receiver_port};
+  const DeviceMap receiver_map = {{"device1", receiver_info}};
+  NetworkEventHandler receiver(receiver_info, receiver_map);
+  CHECK(receiver.start_listening(receiver_port));
+
+  const int connection = connect_to(receiver_port);
+  CHECK(send(connection, stream.data(), stream.size(), MSG_NOSIGNAL) ==
+        static_cast<ssize_t>(stream.size()));
+  // The receiver hangs up rather than passing the status on
+  uint8_t byte;
+  pollfd fd{connection, POLLIN, 0};
+  CHECK(poll(&fd, 1, 10000) == 1);
+  CHECK(recv(connection, &byte, 1, 0) <= 0);
+  close(connection);
+}
+
+/// A device that does not complete the connection holds up the messages to
+/// the others for the connect timeout once, not for every message
+static void test_unreachable_peer() {
+  // Past the full accept queue of the stalled listener, connecting hangs on
+  // the handshake
+  unsigned int stalled_port;
+  const int stalled = listen_on_loopback(stalled_port);
+  CHECK(listen(stalled, 0) == 0);
+  std::vector<int> queued;
+  for (int i = 0; i < 4; ++i) {
+    const int connection =
+        socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<uint16_t>(stalled_port));
+    connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    queued.push_back(connection);
+  }
+
+  constexpr size_t kMessages = 20;
+  PlanReceiver receiver;
+  const DeviceInfo sender_info{"device0", "127.0.0.1", free_port()};
+  const DeviceMap sender_map = {
+      {"device0", sender_info},
+      {"device1", DeviceInfo{"device1", "127.0.0.1", receiver.port()}},
+      {"device2", DeviceInfo{"device2", "127.0.0.1", stalled_port}},
+  };
+  const auto start = std::chrono::steady_clock::now();
+  {
+    NetworkEventHandler sender(sender_info, sender_map);
+    for (size_t i = 0; i < kMessages; ++i) {
+      sender.send_plan_message("device2", PlanMessage::DriftNotice,
+                               static_cast<uint32_t>(i), payload_of(i));
+      sender.send_plan_message("device1", PlanMessage::DriftNotice,
+                               static_cast<uint32_t>(i), payload_of(i));
+    }
+    sender.flush();
+  }
+  const auto received = receiver.wait_for(kMessages);
+  CHECK(std::chrono::steady_clock::now() - start < 5s);
+  for (size_t i = 0; i < kMessages; ++i) {
+    CHECK(received[i].epoch == i);
+    CHECK(received[i].payload == payload_of(i));
+  }
+  for (const int connection : queued) {
+    close(connection);
+  }
+  close(stalled);
+}
+
+/// Results held by a same-host peer that is switching plans fill its ring;
+/// the sender waits for space a bounded time, then sends over TCP
+static void test_full_ring() {
+  const unsigned int receiver_port = free_port();
+  const DeviceInfo receiver_info{"device1", "127.0.0.1", receiver_port};
+  const DeviceInfo sender_info{"device0", "127.0.0.1", free_port()};
+  const DeviceMap device_map = {{"device0", sender_info},
+                                {"device1", receiver_info}};
+  // Holds every message, in place in the ring, as no Orchestrator attaches
+  NetworkEventHandler receiver(receiver_info, device_map);
+  CHECK(receiver.start_listening(receiver_port));
+
+  ExecutionUnit src{}, dest{};
+  src.id = "relu0::eu0";
+  dest.id = "relu1::eu0";
+  constexpr size_t kElements = size_t{1} << 18;
+  // Past the capacity of the ring
+  constexpr size_t kResults = 48;
+  const auto start = std::chrono::steady_clock::now();
+  {
+    NetworkEventHandler sender(sender_info, device_map);
+    for (size_t i = 0; i < kResults; ++i) {
+      auto data = std::make_unique<arm_compute::Tensor>();
+      data->allocator()->init(arm_compute::TensorInfo(
+          arm_compute::TensorShape(kElements), 1, arm_compute::DataType::F32));
+      data->allocator()->allocate();
+      sender.send_intermediate_result(static_cast<RequestID>(i), "device1",
+                                      src, dest, std::move(data),
+                                      {0, static_cast<int>(kElements)});
+    }
+    sender.flush();
+    CHECK(sender.wire_stats(WireCodec::Raw).sent == kResults);
+  }
+  CHECK(std::chrono::steady_clock::now() - start < 10s);
+}
+
+/// Forwards the connections it takes to a port of the loopback address, so
+/// that a device on this host is reached over TCP rather than a ring
+class Relay {
+public:
+  explicit Relay(unsigned int target_port)
+      : listening_(listen_on_loopback(port_)) {
+    thread_ = std::thread([this, target_port] {
+      std::vector<int> sockets;
+      std::vector<std::thread> pumps;
+      while (true) {
+        const int accepted = accept(listening_, nullptr, nullptr);
+        if (accepted < 0) {
+          break;
+        }
+        const int forwarded = connect_to(target_port);
+        sockets.push_back(accepted);
+        sockets.push_back(forwarded);
+        pumps.emplace_back(pump, accepted, forwarded);
+        pumps.emplace_back(pump, forwarded, accepted);
+      }
+      for (const int socket: sockets) {
+        shutdown(socket, SHUT_RDWR);
+      }
+      for (auto &pump: pumps) {
+        pump.join();
+      }
+      for (const int socket: sockets) {
+        close(socket);
+      }
+    });
+  }
+
+  ~Relay() {
+    shutdown(listening_, SHUT_RDWR);
+    thread_.join();
+    close(listening_);
+  }
+
+  unsigned int port() const { return port_; }
+
+private:
+  static void pump(int from, int to) {
+    uint8_t buffer[65536];
+    ssize_t received;
+    while ((received = recv(from, buffer, sizeof(buffer), 0)) > 0) {
+      if (send(to, buffer, received, MSG_NOSIGNAL) != received) {
+        break;
+      }
+    }
+    shutdown(to, SHUT_WR);
+  }
+
+  unsigned int port_ = 0;
+  int listening_;
+  std::thread thread_;
+};
+
+static constexpr size_t kWidth = 8, kHeight = 16, kChannels = 3;
+
+/// The model: three ReLU layers over a feature map of several channels.
+/// The first and last run whole on "device0"; the middle one is split into
+/// two bands on "device1", so that each band gets a strided view of the
+/// rows it requires of the first.
+static ModelDAG make_banded_dag() {
+  ModelDAG dag;
+  dag.name = "banded_relu_chain";
+  dag.input_shape = arm_compute::TensorShape(kWidth, kHeight, kChannels);
+  dag.output_shape = dag.input_shape;
+  std::vector<std::vector<ExecutionUnit>> eus;
+  const std::vector<std::vector<DeviceID>> devices = {
+      {"device0"}, {"device1", "device1"}, {"device0"}};
+  for (int i = 0; i < 3; ++i) {
+    auto layer = std::make_shared<Layer>(Layer{
+        .id = "relu" + std::to_string(i),
+        .type = LayerType::ReLU,
+        .params = {},
+        .hparams = {},
+        .input_shape = dag.input_shape,
+        .output_shape = dag.output_shape,
+    });
+    dag.layers[layer->id] = layer;
+    dag.layer_order.push_back(layer->id);
+    // Uneven bands, so that neither is a whole number of channels
+    eus.push_back(Partitioner::partition_rows(layer, devices[i], {1, 3}));
+  }
+  Partitioner::connect_model_input(eus[0]);
+  Partitioner::connect(eus[0], eus[1]);
+  Partitioner::connect(eus[1], eus[2]);
+  eus[2][0].is_leaf = true;
+  // The second band goes encoded, gathered from its blocks first
+  for (auto &entry: eus[0][0].forward_table) {
+    if (entry.dest_eu_id == eus[1][1].id) {
+      entry.codec = WireCodec::FP16;
+    }
+  }
+  for (auto &layer_eus: eus) {
+    for (auto &eu: layer_eus) {
+      dag.eus.emplace(eu.id, std::move(eu));
+    }
+  }
+  return dag;
+}
+
+/// Element of the input; integers, which FP16 keeps exactly
+static float input_at(size_t x, size_t y, size_t c) {
+  return static_cast<float>(static_cast<int>((x * 5 + y * 7 + c * 11) % 41) - 20);
+}
+
+static std::unique_ptr<arm_compute::Tensor> make_banded_input() {
+  auto input = std::make_unique<arm_compute::Tensor>();
+  input->allocator()->init(arm_compute::TensorInfo(
+      arm_compute::TensorShape(kWidth, kHeight, kChannels), 1,
+      arm_compute::DataType::F32));
+  input->allocator()->allocate();
+  for (size_t c = 0; c < kChannels; ++c) {
+    for (size_t y = 0; y < kHeight; ++y) {
+      for (size_t x = 0; x < kWidth; ++x) {
+        *reinterpret_cast<float *>(input->ptr_to_element(
+            arm_compute::Coordinates(x, y, c))) = input_at(x, y, c);
+      }
+    }
+  }
+  return input;
+}
+
+/// Results cross the devices over TCP as strided views of a band of rows
+/// of every channel; the receivers place each band at its rows, with the
+/// type and shape it was sent with, so the inference computes the ReLU of
+/// its input exactly
+static void test_banded_results() {
+  const DeviceInfo info0{"device0", "127.0.0.1", free_port()};
+  const DeviceInfo info1{"device1", "127.0.0.1", free_port()};
+  Relay to_device0(info0.port), to_device1(info1.port);
+  // Each device reaches the other through the relay
+  const Deployment device0(
+      make_banded_dag(), info0,
+      {{"device0", info0},
+       {"device1", DeviceInfo{"device1", "127.0.0.1", to_device1.port()}}});
+  const Deployment device1(
+      make_banded_dag(), info1,
+      {{"device0", DeviceInfo{"device0", "127.0.0.1", to_device0.port()}},
+       {"device1", info1}});
+  // Outlive the Orchestrators, whose workers report to them
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::map<RequestID, bool> correct;
+  Orchestrator orch0(device0.dag, device0.info, device0.map,
+                     device0.memory_plan, device0.plan, 2);
+  Orchestrator orch1(device1.dag, device1.info, device1.map,
+                     device1.memory_plan, device1.plan, 2);
+
+  orch0.register_inference_complete_callback(
+      [&](RequestID request_id, InferenceStatus status,
+          const arm_compute::Tensor &output) {
+        const auto &info = *output.info();
+        bool matches = status == InferenceStatus::Completed &&
+                       info.data_type() == arm_compute::DataType::F32 &&
+                       info.tensor_shape() == device0.dag.output_shape;
+        for (size_t c = 0; matches && c < kChannels; ++c) {
+          for (size_t y = 0; y < kHeight; ++y) {
+            for (size_t x = 0; x < kWidth; ++x) {
+              const float value = *reinterpret_cast<const float *>(
+                  output.ptr_to_element(arm_compute::Coordinates(x, y, c)));
+              matches &= value == std::max(0.0f, input_at(x, y, c));
+            }
+          }
+        }
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          correct[request_id] = matches;
+        }
+        cv.notify_one();
+      });
+
+  constexpr size_t kInferences = 20;
+  for (size_t i = 0; i < kInferences; ++i) {
+    // Until a request state is free
+    std::optional<RequestID> request_id;
+    for (int attempt = 0; !request_id && attempt < 2000; ++attempt) {
+      if (!(request_id = orch0.start_inference(make_banded_input()))) {
+        std::this_thread::sleep_for(1ms);
+      }
+    }
+    CHECK(request_id.has_value());
+  }
+
+  std::unique_lock<std::mutex> lock(mtx);
+  CHECK(cv.wait_for(lock, 10s, [&] { return correct.size() == kInferences; }));
+  for (const auto &[request_id, matches]: correct) {
+    CHECK(matches);
+  }
+}
+
+int main() {
+  RUN(test_partial_reads);
+  RUN(test_empty_plan_payload);
+  RUN(test_malformed_frame);
+  RUN(test_unknown_abort_status);
+  RUN(test_unreachable_peer);
+  RUN(test_full_ring);
+  RUN(test_banded_results);
+  return 0;
+}
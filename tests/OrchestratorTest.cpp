@@ -0,0 +1,323 @@
+#include "edgeflow/Orchestrator.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+static constexpr size_t kElements = 1024;
+static constexpr size_t kMaxInFlight = 2;
+
+/// Device that takes its connections and never answers, so that no
+/// inference through it completes
+class SilentDevice {
+public:
+  SilentDevice() : listening_(listen_on_loopback(port_)) {
+    thread_ = std::thread([this] {
+      std::vector<int> connections;
+      std::vector<std::thread> readers;
+      while (true) {
+        const int connection = accept(listening_, nullptr, nullptr);
+        if (connection < 0) {
+          break;
+        }
+        connections.push_back(connection);
+        // Drains what arrives, so that the sender never blocks on it
+        readers.emplace_back([connection] {
+          uint8_t buffer[4096];
+          while (recv(connection, buffer, sizeof(buffer), 0) > 0) {}
+        });
+      }
+      for (const int connection: connections) {
+        shutdown(connection, SHUT_RDWR);
+      }
+      for (auto &reader: readers) {
+        reader.join();
+      }
+      for (const int connection: connections) {
+        close(connection);
+      }
+    });
+  }
+
+  ~SilentDevice() {
+    shutdown(listening_, SHUT_RDWR);
+    thread_.join();
+    close(listening_);
+  }
+
+  unsigned int port() const { return port_; }
+
+private:
+  unsigned int port_ = 0;
+  int listening_;
+  std::thread thread_;
+};
+
+/// Links of the devices on the loopback address, for which the plan
+/// predicts next to no latency
+static ClusterProfile loopback_profile() {
+  ClusterProfile profile;
+  profile.default_link = {.bytes_per_ms = 1e9, .latency_ms = 0};
+  return profile;
+}
+
+/// The model: three ReLU layers, the middle one on the silent device
+static Deployment deploy(unsigned int silent_port,
+                         const ClusterProfile &profile = loopback_profile()) {
+  const DeviceInfo info{"device0", "127.0.0.1", free_port()};
+  return Deployment(
+      make_relu_chain(arm_compute::TensorShape(kElements),
+                      {"device0", "device1", "device0"}),
+      info,
+      {{"device0", info},
+       {"device1", DeviceInfo{"device1", "127.0.0.1", silent_port}}},
+      profile);
+}
+
+/// Statuses reported by the Orchestrator
+class Reports {
+public:
+  Orchestrator::Callback callback() {
+    return [this](RequestID request_id, InferenceStatus status,
+                  const arm_compute::Tensor &) {
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        CHECK(statuses_.emplace(request_id, status).second);
+      }
+      cv_.notify_all();
+    };
+  }
+
+  /// Wait for the status of the inference
+  InferenceStatus wait_for(RequestID request_id) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    CHECK(cv_.wait_for(lock, 10s, [&] { return statuses_.count(request_id); }));
+    return statuses_.at(request_id);
+  }
+
+private:
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::map<RequestID, InferenceStatus> statuses_;
+};
+
+static std::unique_ptr<arm_compute::Tensor> make_input() {
+  auto input = std::make_unique<arm_compute::Tensor>();
+  input->allocator()->init(arm_compute::TensorInfo(
+      arm_compute::TensorShape(kElements), 1, arm_compute::DataType::F32));
+  input->allocator()->allocate();
+  return input;
+}
+
+/// Start an inference once a request state is free; the states of aborted
+/// inferences are given back shortly after they are reported, once their
+/// last task settled
+static std::optional<RequestID> start_when_free(Orchestrator &orch,
+                                                Deadline deadline = kNoDeadline) {
+  for (int attempt = 0; attempt < 2000; ++attempt) {
+    if (const auto request_id = orch.start_inference(make_input(), deadline)) {
+      return request_id;
+    }
+    std::this_thread::sleep_for(1ms);
+  }
+  return std::nullopt;
+}
+
+/// An inference stuck on another device is aborted once its deadline
+/// passes, reported as timed out, and gives its state back: rounds of as
+/// many inferences as the Orchestrator takes at once keep being accepted
+static void test_deadline_abort() {
+  SilentDevice silent;
+  const Deployment deployment = deploy(silent.port());
+  Reports reports;
+  Orchestrator orch(deployment.dag, deployment.info, deployment.map,
+                    deployment.memory_plan, deployment.plan, kMaxInFlight);
+  orch.register_inference_complete_callback(reports.callback());
+
+  for (int round = 0; round < 3; ++round) {
+    std::vector<RequestID> request_ids;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kMaxInFlight; ++i) {
+      const auto request_id = start_when_free(orch, start + 50ms);
+      CHECK(request_id.has_value());
+      request_ids.push_back(*request_id);
+    }
+    // Every slot is taken
+    CHECK(!orch.start_inference(make_input(), start + 50ms).has_value());
+
+    for (const RequestID request_id: request_ids) {
+      CHECK(reports.wait_for(request_id) == InferenceStatus::TimedOut);
+    }
+    CHECK(std::chrono::steady_clock::now() - start >= 50ms);
+  }
+}
+
+/// An inference whose deadline comes before the end the plan predicts for
+/// it, from its root through the silent device over Wi-Fi, is rejected up
+/// front, the first one included; one with time to spare is started
+static void test_early_rejection() {
+  SilentDevice silent;
+  const Deployment deployment = deploy(silent.port(), ClusterProfile{});
+  Reports reports;
+  Orchestrator orch(deployment.dag, deployment.info, deployment.map,
+                    deployment.memory_plan, deployment.plan, kMaxInFlight);
+  orch.register_inference_complete_callback(reports.callback());
+
+  // Two hops over the default link
+  const double predicted_ms = deployment.plan.predicted_latency_ms();
+  CHECK(predicted_ms >= 2 * ClusterProfile{}.default_link.latency_ms);
+  const auto predicted = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::duration<double, std::milli>(predicted_ms));
+  CHECK(!orch.start_inference(make_input(),
+                              std::chrono::steady_clock::now() + predicted / 2)
+             .has_value());
+
+  const auto request_id =
+      orch.start_inference(make_input(),
+                           std::chrono::steady_clock::now() + predicted + 50ms);
+  CHECK(request_id.has_value());
+  CHECK(reports.wait_for(*request_id) == InferenceStatus::TimedOut);
+}
+
+/// A cancelled inference is reported as such, and gives its state back
+static void test_cancel() {
+  SilentDevice silent;
+  const Deployment deployment = deploy(silent.port());
+  Reports reports;
+  Orchestrator orch(deployment.dag, deployment.info, deployment.map,
+                    deployment.memory_plan, deployment.plan, kMaxInFlight);
+  orch.register_inference_complete_callback(reports.callback());
+
+  for (int round = 0; round < 3; ++round) {
+    const auto request_id = start_when_free(orch);
+    CHECK(request_id.has_value());
+    CHECK(orch.cancel_inference(*request_id));
+    CHECK(reports.wait_for(*request_id) == InferenceStatus::Cancelled);
+  }
+  // Nor can one cancel an inference not started yet
+  const auto request_id = start_when_free(orch);
+  CHECK(request_id.has_value());
+  CHECK(!orch.cancel_inference(*request_id + 2));
+  CHECK(orch.cancel_inference(*request_id));
+}
+
+/// An input range reaching past the rows of its source, as a hand-written
+/// DAG may have, counts only the rows the source has: the inference
+/// completes rather than wait for rows that never arrive
+static void test_padded_input_range() {
+  const DeviceInfo info{"device0", "127.0.0.1", free_port()};
+  ModelDAG dag = make_relu_chain(arm_compute::TensorShape(kElements),
+                                 {"device0", "device0"});
+  for (auto &requirement: dag.eus.at("relu1::eu0").input_requirements) {
+    requirement.second.src_range.end += 4;
+  }
+  const Deployment deployment(std::move(dag), info, {{"device0", info}});
+  const EUHandle leaf = deployment.plan.find("relu1::eu0");
+  CHECK(deployment.plan.unit(leaf).num_input_rows == kElements);
+
+  Reports reports;
+  Orchestrator orch(deployment.dag, deployment.info, deployment.map,
+                    deployment.memory_plan, deployment.plan, kMaxInFlight);
+  orch.register_inference_complete_callback(reports.callback());
+  const auto request_id = orch.start_inference(make_input());
+  CHECK(request_id.has_value());
+  CHECK(reports.wait_for(*request_id) == InferenceStatus::Completed);
+}
+
+/// The result of the middle stage arrives in two halves, from two threads,
+/// while the deadlines of the inferences fire and the next inferences take
+/// the freed request states. The request stays held while a half is written
+/// into the input of the last stage, so each inference is reported exactly
+/// once, and a completed one carries its own halves only.
+static void test_results_race_deadlines() {
+  SilentDevice silent;
+  const Deployment deployment = deploy(silent.port());
+  Reports reports;
+  Orchestrator orch(deployment.dag, deployment.info, deployment.map,
+                    deployment.memory_plan, deployment.plan, kMaxInFlight);
+  std::atomic<size_t> num_completed{0}, num_timed_out{0};
+  orch.register_inference_complete_callback(
+      [&, report = reports.callback()](RequestID request_id,
+                                       InferenceStatus status,
+                                       const arm_compute::Tensor &output) {
+        if (status == InferenceStatus::Completed) {
+          const auto *values = reinterpret_cast<const float *>(output.buffer());
+          for (size_t i = 0; i < kElements; ++i) {
+            CHECK(values[i] == static_cast<float>(request_id + 1));
+          }
+          num_completed.fetch_add(1, std::memory_order_relaxed);
+        } else if (status == InferenceStatus::TimedOut) {
+          num_timed_out.fetch_add(1, std::memory_order_relaxed);
+        }
+        report(request_id, status, output);
+      });
+
+  constexpr int kHalf = static_cast<int>(kElements / 2);
+  std::vector<RequestID> request_ids;
+  std::vector<std::thread> senders;
+  for (int round = 0; round < 500; ++round) {
+    // Spread the deadlines over the time the halves take to arrive; later
+    // once the inference is rejected as expected to time out anyway
+    auto time_left = std::chrono::microseconds(50 * (round % 20) + 50);
+    Deadline deadline{};
+    std::optional<RequestID> request_id;
+    for (int attempt = 0; !request_id && attempt < 20000; ++attempt) {
+      deadline = std::chrono::steady_clock::now() + time_left;
+      request_id = orch.start_inference(make_input(), deadline);
+      if (!request_id) {
+        time_left += 10us;
+        std::this_thread::sleep_for(100us);
+      }
+    }
+    CHECK(request_id.has_value());
+    request_ids.push_back(*request_id);
+
+    // Not joined before the next inference, which may take the state
+    for (const Range rows: {Range{0, kHalf}, Range{kHalf, 2 * kHalf}}) {
+      senders.emplace_back([&orch, rows, deadline, id = *request_id] {
+        auto data = std::make_unique<arm_compute::Tensor>();
+        data->allocator()->init(arm_compute::TensorInfo(
+            arm_compute::TensorShape(kHalf), 1, arm_compute::DataType::F32));
+        data->allocator()->allocate();
+        auto *values = reinterpret_cast<float *>(data->buffer());
+        std::fill(values, values + kHalf, static_cast<float>(id + 1));
+        orch.on_receive_intermediate_result(
+            id, std::make_unique<ExecutionUnitID>("relu1::eu0"),
+            std::make_unique<ExecutionUnitID>("relu2::eu0"), std::move(data),
+            rows, deadline);
+      });
+    }
+    // A cancellation races the halves as well
+    if (round % 3 == 0) {
+      orch.cancel_inference(*request_id);
+    }
+  }
+  for (auto &sender: senders) {
+    sender.join();
+  }
+
+  for (const RequestID request_id: request_ids) {
+    const InferenceStatus status = reports.wait_for(request_id);
+    CHECK(status == InferenceStatus::Completed ||
+          status == InferenceStatus::TimedOut ||
+          status == InferenceStatus::Cancelled);
+  }
+  std::printf("  %zu completed, %zu timed out\n", num_completed.load(),
+              num_timed_out.load());
+}
+
+int main() {
+  RUN(test_deadline_abort);
+  RUN(test_early_rejection);
+  RUN(test_cancel);
+  RUN(test_padded_input_range);
+  RUN(test_results_race_deadlines);
+  return 0;
+}
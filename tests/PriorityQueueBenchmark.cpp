@@ -0,0 +1,221 @@
+#include "BoundedQueue.hpp"
+#include "RankedDeque.hpp"
+#include "BenchmarkSupport.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+static constexpr unsigned int kFanOut = 4;
+static constexpr unsigned int kDepth = 5;
+// Tasks of a tree: 1 + 4 + ... + 4^5
+static constexpr size_t kTasksPerTree = 1365;
+static constexpr int kWorkIterations = 256;
+
+/// Task of a tree of tasks, as a wide DAG fans out; each task submits its
+/// successors when it completes
+struct Task {
+  unsigned int depth;
+  uint64_t priority;
+};
+
+/// Stand-in for running the operator of the task
+static void run(const Task &task) {
+  volatile uint64_t sum = task.priority;
+  for (int i = 0; i < kWorkIterations; ++i) {
+    sum = sum + i;
+  }
+}
+
+/// Successors of the task, or none at the bottom of its tree
+static std::vector<std::unique_ptr<Task>> successors(const Task &task) {
+  std::vector<std::unique_ptr<Task>> tasks;
+  if (task.depth < kDepth) {
+    for (unsigned int i = 0; i < kFanOut; ++i) {
+      tasks.push_back(std::make_unique<Task>(
+          Task{task.depth + 1, task.priority * kFanOut + i}));
+    }
+  }
+  return tasks;
+}
+
+/// The queue every worker took its tasks from before: one mutex and
+/// condition variable, which the workers and submitters all contend for
+class SharedQueue {
+public:
+  void push(std::unique_ptr<Task> task) {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      q_.push(std::move(task));
+    }
+    cv_.notify_one();
+  }
+
+  /// Blocking pop
+  /// @return The task, or nullptr once closed
+  std::unique_ptr<Task> pop() {
+    std::unique_lock<std::mutex> lock(mtx_);
+    cv_.wait(lock, [this] { return closed_ || !q_.empty(); });
+    if (q_.empty()) {
+      return nullptr;
+    }
+    auto task = std::move(q_.front());
+    q_.pop();
+    return task;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      closed_ = true;
+    }
+    cv_.notify_all();
+  }
+
+private:
+  std::queue<std::unique_ptr<Task>> q_;
+  bool closed_ = false;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+};
+
+/// Tasks per millisecond of the workers on one shared queue
+static double run_shared(unsigned int num_workers, size_t trees) {
+  SharedQueue queue;
+  std::atomic<size_t> remaining{trees * kTasksPerTree};
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned int w = 0; w < num_workers; ++w) {
+    workers.emplace_back([&] {
+      while (const auto task = queue.pop()) {
+        run(*task);
+        for (auto &successor: successors(*task)) {
+          queue.push(std::move(successor));
+        }
+        if (remaining.fetch_sub(1) == 1) {
+          queue.close();
+        }
+      }
+    });
+  }
+  for (size_t i = 0; i < trees; ++i) {
+    queue.push(std::make_unique<Task>(Task{0, i}));
+  }
+  for (auto &worker: workers) {
+    worker.join();
+  }
+  return trees * kTasksPerTree / ms_since(start);
+}
+
+/// Tasks per millisecond of the workers scheduling as the
+/// ComputationEngine does with `EngineOptions::per_worker_queues`:
+/// successors go to the worker's own ready queue, bucketed by their depth,
+/// tasks from other threads through the injection queue, and a worker out
+/// of work steals from the others before it sleeps
+static double run_per_worker(unsigned int num_workers, size_t trees) {
+  // The root of a tree has the greatest upward rank
+  using ReadyQueue = RankedDeque<Task, kDepth + 1>;
+  const auto bucket = [](const Task &task) { return kDepth - task.depth; };
+  BoundedQueue<Task> injection_queue(256, OverflowPolicy::Block);
+  std::vector<std::unique_ptr<ReadyQueue>> ready_queues;
+  for (unsigned int w = 0; w < num_workers; ++w) {
+    ready_queues.push_back(
+        std::make_unique<ReadyQueue>(std::chrono::milliseconds(1)));
+  }
+  std::atomic<size_t> remaining{trees * kTasksPerTree};
+  std::atomic<size_t> num_queued{0};
+  std::atomic<unsigned int> num_idle{0};
+  std::atomic<bool> stop{false};
+  std::mutex idle_mtx;
+  std::condition_variable idle_cv;
+  const auto wake_idle = [&] {
+    if (num_idle.load(std::memory_order_seq_cst) > 0) {
+      { std::lock_guard<std::mutex> lock(idle_mtx); }
+      idle_cv.notify_one();
+    }
+  };
+
+  const auto try_take = [&](unsigned int worker) -> std::unique_ptr<Task> {
+    ReadyQueue &own = *ready_queues[worker];
+    while (auto task = injection_queue.try_pop()) {
+      const size_t b = bucket(*task);
+      own.push(b, std::move(task));
+    }
+    if (auto task = own.pop(std::chrono::steady_clock::now())) {
+      return task;
+    }
+    for (unsigned int i = 1; i < num_workers; ++i) {
+      ReadyQueue &victim = *ready_queues[(worker + i) % num_workers];
+      if (victim.size() == 0) {
+        continue;
+      }
+      if (auto task = victim.steal()) {
+        return task;
+      }
+    }
+    return nullptr;
+  };
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned int w = 0; w < num_workers; ++w) {
+    workers.emplace_back([&, w] {
+      while (!stop) {
+        auto task = try_take(w);
+        if (!task) {
+          std::unique_lock<std::mutex> lock(idle_mtx);
+          num_idle.fetch_add(1, std::memory_order_seq_cst);
+          idle_cv.wait(lock, [&] {
+            return stop || num_queued.load(std::memory_order_seq_cst) > 0;
+          });
+          num_idle.fetch_sub(1, std::memory_order_relaxed);
+          continue;
+        }
+        num_queued.fetch_sub(1, std::memory_order_relaxed);
+        run(*task);
+        for (auto &successor: successors(*task)) {
+          num_queued.fetch_add(1, std::memory_order_seq_cst);
+          const size_t b = bucket(*successor);
+          ready_queues[w]->push(b, std::move(successor));
+          wake_idle();
+        }
+        if (remaining.fetch_sub(1) == 1) {
+          {
+            std::lock_guard<std::mutex> lock(idle_mtx);
+            stop = true;
+          }
+          idle_cv.notify_all();
+        }
+      }
+    });
+  }
+  for (size_t i = 0; i < trees; ++i) {
+    num_queued.fetch_add(1, std::memory_order_seq_cst);
+    injection_queue.push(std::make_unique<Task>(Task{0, i}));
+    wake_idle();
+  }
+  for (auto &worker: workers) {
+    worker.join();
+  }
+  return trees * kTasksPerTree / ms_since(start);
+}
+
+/// Throughput of the workers on trees of short tasks, by the number of
+/// workers, with one queue shared by all of them and with per-worker ready
+/// queues, as the ComputationEngine takes them by default
+int main(int argc, char **argv) {
+  const size_t trees = count_argument(argc, argv, 200);
+  const unsigned int max_workers =
+      std::max(4u, std::thread::hardware_concurrency());
+  std::printf("%8s %16s %20s\n", "workers", "shared_Mtask/s",
+              "per_worker_Mtask/s");
+  for (unsigned int workers = 1; workers <= max_workers; workers *= 2) {
+    std::printf("%8u %16.3f %20.3f\n", workers,
+                run_shared(workers, trees) / 1e3,
+                run_per_worker(workers, trees) / 1e3);
+  }
+  return 0;
+}
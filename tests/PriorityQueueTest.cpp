@@ -0,0 +1,73 @@
+#include "PriorityQueue.hpp"
+#include "TestSupport.h"
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using IntQueue = PriorityQueue<int, std::less<int>>;
+
+/// Items come out greatest first
+static void test_priority_order() {
+  IntQueue queue;
+  for (const int item: {3, 9, 1, 7, 5}) {
+    queue.push(std::make_unique<int>(item));
+  }
+  CHECK(queue.size() == 5);
+  for (const int expected: {9, 7, 5, 3, 1}) {
+    auto item = queue.try_pop();
+    CHECK(item && *item == expected);
+  }
+  CHECK(queue.try_pop() == nullptr);
+  CHECK(queue.size() == 0);
+}
+
+/// As the ready queue the workers share: one pushes and pops its tasks
+/// while the others take from it too, and every task is taken exactly once
+static void test_owner_and_thieves() {
+  constexpr int kItems = 200000, kThieves = 3;
+  IntQueue queue;
+  std::vector<std::atomic<int>> taken(kItems);
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> thieves;
+  for (int t = 0; t < kThieves; ++t) {
+    thieves.emplace_back([&] {
+      while (!done.load(std::memory_order_acquire) || queue.size() > 0) {
+        // Victims that look empty are skipped without taking the lock
+        if (queue.size() == 0) {
+          std::this_thread::yield();
+          continue;
+        }
+        if (auto item = queue.try_pop()) {
+          taken[*item].fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    });
+  }
+  for (int i = 0; i < kItems; ++i) {
+    queue.push(std::make_unique<int>(i));
+    // The owner runs one task for every two it makes ready
+    if (i % 2 == 1) {
+      if (auto item = queue.try_pop()) {
+        taken[*item].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+  done.store(true, std::memory_order_release);
+  for (auto &thief: thieves) thief.join();
+  while (auto item = queue.try_pop()) {
+    taken[*item].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  for (const auto &count: taken) {
+    CHECK(count.load() == 1);
+  }
+  CHECK(queue.size() == 0);
+}
+
+int main() {
+  RUN(test_priority_order);
+  RUN(test_owner_and_thieves);
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include "RankedDeque.hpp"
+#include "TestSupport.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+using IntDeque = RankedDeque<int, 4>;
+
+static constexpr auto kPromotion = std::chrono::milliseconds(10);
+
+/// The owner takes the greatest bucket first, and the most recent item of
+/// a bucket first
+static void test_rank_order() {
+  IntDeque deque(kPromotion);
+  const auto now = Clock::now();
+  deque.push(1, std::make_unique<int>(10));
+  deque.push(3, std::make_unique<int>(30));
+  deque.push(1, std::make_unique<int>(11));
+  deque.push(3, std::make_unique<int>(31));
+  deque.push(0, std::make_unique<int>(0));
+  CHECK(deque.size() == 5);
+  for (const int expected: {31, 30, 11, 10, 0}) {
+    auto item = deque.pop(now);
+    CHECK(item && *item == expected);
+  }
+  CHECK(deque.pop(now) == nullptr);
+  CHECK(deque.size() == 0);
+}
+
+/// Thieves take the oldest item of the greatest bucket
+static void test_steal_order() {
+  IntDeque deque(kPromotion);
+  deque.push(0, std::make_unique<int>(0));
+  deque.push(2, std::make_unique<int>(20));
+  deque.push(2, std::make_unique<int>(21));
+  for (const int expected: {20, 21, 0}) {
+    auto item = deque.steal();
+    CHECK(item && *item == expected);
+  }
+  CHECK(deque.steal() == nullptr);
+}
+
+/// A bucket that waited gains rank: once a lower bucket waited longer than
+/// its distance to a greater one, its oldest item goes first, and so does
+/// the oldest item of a bucket that waited one promotion
+static void test_aging() {
+  IntDeque deque(kPromotion);
+  const auto start = Clock::now();
+  deque.push(0, std::make_unique<int>(0));
+  deque.push(0, std::make_unique<int>(1));
+  deque.push(3, std::make_unique<int>(30));
+  // Bucket 0 starts to wait
+  auto item = deque.pop(start);
+  CHECK(item && *item == 30);
+  deque.push(2, std::make_unique<int>(20));
+  deque.push(2, std::make_unique<int>(21));
+
+  // Bucket 0 waited three promotions, bucket 2 none
+  item = deque.pop(start + 3 * kPromotion);
+  CHECK(item && *item == 0);
+  // Bucket 0 was just served, so bucket 2 goes first again, newest first
+  item = deque.pop(start + 3 * kPromotion);
+  CHECK(item && *item == 21);
+  // Bucket 2 waited one promotion, so its oldest item is due
+  item = deque.pop(start + 4 * kPromotion);
+  CHECK(item && *item == 20);
+  item = deque.pop(start + 4 * kPromotion);
+  CHECK(item && *item == 1);
+  CHECK(deque.pop(start + 4 * kPromotion) == nullptr);
+}
+
+/// As a worker's ready queue: the owner pushes into and pops from all the
+/// buckets while the other workers steal from it, and every item is taken
+/// exactly once
+static void test_owner_and_thieves() {
+  constexpr int kItems = 200000, kThieves = 3;
+  IntDeque deque(kPromotion);
+  std::vector<std::atomic<int>> taken(kItems);
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> thieves;
+  for (int t = 0; t < kThieves; ++t) {
+    thieves.emplace_back([&] {
+      while (!done.load(std::memory_order_acquire) || deque.size() > 0) {
+        if (auto item = deque.steal()) {
+          taken[*item].fetch_add(1, std::memory_order_relaxed);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (int i = 0; i < kItems; ++i) {
+    deque.push(static_cast<size_t>(i) % 4, std::make_unique<int>(i));
+    // The owner runs one item for every two it makes ready
+    if (i % 2 == 1) {
+      if (auto item = deque.pop(Clock::now())) {
+        taken[*item].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+  done.store(true, std::memory_order_release);
+  for (auto &thief: thieves) thief.join();
+  while (auto item = deque.pop(Clock::now())) {
+    taken[*item].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  for (const auto &count: taken) {
+    CHECK(count.load() == 1);
+  }
+  CHECK(deque.size() == 0);
+}
+
+int main() {
+  RUN(test_rank_order);
+  RUN(test_steal_order);
+  RUN(test_aging);
+  RUN(test_owner_and_thieves);
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include "edgeflow/NetworkEventHandler.h"
+#include "BenchmarkSupport.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using PlanMessage = NetworkEventHandler::PlanMessage;
+
+/// The frame of a plan message "device0" sends to "device1", as recorded on
+/// the wire
+static std::vector<uint8_t> record_frame(size_t payload_size) {
+  unsigned int tap_port;
+  const int tap = listen_on_loopback(tap_port);
+  std::vector<uint8_t> frame;
+  std::thread tap_thread([&] {
+    const int connection = accept(tap, nullptr, nullptr);
+    CHECK(connection >= 0);
+    uint8_t buffer[65536];
+    ssize_t received;
+    while ((received = recv(connection, buffer, sizeof(buffer), 0)) > 0) {
+      frame.insert(frame.end(), buffer, buffer + received);
+    }
+    close(connection);
+  });
+  {
+    const DeviceInfo sender_info{"device0", "127.0.0.1", free_port()};
+    const DeviceMap sender_map = {
+        {"device0", sender_info},
+        {"device1", DeviceInfo{"device1", "127.0.0.1", tap_port}},
+    };
+    NetworkEventHandler sender(sender_info, sender_map);
+    sender.send_plan_message("device1", PlanMessage::DriftNotice, 0,
+                             std::vector<uint8_t>(payload_size, 0x5A));
+    sender.flush();
+  }
+  // The sender hung up on the tap when it was destroyed
+  tap_thread.join();
+  close(tap);
+  CHECK(!frame.empty());
+  return frame;
+}
+
+/// Messages per millisecond the reactor of one handler takes in, from
+/// `num_peers` connections sending the frame over and over
+static double measure(const std::vector<uint8_t> &frame, size_t num_peers,
+                      size_t num_messages) {
+  const DeviceInfo info{"device1", "127.0.0.1", free_port()};
+  const DeviceMap map = {{"device0", DeviceInfo{"device0", "127.0.0.1", free_port()}},
+                         {"device1", info}};
+  const size_t per_peer = num_messages / num_peers;
+  const size_t total = per_peer * num_peers;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::atomic<size_t> received{0};
+  // Declared after what its reactor records to, so that it is destroyed first
+  NetworkEventHandler handler(info, map);
+  handler.register_plan_callback(
+      [&](PlanMessage, const DeviceID &, uint32_t, std::vector<uint8_t>) {
+        if (received.fetch_add(1, std::memory_order_relaxed) + 1 == total) {
+          { std::lock_guard<std::mutex> lock(mtx); }
+          cv.notify_one();
+        }
+      });
+  CHECK(handler.start_listening(info.port));
+
+  std::vector<int> peers;
+  for (size_t i = 0; i < num_peers; ++i) {
+    peers.push_back(connect_to(info.port));
+  }
+
+  // A few threads send for all the peers, one frame per peer in turn, so
+  // that the frames of the peers interleave at the reactor
+  const size_t num_senders = std::min<size_t>(num_peers, 4);
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> senders;
+  for (size_t s = 0; s < num_senders; ++s) {
+    senders.emplace_back([&, s] {
+      for (size_t n = 0; n < per_peer; ++n) {
+        for (size_t p = s; p < num_peers; p += num_senders) {
+          CHECK(send(peers[p], frame.data(), frame.size(), MSG_NOSIGNAL) ==
+                static_cast<ssize_t>(frame.size()));
+        }
+      }
+    });
+  }
+  for (auto &sender: senders) {
+    sender.join();
+  }
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    CHECK(cv.wait_for(lock, 60s, [&] { return received == total; }));
+  }
+  const double elapsed_ms = ms_since(start);
+  for (const int peer: peers) {
+    close(peer);
+  }
+  return total / elapsed_ms;
+}
+
+/// Ingress throughput of the reactor by the number of peers and the size of
+/// the messages. The messages are plan messages, which go through the same
+/// reassembly as results without an Orchestrator behind them.
+int main(int argc, char **argv) {
+  const size_t messages = count_argument(argc, argv, 200000);
+  std::printf("%8s %12s %12s %12s\n", "peers", "frame_bytes", "Kmsg/s",
+              "MB/s");
+  for (const size_t payload_size: {0, 64, 1024}) {
+    const std::vector<uint8_t> frame = record_frame(payload_size);
+    for (size_t peers = 1; peers <= 256; peers *= 4) {
+      const double per_ms = measure(frame, peers, messages);
+      std::printf("%8zu %12zu %12.1f %12.1f\n", peers, frame.size(), per_ms,
+                  per_ms * frame.size() / 1e3);
+    }
+  }
+  return 0;
+}
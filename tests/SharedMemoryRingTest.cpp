@@ -0,0 +1,260 @@
+#include "edgeflow/SharedMemoryRing.h"
+#include "TestSupport.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+/// The two sides of a ring in one process, as handed over to a peer
+struct RingPair {
+  std::unique_ptr<SharedMemoryRing> producer;
+  std::shared_ptr<SharedMemoryRing> consumer;
+  int consumer_link = -1; // Hung up to tell the producer the consumer is gone
+
+  explicit RingPair(size_t capacity) {
+    int link[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, link) == 0);
+    producer = SharedMemoryRing::create(capacity, link[0]);
+    CHECK(producer);
+    consumer = SharedMemoryRing::attach(dup(producer->memory_fd()),
+                                        dup(producer->data_fd()),
+                                        dup(producer->space_fd()));
+    CHECK(consumer);
+    consumer_link = link[1];
+  }
+
+  ~RingPair() {
+    if (consumer_link >= 0) {
+      close(consumer_link);
+    }
+  }
+};
+
+static size_t page_size() {
+  return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+/// Byte `i` of the payload of message `seq`
+static uint8_t pattern(uint32_t seq, size_t i) {
+  return static_cast<uint8_t>(seq * 31 + i);
+}
+
+static bool push_message(SharedMemoryRing &ring, uint32_t seq, size_t size,
+                         std::chrono::milliseconds timeout = 10s) {
+  std::vector<uint8_t> payload(size);
+  for (size_t i = 0; i < size; ++i) {
+    payload[i] = pattern(seq, i);
+  }
+  // Split over two buffers, as the handler gathers its messages
+  const size_t split = size / 3;
+  const iovec head[] = {{&seq, sizeof(seq)}};
+  const iovec parts[] = {{payload.data(), split},
+                         {payload.data() + split, size - split}};
+  return ring.push(head, 1, parts, 2, timeout);
+}
+
+static void check_message(const SharedMemoryRing::Record &record,
+                          uint32_t expected_seq, size_t expected_size) {
+  CHECK(record.head_size == sizeof(uint32_t));
+  uint32_t seq;
+  std::memcpy(&seq, record.head, sizeof(seq));
+  CHECK(seq == expected_seq);
+  CHECK(record.payload_size == expected_size);
+  CHECK(reinterpret_cast<uintptr_t>(record.payload) %
+            SharedMemoryRing::kAlignment == 0);
+  for (size_t i = 0; i < record.payload_size; ++i) {
+    CHECK(record.payload[i] == pattern(seq, i));
+  }
+}
+
+/// Take the next record, waiting for the producer as the reactor does
+static SharedMemoryRing::Record take(SharedMemoryRing &ring) {
+  SharedMemoryRing::Record record;
+  while (!ring.next(record)) {
+    if (!ring.sleep()) {
+      continue;
+    }
+    pollfd fd{ring.data_fd(), POLLIN, 0};
+    CHECK(poll(&fd, 1, 5000) == 1);
+    ring.wake_up();
+  }
+  return record;
+}
+
+/// Size of the payload of message `seq`; varied so that the records end at
+/// every offset of the buffer and get fillers before its end
+static size_t message_size(uint32_t seq) {
+  return (seq * 97) % (page_size() / 5) + 1;
+}
+
+/// Records of varied sizes go around the buffer many times, with the
+/// producer waiting for space, and come out whole and in order
+static void test_wrap_around() {
+  constexpr uint32_t kMessages = 20000;
+  RingPair pair(page_size());
+
+  std::thread producer([&] {
+    for (uint32_t seq = 0; seq < kMessages; ++seq) {
+      CHECK(push_message(*pair.producer, seq, message_size(seq)));
+    }
+  });
+  for (uint32_t seq = 0; seq < kMessages; ++seq) {
+    const auto record = take(*pair.consumer);
+    check_message(record, seq, message_size(seq));
+    pair.consumer->release(record);
+  }
+  producer.join();
+}
+
+/// Released records are reclaimed only once every record before them is
+/// released, so the producer waits for the first one
+static void test_out_of_order_release() {
+  // Three records fit in the buffer, a fourth does not
+  const size_t size = page_size() / 4;
+  RingPair pair(page_size());
+  SharedMemoryRing::Record records[3];
+  for (uint32_t seq = 0; seq < 3; ++seq) {
+    CHECK(push_message(*pair.producer, seq, size));
+    records[seq] = take(*pair.consumer);
+    check_message(records[seq], seq, size);
+  }
+
+  std::atomic<bool> pushed{false};
+  std::thread producer([&] {
+    CHECK(push_message(*pair.producer, 3, size));
+    pushed = true;
+  });
+  pair.consumer->release(records[2]);
+  pair.consumer->release(records[1]);
+  std::this_thread::sleep_for(50ms);
+  CHECK(!pushed);
+
+  pair.consumer->release(records[0]);
+  producer.join();
+  CHECK(pushed);
+  const auto record = take(*pair.consumer);
+  check_message(record, 3, size);
+  pair.consumer->release(record);
+}
+
+/// A record too large for the buffer is refused instead of waiting forever
+static void test_too_large() {
+  RingPair pair(page_size());
+  CHECK(!push_message(*pair.producer, 0, page_size()));
+  // Half of the capacity always fits, wherever the ring stands
+  for (uint32_t seq = 1; seq < 8; ++seq) {
+    CHECK(push_message(*pair.producer, seq, page_size() / 2 - 256));
+    const auto record = take(*pair.consumer);
+    check_message(record, seq, page_size() / 2 - 256);
+    pair.consumer->release(record);
+  }
+}
+
+/// A record whose sizes do not fit where it is, as a faulty producer could
+/// write, makes the ring corrupt instead of being read: a size of 0, which
+/// would never move the consumer on, one running past the end of the
+/// buffer or not in whole alignment units, and a payload past the record
+static void test_malformed_records() {
+  // Offsets of the size of the first record and of its payload, which
+  // starts the page after the control block
+  const size_t size_offset = page_size(), payload_size_offset = page_size() + 8;
+  const std::pair<size_t, uint64_t> corruptions[] = {
+      {size_offset, 0},
+      {size_offset, 2 * page_size()},
+      {size_offset, SharedMemoryRing::kAlignment + 1},
+      {payload_size_offset, page_size()},
+  };
+  for (const auto &[offset, value]: corruptions) {
+    RingPair pair(page_size());
+    CHECK(push_message(*pair.producer, 0, 100));
+    void *mapping = mmap(nullptr, 2 * page_size(), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, pair.producer->memory_fd(), 0);
+    CHECK(mapping != MAP_FAILED);
+    std::memcpy(static_cast<uint8_t *>(mapping) + offset, &value,
+                sizeof(value));
+    munmap(mapping, 2 * page_size());
+
+    SharedMemoryRing::Record record;
+    CHECK(!pair.consumer->next(record));
+    CHECK(pair.consumer->corrupt());
+    // Nor is anything taken from it afterwards
+    CHECK(push_message(*pair.producer, 1, 100));
+    CHECK(!pair.consumer->next(record));
+  }
+}
+
+/// A producer waiting for space gives up once the consumer hangs up
+static void test_consumer_gone() {
+  const size_t size = page_size() / 4;
+  RingPair pair(page_size());
+  for (uint32_t seq = 0; seq < 3; ++seq) {
+    CHECK(push_message(*pair.producer, seq, size));
+  }
+
+  std::thread hang_up([&] {
+    std::this_thread::sleep_for(50ms);
+    close(pair.consumer_link);
+    pair.consumer_link = -1;
+  });
+  CHECK(!push_message(*pair.producer, 3, size));
+  hang_up.join();
+  CHECK(pair.producer->closed());
+  CHECK(!push_message(*pair.producer, 4, 1));
+}
+
+/// A producer waiting for space gives up once the timeout passes, and does
+/// not wait again until the ring has space
+static void test_full_timeout() {
+  const size_t size = page_size() / 4;
+  RingPair pair(page_size());
+  SharedMemoryRing::Record records[3];
+  for (uint32_t seq = 0; seq < 3; ++seq) {
+    CHECK(push_message(*pair.producer, seq, size));
+    records[seq] = take(*pair.consumer);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  CHECK(!push_message(*pair.producer, 3, size, 100ms));
+  CHECK(std::chrono::steady_clock::now() - start >= 100ms);
+  CHECK(!pair.producer->closed());
+  start = std::chrono::steady_clock::now();
+  CHECK(!push_message(*pair.producer, 3, size, 10s));
+  CHECK(std::chrono::steady_clock::now() - start < 1s);
+
+  // Space reclaimed while the producer does not wait
+  for (const auto &record: records) {
+    pair.consumer->release(record);
+  }
+  for (uint32_t seq = 3; seq < 6; ++seq) {
+    CHECK(push_message(*pair.producer, seq, size, 100ms));
+    const auto record = take(*pair.consumer);
+    check_message(record, seq, size);
+    records[seq - 3] = record;
+  }
+  // It waits again, until the consumer frees space
+  std::thread release([&] {
+    std::this_thread::sleep_for(50ms);
+    pair.consumer->release(records[0]);
+  });
+  CHECK(push_message(*pair.producer, 6, size, 10s));
+  release.join();
+  check_message(take(*pair.consumer), 6, size);
+}
+
+int main() {
+  RUN(test_wrap_around);
+  RUN(test_out_of_order_release);
+  RUN(test_too_large);
+  RUN(test_malformed_records);
+  RUN(test_consumer_gone);
+  RUN(test_full_timeout);
+  return 0;
+}
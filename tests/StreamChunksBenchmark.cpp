@@ -0,0 +1,172 @@
+#include "edgeflow/GraphOptimizer.h"
+#include "edgeflow/Orchestrator.h"
+#include "edgeflow/Partitioner.h"
+#include "BenchmarkSupport.h"
+#include "TestSupport.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+static constexpr size_t kCols = 1024, kRows = 512;
+
+/// Emulated link to a device on this host: forwards the connections it
+/// takes to the port of the device, paced at a given rate. The device is
+/// reached over TCP rather than a ring, as no ring is offered on the port
+/// of the link.
+class Link {
+public:
+  /// @param bytes_per_ms Rate of each direction, or 0 for the loopback rate
+  Link(unsigned int target_port, double bytes_per_ms)
+      : listening_(listen_on_loopback(port_)) {
+    thread_ = std::thread([this, target_port, bytes_per_ms] {
+      std::vector<int> sockets;
+      std::vector<std::thread> pumps;
+      while (true) {
+        const int accepted = accept(listening_, nullptr, nullptr);
+        if (accepted < 0) {
+          break;
+        }
+        const int forwarded = connect_to(target_port);
+        sockets.push_back(accepted);
+        sockets.push_back(forwarded);
+        pumps.emplace_back(pump, accepted, forwarded, bytes_per_ms);
+        pumps.emplace_back(pump, forwarded, accepted, bytes_per_ms);
+      }
+      for (const int socket: sockets) {
+        shutdown(socket, SHUT_RDWR);
+      }
+      for (auto &pump: pumps) {
+        pump.join();
+      }
+      for (const int socket: sockets) {
+        close(socket);
+      }
+    });
+  }
+
+  ~Link() {
+    shutdown(listening_, SHUT_RDWR);
+    thread_.join();
+    close(listening_);
+  }
+
+  unsigned int port() const { return port_; }
+
+private:
+  static void pump(int from, int to, double bytes_per_ms) {
+    uint8_t buffer[16384];
+    ssize_t received;
+    auto next = std::chrono::steady_clock::now();
+    while ((received = recv(from, buffer, sizeof(buffer), 0)) > 0) {
+      if (bytes_per_ms > 0) {
+        // An idle link earns no credit for a burst
+        next = std::max(next, std::chrono::steady_clock::now()) +
+               std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                   std::chrono::duration<double, std::milli>(received /
+                                                             bytes_per_ms));
+        std::this_thread::sleep_until(next);
+      }
+      if (send(to, buffer, received, MSG_NOSIGNAL) != received) {
+        break;
+      }
+    }
+    shutdown(to, SHUT_WR);
+  }
+
+  unsigned int port_ = 0;
+  int listening_;
+  std::thread thread_;
+};
+
+/// Eight ReLU layers on a feature map of 2 MiB: the first four run on
+/// "device0", the next three on "device1", and the last one on "device0".
+/// The chains of each device are merged into one unit, and the two that
+/// send to the other device compute their output in bands of rows.
+static ModelDAG make_dag(size_t stream_chunks) {
+  std::vector<DeviceID> devices;
+  for (int i = 0; i < 8; ++i) {
+    devices.push_back(i < 4 || i == 7 ? "device0" : "device1");
+  }
+  ModelDAG dag = make_relu_chain(arm_compute::TensorShape(kCols, kRows), devices);
+  GraphOptimizer::optimize(dag);
+  Partitioner::assign_stream_chunks(dag, stream_chunks);
+  return dag;
+}
+
+/// Median latency of an inference alone
+/// @param bytes_per_ms Rate of the links between the devices, or 0 for
+/// the loopback rate
+static double measure(size_t stream_chunks, double bytes_per_ms,
+                      size_t inferences) {
+  const DeviceInfo info0{"device0", "127.0.0.1", free_port()};
+  const DeviceInfo info1{"device1", "127.0.0.1", free_port()};
+  Link to_device0(info0.port, bytes_per_ms), to_device1(info1.port, bytes_per_ms);
+  // Each device reaches the other through the link
+  const DeviceMap map0 = {
+      {"device0", info0},
+      {"device1", DeviceInfo{"device1", "127.0.0.1", to_device1.port()}}};
+  const DeviceMap map1 = {
+      {"device0", DeviceInfo{"device0", "127.0.0.1", to_device0.port()}},
+      {"device1", info1}};
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  size_t completed = 0;
+  const Deployment device0(make_dag(stream_chunks), info0, map0);
+  const Deployment device1(make_dag(stream_chunks), info1, map1);
+  Orchestrator orch0(device0.dag, device0.info, device0.map,
+                     device0.memory_plan, device0.plan, 1);
+  Orchestrator orch1(device1.dag, device1.info, device1.map,
+                     device1.memory_plan, device1.plan, 1);
+  orch0.register_inference_complete_callback(
+      [&](RequestID, InferenceStatus status, const arm_compute::Tensor &) {
+        CHECK(status == InferenceStatus::Completed);
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          ++completed;
+        }
+        cv.notify_one();
+      });
+
+  const auto make_input = [] {
+    auto input = std::make_unique<arm_compute::Tensor>();
+    input->allocator()->init(arm_compute::TensorInfo(
+        arm_compute::TensorShape(kCols, kRows), 1, arm_compute::DataType::F32));
+    input->allocator()->allocate();
+    return input;
+  };
+  // One more inference than measured, which opens the connections
+  std::vector<double> latencies;
+  for (size_t n = 0; n <= inferences; ++n) {
+    const auto start = std::chrono::steady_clock::now();
+    // The state of the previous inference is given back after its report
+    while (!orch0.start_inference(make_input())) {
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    CHECK(cv.wait_for(lock, 60s, [&] { return completed == n + 1; }));
+    if (n > 0) {
+      latencies.push_back(ms_since(start));
+    }
+  }
+  return percentile(latencies, 0.5);
+}
+
+/// Latency of an inference whose two 2 MiB results cross between two
+/// devices of this host, sent whole and in bands computed one after the
+/// other, over the loopback link and over links paced at 100 MB/s
+int main(int argc, char **argv) {
+  const size_t inferences = count_argument(argc, argv, 50);
+  std::printf("%10s %8s %10s\n", "link", "chunks", "p50_ms");
+  for (const double bytes_per_ms: {0.0, 1e5}) {
+    for (const size_t chunks: {1, 2, 4, 8}) {
+      std::printf("%10s %8zu %10.3f\n",
+                  bytes_per_ms > 0 ? "100MB/s" : "loopback", chunks,
+                  measure(chunks, bytes_per_ms, inferences));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,165 @@
+#ifndef EDGEFLOW_TESTSUPPORT_H
+#define EDGEFLOW_TESTSUPPORT_H
+
+#include "edgeflow/ExecutionPlan.h"
+#include "edgeflow/MemoryPlanner.h"
+#include "edgeflow/Partitioner.h"
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstdlib>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+/// Fail the test, i.e., exit with a non-zero status, if the condition does
+/// not hold
+#define CHECK(condition)                                                     \
+  do {                                                                       \
+    if (!(condition)) {                                                      \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,  \
+                   #condition);                                              \
+      std::exit(1);                                                          \
+    }                                                                        \
+  } while (false)
+
+/// Run one test case of a test executable, announcing it on stdout
+#define RUN(test_case)                                                       \
+  do {                                                                       \
+    std::printf("%s\n", #test_case);                                         \
+    std::fflush(stdout);                                                     \
+    test_case();                                                             \
+  } while (false)
+
+/// Listen on a port of the loopback address picked by the system
+/// @param port Set to the port
+/// @return The listening socket
+inline int listen_on_loopback(unsigned int &port) {
+  const int listening = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  CHECK(listening >= 0 &&
+        bind(listening, reinterpret_cast<sockaddr *>(&address), length) == 0 &&
+        listen(listening, 16) == 0 &&
+        getsockname(listening, reinterpret_cast<sockaddr *>(&address), &length) == 0);
+  port = ntohs(address.sin_port);
+  return listening;
+}
+
+/// A port of the loopback address nothing listens on, for a device
+inline unsigned int free_port() {
+  unsigned int port;
+  close(listen_on_loopback(port));
+  return port;
+}
+
+/// Connect to a port of the loopback address, as a peer device would
+inline int connect_to(unsigned int port) {
+  const int connection = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  CHECK(connection >= 0 &&
+        connect(connection, reinterpret_cast<sockaddr *>(&address),
+                sizeof(address)) == 0);
+  const int no_delay = 1;
+  setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+  return connection;
+}
+
+/// A chain of ReLU layers of the shape, one per device, each run whole on
+/// its device
+inline ModelDAG make_relu_chain(const arm_compute::TensorShape &shape,
+                                const std::vector<DeviceID> &devices) {
+  ModelDAG dag;
+  dag.name = "relu_chain";
+  dag.input_shape = shape;
+  dag.output_shape = shape;
+  std::vector<std::shared_ptr<Layer>> layers;
+  for (size_t i = 0; i < devices.size(); ++i) {
+    auto layer = std::make_shared<Layer>(Layer{
+        .id = "relu" + std::to_string(i),
+        .type = LayerType::ReLU,
+        .params = {},
+        .hparams = {},
+        .input_shape = shape,
+        .output_shape = shape,
+    });
+    dag.layers[layer->id] = layer;
+    dag.layer_order.push_back(layer->id);
+    layers.push_back(std::move(layer));
+  }
+  for (auto &layer_eus: Partitioner::partition_pipeline(layers, devices)) {
+    for (auto &eu: layer_eus) {
+      dag.eus.emplace(eu.id, std::move(eu));
+    }
+  }
+  return dag;
+}
+
+/// Two ReLU layers over a vector of rows. The first is split into thin
+/// bands on "device1", whose results the tests deliver themselves; the
+/// second into units on "device0", the leaves, most of which take their
+/// input from several bands.
+inline ModelDAG make_wide_dag(int rows, size_t num_producers,
+                              size_t num_consumers) {
+  ModelDAG dag;
+  dag.name = "wide_relu";
+  dag.input_shape = arm_compute::TensorShape(rows);
+  dag.output_shape = dag.input_shape;
+  std::vector<std::vector<ExecutionUnit>> eus;
+  for (const size_t num_units: {num_producers, num_consumers}) {
+    auto layer = std::make_shared<Layer>(Layer{
+        .id = "relu" + std::to_string(eus.size()),
+        .type = LayerType::ReLU,
+        .params = {},
+        .hparams = {},
+        .input_shape = dag.input_shape,
+        .output_shape = dag.output_shape,
+    });
+    dag.layers[layer->id] = layer;
+    dag.layer_order.push_back(layer->id);
+    const std::vector<DeviceID> devices(
+        num_units, eus.empty() ? "device1" : "device0");
+    eus.push_back(Partitioner::partition_rows(layer, devices));
+  }
+  Partitioner::connect_model_input(eus[0]);
+  Partitioner::connect(eus[0], eus[1]);
+  for (auto &eu: eus[1]) {
+    eu.is_leaf = true;
+  }
+  for (auto &layer_eus: eus) {
+    for (auto &eu: layer_eus) {
+      dag.eus.emplace(eu.id, std::move(eu));
+    }
+  }
+  return dag;
+}
+
+/// A model deployed on one device, with the plans an Orchestrator of the
+/// device takes
+struct Deployment {
+  ModelDAG dag;
+  DeviceInfo info;
+  DeviceMap map;
+  MemoryPlan memory_plan;
+  ExecutionPlan plan;
+
+  /// @param profile Throughput of the devices and links, for the ranks
+  Deployment(ModelDAG model, const DeviceInfo &device_info,
+             const DeviceMap &device_map, const ClusterProfile &profile = {})
+      : dag(std::move(model)), info(device_info), map(device_map),
+        memory_plan(MemoryPlanner::plan(dag, info.id)),
+        plan(ExecutionPlan::compile(dag, info.id, memory_plan, profile)) {}
+
+  // The execution plan points into the DAG and the memory plan
+  Deployment(const Deployment &) = delete;
+  Deployment &operator=(const Deployment &) = delete;
+};
+
+#endif // EDGEFLOW_TESTSUPPORT_H
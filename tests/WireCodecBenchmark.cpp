@@ -0,0 +1,184 @@
+#include "edgeflow/Orchestrator.h"
+#include "edgeflow/Partitioner.h"
+#include "edgeflow/WireCodec.h"
+#include "BenchmarkSupport.h"
+#include "TestSupport.h"
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+static constexpr size_t kElements = size_t{1} << 20;
+static const char *const kCodecNames[] = {"raw", "sparse", "fp16", "int8"};
+static const WireCodec kCodecs[] = {WireCodec::Raw, WireCodec::Sparse,
+                                    WireCodec::FP16, WireCodec::Int8};
+
+/// Elements uniform in [low, high), clamped at zero from below if `relu`,
+/// so that the share of zeros is about -low / (high - low)
+static std::vector<float> make_elements(float low, float high, bool relu) {
+  std::mt19937 rng(24);
+  std::uniform_real_distribution<float> value(low, high);
+  std::vector<float> elements(kElements);
+  for (auto &element: elements) {
+    element = relu ? std::max(0.0f, value(rng)) : value(rng);
+  }
+  return elements;
+}
+
+/// Largest and root mean square error of the decoded elements
+struct Drift {
+  double max_error = 0, rms_error = 0;
+};
+
+static Drift drift(const float *decoded, const float *reference, size_t count) {
+  Drift d;
+  double sum_squares = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const double error = std::fabs(decoded[i] - reference[i]);
+    d.max_error = std::max(d.max_error, error);
+    sum_squares += error * error;
+  }
+  d.rms_error = std::sqrt(sum_squares / count);
+  return d;
+}
+
+/// Compression ratio, encode and decode speed and error of each codec on
+/// the elements
+static void measure_codecs(const char *data_name,
+                           const std::vector<float> &elements,
+                           size_t iterations) {
+  std::vector<float> decoded(elements.size());
+  for (size_t c = 0; c < std::size(kCodecs); ++c) {
+    std::vector<uint8_t> encoded(max_encoded_size(kCodecs[c], elements.size()));
+    size_t size = 0;
+    std::vector<double> encode_ms, decode_ms;
+    for (size_t i = 0; i < iterations; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      size = encode_elements(kCodecs[c], elements.data(), elements.size(),
+                             encoded.data());
+      encode_ms.push_back(ms_since(start));
+      start = std::chrono::steady_clock::now();
+      CHECK(decode_elements(kCodecs[c], encoded.data(), size, decoded.data(),
+                            decoded.size()));
+      decode_ms.push_back(ms_since(start));
+    }
+    const double raw_bytes = elements.size() * sizeof(float);
+    const Drift d = drift(decoded.data(), elements.data(), elements.size());
+    std::printf("%-12s %-7s %7.2f %12.1f %12.1f %12.3g %12.3g\n", data_name,
+                kCodecNames[c], raw_bytes / size,
+                raw_bytes / percentile(encode_ms, 0.5) / 1e3,
+                raw_bytes / percentile(decode_ms, 0.5) / 1e3, d.max_error,
+                d.rms_error);
+  }
+}
+
+/// Three ReLU layers; the middle one runs on "device1", so that every
+/// inference sends two results across, encoded with the codec
+static ModelDAG make_dag(WireCodec codec) {
+  ModelDAG dag = make_relu_chain(arm_compute::TensorShape(kElements),
+                                 {"device0", "device1", "device0"});
+  // Without a lossy codec, the results of the ReLUs are sent sparse
+  if (codec != WireCodec::Raw) {
+    Partitioner::assign_wire_codecs(
+        dag, codec == WireCodec::Sparse ? WireCodec::Raw : codec);
+  }
+  return dag;
+}
+
+/// Median latency of an inference between two devices over TCP with the
+/// codec, and the drift of its output from the ReLU of the input in F32
+static std::pair<double, Drift> measure_inference(WireCodec codec,
+                                                  const std::vector<float> &input,
+                                                  size_t inferences) {
+  const DeviceInfo info0{"device0", "127.0.0.1", free_port()};
+  const DeviceInfo info1{"device1", "127.0.0.1", free_port()};
+  const DeviceMap map = {{"device0", info0}, {"device1", info1}};
+  // The codecs apply to TCP; the rings carry the elements as computed
+  const std::vector<int> holders = {hold_ring_address(info0.port),
+                                    hold_ring_address(info1.port)};
+  std::vector<float> reference(input.size());
+  for (size_t i = 0; i < input.size(); ++i) {
+    reference[i] = std::max(0.0f, input[i]);
+  }
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  size_t completed = 0;
+  Drift worst;
+  const Deployment device0(make_dag(codec), info0, map);
+  const Deployment device1(make_dag(codec), info1, map);
+  Orchestrator orch0(device0.dag, device0.info, device0.map,
+                     device0.memory_plan, device0.plan, 1);
+  Orchestrator orch1(device1.dag, device1.info, device1.map,
+                     device1.memory_plan, device1.plan, 1);
+  orch0.register_inference_complete_callback(
+      [&](RequestID, InferenceStatus status, const arm_compute::Tensor &output) {
+        CHECK(status == InferenceStatus::Completed);
+        const auto *values = reinterpret_cast<const float *>(
+            output.buffer() + output.info()->offset_first_element_in_bytes());
+        const Drift d = drift(values, reference.data(), reference.size());
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          worst.max_error = std::max(worst.max_error, d.max_error);
+          worst.rms_error = std::max(worst.rms_error, d.rms_error);
+          ++completed;
+        }
+        cv.notify_one();
+      });
+
+  const auto make_input = [&input] {
+    auto tensor = std::make_unique<arm_compute::Tensor>();
+    tensor->allocator()->init(arm_compute::TensorInfo(
+        arm_compute::TensorShape(input.size()), 1, arm_compute::DataType::F32));
+    tensor->allocator()->allocate();
+    std::copy(input.begin(), input.end(),
+              reinterpret_cast<float *>(tensor->buffer()));
+    return tensor;
+  };
+  // One more inference than measured, which opens the connections
+  std::vector<double> latencies;
+  for (size_t n = 0; n <= inferences; ++n) {
+    const auto start = std::chrono::steady_clock::now();
+    // The state of the previous inference is given back after its report
+    while (!orch0.start_inference(make_input())) {
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    CHECK(cv.wait_for(lock, 60s, [&] { return completed == n + 1; }));
+    if (n > 0) {
+      latencies.push_back(ms_since(start));
+    }
+  }
+
+  for (const int holder: holders) {
+    close(holder);
+  }
+  return {percentile(latencies, 0.5), worst};
+}
+
+/// For each codec: the compression ratio, the encode and decode speed, and
+/// the error on 4 MiB of elements as a ReLU leaves them, mostly zero, and
+/// of both signs; then the latency of inferences between two devices of
+/// this host over TCP, and the drift of their output from F32
+int main(int argc, char **argv) {
+  const size_t iterations = count_argument(argc, argv, 20);
+  std::printf("%-12s %-7s %7s %12s %12s %12s %12s\n", "data", "codec", "ratio",
+              "encode_MB/s", "decode_MB/s", "max_error", "rms_error");
+  measure_codecs("relu_50%", make_elements(-1.0f, 1.0f, true), iterations);
+  measure_codecs("relu_90%", make_elements(-9.0f, 1.0f, true), iterations);
+  measure_codecs("signed", make_elements(-40.0f, 25.0f, false), iterations);
+
+  std::printf("\n%-7s %10s %12s %12s\n", "codec", "p50_ms", "max_drift",
+              "rms_drift");
+  const std::vector<float> input = make_elements(-40.0f, 25.0f, false);
+  for (size_t c = 0; c < std::size(kCodecs); ++c) {
+    const auto [latency, d] = measure_inference(kCodecs[c], input, iterations);
+    std::printf("%-7s %10.3f %12.3g %12.3g\n", kCodecNames[c], latency,
+                d.max_error, d.rms_error);
+  }
+  return 0;
+}
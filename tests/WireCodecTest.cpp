@@ -0,0 +1,136 @@
+#include "edgeflow/WireCodec.h"
+#include "TestSupport.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+/// Element counts around the widths of the vector loops, and their tails
+static const size_t kCounts[] = {1, 3, 7, 8, 9, 15, 16, 17, 31, 64, 1000, 4099};
+
+/// Elements as a ReLU leaves them: about two thirds zero, the others
+/// positive, some in groups of 8 nonzero elements
+static std::vector<float> relu_like(size_t count, std::mt19937 &rng) {
+  std::uniform_real_distribution<float> value(0.0f, 6.0f);
+  std::uniform_int_distribution<int> kind(0, 2);
+  std::vector<float> elements(count);
+  for (size_t i = 0; i < count; ++i) {
+    const bool dense_group = (i / 8) % 5 == 0;
+    elements[i] = dense_group || kind(rng) == 0 ? value(rng) : 0.0f;
+  }
+  return elements;
+}
+
+/// Elements of both signs
+static std::vector<float> signed_values(size_t count, std::mt19937 &rng) {
+  std::uniform_real_distribution<float> value(-40.0f, 25.0f);
+  std::vector<float> elements(count);
+  for (auto &element: elements) {
+    element = value(rng);
+  }
+  return elements;
+}
+
+/// Encode and decode the elements, checking every decoded element against
+/// the error bound the encoder reports
+/// @return The reported bound
+static float round_trip(WireCodec codec, const std::vector<float> &elements) {
+  const size_t count = elements.size();
+  std::vector<uint8_t> encoded(max_encoded_size(codec, count));
+  float max_error = -1;
+  const size_t size = encode_elements(codec, elements.data(), count,
+                                      encoded.data(), &max_error);
+  CHECK(size <= encoded.size());
+  CHECK(max_error >= 0);
+
+  std::vector<float> decoded(count);
+  CHECK(decode_elements(codec, encoded.data(), size, decoded.data(), count));
+  for (size_t i = 0; i < count; ++i) {
+    CHECK(std::fabs(decoded[i] - elements[i]) <= max_error);
+  }
+
+  // A truncated encoding is refused
+  CHECK(!decode_elements(codec, encoded.data(), size - 1, decoded.data(), count));
+  return max_error;
+}
+
+/// Raw and Sparse are lossless
+static void test_lossless() {
+  std::mt19937 rng(1);
+  for (const size_t count: kCounts) {
+    for (const auto &elements: {relu_like(count, rng), signed_values(count, rng),
+                                std::vector<float>(count, 0.0f)}) {
+      CHECK(round_trip(WireCodec::Raw, elements) == 0);
+      CHECK(round_trip(WireCodec::Sparse, elements) == 0);
+    }
+  }
+}
+
+/// Sparse takes a bit per element and the nonzero values only
+static void test_sparse_size() {
+  std::mt19937 rng(2);
+  for (const size_t count: kCounts) {
+    const auto elements = relu_like(count, rng);
+    size_t nonzero = 0;
+    for (const float element: elements) {
+      nonzero += element != 0;
+    }
+    std::vector<uint8_t> encoded(max_encoded_size(WireCodec::Sparse, count));
+    const size_t size = encode_elements(WireCodec::Sparse, elements.data(),
+                                        count, encoded.data());
+    CHECK(size == (count + 7) / 8 + nonzero * sizeof(float));
+  }
+}
+
+/// FP16 rounds to half a unit in the last place of the largest magnitude
+static void test_fp16() {
+  std::mt19937 rng(3);
+  for (const size_t count: kCounts) {
+    for (const auto &elements: {relu_like(count, rng), signed_values(count, rng)}) {
+      float largest = 0;
+      for (const float element: elements) {
+        largest = std::max(largest, std::fabs(element));
+      }
+      const float max_error = round_trip(WireCodec::FP16, elements);
+      CHECK(max_error <= largest * std::ldexp(1.0f, -11));
+    }
+  }
+}
+
+/// Int8 rounds to half a quantization step over the range of the elements
+static void test_int8() {
+  std::mt19937 rng(4);
+  for (const size_t count: kCounts) {
+    for (const auto &elements: {relu_like(count, rng), signed_values(count, rng)}) {
+      float min = 0, max = 0;
+      for (const float element: elements) {
+        min = std::min(min, element);
+        max = std::max(max, element);
+      }
+      const float max_error = round_trip(WireCodec::Int8, elements);
+      CHECK(max_error <= (max - min) / 255.0f / 2 * 1.0001f);
+    }
+  }
+  // Zeros only, whose range is empty
+  round_trip(WireCodec::Int8, std::vector<float>(100, 0.0f));
+}
+
+/// A sparse bitmap with bits set past the last element is refused
+static void test_malformed_sparse() {
+  const float elements[3] = {1.0f, 0.0f, 2.0f};
+  std::vector<uint8_t> encoded(max_encoded_size(WireCodec::Sparse, 3));
+  const size_t size = encode_elements(WireCodec::Sparse, elements, 3,
+                                      encoded.data());
+  encoded[0] |= 0x80;
+  float decoded[3];
+  CHECK(!decode_elements(WireCodec::Sparse, encoded.data(), size, decoded, 3));
+}
+
+int main() {
+  RUN(test_lossless);
+  RUN(test_sparse_size);
+  RUN(test_fp16);
+  RUN(test_int8);
+  RUN(test_malformed_sparse);
+  return 0;
+}